@@ -42,4 +42,58 @@ project "SectorShooter"
       postbuildcommands 
       { 
       	 setup_dirs("bin/Release/assets")
-      }	
\ No newline at end of file
+      }	
+
+-- headless build that replays a camera path through the renderer and prints frame timings
+project "Timedemo"
+   language "C"
+   cdialect "C11"
+   compileas "C"
+   targetdir "bin/%{cfg.buildcfg}"
+   location ""
+	includedirs { "thirdparty" }
+	includedirs { "src" }
+	includedirs { "win" }
+	defines { "HEADLESS_TIMEDEMO" }
+
+   files { "**.h", "**.c"}
+
+   filter "system:linux"
+      links { "pthread", "m", "dl" }
+
+   filter "configurations:Debug"
+      kind "ConsoleApp"
+      defines { "DEBUG", "_CRT_SECURE_NO_WARNINGS" }
+      symbols "On"
+
+   filter "configurations:Release"
+      kind "ConsoleApp"
+      defines { "NDEBUG", "_CRT_SECURE_NO_WARNINGS" }
+      optimize "On"
+
+-- headless build that bakes the lightmap of one map and prints bake timings
+project "Lightbake"
+   language "C"
+   cdialect "C11"
+   compileas "C"
+   targetdir "bin/%{cfg.buildcfg}"
+   location ""
+	includedirs { "thirdparty" }
+	includedirs { "src" }
+	includedirs { "win" }
+	defines { "HEADLESS_LIGHTBAKE" }
+
+   files { "**.h", "**.c"}
+
+   filter "system:linux"
+      links { "pthread", "m", "dl" }
+
+   filter "configurations:Debug"
+      kind "ConsoleApp"
+      defines { "DEBUG", "_CRT_SECURE_NO_WARNINGS" }
+      symbols "On"
+
+   filter "configurations:Release"
+      kind "ConsoleApp"
+      defines { "NDEBUG", "_CRT_SECURE_NO_WARNINGS" }
+      optimize "On"
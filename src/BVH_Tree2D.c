@@ -2,6 +2,8 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
 
 #include "u_math.h"
 #include "dynamic_array.h"
@@ -674,6 +676,265 @@ int BVH_Tree_Cull_Trace(BVH_Tree* const p_tree, float p_startX, float p_startY,
 	return hit_count;
 }
 
+typedef struct
+{
+	int index;
+	float entry_frac;
+} BVH_ClosestStackItem;
+
+float BVH_Tree_Trace_Closest(BVH_Tree* const p_tree, float p_startX, float p_startY, float p_endX, float p_endY, float p_maxFrac, BVH_TraceHitFun p_hitFun, void* p_user)
+{
+	if (p_tree->root == BVH_NODE_NULL_INDEX)
+	{
+		return p_maxFrac;
+	}
+
+	BVH_Node* root = dA_at(p_tree->nodes->pool, p_tree->root);
+
+	float root_frac = 0;
+
+	if (!Math_TraceLineVsBox2(p_startX, p_startY, p_endX, p_endY, root->bbox, NULL, NULL, &root_frac))
+	{
+		return p_maxFrac;
+	}
+
+	//children are tested before they are pushed, so every item on the stack is known to be entered at entry_frac
+	BVH_ClosestStackItem stack[BVH_STACK_HELPER_ALLOC_SIZE];
+	int stack_index = 0;
+
+	stack[stack_index].index = p_tree->root;
+	stack[stack_index].entry_frac = root_frac;
+	stack_index++;
+
+	while (stack_index > 0)
+	{
+		BVH_ClosestStackItem stack_item = stack[--stack_index];
+
+		//a hit found since the push is closer than anything in this node
+		if (stack_item.entry_frac > p_maxFrac)
+		{
+			continue;
+		}
+
+		BVH_Node* node = dA_at(p_tree->nodes->pool, stack_item.index);
+
+		//Is the node leaf?
+		if (node->left == BVH_NODE_NULL_INDEX)
+		{
+			p_maxFrac = p_hitFun(p_user, node->data_index, p_maxFrac);
+			continue;
+		}
+
+		BVH_ClosestStackItem children[2];
+		int num_children = 0;
+
+		int child_indexes[2] = { node->left, node->right };
+
+		for (int i = 0; i < 2; i++)
+		{
+			if (child_indexes[i] == BVH_NODE_NULL_INDEX)
+			{
+				continue;
+			}
+
+			BVH_Node* child = dA_at(p_tree->nodes->pool, child_indexes[i]);
+
+			float entry_frac = 0;
+
+			if (!Math_TraceLineVsBox2(p_startX, p_startY, p_endX, p_endY, child->bbox, NULL, NULL, &entry_frac) || entry_frac > p_maxFrac)
+			{
+				continue;
+			}
+
+			children[num_children].index = child_indexes[i];
+			children[num_children].entry_frac = entry_frac;
+			num_children++;
+		}
+
+		assert(stack_index + num_children <= BVH_STACK_HELPER_ALLOC_SIZE);
+
+		//push the farther child first so the nearer one is visited first
+		if (num_children == 2 && children[0].entry_frac < children[1].entry_frac)
+		{
+			stack[stack_index++] = children[1];
+			stack[stack_index++] = children[0];
+		}
+		else
+		{
+			for (int i = 0; i < num_children; i++)
+			{
+				stack[stack_index++] = children[i];
+			}
+		}
+	}
+
+	return p_maxFrac;
+}
+
+typedef struct
+{
+	int index;
+	unsigned mask;
+} BVH_PacketStackItem;
+
+static inline __m128 BVH_Select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+//Math_TraceLineVsBox2 for 4 traces at once, returns a lane mask of the traces that touch the box
+static inline int BVH_TraceVsBox4(__m128 start_x, __m128 start_y, __m128 end_x, __m128 end_y, float bbox[2][2])
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	__m128 min_dist = zero;
+	__m128 max_dist = one;
+	__m128 reject = zero;
+
+	for (int i = 0; i < 2; i++)
+	{
+		__m128 box_begin = _mm_set1_ps(bbox[0][i]);
+		__m128 box_end = _mm_set1_ps(bbox[1][i]);
+		__m128 trace_start = (i == 0) ? start_x : start_y;
+		__m128 trace_end = (i == 0) ? end_x : end_y;
+
+		__m128 trace_length = _mm_sub_ps(trace_end, trace_start);
+		__m128 forward = _mm_cmplt_ps(trace_start, trace_end);
+
+		//lanes that don't take a branch can divide by zero, their result is never selected
+		__m128 to_begin = _mm_div_ps(_mm_sub_ps(box_begin, trace_start), trace_length);
+		__m128 to_end = _mm_div_ps(_mm_sub_ps(box_end, trace_start), trace_length);
+
+		__m128 reject_forward = _mm_or_ps(_mm_cmpgt_ps(trace_start, box_end), _mm_cmplt_ps(trace_end, box_begin));
+		__m128 reject_backward = _mm_or_ps(_mm_cmpgt_ps(trace_end, box_end), _mm_cmplt_ps(trace_start, box_begin));
+
+		__m128 c_min_forward = BVH_Select(_mm_cmplt_ps(trace_start, box_begin), to_begin, zero);
+		__m128 c_max_forward = BVH_Select(_mm_cmpgt_ps(trace_end, box_end), to_end, one);
+		__m128 c_min_backward = BVH_Select(_mm_cmpgt_ps(trace_start, box_end), to_end, zero);
+		__m128 c_max_backward = BVH_Select(_mm_cmplt_ps(trace_end, box_begin), to_begin, one);
+
+		reject = _mm_or_ps(reject, BVH_Select(forward, reject_forward, reject_backward));
+		min_dist = _mm_max_ps(min_dist, BVH_Select(forward, c_min_forward, c_min_backward));
+		max_dist = _mm_min_ps(max_dist, BVH_Select(forward, c_max_forward, c_max_backward));
+	}
+
+	reject = _mm_or_ps(reject, _mm_cmplt_ps(max_dist, min_dist));
+
+	return ~_mm_movemask_ps(reject) & 0xF;
+}
+
+int BVH_Tree_Cull_TracePacket(BVH_Tree* const p_tree, int p_numRays, const float* p_startX, const float* p_startY, const float* p_endX, const float* p_endY, int p_maxHitCount, int* p_hits, unsigned* p_hitMasks)
+{
+	if (p_tree->root == BVH_NODE_NULL_INDEX || p_numRays <= 0)
+	{
+		return 0;
+	}
+
+	p_numRays = min(p_numRays, BVH_PACKET_MAX_RAYS);
+
+	//pad to whole groups of 4 with the first ray, the padded lanes are masked out
+	float start_x[BVH_PACKET_MAX_RAYS];
+	float start_y[BVH_PACKET_MAX_RAYS];
+	float end_x[BVH_PACKET_MAX_RAYS];
+	float end_y[BVH_PACKET_MAX_RAYS];
+
+	for (int i = 0; i < BVH_PACKET_MAX_RAYS; i++)
+	{
+		int ray = (i < p_numRays) ? i : 0;
+
+		start_x[i] = p_startX[ray];
+		start_y[i] = p_startY[ray];
+		end_x[i] = p_endX[ray];
+		end_y[i] = p_endY[ray];
+	}
+
+	int num_groups = (p_numRays + 3) / 4;
+
+	__m128 group_start_x[BVH_PACKET_MAX_RAYS / 4];
+	__m128 group_start_y[BVH_PACKET_MAX_RAYS / 4];
+	__m128 group_end_x[BVH_PACKET_MAX_RAYS / 4];
+	__m128 group_end_y[BVH_PACKET_MAX_RAYS / 4];
+
+	for (int g = 0; g < num_groups; g++)
+	{
+		group_start_x[g] = _mm_loadu_ps(&start_x[g * 4]);
+		group_start_y[g] = _mm_loadu_ps(&start_y[g * 4]);
+		group_end_x[g] = _mm_loadu_ps(&end_x[g * 4]);
+		group_end_y[g] = _mm_loadu_ps(&end_y[g * 4]);
+	}
+
+	//the tree is kept balanced, so the depth and with it the stack stays small
+	BVH_PacketStackItem stack[BVH_STACK_HELPER_ALLOC_SIZE];
+	int stack_index = 0;
+
+	stack[stack_index].index = p_tree->root;
+	stack[stack_index].mask = (1u << p_numRays) - 1;
+	stack_index++;
+
+	int hit_count = 0;
+
+	while (stack_index > 0)
+	{
+		if (hit_count >= p_maxHitCount)
+		{
+			return hit_count;
+		}
+
+		BVH_PacketStackItem stack_item = stack[--stack_index];
+
+		if (stack_item.index == BVH_NODE_NULL_INDEX)
+			continue;
+
+		BVH_Node* node = dA_at(p_tree->nodes->pool, stack_item.index);
+
+		//rays that missed the node are dropped for the whole subtree
+		unsigned mask = 0;
+
+		for (int g = 0; g < num_groups; g++)
+		{
+			if ((stack_item.mask >> (g * 4)) & 0xF)
+			{
+				mask |= (unsigned)BVH_TraceVsBox4(group_start_x[g], group_start_y[g], group_end_x[g], group_end_y[g], node->bbox) << (g * 4);
+			}
+		}
+
+		mask &= stack_item.mask;
+
+		if (mask == 0)
+		{
+			continue;
+		}
+
+		//Is the node leaf?
+		if (node->left == BVH_NODE_NULL_INDEX)
+		{
+			p_hits[hit_count] = node->data_index;
+			p_hitMasks[hit_count] = mask;
+
+			hit_count++;
+		}
+		else
+		{
+			assert(stack_index + 2 <= BVH_STACK_HELPER_ALLOC_SIZE);
+
+			//is parent so insert children to the stack
+			stack[stack_index].index = node->left;
+			stack[stack_index].mask = mask;
+			stack_index++;
+
+			if (node->right != BVH_NODE_NULL_INDEX)
+			{
+				stack[stack_index].index = node->right;
+				stack[stack_index].mask = mask;
+				stack_index++;
+			}
+		}
+	}
+
+	return hit_count;
+}
+
 int BVH_Tree_GetAllNodes(BVH_Tree* const p_tree, int p_maxNodes, BVH_Node** r_nodes)
 {
 	if (p_tree->root == BVH_NODE_NULL_INDEX)
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include "u_object_pool.h"
 
+#define BVH_PACKET_MAX_RAYS 8
+
 typedef int BVH_ID;
 
 typedef struct
@@ -33,9 +35,13 @@ void BVH_Tree_ClearAll(BVH_Tree* const p_tree);
 bool BVH_Tree_UpdateBounds(BVH_Tree* const p_tree, BVH_ID p_bvhID, float p_bbox[2][2]);
 int BVH_Tree_GetData(BVH_Tree* const p_tree, BVH_ID p_bvhID);
 typedef void (*BVH_RegisterFun)(int _data_index, BVH_ID _index, int _hit_count);
+//called for every leaf the trace enters before _max_frac, returns the new max frac
+typedef float (*BVH_TraceHitFun)(void* _user, int _data_index, float _max_frac);
 
 
 int BVH_Tree_Cull_Box(BVH_Tree* const p_tree, float bbox[2][2], int p_maxHitCount, int* p_hits);
 int BVH_Tree_Cull_Trace(BVH_Tree* const p_tree, float p_startX, float p_startY, float p_endX, float p_endY, int p_maxHitCount, int* p_hits);
+float BVH_Tree_Trace_Closest(BVH_Tree* const p_tree, float p_startX, float p_startY, float p_endX, float p_endY, float p_maxFrac, BVH_TraceHitFun p_hitFun, void* p_user);
+int BVH_Tree_Cull_TracePacket(BVH_Tree* const p_tree, int p_numRays, const float* p_startX, const float* p_startY, const float* p_endX, const float* p_endY, int p_maxHitCount, int* p_hits, unsigned* p_hitMasks);
 
 #endif
\ No newline at end of file
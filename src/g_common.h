@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <GLFW/glfw3.h>
 
 #include "BVH_Tree2D.h"
@@ -12,11 +13,21 @@
 
 #include "u_object_pool.h"
 
+struct LightCompilerInfo;
+struct LightBakeTimings;
+
 //#define DONT_DRAW_HUD
 //#define DRAW_LIGHT_POINTS
 //#define DRAW_TRACE_POINTS
 //#define DONT_FILE_LIGHTMAPS
 //#define DISABLE_LIGHTMAPS
+//#define DONT_BALANCE_SLICES
+//#define RENDER_WORK_STEALING
+//#define DISABLE_SIMD_SPANS
+//#define LIGHT_FIXED_POINT
+//#define COLUMN_MAJOR_FRAMEBUFFER
+//#define SURFACE_CACHE
+//#define DISABLE_MIPMAPS
 #define TRACE_NO_HIT INT_MAX
 
 #define NULL_INDEX -1
@@ -122,8 +133,9 @@ void Game_NewTick();
 int Game_GetTick();
 void Game_LogicUpdate(double delta);
 void Game_SmoothUpdate(double lerp, double delta);
-void Game_Draw(Image* image, FontData* fd);
-void Game_DrawHud(Image* image, FontData* fd, int start_x, int end_x);
+void Game_GetHudState(HudState* hud);
+void Game_Draw(Image* image, FontData* fd, FramePacket* packet);
+void Game_DrawHud(Image* image, FontData* fd, FramePacket* packet, int start_x, int end_x);
 void Game_SetState(GameState state);
 GameState Game_GetState();
 GameAssets* Game_GetAssets();
@@ -332,7 +344,7 @@ typedef enum
 	OBJ_FLAG__JUST_TELEPORTED = 1 << 13,
 } ObjectFlag;
 
-typedef struct
+typedef struct Object
 {
 	int spatial_id;
 	int sector_index;
@@ -443,7 +455,7 @@ typedef struct
 
 	Lightmap lightmap;
 } Linedef;
-typedef struct
+typedef struct Line
 {
 	float x0, x1;
 	float y0, y1;
@@ -467,7 +479,7 @@ typedef struct
 	int children[2];
 } BSPNode;
 
-typedef struct
+typedef struct Sector
 {
 	Object* object_list;
 	Object_Pool* render_object_list;
@@ -526,7 +538,20 @@ typedef struct
 	float bounds[3];
 } Lightgrid;
 
+//hash of everything that went into the lightmaps of each sector (floor and ceiling) and linedef,
+//saved with the lightmaps so that a rebake only redoes the sectors a change can reach
 typedef struct
+{
+	unsigned settings;
+
+	int num_sectors;
+	unsigned* sectors;
+
+	int num_linedefs;
+	unsigned* linedefs;
+} LightHashes;
+
+typedef struct Map
 {
 	BVH_Tree spatial_tree;
 
@@ -552,6 +577,7 @@ typedef struct
 	unsigned char* reject_matrix;
 
 	Lightgrid lightgrid;
+	LightHashes light_hashes;
 
 	int num_objects;
 	Object objects[MAX_OBJECTS];
@@ -613,6 +639,8 @@ bool Load_Doommap(const char* filename, const char* skyname, struct LightCompile
 bool Load_DoomIWAD(const char* filename);
 bool Load_Lightmap(const char* filename, Map* map);
 bool Save_Lightmap(const char* filename, Map* map);
+bool Load_BakeLightmap(const char* filename, struct LightCompilerInfo* light_compiler_info, int num_threads, bool incremental, struct LightBakeTimings* r_timings, Map* map);
+void Load_SetLightmapsOnLoad(bool enable);
 
 //Player stuff
 typedef struct
@@ -673,7 +701,8 @@ void Player_Update(GLFWwindow* window, float delta);
 void Player_LerpUpdate(double lerp, double delta);
 void Player_GetView(float* r_x, float* r_y, float* r_z, float* r_yaw, float* r_angle);
 void Player_MouseCallback(float x, float y);
-void Player_DrawHud(Image* image, FontData* font, int start_x, int end_x);
+void Player_GetHudState(HudState* hud);
+void Player_DrawHud(Image* image, FontData* font, FramePacket* packet, int start_x, int end_x);
 float Player_GetSensitivity();
 void Player_SetSensitivity(float sens);
 void Player_SetGun(GunType gun_type);
@@ -701,6 +730,26 @@ void Missile_DirectHit(Object* obj, Object* target);
 void Missile_Explode(Object* obj);
 
 //Trace stuff
+#define TRACE_PACKET_MAX_RAYS BVH_PACKET_MAX_RAYS
+typedef struct
+{
+	int num_rays;
+
+	float start_x[TRACE_PACKET_MAX_RAYS];
+	float start_y[TRACE_PACKET_MAX_RAYS];
+	float start_z[TRACE_PACKET_MAX_RAYS];
+	float end_x[TRACE_PACKET_MAX_RAYS];
+	float end_y[TRACE_PACKET_MAX_RAYS];
+	float end_z[TRACE_PACKET_MAX_RAYS];
+
+	//closest hit per ray, same values Trace_FindLine returns
+	int hits[TRACE_PACKET_MAX_RAYS];
+	float hit_x[TRACE_PACKET_MAX_RAYS];
+	float hit_y[TRACE_PACKET_MAX_RAYS];
+	float hit_z[TRACE_PACKET_MAX_RAYS];
+	float frac[TRACE_PACKET_MAX_RAYS];
+} TracePacket;
+
 int* Trace_GetSpecialLines(int* r_length);
 int* Trace_GetHitObjects();
 bool Trace_CheckBoxPosition(Object* obj, float x, float y, float size, float* r_floorZ, float* r_ceilZ, float* r_lowFloorZ);
@@ -712,7 +761,8 @@ int Trace_AreaObjects(Object* obj, float x, float y, float size);
 int Trace_SectorObjects(Sector* sector);
 int Trace_SectorLines(Sector* sector, bool front_only);
 int Trace_SectorAll(Sector* sector);
-int Trace_FindLine(float start_x, float start_y, float start_z, float end_x, float end_y, float end_z, bool ignore_sky_plane, int* r_hits, int max_hit_count, float* r_hitX, float* r_hitY, float* r_hitZ, float* r_frac);
+int Trace_FindLine(float start_x, float start_y, float start_z, float end_x, float end_y, float end_z, bool ignore_sky_plane, float* r_hitX, float* r_hitY, float* r_hitZ, float* r_frac);
+void Trace_FindLinePacket(TracePacket* packet, bool ignore_sky_plane, int* r_hits, unsigned* r_hit_masks, int max_hit_count);
 int Trace_FindSectors(int ignore_sector_index, float bbox[2][2]);
 
 //Object stuff
@@ -794,7 +844,8 @@ void Monster_SetAsSuper(Object* obj);
 //Visual map stuff
 void VisualMap_Init();
 void VisualMap_Update(GLFWwindow* window, double delta);
-void VisualMap_Draw(Image* image, FontData* font);
+void VisualMap_GetState(VisualMapState* state);
+void VisualMap_Draw(Image* image, FontData* font, FramePacket* packet);
 int VisualMap_GetMode();
 
 //Save/load game stuff
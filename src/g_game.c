@@ -162,6 +162,16 @@ bool Game_LoadAssets()
 	Image_GenerateFrameInfo(&assets.pistol_texture);
 	Image_GenerateFrameInfo(&assets.devastator_texture);
 
+	//only world sprites are drawn scaled down, the weapon and decal sheets are left alone
+	Image_GenerateMipmaps(&assets.missing_texture.img);
+	Image_GenerateMipmaps(&assets.object_textures);
+	Image_GenerateMipmaps(&assets.blood_imp_texture);
+	Image_GenerateMipmaps(&assets.missile_textures);
+	Image_GenerateMipmaps(&assets.boar_texture);
+	Image_GenerateMipmaps(&assets.bruiser_texture);
+	Image_GenerateMipmaps(&assets.templar_texture);
+	Image_GenerateMipmaps(&assets.particle_textures);
+
 	return true;
 }
 
@@ -281,13 +291,12 @@ void Game_SmoothUpdate(double lerp, double delta)
 			break;
 		}
 
-		Render_LockObjectMutex(true);
-
+		//the renderer only reads the published frame packets, so nothing here needs a lock
 		Player_LerpUpdate(lerp, delta);
 		Map_SmoothUpdate(lerp, delta);
 		VisualMap_Update(window, delta);
 
-		Render_UnlockObjectMutex(true);
+		Render_PublishFramePacket(Map_GetMap());
 		break;
 	}
 	case GS__LEVEL_END:
@@ -305,7 +314,16 @@ void Game_SmoothUpdate(double lerp, double delta)
 	}
 }
 
-void Game_Draw(Image* image, FontData* fd)
+void Game_GetHudState(HudState* hud)
+{
+	Player_GetHudState(hud);
+
+	strncpy(hud->status_msg, game.status_msg, sizeof(hud->status_msg) - 1);
+	hud->status_msg[sizeof(hud->status_msg) - 1] = 0;
+	hud->status_msg_timer = game.status_msg_timer;
+}
+
+void Game_Draw(Image* image, FontData* fd, FramePacket* packet)
 {
 	switch (game.state)
 	{
@@ -321,7 +339,7 @@ void Game_Draw(Image* image, FontData* fd)
 			break;
 		}
 		//level rendering and sprite rendering is handled by the renderer
-		VisualMap_Draw(image, fd);
+		VisualMap_Draw(image, fd, packet);
 
 		break;
 	}
@@ -340,7 +358,7 @@ void Game_Draw(Image* image, FontData* fd)
 	}
 }
 
-void Game_DrawHud(Image* image, FontData* fd, int start_x, int end_x)
+void Game_DrawHud(Image* image, FontData* fd, FramePacket* packet, int start_x, int end_x)
 {
 	switch (game.state)
 	{
@@ -352,7 +370,7 @@ void Game_DrawHud(Image* image, FontData* fd, int start_x, int end_x)
 		}
 
 		//draw player stuff (gun and hud) and some shader stuff
-		Player_DrawHud(image, fd, start_x, end_x);
+		Player_DrawHud(image, fd, packet, start_x, end_x);
 
 		break;
 	}
@@ -360,9 +378,9 @@ void Game_DrawHud(Image* image, FontData* fd, int start_x, int end_x)
 		break;
 	}
 
-	if (game.status_msg_timer > 0)
+	if (packet->hud.status_msg_timer > 0)
 	{
-		Text_DrawColor(image, fd, 0.05, 0.1, 0.5, 0.5, start_x, end_x, 232, 0, 0, 255, game.status_msg);
+		Text_DrawColor(image, fd, 0.05, 0.1, 0.5, 0.5, start_x, end_x, 232, 0, 0, 255, packet->hud.status_msg);
 	}
 }
 
@@ -415,13 +433,9 @@ bool Game_ChangeLevel(int level_index, bool player_keep_stuff)
 		//flush sound system
 		Sound_FlushAll();
 
-		const char* level = LEVELS[level_index];
-		const char* sky = SKIES[level_index];
-		LightCompilerInfo* lci = Info_GetLightCompilerInfo(level_index);
+		printf("Setting Level to %s\n", LEVELS[level_index]);
 
-		printf("Setting Level to %s\n", level);
-
-		if (!Map_Load(level, sky, lci))
+		if (!Map_LoadFromIndex(level_index))
 		{
 			Render_Resume();
 			return false;
@@ -432,6 +446,9 @@ bool Game_ChangeLevel(int level_index, bool player_keep_stuff)
 
 		Player_Init(player_keep_stuff);
 
+		//replace the old map's frame before the renderer resumes
+		Render_PublishFramePacket(map);
+
 	}
 
 	game.level_index = level_index;
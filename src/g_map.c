@@ -128,6 +128,9 @@ bool Map_Load(const char* filename, const char* skyname, LightCompilerInfo* ligh
 {
 	Map_Destruct();
 
+	//cached surfaces were lit with the old map's lightmaps
+	Surface_InvalidateAll();
+
 	return Load_Doommap(filename, skyname, light_compiler_info, &s_map);
 }
 
@@ -345,8 +348,6 @@ void Map_DeleteObject(Object* obj)
 
 	if (Object_IsSectorLinked(obj) || obj->linked_sector_array)
 	{
-		Render_LockObjectMutex(true);
-
 		Object_UnlinkSector(obj);
 
 		if (obj->linked_sector_array)
@@ -356,8 +357,6 @@ void Map_DeleteObject(Object* obj)
 			dA_Destruct(obj->linked_sector_array);
 			obj->linked_sector_array = NULL;
 		}
-
-		Render_UnlockObjectMutex(true);
 	}
 
 	ObjectID id = obj->id;
@@ -692,6 +691,8 @@ void Map_Destruct()
 	if (s_map.sidedefs) free(s_map.sidedefs);
 	if (s_map.reject_matrix) free(s_map.reject_matrix);
 	if (s_map.lightgrid.blocks) free(s_map.lightgrid.blocks);
+	if (s_map.light_hashes.sectors) free(s_map.light_hashes.sectors);
+	if (s_map.light_hashes.linedefs) free(s_map.light_hashes.linedefs);
 
 	BVH_Tree_Destruct(&s_map.spatial_tree);
 
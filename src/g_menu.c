@@ -1,6 +1,7 @@
 #include "g_common.h"
 
 #include <stdio.h>
+#include <time.h>
 
 #include "main.h"
 #include "sound.h"
@@ -77,6 +78,7 @@ static bool Menu_CheckInput(int key, int state)
 		return false;
 	}
 
+#ifndef HEADLESS
 	GLFWwindow* window = Engine_GetWindow();
 
 	if (glfwGetKey(window, key) == state)
@@ -84,6 +86,7 @@ static bool Menu_CheckInput(int key, int state)
 		menu_core.input_timer = INPUT_COOLDOWN;
 		return true;
 	}
+#endif // !HEADLESS
 
 	return false;
 }
@@ -94,6 +97,7 @@ static bool Menu_CheckMouseInput(int key, int state)
 		return false;
 	}
 
+#ifndef HEADLESS
 	GLFWwindow* window = Engine_GetWindow();
 
 	if (glfwGetMouseButton(window, key) == state)
@@ -101,6 +105,7 @@ static bool Menu_CheckMouseInput(int key, int state)
 		menu_core.input_timer = INPUT_COOLDOWN;
 		return true;
 	}
+#endif // !HEADLESS
 
 	return false;
 }
@@ -204,14 +209,16 @@ static void Menu_HandleLoadSave()
 		}
 		else if (menu_core.sub_menu == SUB_MENU_SAVE)
 		{
-			SYSTEMTIME time;
-			memset(&time, 0, sizeof(time));
-			GetSystemTime(&time);
+			time_t now = time(NULL);
+			struct tm* utc = gmtime(&now);
 
 			char time_buf[32];
 			memset(time_buf, 0, sizeof(time_buf));
 
-			sprintf(time_buf, "%i-%i-%i-%i", time.wYear, time.wMonth, time.wDay, time.wHour);
+			if (utc)
+			{
+				sprintf(time_buf, "%i-%i-%i-%i", utc->tm_year + 1900, utc->tm_mon + 1, utc->tm_mday, utc->tm_hour);
+			}
 
 			Game_Save(menu_core.index, time_buf);
 
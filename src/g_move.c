@@ -441,8 +441,6 @@ bool Move_SetPosition(Object* obj, float x, float y, float size)
 
 	if (obj->sprite.img)
 	{
-		Render_LockObjectMutex(true);
-
 		if (new_sector_index != obj->sector_index)
 		{
 			Object_UnlinkSector(obj);
@@ -460,8 +458,6 @@ bool Move_SetPosition(Object* obj, float x, float y, float size)
 		{
 			Map_CalcBlockLight(obj->x, obj->y, obj->z + obj->height * 0.5, &obj->sprite.light);
 		}
-
-		Render_UnlockObjectMutex(true);
 	}
 	else
 	{
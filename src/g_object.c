@@ -926,8 +926,6 @@ void Object_ConsumePickup(Object* obj)
 
 	if (Object_IsSectorLinked(obj) || obj->linked_sector_array)
 	{
-		Render_LockObjectMutex(true);
-
 		Object_UnlinkSector(obj);
 
 		if (obj->linked_sector_array)
@@ -937,8 +935,6 @@ void Object_ConsumePickup(Object* obj)
 			dA_Destruct(obj->linked_sector_array);
 			obj->linked_sector_array = NULL;
 		}
-
-		Render_UnlockObjectMutex(true);
 	}
 
 	//keep for the save file
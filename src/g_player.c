@@ -416,6 +416,7 @@ static void Player_ProcessInput(GLFWwindow* window)
 	int move_y = 0;
 	int slow_move = 0;
 
+#ifndef HEADLESS
 	//movement
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
 	{
@@ -497,6 +498,7 @@ static void Player_ProcessInput(GLFWwindow* window)
 	{
 		Game_SetState(GS__MENU);
 	}
+#endif // !HEADLESS
 
 	player.move_x = move_x;
 	player.move_y = move_y;
@@ -985,48 +987,69 @@ void Player_MouseCallback(float x, float y)
 	}
 }
 
-void Player_DrawHud(Image* image, FontData* font, int start_x, int end_x)
+void Player_GetHudState(HudState* hud)
 {
-#ifdef DONT_DRAW_HUD
-	return;
-#endif // DONT_DRAW_HUD
+	if (!player.obj)
+	{
+		return;
+	}
 
-	Render_LockObjectMutex(false);
+	hud->gun = player.gun;
+	hud->hurt_timer = player.hurt_timer;
+	hud->hit_timer = player.hit_timer;
+	hud->god_timer = player.godmode_timer;
+	hud->quad_timer = player.quad_timer;
+	hud->hp = player.obj->hp;
+	hud->gun_sprite = player.gun_sprites[player.gun];
+	hud->gun_offset_x = player.gun_offset_x;
+	hud->gun_offset_y = player.gun_offset_y;
+	hud->bullet_ammo = player.bullet_ammo;
+	hud->buck_ammo = player.buck_ammo;
+	hud->rocket_ammo = player.rocket_ammo;
 
-	//keep on stack
-	GunType gun = player.gun;
-	float hurt_timer = player.hurt_timer;
-	float hit_timer = player.hit_timer;
-	float god_timer = player.godmode_timer;
-	float quad_timer = player.quad_timer;
-	int hp = player.obj->hp;
-	int visual_map_mode = VisualMap_GetMode();
 	Vec3_u16 light = player.obj->sprite.light;
-	Sprite gun_sprite = player.gun_sprites[player.gun];
-	float gun_offset_x = player.gun_offset_x;
-	float gun_offset_y = player.gun_offset_y;
-	int bullet_ammo = player.bullet_ammo;
-	int buck_ammo = player.buck_ammo;
-	int rocket_ammo = player.rocket_ammo;
-	int sector_index = player.obj->sector_index;
-
-	Render_UnlockObjectMutex(false);
 
-	//draw gun
-	if (hp > 0)
-	{
 #ifdef DISABLE_LIGHTMAPS
+	if (player.obj->sector_index >= 0)
+	{
+		Sector* sector = Map_GetSector(player.obj->sector_index);
 
-		if (sector_index >= 0)
-		{
-			Sector* sector = Map_GetSector(sector_index);
-
-			light.r = sector->light_level;
-			light.g = sector->light_level;
-			light.b = sector->light_level;
-		}
+		light.r = sector->light_level;
+		light.g = sector->light_level;
+		light.b = sector->light_level;
+	}
 #endif
 
+	hud->gun_sprite.light = light;
+}
+
+void Player_DrawHud(Image* image, FontData* font, FramePacket* packet, int start_x, int end_x)
+{
+#ifdef DONT_DRAW_HUD
+	return;
+#endif // DONT_DRAW_HUD
+
+	//everything comes from the frame packet, the game thread is already updating the player
+	HudState* hud = &packet->hud;
+
+	GunType gun = hud->gun;
+	float hurt_timer = hud->hurt_timer;
+	float hit_timer = hud->hit_timer;
+	float god_timer = hud->god_timer;
+	float quad_timer = hud->quad_timer;
+	int hp = hud->hp;
+	int visual_map_mode = packet->visual_map.mode;
+	Sprite gun_sprite = hud->gun_sprite;
+	Vec3_u16 light = gun_sprite.light;
+	float gun_offset_x = hud->gun_offset_x;
+	float gun_offset_y = hud->gun_offset_y;
+	int bullet_ammo = hud->bullet_ammo;
+	int buck_ammo = hud->buck_ammo;
+	int rocket_ammo = hud->rocket_ammo;
+
+	//draw gun
+	if (hp > 0)
+	{
 		//check for gunshot light
 		if (gun_sprite.frame == gun_sprite.action_frame)
 		{
@@ -7,6 +7,10 @@
 #include "game_info.h"
 #include "u_math.h"
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
 #define SAVE_VERSION 1
 #define SAVE_MAGIC 0xF0Cef0
 
@@ -70,6 +74,7 @@ typedef struct
 	SaveLump lumps[MAX_LUMPS];
 } SaveHeader;
 
+#ifdef _WIN32
 static void GetSaveDirectory(WCHAR dest[MAX_PATH])
 {
 	//query working directory
@@ -108,6 +113,13 @@ static void SetupSaveDirectory()
 
 	CreateDirectory(save_dir, NULL);
 }
+#else
+static void SetupSaveDirectory()
+{
+	//makes sure save folder is creating, relative to the working directory
+	mkdir(SAVEFOLDER + 1, 0755);
+}
+#endif // _WIN32
 
 static void* MallocLump(FILE* file, SaveHeader* header, int lump_num, int size, int* r_size)
 {
@@ -562,7 +574,7 @@ static void Load_ParseObj(SaveHeader* header, FILE* file, Map* map)
 		}
 
 		//set position
-		Move_SetPosition(obj, obj->x, obj->y, obj->z, obj->size);
+		Move_SetPosition(obj, obj->x, obj->y, obj->size);
 	}
 
 	if (obj_lump) free(obj_lump);
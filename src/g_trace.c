@@ -2,6 +2,8 @@
 
 #include "u_math.h"
 
+#include <immintrin.h>
+
 #define MAX_TRACE_ITEMS 10000
 #define MAX_TRACE_SORT_ITEMS 10000
 #define MAX_SPECIAL_LINES 1000
@@ -968,190 +970,409 @@ int Trace_SectorAll(Sector* sector)
 
 	return num_collisions;
 }
-int Trace_FindLine(float start_x, float start_y, float start_z, float end_x, float end_y, float end_z, bool ignore_sky_plane, int* r_hits, int max_hit_count, float* r_hitX, float* r_hitY, float* r_hitZ, float* r_frac)
+//walls that a trace at height z passes thru, or that are ignored, return false
+static bool Trace_AcceptLineHit(Map* map, Linedef* line, float start_x, float start_y, float z, float hit_x, float hit_y, bool ignore_sky_plane)
 {
-	Map* map = Map_GetMap();
-	int num_traces = BVH_Tree_Cull_Trace(&map->spatial_tree, start_x, start_y, end_x, end_y, max_hit_count, r_hits);
+	Sector* frontsector = &map->sectors[line->front_sector];
+	Sector* backsector = NULL;
 
-	Linedef trace_line;
-	Trace_SetupTraceLine(&trace_line, start_x, start_y, end_x, end_y);
-
-	float dz = end_z - start_z;
-
-	float min_frac = 1.001;
-	int min_hit = TRACE_NO_HIT;
-	float min_hit_x = FLT_MAX;
-	float min_hit_y = FLT_MAX;
-	float min_hit_z = FLT_MAX;
+	if (line->back_sector >= 0)
+	{
+		backsector = &map->sectors[line->back_sector];
+	}
 
-	for (int i = 0; i < num_traces; i++)
+	if (backsector)
 	{
-		int index = r_hits[i];
+		float open_low = max(frontsector->floor, backsector->floor);
+		float open_high = min(frontsector->ceil, backsector->ceil);
+		float open_range = open_high - open_low;
 
-		//ignore objects
-		if (index >= 0)
+		if (open_range > 0 && open_low < open_high)
 		{
-			continue;
-		}
+			if (frontsector->is_sky)
+			{
+				Sidedef* front_sidedef = Map_GetSideDef(line->sides[0]);
 
-		int line_index = -(index + 1);
-		Linedef* line = Map_GetLineDef(line_index);
+				if (front_sidedef)
+				{
+					//ignore lines with no textures
+					if (z > open_high)
+					{
+						if (!front_sidedef->top_texture)
+						{
+							return false;
+						}
+					}
+					else if (z < open_low)
+					{
+						if (!front_sidedef->bottom_texture)
+						{
+							return false;
+						}
+					}
+				}
+			}
 
-		Sector* frontsector = &map->sectors[line->front_sector];
-		Sector* backsector = NULL;
+				
+			//the trace will not hit floor and ceil
+			if (open_low < z && open_high > z)
+			{
+				int side = Line_PointSide(line, start_x, start_y);
+				Sidedef* sidedef = Map_GetSideDef(line->sides[side]);
+				
+				Sector* side_sector = frontsector;
 
-		if (line->back_sector >= 0)
-		{
-			backsector = &map->sectors[line->back_sector];
-		}
+				if (side == 1)
+				{
+					side_sector = backsector;
+				}
 
-		float hit_x = 0;
-		float hit_y = 0;
-		float frac = 1;
+				//check for middle texture
+				if (sidedef->middle_texture)
+				{
+					int tx = 0;
+					int ty = z - side_sector->ceil;
 
-		int s1 = Line_PointSide(line, trace_line.x0, trace_line.y0);
-		int s2 = Line_PointSide(line, trace_line.x1, trace_line.y1);
+					float u = 0;
+					float t = 0;
 
-		if (s1 == s2)
-		{
-			continue;
-		}
+					float dx = line->x0 - line->x1;
+					float dy = line->y0 - line->y1;
 
-		frac = Line_InterceptLine(&trace_line, line);
+					float texwidth = line->width * 2;
 
-		if (frac < 0.0 || frac > 1.0)
-		{
-			continue;
+					if (fabs(dx) > fabs(dy))
+					{
+						t = (hit_x - line->x1) / dx;
+					}
+					else
+					{
+						t = (hit_y - line->y1) / dy;
+					}
+					u = t + u * t;
+					u = fabs(u);
+					u *= texwidth;
+
+					tx = u;
+					ty /= 2;
+
+					tx += sidedef->x_offset;
+					ty += sidedef->y_offset;
+
+					unsigned char* texture_sample = Image_Get(&sidedef->middle_texture->img, tx & sidedef->middle_texture->width_mask, ty & sidedef->middle_texture->height_mask);
+
+					if (texture_sample[3] < 127)
+					{
+						return false;
+					}
+				}
+				else
+				{
+					return false;
+				}
+			}
 		}
+	}
 
-		if (!Trace_LineIntersectLine(map, &trace_line, line, &hit_x, &hit_y, &frac))
+	if (ignore_sky_plane)
+	{
+		if (frontsector->is_sky && z > frontsector->ceil)
 		{
-			continue;
+			return false;
 		}
+		else if (backsector && backsector->is_sky && z > backsector->ceil)
+		{
+			return false;
+		}
+	}
 
-		float z = start_z + dz * frac;
+	return true;
+}
 
-		if (backsector)
-		{
-			float open_low = max(frontsector->floor, backsector->floor);
-			float open_high = min(frontsector->ceil, backsector->ceil);
-			float open_range = open_high - open_low;
+typedef struct
+{
+	Map* map;
+	Linedef trace_line;
+	float start_x;
+	float start_y;
+	float start_z;
+	float dz;
+	bool ignore_sky_plane;
+
+	int hit;
+	float hit_x;
+	float hit_y;
+	float hit_z;
+} TraceClosestLine;
+
+static float Trace_ClosestLineHit(void* user, int index, float max_frac)
+{
+	TraceClosestLine* trace = user;
 
-			if (open_range > 0 && open_low < open_high)
-			{
-				if (frontsector->is_sky)
-				{
-					Sidedef* front_sidedef = Map_GetSideDef(line->sides[0]);
+	//ignore objects
+	if (index >= 0)
+	{
+		return max_frac;
+	}
 
-					if (front_sidedef)
-					{
-						//ignore lines with no textures
-						if (z > open_high)
-						{
-							if (!front_sidedef->top_texture)
-							{
-								continue;
-							}
-						}
-						else if (z < open_low)
-						{
-							if (!front_sidedef->bottom_texture)
-							{
-								continue;
-							}
-						}
-					}
-				}
+	int line_index = -(index + 1);
+	Linedef* line = Map_GetLineDef(line_index);
 
-					
-				//the trace will not hit floor and ceil
-				if (open_low < z && open_high > z)
-				{
-					int side = Line_PointSide(line, start_x, start_y);
-					Sidedef* sidedef = Map_GetSideDef(line->sides[side]);
-					
-					Sector* side_sector = frontsector;
+	float hit_x = 0;
+	float hit_y = 0;
+	float frac = 1;
 
-					if (side == 1)
-					{
-						side_sector = backsector;
-					}
+	int s1 = Line_PointSide(line, trace->trace_line.x0, trace->trace_line.y0);
+	int s2 = Line_PointSide(line, trace->trace_line.x1, trace->trace_line.y1);
 
-					//check for middle texture
-					if (sidedef->middle_texture)
-					{
-						int tx = 0;
-						int ty = z - side_sector->ceil;
+	if (s1 == s2)
+	{
+		return max_frac;
+	}
 
-						float u = 0;
-						float t = 0;
+	frac = Line_InterceptLine(&trace->trace_line, line);
 
-						float dx = line->x0 - line->x1;
-						float dy = line->y0 - line->y1;
+	if (frac < 0.0 || frac > 1.0)
+	{
+		return max_frac;
+	}
 
-						float texwidth = line->width * 2;
+	if (!Trace_LineIntersectLine(trace->map, &trace->trace_line, line, &hit_x, &hit_y, &frac))
+	{
+		return max_frac;
+	}
 
-						if (fabs(dx) > fabs(dy))
-						{
-							t = (hit_x - line->x1) / dx;
-						}
-						else
-						{
-							t = (hit_y - line->y1) / dy;
-						}
-						u = t + u * t;
-						u = fabs(u);
-						u *= texwidth;
+	//only closer hits need the opening and texture checks
+	if (frac >= max_frac)
+	{
+		return max_frac;
+	}
 
-						tx = u;
-						ty /= 2;
+	float z = trace->start_z + trace->dz * frac;
 
-						tx += sidedef->x_offset;
-						ty += sidedef->y_offset;
+	if (!Trace_AcceptLineHit(trace->map, line, trace->start_x, trace->start_y, z, hit_x, hit_y, trace->ignore_sky_plane))
+	{
+		return max_frac;
+	}
 
-						unsigned char* texture_sample = Image_Get(&sidedef->middle_texture->img, tx & sidedef->middle_texture->width_mask, ty & sidedef->middle_texture->height_mask);
+	trace->hit = line_index;
+	trace->hit_x = hit_x;
+	trace->hit_y = hit_y;
+	trace->hit_z = z;
 
-						if (texture_sample[3] < 127)
-						{
-							continue;
-						}
-					}
-					else
-					{
-						continue;
-					}
-				}
-			}
+	return frac;
+}
+
+int Trace_FindLine(float start_x, float start_y, float start_z, float end_x, float end_y, float end_z, bool ignore_sky_plane, float* r_hitX, float* r_hitY, float* r_hitZ, float* r_frac)
+{
+	TraceClosestLine trace;
+
+	trace.map = Map_GetMap();
+	trace.start_x = start_x;
+	trace.start_y = start_y;
+	trace.start_z = start_z;
+	trace.dz = end_z - start_z;
+	trace.ignore_sky_plane = ignore_sky_plane;
+	trace.hit = TRACE_NO_HIT;
+	trace.hit_x = FLT_MAX;
+	trace.hit_y = FLT_MAX;
+	trace.hit_z = FLT_MAX;
+
+	Trace_SetupTraceLine(&trace.trace_line, start_x, start_y, end_x, end_y);
+
+	//the bvh is walked front to back and nodes behind the closest hit so far are skipped
+	float min_frac = BVH_Tree_Trace_Closest(&trace.map->spatial_tree, start_x, start_y, end_x, end_y, 1.001, Trace_ClosestLineHit, &trace);
+
+	if (r_frac) *r_frac = min_frac;
+	if (r_hitX) *r_hitX = trace.hit_x;
+	if (r_hitY) *r_hitY = trace.hit_y;
+	if (r_hitZ) *r_hitZ = trace.hit_z;
+
+	return trace.hit;
+}
+
+//the tests of Trace_FindLine (both point side checks and Line_SegmentInterceptSegmentLine) for 4 traces against one line,
+//returns a lane mask of the traces that cross the line
+static int Trace_LineCrossMask4(Linedef* line, __m128 start_x, __m128 start_y, __m128 end_x, __m128 end_y, __m128* r_frac)
+{
+	__m128 side_epsilon = _mm_set1_ps((float)MATH_EQUAL_EPSILON);
+	__m128 cmp_epsilon = _mm_set1_ps((float)CMP_EPSILON);
+	__m128 neg_cmp_epsilon = _mm_set1_ps((float)-CMP_EPSILON);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	__m128 line_x0 = _mm_set1_ps(line->x0);
+	__m128 line_y0 = _mm_set1_ps(line->y0);
+	__m128 line_x1 = _mm_set1_ps(line->x1);
+	__m128 line_y1 = _mm_set1_ps(line->y1);
+	__m128 line_dx = _mm_set1_ps(line->dx);
+	__m128 line_dy = _mm_set1_ps(line->dy);
+
+	__m128 trace_dx = _mm_sub_ps(end_x, start_x);
+	__m128 trace_dy = _mm_sub_ps(end_y, start_y);
+	__m128 trace_dot = _mm_add_ps(_mm_mul_ps(trace_dx, trace_dx), _mm_mul_ps(trace_dy, trace_dy));
+
+	//trace ends on both sides of the line
+	__m128 s1 = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(start_y, line_y0), line_dx), _mm_mul_ps(_mm_sub_ps(line_x0, start_x), line_dy)), side_epsilon);
+	__m128 s2 = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(end_y, line_y0), line_dx), _mm_mul_ps(_mm_sub_ps(line_x0, end_x), line_dy)), side_epsilon);
+	__m128 pass = _mm_xor_ps(s1, s2);
+
+	//intercept of the trace on the infinite line, parallel lines pass with 0
+	__m128 den = _mm_sub_ps(_mm_mul_ps(trace_dy, line_dx), _mm_mul_ps(trace_dx, line_dy));
+	__m128 num = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(start_x, line_x0), trace_dy), _mm_mul_ps(_mm_sub_ps(line_y0, start_y), trace_dx));
+	__m128 intercept = _mm_div_ps(num, den);
+	__m128 intercept_ok = _mm_and_ps(_mm_cmpge_ps(intercept, zero), _mm_cmple_ps(intercept, one));
+	pass = _mm_and_ps(pass, _mm_or_ps(_mm_cmpeq_ps(den, zero), intercept_ok));
+
+	//line ends on both sides of the trace
+	__m128 s3 = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(line_y0, start_y), trace_dx), _mm_mul_ps(_mm_sub_ps(start_x, line_x0), trace_dy)), side_epsilon);
+	__m128 s4 = _mm_cmplt_ps(_mm_add_ps(_mm_mul_ps(_mm_sub_ps(line_y1, start_y), trace_dx), _mm_mul_ps(_mm_sub_ps(start_x, line_x1), trace_dy)), side_epsilon);
+	pass = _mm_and_ps(pass, _mm_xor_ps(s3, s4));
+	pass = _mm_and_ps(pass, _mm_cmpgt_ps(trace_dot, zero));
+
+	if (_mm_movemask_ps(pass) == 0)
+	{
+		return 0;
+	}
+
+	//Line_SegmentInterceptSegmentLine
+	__m128 l0n_x = _mm_div_ps(trace_dx, trace_dot);
+	__m128 l0n_y = _mm_div_ps(trace_dy, trace_dot);
+
+	__m128 c_dx = _mm_sub_ps(line_x0, start_x);
+	__m128 c_dy = _mm_sub_ps(line_y0, start_y);
+	__m128 d_dx = _mm_sub_ps(line_x1, start_x);
+	__m128 d_dy = _mm_sub_ps(line_y1, start_y);
+
+	__m128 c_x = _mm_add_ps(_mm_mul_ps(c_dx, l0n_x), _mm_mul_ps(c_dy, l0n_y));
+	__m128 c_y = _mm_sub_ps(_mm_mul_ps(c_dy, l0n_x), _mm_mul_ps(c_dx, l0n_y));
+	__m128 d_x = _mm_add_ps(_mm_mul_ps(d_dx, l0n_x), _mm_mul_ps(d_dy, l0n_y));
+	__m128 d_y = _mm_sub_ps(_mm_mul_ps(d_dy, l0n_x), _mm_mul_ps(d_dx, l0n_y));
+
+	__m128 both_below = _mm_and_ps(_mm_cmplt_ps(c_y, neg_cmp_epsilon), _mm_cmplt_ps(d_y, neg_cmp_epsilon));
+	__m128 both_above = _mm_and_ps(_mm_cmpgt_ps(c_y, cmp_epsilon), _mm_cmpgt_ps(d_y, cmp_epsilon));
+
+	//Math_IsEqualApprox
+	__m128 threshold = _mm_max_ps(_mm_mul_ps(cmp_epsilon, _mm_and_ps(c_y, abs_mask)), cmp_epsilon);
+	__m128 parallel = _mm_or_ps(_mm_cmpeq_ps(c_y, d_y), _mm_cmplt_ps(_mm_and_ps(_mm_sub_ps(c_y, d_y), abs_mask), threshold));
+
+	pass = _mm_andnot_ps(_mm_or_ps(_mm_or_ps(both_below, both_above), parallel), pass);
+
+	__m128 pos = _mm_add_ps(d_x, _mm_div_ps(_mm_mul_ps(_mm_sub_ps(c_x, d_x), d_y), _mm_sub_ps(d_y, c_y)));
+	pass = _mm_and_ps(pass, _mm_and_ps(_mm_cmpge_ps(pos, zero), _mm_cmple_ps(pos, one)));
+
+	*r_frac = pos;
+
+	return _mm_movemask_ps(pass);
+}
+
+void Trace_FindLinePacket(TracePacket* packet, bool ignore_sky_plane, int* r_hits, unsigned* r_hit_masks, int max_hit_count)
+{
+	Map* map = Map_GetMap();
+
+	int num_rays = Math_Clampl(packet->num_rays, 0, TRACE_PACKET_MAX_RAYS);
+
+	for (int i = 0; i < TRACE_PACKET_MAX_RAYS; i++)
+	{
+		packet->hits[i] = TRACE_NO_HIT;
+		packet->frac[i] = 1.001;
+		packet->hit_x[i] = FLT_MAX;
+		packet->hit_y[i] = FLT_MAX;
+		packet->hit_z[i] = FLT_MAX;
+	}
+
+	if (num_rays <= 0)
+	{
+		return;
+	}
+
+	//unused lanes trace a copy of the first ray and are masked out
+	for (int i = num_rays; i < TRACE_PACKET_MAX_RAYS; i++)
+	{
+		packet->start_x[i] = packet->start_x[0];
+		packet->start_y[i] = packet->start_y[0];
+		packet->start_z[i] = packet->start_z[0];
+		packet->end_x[i] = packet->end_x[0];
+		packet->end_y[i] = packet->end_y[0];
+		packet->end_z[i] = packet->end_z[0];
+	}
+
+	int num_traces = BVH_Tree_Cull_TracePacket(&map->spatial_tree, num_rays, packet->start_x, packet->start_y, packet->end_x, packet->end_y, max_hit_count, r_hits, r_hit_masks);
+
+	int num_groups = (num_rays + 3) / 4;
+
+	for (int i = 0; i < num_traces; i++)
+	{
+		int index = r_hits[i];
+
+		//ignore objects
+		if (index >= 0)
+		{
+			continue;
 		}
 
-		if (ignore_sky_plane)
+		int line_index = -(index + 1);
+		Linedef* line = Map_GetLineDef(line_index);
+
+		for (int g = 0; g < num_groups; g++)
 		{
-			if (frontsector->is_sky && z > frontsector->ceil)
+			int group_mask = (r_hit_masks[i] >> (g * 4)) & 0xF;
+
+			if (group_mask == 0)
 			{
 				continue;
 			}
-			else if (backsector && backsector->is_sky && z > backsector->ceil)
+
+			__m128 start_x = _mm_loadu_ps(&packet->start_x[g * 4]);
+			__m128 start_y = _mm_loadu_ps(&packet->start_y[g * 4]);
+			__m128 start_z = _mm_loadu_ps(&packet->start_z[g * 4]);
+			__m128 end_x = _mm_loadu_ps(&packet->end_x[g * 4]);
+			__m128 end_y = _mm_loadu_ps(&packet->end_y[g * 4]);
+			__m128 end_z = _mm_loadu_ps(&packet->end_z[g * 4]);
+
+			__m128 frac = _mm_setzero_ps();
+
+			group_mask &= Trace_LineCrossMask4(line, start_x, start_y, end_x, end_y, &frac);
+
+			if (group_mask == 0)
 			{
 				continue;
 			}
-		}
 
-		if (frac < min_frac)
-		{
-			min_frac = frac;
-			min_hit_x = hit_x;
-			min_hit_y = hit_y;
-			min_hit_z = z;
-			min_hit = line_index;
-		}
-	}
+			float lane_hit_x[4];
+			float lane_hit_y[4];
+			float lane_hit_z[4];
+			float lane_frac[4];
 
-	if (r_frac) *r_frac = min_frac;
-	if (r_hitX) *r_hitX = min_hit_x;
-	if (r_hitY) *r_hitY = min_hit_y;
-	if (r_hitZ) *r_hitZ = min_hit_z;
+			_mm_storeu_ps(lane_hit_x, _mm_add_ps(start_x, _mm_mul_ps(_mm_sub_ps(end_x, start_x), frac)));
+			_mm_storeu_ps(lane_hit_y, _mm_add_ps(start_y, _mm_mul_ps(_mm_sub_ps(end_y, start_y), frac)));
+			_mm_storeu_ps(lane_hit_z, _mm_add_ps(start_z, _mm_mul_ps(_mm_sub_ps(end_z, start_z), frac)));
+			_mm_storeu_ps(lane_frac, frac);
 
-	return min_hit;
+			for (int k = 0; k < 4; k++)
+			{
+				int ray = g * 4 + k;
+
+				//only closer hits need the opening and texture checks
+				if (!(group_mask & (1 << k)) || lane_frac[k] >= packet->frac[ray])
+				{
+					continue;
+				}
+
+				if (!Trace_AcceptLineHit(map, line, packet->start_x[ray], packet->start_y[ray], lane_hit_z[k], lane_hit_x[k], lane_hit_y[k], ignore_sky_plane))
+				{
+					continue;
+				}
+
+				packet->frac[ray] = lane_frac[k];
+				packet->hit_x[ray] = lane_hit_x[k];
+				packet->hit_y[ray] = lane_hit_y[k];
+				packet->hit_z[ray] = lane_hit_z[k];
+				packet->hits[ray] = line_index;
+			}
+		}
+	}
 }
 
 int Trace_FindSectors(int ignore_sector_index, float bbox[2][2])
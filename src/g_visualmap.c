@@ -3,7 +3,6 @@
 #include "u_math.h"
 #include "game_info.h"
 
-#define MAX_ITEMS 2000
 #define MANUAL_MOVE_SPEED 500
 #define MAX_ZOOM_LEVEL 4
 #define ZOOM_STEP 0.25
@@ -38,13 +37,13 @@ typedef struct
 	float pulse;
 	int pulse_dir;
 
-	int result_traces[MAX_ITEMS];
 } VisualMap;
 
 static VisualMap s_visualMap;
 
 static void VisualMap_ProcessInput(GLFWwindow* window, float delta)
 {
+#ifndef HEADLESS
 	if (s_visualMap.input_timer > 0)
 	{
 		return;
@@ -98,6 +97,7 @@ static void VisualMap_ProcessInput(GLFWwindow* window, float delta)
 		s_visualMap.mode = (s_visualMap.mode + 1) % 3;
 		s_visualMap.input_timer = 0.5;
 	}
+#endif // !HEADLESS
 }
 
 void VisualMap_Init()
@@ -193,125 +193,144 @@ void VisualMap_Update(GLFWwindow* window, double delta)
 
 }
 
-void VisualMap_Draw(Image* image, FontData* font)
+void VisualMap_GetState(VisualMapState* state)
 {
+	state->mode = s_visualMap.mode;
+	state->rotate = s_visualMap.rotate;
+	state->player_follow_mode = s_visualMap.player_follow_mode;
+
+	memcpy(state->bbox, s_visualMap.bbox, sizeof(state->bbox));
+
+	state->angle = s_visualMap.angle;
+	state->player_angle = s_visualMap.player_angle;
+	state->player_x = s_visualMap.player_x;
+	state->player_y = s_visualMap.player_y;
+
+	state->center_x = s_visualMap.center_x;
+	state->center_y = s_visualMap.center_y;
+
+	if (state->rotate)
+	{
+		Math_XY_Rotate(&state->center_x, &state->center_y, cosf(state->angle), sinf(state->angle));
+	}
+
+	state->center_x -= s_visualMap.w_offset;
+	state->center_y -= s_visualMap.h_offset;
+
+	state->pulse = s_visualMap.pulse;
+	state->zoom_level = ((float)s_visualMap.zoom_level * (float)ZOOM_STEP) * (float)Render_GetRenderScale();
+}
+
+void VisualMap_Draw(Image* image, FontData* font, FramePacket* packet)
+{
+	VisualMapState* state = &packet->visual_map;
+
 	//visual map is closed
-	if (s_visualMap.mode == 0)
+	if (state->mode == 0)
 	{
 		return;
 	}
 
-	Render_LockObjectMutex(false);
-
-	//keep everything on the stack, so that the mutex would not last so long
-	bool rotate = s_visualMap.rotate;
-	int mode = s_visualMap.mode;
+	//everything comes from the frame packet, the game thread is already updating the visual map
+	bool rotate = state->rotate;
+	int mode = state->mode;
 
 	float bbox[2][2];
-	memcpy(bbox, s_visualMap.bbox, sizeof(bbox));
+	memcpy(bbox, state->bbox, sizeof(bbox));
 
 	Map* map = Map_GetMap();
 
-	float angle = s_visualMap.angle;
+	float angle = state->angle;
 	float cos_angle = cosf(angle);
 	float sin_angle = sinf(angle);
 
-	float player_angle = s_visualMap.player_angle;
-	float player_x = s_visualMap.player_x;
-	float player_y = s_visualMap.player_y;
-
-	float center_x = s_visualMap.center_x;
-	float center_y = s_visualMap.center_y;
-
-	if (rotate)
-	{
-		Math_XY_Rotate(&center_x, &center_y, cosf(angle), sinf(angle));
-	}
-
-	center_x -= s_visualMap.w_offset;
-	center_y -= s_visualMap.h_offset;
+	float player_angle = state->player_angle;
+	float player_x = state->player_x;
+	float player_y = state->player_y;
 
-	float pulse = s_visualMap.pulse;
-	float zoom_level = ((float)s_visualMap.zoom_level * (float)ZOOM_STEP) * (float)Render_GetRenderScale();
+	float center_x = state->center_x;
+	float center_y = state->center_y;
 
-	Render_UnlockObjectMutex(false);
+	float pulse = state->pulse;
+	float zoom_level = state->zoom_level;
 
 	if (mode == 1)
 	{
 		Image_Clear(image, 0);
 	}
 
-	int num_hits = BVH_Tree_Cull_Box(Map_GetSpatialTree(), bbox, MAX_ITEMS, s_visualMap.result_traces);
-
-	for (int i = 0; i < num_hits; i++)
+	//the spatial tree also holds objects the game thread keeps moving, so walk the lines directly
+	for (int i = 0; i < map->num_linedefs; i++)
 	{
-		int index = s_visualMap.result_traces[i];
+		Linedef* line = &map->linedefs[i];
 
-		//Is a line
-		if (index < 0)
+		if (!Math_BoxIntersectsBox(bbox, line->bbox))
 		{
-			index = -(index + 1);
-			Linedef* line = &map->linedefs[index];
+			continue;
+		}
 
-			if (!(line->flags & MF__LINE_MAPPED) || (line->flags & MF__LINE_DONT_DRAW))
-			{
-				continue;
-			}
+		if (!(line->flags & MF__LINE_MAPPED) || (line->flags & MF__LINE_DONT_DRAW))
+		{
+			continue;
+		}
 
-			Sector* frontsector = Map_GetSector(line->front_sector);
-			Sector* backsector = NULL;
-			if (line->back_sector >= 0)
-			{
-				backsector = Map_GetSector(line->back_sector);
-			}
+		//heights come from the frame packet, not the sectors the game thread is moving
+		Sector frontsector_state = *Map_GetSector(line->front_sector);
+		RenderUtl_ApplyFramePacketSector(packet, &frontsector_state);
+
+		Sector* frontsector = &frontsector_state;
+		Sector* backsector = NULL;
+		Sector backsector_state;
+
+		if (line->back_sector >= 0)
+		{
+			backsector_state = *Map_GetSector(line->back_sector);
+			RenderUtl_ApplyFramePacketSector(packet, &backsector_state);
 
-			unsigned char color[4] = { WALL_COLOR[0], WALL_COLOR[1], WALL_COLOR[2], 255};
+			backsector = &backsector_state;
+		}
+
+		unsigned char color[4] = { WALL_COLOR[0], WALL_COLOR[1], WALL_COLOR[2], 255};
 
-			if (backsector && !(line->flags & MF__LINE_SECRET))
+		if (backsector && !(line->flags & MF__LINE_SECRET))
+		{
+			if (line->special == SPECIAL__USE_DOOR || line->special == SPECIAL__USE_DOOR_NEVER_CLOSE || line->special == SPECIAL__USE_LIFT || 
+				line->special == SPECIAL__TRIGGER_TELEPORT || line->special == SPECIAL__TRIGGER_EXIT)
 			{
-				if (line->special == SPECIAL__USE_DOOR || line->special == SPECIAL__USE_DOOR_NEVER_CLOSE || line->special == SPECIAL__USE_LIFT || 
-					line->special == SPECIAL__TRIGGER_TELEPORT || line->special == SPECIAL__TRIGGER_EXIT)
-				{
-					for (int k = 0; k < 3; k++)
-					{
-						color[k] = SPECIAL_WALL_COLOR[k] * pulse;
-					}
-				}
-				else if (frontsector->floor != backsector->floor)
-				{
-					color[0] = FLOOR_MISMATCH_COLOR[0]; color[1] = FLOOR_MISMATCH_COLOR[1]; color[2] = FLOOR_MISMATCH_COLOR[2];
-				}
-				else if (frontsector->ceil != backsector->ceil)
+				for (int k = 0; k < 3; k++)
 				{
-					color[0] = CEIL_MISMATCH_COLOR[0]; color[1] = CEIL_MISMATCH_COLOR[1]; color[2] = CEIL_MISMATCH_COLOR[2];
+					color[k] = SPECIAL_WALL_COLOR[k] * pulse;
 				}
 			}
-
-			float line_x0 = line->x0;
-			float line_y0 = line->y0;
-
-			float line_x1 = line->x1;
-			float line_y1 = line->y1;
-
-			if (rotate)
+			else if (frontsector->floor != backsector->floor)
+			{
+				color[0] = FLOOR_MISMATCH_COLOR[0]; color[1] = FLOOR_MISMATCH_COLOR[1]; color[2] = FLOOR_MISMATCH_COLOR[2];
+			}
+			else if (frontsector->ceil != backsector->ceil)
 			{
-				Math_XY_Rotate(&line_x0, &line_y0, cos_angle, sin_angle);
-				Math_XY_Rotate(&line_x1, &line_y1, cos_angle, sin_angle);
+				color[0] = CEIL_MISMATCH_COLOR[0]; color[1] = CEIL_MISMATCH_COLOR[1]; color[2] = CEIL_MISMATCH_COLOR[2];
 			}
+		}
 
-			int x0 = (line_x0 - center_x) * zoom_level;
-			int y0 = (line_y0 - center_y) * zoom_level;
-		    int x1 = (line_x1 - center_x) * zoom_level;
-			int y1 = (line_y1 - center_y) * zoom_level;
+		float line_x0 = line->x0;
+		float line_y0 = line->y0;
 
-			Video_DrawLine(image, x0, y0, x1, y1, color);
-		}
-		else
+		float line_x1 = line->x1;
+		float line_y1 = line->y1;
+
+		if (rotate)
 		{
-			
+			Math_XY_Rotate(&line_x0, &line_y0, cos_angle, sin_angle);
+			Math_XY_Rotate(&line_x1, &line_y1, cos_angle, sin_angle);
 		}
-	}
 
+		int x0 = (line_x0 - center_x) * zoom_level;
+		int y0 = (line_y0 - center_y) * zoom_level;
+	    int x1 = (line_x1 - center_x) * zoom_level;
+		int y1 = (line_y1 - center_y) * zoom_level;
+
+		Video_DrawLine(image, x0, y0, x1, y1, color);
+	}
 
 	//draw player arrow
 	unsigned char color[4] = { PLAYER_COLOR[0], PLAYER_COLOR[1], PLAYER_COLOR[2], 255};
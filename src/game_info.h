@@ -336,7 +336,7 @@ typedef struct
 	float rolloff;
 } SFXInfo;
 
-typedef struct
+typedef struct LightCompilerInfo
 {
 	float sky_scale;
 	float sun_z;
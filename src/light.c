@@ -18,7 +18,8 @@
 
 #define AA_SAMPLES 4
 
-#define NUM_BOUNCES 12
+#define MIN_LIGHT_TASKS 1024
+
 #define RADIOSITY_TRACE_DIST 1024
 #define RADIOSITY_SAMPLES 128
 #define RADIOSITY_REFLECTANCE 0.25
@@ -54,6 +55,12 @@
 #define AREA_LIGHT_BIAS_TO_CENTER 8.0
 #define AREA_LIGHT_NORMAL_BIAS 4.0
 
+//fnv-1a
+#define LIGHT_HASH_SEED 2166136261u
+#define LIGHT_HASH_PRIME 16777619u
+
+static void LightGlobal_RunTasks(LightGlobal* global, LightTraceThread* thread, int bounce);
+
 //only for debugging light points
 #ifdef DRAW_LIGHT_POINTS
 static Vec4 lightPoints[10000000];
@@ -125,10 +132,10 @@ static float GetCosineDirection(LightTraceThread* thread, float normal[3], float
 	dest[2] = dir_z;
 }
 
-static void LightThread_Loop(LightTraceThread* thread)
+static void LightThread_Loop(void* arg)
 {
+	LightTraceThread* thread = arg;
 	LightGlobal* global = thread->globals;
-	Lightgrid* lightgrid = &Map_GetMap()->lightgrid;
 
 	int bounces_performed = 0;
 	bool shutdown_threads = global->shutdown_threads;
@@ -136,64 +143,29 @@ static void LightThread_Loop(LightTraceThread* thread)
 	while(!shutdown_threads)	
 	{
 		//wait for work
-		WaitForSingleObject(thread->start_work_event, INFINITE);
+		Event_Wait(thread->start_work_event);
 
-		EnterCriticalSection(&global->start_mutex);
+		Mutex_Lock(&global->start_mutex);
 		int bounce = global->bounce;
 		shutdown_threads = global->shutdown_threads;
-		LeaveCriticalSection(&global->start_mutex);
+		Mutex_Unlock(&global->start_mutex);
 
-		ResetEvent(thread->finished_event);
-		ResetEvent(thread->start_work_event);
+		Event_Reset(thread->finished_event);
+		Event_Reset(thread->start_work_event);
 
-		SetEvent(thread->active_event);
+		Event_Set(thread->active_event);
 
 		//do the work
 		if (bounce >= 0 || bounce == BOUNCE_AO)
 		{
-			for (int s = thread->sector_start; s < thread->sector_end; s++)
-			{
-				Sector* sector = Map_GetSector(s);
-
-				//dont map some sectors, mostly that change light
-				if (sector->special == SECTOR_SPECIAL__LIGHT_FLICKER || sector->special == SECTOR_SPECIAL__LIGHT_GLOW)
-				{
-					continue;
-				}
-
-				Lightmap_Sector(global, thread, sector, bounce);
-			}
-
-			if (bounce != BOUNCE_AO)
-			{
-				for (int i = thread->grid_start; i < thread->grid_end; i++)
-				{
-					Lightblock* block = &lightgrid->blocks[i];
-					int z = (i / ((int)lightgrid->bounds[0] * (int)lightgrid->bounds[1]));
-					int y = (i / (int)lightgrid->bounds[0]) % (int)lightgrid->bounds[1];
-					int x = i % (int)lightgrid->bounds[0];
-
-					float position[3];
-
-					position[0] = lightgrid->origin[0] + (x * lightgrid->size[0]);
-					position[1] = lightgrid->origin[1] + (y * lightgrid->size[1]);
-					position[2] = lightgrid->origin[2] + (z * lightgrid->size[2]);
+			LightGlobal_RunTasks(global, thread, bounce);
 
-					if (!Lightblock_Process(global, thread, block, position, bounce))
-					{
-						//mark as out of bounds, so that the sample will be ignored
-						//block->light.r = 0xffff;
-						//block->light.g = 0xffff;
-						//block->light.b = 0xffff;
-					}
-				}
-			}
 			bounces_performed++;
 		}
 
 		
-		ResetEvent(thread->active_event);
-		SetEvent(thread->finished_event);
+		Event_Reset(thread->active_event);
+		Event_Set(thread->finished_event);
 	}
 }
 
@@ -207,7 +179,7 @@ static void LightGlobal_WaitForAllThreads(LightGlobal* global)
 	{
 		LightTraceThread* thr = &global->threads[i];
 
-		WaitForSingleObject(thr->finished_event, INFINITE);
+		Event_Wait(thr->finished_event);
 	}
 }
 
@@ -219,18 +191,18 @@ static void LightGlobal_SetWorkStateForAllThreads(LightGlobal* global, int bounc
 	}
 
 	//set start work event for all threads
-	EnterCriticalSection(&global->start_mutex);
+	Mutex_Lock(&global->start_mutex);
 	if (bounce == BOUNCE_EXIT) global->shutdown_threads = true;
 	global->bounce = bounce;
 	global->ticks++;
-	LeaveCriticalSection(&global->start_mutex);
+	Mutex_Unlock(&global->start_mutex);
 
 	for (int i = 0; i < global->num_threads; i++)
 	{
 		LightTraceThread* thr = &global->threads[i];
 
-		SetEvent(thr->start_work_event);
-		WaitForSingleObject(thr->active_event, INFINITE);
+		Event_Set(thr->start_work_event);
+		Event_Wait(thr->active_event);
 	}
 }
 
@@ -803,7 +775,7 @@ static bool LightGlobal_SetupLights(LightGlobal* global, LightCompilerInfo* ligh
 	return true;
 }
 
-void LightGlobal_Setup(LightGlobal* global, LightCompilerInfo* compiler_info)
+void LightGlobal_Setup(LightGlobal* global, LightCompilerInfo* compiler_info, int num_threads)
 {
 	Map* map = Map_GetMap();
 
@@ -1031,12 +1003,13 @@ void LightGlobal_Setup(LightGlobal* global, LightCompilerInfo* compiler_info)
 	}
 
 	//setup stuff for multithreading
-	InitializeCriticalSection(&global->start_mutex);
+	Mutex_Init(&global->start_mutex);
+	Mutex_Init(&global->alloc_mutex);
 
-	global->start_work_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	global->start_work_event = Event_Create(true, false);
 
-	//setup threads
-	global->num_threads = QueryNumLogicalProcessors();
+	//setup threads, 0 or less means one per logical processor
+	global->num_threads = (num_threads > 0) ? num_threads : QueryNumLogicalProcessors();
 
 	if (global->num_threads >= MAX_THREADS)
 	{
@@ -1052,49 +1025,18 @@ void LightGlobal_Setup(LightGlobal* global, LightCompilerInfo* compiler_info)
 			return;
 		}
 
-		float num_threads = global->num_threads;
-		int sector_slice = ceil((float)map->num_sectors / num_threads);
-
-		int sector_start = 0;
-		int sector_end = sector_slice;
-		
-		int total_grid_points = map->lightgrid.block_size[0] * map->lightgrid.block_size[1] * map->lightgrid.block_size[2];
-
-		int grid_slice = ceil((float)total_grid_points / num_threads);
-
-		int grid_start = 0;
-		int grid_end = grid_slice;
-
-		DWORD thread_id = 0;
 		for (int i = 0; i < global->num_threads; i++)
 		{
 			LightTraceThread* thread = &global->threads[i];
-			thread->sector_start = sector_start;
-			thread->sector_end = sector_end;
-
-			sector_start = sector_end;
-			sector_end += sector_slice;
-
-			sector_start = Math_Clampl(sector_start, 0, map->num_sectors);
-			sector_end = Math_Clampl(sector_end, 0, map->num_sectors);
-
-			thread->grid_start = grid_start;
-			thread->grid_end = grid_end;
-
-			grid_start = grid_end;
-			grid_end += grid_slice;
-
-			grid_start = Math_Clampl(grid_start, 0, total_grid_points);
-			grid_end = Math_Clampl(grid_end, 0, total_grid_points);
 
 			thread->globals = global;
 
-			thread->active_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-			thread->finished_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-			thread->start_work_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-			thread->thread_handle = CreateThread(NULL, 0, LightThread_Loop, thread, 0, &thread_id);
+			thread->active_event = Event_Create(true, false);
+			thread->finished_event = Event_Create(true, false);
+			thread->start_work_event = Event_Create(true, false);
+			thread->thread_handle = Thread_Create(LightThread_Loop, thread);
 
-			thread->seed = (int)glfwGetTimerValue() * i;
+			thread->seed = (int)(Time_GetSeconds() * 1000000.0) * i;
 		}
 
 		printf("Setting up %i lightmap threads \n", global->num_threads);
@@ -1135,24 +1077,26 @@ void LightGlobal_Destruct(LightGlobal* global)
 	{
 		LightTraceThread* thr = &global->threads[i];
 
-		WaitForSingleObject(thr->thread_handle, INFINITE);
-		CloseHandle(thr->thread_handle);
-		CloseHandle(thr->active_event);
-		CloseHandle(thr->finished_event);
-		CloseHandle(thr->start_work_event);
+		Thread_Join(thr->thread_handle);
+		Event_Destruct(thr->active_event);
+		Event_Destruct(thr->finished_event);
+		Event_Destruct(thr->start_work_event);
 	}
 
 	printf("Shut down %i lightmap threads \n", global->num_threads);
 
-	DeleteCriticalSection(&global->start_mutex);
-	CloseHandle(global->start_work_event);
+	Mutex_Destruct(&global->start_mutex);
+	Mutex_Destruct(&global->alloc_mutex);
+	Event_Destruct(global->start_work_event);
 
 	dA_Destruct(global->light_list);
+	if (global->tasks) free(global->tasks);
 	if (global->thread) free(global->thread);
 	if (global->threads) free(global->threads);
 	if (global->random_vectors) free(global->random_vectors);
 	if (global->deviance_vectors) free(global->deviance_vectors);
 	if (global->ao_sample_vectors) free(global->ao_sample_vectors);
+	if (global->rebake_sectors) free(global->rebake_sectors);
 
 	if (global->ceil_back_lightmaps)
 	{
@@ -1207,13 +1151,9 @@ void LightGlobal_Destruct(LightGlobal* global)
 	}
 }
 
-static bool TraceLine(LightGlobal* global, LightTraceThread* thread, LightTraceResult* result, float start_x, float start_y, float start_z, float end_x, float end_y, float end_z, bool ignore_sky_plane, bool need_color_info)
+//fills the surface, light and color info of the line hit found by Trace_FindLine
+static bool TraceLine_ResolveHit(LightGlobal* global, LightTraceResult* result, int hit, float start_x, float start_y, float start_z, float end_x, float end_y, float end_z, bool ignore_sky_plane, bool need_color_info)
 {
-	memset(result, 0, sizeof(LightTraceResult));
-	result->frac = 1;
-	
-	int hit = Trace_FindLine(start_x, start_y, start_z, end_x, end_y, end_z, ignore_sky_plane, thread->hits, LIGHTTRACE_MAX_HITS, &result->hit[0], &result->hit[1], &result->hit[2], &result->frac);
-
 	if (hit == TRACE_NO_HIT)
 	{
 		return false;
@@ -1507,6 +1447,36 @@ static bool TraceLine(LightGlobal* global, LightTraceThread* thread, LightTraceR
 	return true;
 }
 
+static bool TraceLine(LightGlobal* global, LightTraceThread* thread, LightTraceResult* result, float start_x, float start_y, float start_z, float end_x, float end_y, float end_z, bool ignore_sky_plane, bool need_color_info)
+{
+	memset(result, 0, sizeof(LightTraceResult));
+	result->frac = 1;
+	
+	int hit = Trace_FindLine(start_x, start_y, start_z, end_x, end_y, end_z, ignore_sky_plane, &result->hit[0], &result->hit[1], &result->hit[2], &result->frac);
+
+	return TraceLine_ResolveHit(global, result, hit, start_x, start_y, start_z, end_x, end_y, end_z, ignore_sky_plane, need_color_info);
+}
+
+//traces all rays of the packet thru the bvh together, r_hit tells which results are valid
+static void TraceLine_Packet(LightGlobal* global, LightTraceThread* thread, TracePacket* packet, LightTraceResult* results, bool* r_hit, bool ignore_sky_plane, bool need_color_info)
+{
+	Trace_FindLinePacket(packet, ignore_sky_plane, thread->hits, thread->hit_masks, LIGHTTRACE_MAX_HITS);
+
+	for (int i = 0; i < packet->num_rays; i++)
+	{
+		LightTraceResult* result = &results[i];
+
+		memset(result, 0, sizeof(LightTraceResult));
+
+		result->hit[0] = packet->hit_x[i];
+		result->hit[1] = packet->hit_y[i];
+		result->hit[2] = packet->hit_z[i];
+		result->frac = packet->frac[i];
+
+		r_hit[i] = TraceLine_ResolveHit(global, result, packet->hits[i], packet->start_x[i], packet->start_y[i], packet->start_z[i], packet->end_x[i], packet->end_y[i], packet->end_z[i], ignore_sky_plane, need_color_info);
+	}
+}
+
 static Vec4 calc_light(float light_dir[3], float light_color[3], float normal[3], float attenuation)
 {
 	float dot = 1;
@@ -1611,6 +1581,29 @@ static float calc_hit_radiosity_angle(float position[3], float normal[3], LightT
 	}
 	return angle;
 }
+static bool Lightmap_IsSectorRebaked(LightGlobal* global, int sector_index)
+{
+	//no list means a full bake
+	if (!global->rebake_sectors)
+	{
+		return true;
+	}
+
+	return sector_index >= 0 && global->rebake_sectors[sector_index];
+}
+
+static void Lightmap_FreeLightmap(Lightmap* lm)
+{
+	if (lm->data)
+	{
+		free(lm->data);
+	}
+
+	lm->data = NULL;
+	lm->width = 0;
+	lm->height = 0;
+}
+
 static void Lightmap_CopyLightmap(Lightmap* dest, Lightmap* source)
 {
 	if (!source->data || source->width <= 0 || source->height <= 0)
@@ -1638,6 +1631,36 @@ static void Lightmap_CopyLightmap(Lightmap* dest, Lightmap* source)
 	memcpy(dest->data, source->data, sizeof(Vec4) * source->width * source->height);
 }
 
+//fills the back lightmap from a finished lightmap that is kept, so rebaked surfaces get its bounce light
+static void Lightmap_SeedBackLightmap(Lightmap* dest, Lightmap* source)
+{
+	if (!source->data || source->width <= 0 || source->height <= 0)
+	{
+		return;
+	}
+
+	dest->float_data = calloc(source->width * source->height, sizeof(Vec4));
+
+	if (!dest->float_data)
+	{
+		return;
+	}
+
+	dest->width = source->width;
+	dest->height = source->height;
+
+	for (int i = 0; i < source->width * source->height; i++)
+	{
+		Vec3_u16* sample = &source->data[i];
+		Vec4* dest_sample = &dest->float_data[i];
+
+		dest_sample->r = sample->r;
+		dest_sample->g = sample->g;
+		dest_sample->b = sample->b;
+		dest_sample->a = 1;
+	}
+}
+
 static void Lightmap_FilterLightmap(Lightmap* lm)
 {
 	Vec4* cast_data = lm->float_data;
@@ -1796,6 +1819,11 @@ static void Lightmap_SwapLightmaps(LightGlobal* global, Map* map)
 	{
 		Sector* sector = Map_GetSector(i);
 
+		if (!Lightmap_IsSectorRebaked(global, i))
+		{
+			continue;
+		}
+
 		Lightmap* back_floor_lightmap = &global->floor_back_lightmaps[i];
 		Lightmap* back_ceil_lightmap = &global->ceil_back_lightmaps[i];
 
@@ -1812,6 +1840,11 @@ static void Lightmap_SwapLightmaps(LightGlobal* global, Map* map)
 	for (int i = 0; i < map->num_linedefs; i++)
 	{
 		Linedef* linedef = Map_GetLineDef(i);
+
+		if (!Lightmap_IsSectorRebaked(global, linedef->front_sector))
+		{
+			continue;
+		}
 		
 		Lightmap* back_lightmap = &global->line_back_lightmaps[i];
 
@@ -1821,12 +1854,18 @@ static void Lightmap_SwapLightmaps(LightGlobal* global, Map* map)
 		}
 	}
 }
-static void Lightmap_CopyFinalLightmaps(Map* map)
+static void Lightmap_CopyFinalLightmaps(LightGlobal* global, Map* map)
 {
+	//kept lightmaps are already final
 	for (int i = 0; i < map->num_sectors; i++)
 	{
 		Sector* sector = Map_GetSector(i);
 
+		if (!Lightmap_IsSectorRebaked(global, i))
+		{
+			continue;
+		}
+
 		Lightmap* floor_lightmap = &sector->floor_lightmap;
 		Lightmap* ceil_lightmap = &sector->ceil_lightmap;
 
@@ -1848,6 +1887,11 @@ static void Lightmap_CopyFinalLightmaps(Map* map)
 	{
 		Linedef* linedef = Map_GetLineDef(i);
 
+		if (!Lightmap_IsSectorRebaked(global, linedef->front_sector))
+		{
+			continue;
+		}
+
 		if (linedef->lightmap.data)
 		{
 			Lightmap_FilterLightmap(&linedef->lightmap);
@@ -1978,79 +2022,100 @@ static float Lightmap_CalcAo(LightGlobal* global, LightTraceThread* thread, Line
 	float start_y = position[1] + normal[1] * 1;
 	float start_z = position[2] + normal[2] * 1;
 
-	for (int i = 0; i < global->num_ao_sample_vectors; i++)
+	LightTraceResult trace_results[TRACE_PACKET_MAX_RAYS];
+	bool trace_hits[TRACE_PACKET_MAX_RAYS];
+
+	//the cone vectors all start at the same luxel, so they are traced in packets
+	for (int first = 0; first < global->num_ao_sample_vectors; first += TRACE_PACKET_MAX_RAYS)
 	{
-		float x = global->ao_sample_vectors[(i * 3) + 0];
-		float y = global->ao_sample_vectors[(i * 3) + 1];
-		float z = global->ao_sample_vectors[(i * 3) + 2];
+		TracePacket packet;
+		packet.num_rays = min(global->num_ao_sample_vectors - first, TRACE_PACKET_MAX_RAYS);
 
-		//tangent space
-		float dir_x = rt[0] * x + up[0] * y + normal[0] * z;
-		float dir_y = rt[1] * x + up[1] * y + normal[1] * z;
-		float dir_z = rt[2] * x + up[2] * y + normal[2] * z;
+		for (int k = 0; k < packet.num_rays; k++)
+		{
+			int i = first + k;
 
-		float end_x = start_x + (dir_x * ao_depth);
-		float end_y = start_y + (dir_y * ao_depth);
-		float end_z = start_z + (dir_z * ao_depth);
+			float x = global->ao_sample_vectors[(i * 3) + 0];
+			float y = global->ao_sample_vectors[(i * 3) + 1];
+			float z = global->ao_sample_vectors[(i * 3) + 2];
 
-		LightTraceResult trace_result;
-		if (!TraceLine(global, thread, &trace_result, start_x, start_y, start_z, end_x, end_y, end_z, true, false))
-		{
-			//nothing was hit
-			continue;
-		}
-		
-		if (trace_result.hit_type == LST__SKY)
-		{
-			continue;
+			//tangent space
+			float dir_x = rt[0] * x + up[0] * y + normal[0] * z;
+			float dir_y = rt[1] * x + up[1] * y + normal[1] * z;
+			float dir_z = rt[2] * x + up[2] * y + normal[2] * z;
+
+			packet.start_x[k] = start_x;
+			packet.start_y[k] = start_y;
+			packet.start_z[k] = start_z;
+			packet.end_x[k] = start_x + (dir_x * ao_depth);
+			packet.end_y[k] = start_y + (dir_y * ao_depth);
+			packet.end_z[k] = start_z + (dir_z * ao_depth);
 		}
 
-		if (trace_result.hit_type == LST__WALL)
+		TraceLine_Packet(global, thread, &packet, trace_results, trace_hits, true, false);
+
+		for (int k = 0; k < packet.num_rays; k++)
 		{
-			Linedef* linedef = trace_result.linedef;
+			LightTraceResult* trace_result = &trace_results[k];
 
-			if (target_line && linedef)
+			if (!trace_hits[k])
 			{
-				//avoid self
-				if (linedef == target_line)
-				{
-					continue;
-				}
+				//nothing was hit
+				continue;
+			}
+		
+			if (trace_result->hit_type == LST__SKY)
+			{
+				continue;
+			}
+
+			if (trace_result->hit_type == LST__WALL)
+			{
+				Linedef* linedef = trace_result->linedef;
 
-				//try to reduce seams between simillar lines
-				if (linedef->dx == target_line->dx && linedef->dy == target_line->dy)
+				if (target_line && linedef)
 				{
-					continue;
-				}
+					//avoid self
+					if (linedef == target_line)
+					{
+						continue;
+					}
+
+					//try to reduce seams between simillar lines
+					if (linedef->dx == target_line->dx && linedef->dy == target_line->dy)
+					{
+						continue;
+					}
 
+				}
 			}
-		}
-		else if (trace_result.sector)
-		{
-			if (trace_result.hit_type == LST__CEIL)
+			else if (trace_result->sector)
 			{
-				if (trace_result.sector->ceil == position[2])
+				if (trace_result->hit_type == LST__CEIL)
 				{
-					continue;
+					if (trace_result->sector->ceil == position[2])
+					{
+						continue;
+					}
 				}
-			}
-			else if (trace_result.hit_type == LST__FLOOR)
-			{
-				if (trace_result.sector->floor == position[2])
+				else if (trace_result->hit_type == LST__FLOOR)
 				{
-					continue;
+					if (trace_result->sector->floor == position[2])
+					{
+						continue;
+					}
 				}
 			}
-		}
 
-		float delta[3];
-		delta[0] = trace_result.hit[0] - start_x;
-		delta[1] = trace_result.hit[1] - start_y;
-		delta[2] = trace_result.hit[2] - start_z;
+			float delta[3];
+			delta[0] = trace_result->hit[0] - start_x;
+			delta[1] = trace_result->hit[1] - start_y;
+			delta[2] = trace_result->hit[2] - start_z;
 
-		float len = Math_XYZ_Length(delta[0], delta[1], delta[2]);
+			float len = Math_XYZ_Length(delta[0], delta[1], delta[2]);
 
-		gather_ao += 1.0 - inv_depth * len;
+			gather_ao += 1.0 - inv_depth * len;
+		}
 	}
 
 	//direct
@@ -2338,82 +2403,101 @@ static Vec4 Lightmap_CalcRadiosity(LightGlobal* global, LightTraceThread* thread
 		start_z = position[2] + normal[2] * 1;
 	}
 
-	for (int i = 0; i < global->num_random_vectors; i++)
+	LightTraceResult traces[TRACE_PACKET_MAX_RAYS];
+	bool trace_hits[TRACE_PACKET_MAX_RAYS];
+
+	//the hemisphere samples all start at the same point, so they are traced in packets
+	for (int first = 0; first < global->num_random_vectors; first += TRACE_PACKET_MAX_RAYS)
 	{
-		float r_x = global->random_vectors[(i * 3) + 0];
-		float r_y = global->random_vectors[(i * 3) + 1];
-		float r_z = global->random_vectors[(i * 3) + 2];
+		TracePacket packet;
+		packet.num_rays = min(global->num_random_vectors - first, TRACE_PACKET_MAX_RAYS);
 
-		if (normal)
+		for (int k = 0; k < packet.num_rays; k++)
 		{
-			if (Math_XYZ_Dot(r_x, r_y, r_z, normal[0], normal[1], normal[2]) < 0)
+			int i = first + k;
+
+			float r_x = global->random_vectors[(i * 3) + 0];
+			float r_y = global->random_vectors[(i * 3) + 1];
+			float r_z = global->random_vectors[(i * 3) + 2];
+
+			if (normal)
 			{
-				r_x = -r_x;
-				r_y = -r_y;
-				r_z = -r_z;
+				if (Math_XYZ_Dot(r_x, r_y, r_z, normal[0], normal[1], normal[2]) < 0)
+				{
+					r_x = -r_x;
+					r_y = -r_y;
+					r_z = -r_z;
+				}
 			}
-		}
-	
-		float end_x = start_x + (r_x * RADIOSITY_TRACE_DIST);
-		float end_y = start_y + (r_y * RADIOSITY_TRACE_DIST);
-		float end_z = start_z + (r_z * RADIOSITY_TRACE_DIST);
 
-		LightTraceResult trace;
-		//didn't hit anything
-		if (!TraceLine(global, thread, &trace, start_x, start_y, start_z, end_x, end_y, end_z, false, true))
-		{
-			continue;
+			packet.start_x[k] = start_x;
+			packet.start_y[k] = start_y;
+			packet.start_z[k] = start_z;
+			packet.end_x[k] = start_x + (r_x * RADIOSITY_TRACE_DIST);
+			packet.end_y[k] = start_y + (r_y * RADIOSITY_TRACE_DIST);
+			packet.end_z[k] = start_z + (r_z * RADIOSITY_TRACE_DIST);
 		}
-		if (trace_line)
+
+		TraceLine_Packet(global, thread, &packet, traces, trace_hits, false, true);
+
+		for (int k = 0; k < packet.num_rays; k++)
 		{
-			if (trace.linedef == trace_line)
+			LightTraceResult* trace = &traces[k];
+
+			//didn't hit anything
+			if (!trace_hits[k])
 			{
 				continue;
 			}
-		}
+			if (trace_line)
+			{
+				if (trace->linedef == trace_line)
+				{
+					continue;
+				}
+			}
 
-		if (trace.hit_type == LST__SKY)
-		{
-			float p = RADIOSITY_PROBABILITY;
-			float brdf = RADIOSITY_SKY_BRDF;
+			if (trace->hit_type == LST__SKY)
+			{
+				float p = RADIOSITY_PROBABILITY;
+				float brdf = RADIOSITY_SKY_BRDF;
 
-			Vec4 sky_ambient = Vec4_Zero();
-			sky_ambient.r = (brdf * (global->sky_color[0]) * 1 / p);
-			sky_ambient.g = (brdf * (global->sky_color[1]) * 1 / p);
-			sky_ambient.b = (brdf * (global->sky_color[2]) * 1 / p);
-			sky_ambient.a = 1;
+				Vec4 sky_ambient = Vec4_Zero();
+				sky_ambient.r = (brdf * (global->sky_color[0]) * 1 / p);
+				sky_ambient.g = (brdf * (global->sky_color[1]) * 1 / p);
+				sky_ambient.b = (brdf * (global->sky_color[2]) * 1 / p);
+				sky_ambient.a = 1;
 
-			Vec4_Add(&total_light, sky_ambient);
-		}
-		else
-		{
-			float max_light = max(trace.light_sample.r, max(trace.light_sample.g, trace.light_sample.b));
-			if (max_light > 0)
+				Vec4_Add(&total_light, sky_ambient);
+			}
+			else
 			{
-				float angle = calc_hit_radiosity_angle(position, normal, &trace);
-				
-				if (angle > 0)
+				float max_light = max(trace->light_sample.r, max(trace->light_sample.g, trace->light_sample.b));
+				if (max_light > 0)
 				{
-					float p = RADIOSITY_PROBABILITY;
-					float brdf = RADIOSITY_BRDF;
+					float angle = calc_hit_radiosity_angle(position, normal, trace);
+				
+					if (angle > 0)
+					{
+						float p = RADIOSITY_PROBABILITY;
+						float brdf = RADIOSITY_BRDF;
 
-					float norm_light_r = trace.light_sample.r / 255.0;
-					float norm_light_g = trace.light_sample.g / 255.0;
-					float norm_light_b = trace.light_sample.b / 255.0;
+						float norm_light_r = trace->light_sample.r / 255.0;
+						float norm_light_g = trace->light_sample.g / 255.0;
+						float norm_light_b = trace->light_sample.b / 255.0;
 
-					Vec4 trace_light = Vec4_Zero();
-					trace_light.r = (brdf * (trace.color_sample.r * norm_light_r) * angle / p) * RADIOSITY_SCALE;
-					trace_light.g = (brdf * (trace.color_sample.g * norm_light_g) * angle / p) * RADIOSITY_SCALE;
-					trace_light.b = (brdf * (trace.color_sample.b * norm_light_b) * angle / p) * RADIOSITY_SCALE;
-					trace_light.a = 1;
+						Vec4 trace_light = Vec4_Zero();
+						trace_light.r = (brdf * (trace->color_sample.r * norm_light_r) * angle / p) * RADIOSITY_SCALE;
+						trace_light.g = (brdf * (trace->color_sample.g * norm_light_g) * angle / p) * RADIOSITY_SCALE;
+						trace_light.b = (brdf * (trace->color_sample.b * norm_light_b) * angle / p) * RADIOSITY_SCALE;
+						trace_light.a = 1;
 
-					Vec4_Add(&total_light, trace_light);
-				}
+						Vec4_Add(&total_light, trace_light);
+					}
 				
+				}
 			}
 		}
-
-		
 	}
 
 	Vec4_DivScalar(&total_light, global->num_random_vectors);
@@ -2497,8 +2581,27 @@ static void Lightmap_SampleFloorAndCeilAtPoint(LightGlobal* global, LightTraceTh
 	}
 }
 
+static void Lightmap_Allocate(LightGlobal* global, Lightmap* lm, int x_tiles, int y_tiles)
+{
+	if (x_tiles <= 0 || y_tiles <= 0)
+	{
+		return;
+	}
+
+	Mutex_Lock(&global->alloc_mutex);
+
+	if (!lm->data)
+	{
+		lm->data = calloc(x_tiles * y_tiles, sizeof(Vec4));
+		lm->width = x_tiles;
+		lm->height = y_tiles;
+	}
+
+	Mutex_Unlock(&global->alloc_mutex);
+}
+
 static void Lightmap_FloorAndCeillingPass(LightGlobal* global, LightTraceThread* thread, Sector* sector, LightDef* light,
-	int x_tiles, int y_tiles, float x_step, float y_step, int bounce)
+	int x_tiles, int y_tiles, float x_step, float y_step, int x_start, int x_end, int bounce)
 {
 	Lightmap* floor_lightmap = &sector->floor_lightmap;
 	Lightmap* ceil_lightmap = &sector->ceil_lightmap;
@@ -2538,7 +2641,20 @@ static void Lightmap_FloorAndCeillingPass(LightGlobal* global, LightTraceThread*
 	floor_self_light = false;
 	ceil_self_light = false;
 
-	for (int x = 0; x < x_tiles; x++)
+	//same lightmaps that Lightmap_Set would create, done here so that two rows can't both create them
+	if (bounce >= 0)
+	{
+		Lightmap_Allocate(global, floor_lightmap, x_tiles, y_tiles);
+
+		if (bounce == 0 || !sector->is_sky)
+		{
+			Lightmap_Allocate(global, ceil_lightmap, x_tiles, y_tiles);
+		}
+	}
+
+	position[0] += x_start * x_step;
+
+	for (int x = x_start; x < x_end; x++)
 	{
 		position[1] = sector->bbox[1][1];
 
@@ -2862,79 +2978,118 @@ static void Lightmap_LinePass(LightGlobal* global, LightTraceThread* thread, Lin
 }
 
 
-static void Lightmap_LightPass(LightGlobal* global, LightTraceThread* thread, Sector* sector, int bounce, float sector_dx, float sector_dy,
-	int sector_x_tiles, int sector_y_tiles, float sector_x_step, float sector_y_step, LightDef* light)
+static void Lightmap_GetSectorTiles(Sector* sector, int* r_x_tiles, int* r_y_tiles, float* r_x_step, float* r_y_step)
+{
+	float sector_dx = (sector->bbox[1][0] - sector->bbox[0][0]) * 2.0;
+	float sector_dy = (sector->bbox[1][1] - sector->bbox[0][1]) * 2.0;
+
+	int sector_x_tiles = ceil(sector_dx / LIGHTMAP_LUXEL_SIZE);
+	int sector_y_tiles = ceil(sector_dy / LIGHTMAP_LUXEL_SIZE);
+
+	*r_x_tiles = sector_x_tiles;
+	*r_y_tiles = sector_y_tiles;
+	*r_x_step = sector_dx / (sector_x_tiles);
+	*r_y_step = sector_dy / (sector_y_tiles);
+}
+
+static bool Lightmap_SkipSector(Sector* sector)
+{
+	//dont map some sectors, mostly that change light
+	return sector->special == SECTOR_SPECIAL__LIGHT_FLICKER || sector->special == SECTOR_SPECIAL__LIGHT_GLOW;
+}
+
+static bool Lightmap_IsLightInSector(LightDef* light, Sector* sector)
 {
-	//only lightmap floor and ceil if it's open
-	if (sector->base_ceil - sector->base_floor > 0)
+	if (light->type == LDT__POINT || light->type == LDT__AREA)
 	{
-		Lightmap_FloorAndCeillingPass(global, thread, sector, light, sector_x_tiles, sector_y_tiles, sector_x_step, sector_y_step, bounce);
+		return Math_BoxIntersectsBox(light->bbox, sector->bbox);
 	}
 
-	//for each linedef
-	LinedefList* list = &global->linedef_list[sector->index];
-	for (int k = 0; k < list->num_lines; k++)
+	return true;
+}
+
+static bool Lightmap_IsLineVisible(Sector* sector, Linedef* line)
+{
+	if (line->front_sector != sector->index)
 	{
-		Linedef* line = list->lines[k];
+		return false;
+	}
 
-		if (line->front_sector != sector->index)
-		{
-			continue;
-		}
+	//check for invisible lines
+	if (line->back_sector >= 0 && line->sides[1] >= 0)
+	{
+		Sector* backsector = Map_GetSector(line->back_sector);
 
-		//check for invisible lines
-		if (line->back_sector >= 0 && line->sides[1] >= 0)
+		if (sector->ceil == backsector->ceil && sector->floor == backsector->floor)
 		{
-			Sector* backsector = Map_GetSector(line->back_sector);
-
-			if (sector->ceil == backsector->ceil && sector->floor == backsector->floor)
+			if (line->sides[0] >= 0)
 			{
-				if (line->sides[0] >= 0)
-				{
-					Sidedef* sidedef = Map_GetSideDef(line->sides[0]);
+				Sidedef* sidedef = Map_GetSideDef(line->sides[0]);
 
-					if (sidedef)
-					{
-						if (!sidedef->middle_texture)
-						{
-							continue;
-						}
-					}
-					else
+				if (sidedef)
+				{
+					if (!sidedef->middle_texture)
 					{
-						continue;
+						return false;
 					}
 				}
 				else
 				{
-					continue;
+					return false;
 				}
 			}
-		}
-		else if(line->sides[0] >= 0)
-		{
-			Sidedef* sidedef = Map_GetSideDef(line->sides[0]);
-
-			if (sidedef && !sidedef->middle_texture)
+			else
 			{
-				continue;
+				return false;
 			}
 		}
+	}
+	else if(line->sides[0] >= 0)
+	{
+		Sidedef* sidedef = Map_GetSideDef(line->sides[0]);
 
-		Lightmap_LinePass(global, thread, line, light, bounce);
+		if (sidedef && !sidedef->middle_texture)
+		{
+			return false;
+		}
 	}
-}
 
-void Lightmap_Sector(LightGlobal* global, LightTraceThread* thread, Sector* sector, int bounce)
+	return true;
+}
+
+static void Lightmap_SectorRow(LightGlobal* global, LightTraceThread* thread, Sector* sector, int x, int bounce)
 {
-	float sector_dx = (sector->bbox[1][0] - sector->bbox[0][0]) * 2.0;
-	float sector_dy = (sector->bbox[1][1] - sector->bbox[0][1]) * 2.0;
+	int sector_x_tiles, sector_y_tiles;
+	float sector_x_step, sector_y_step;
 
-	int sector_x_tiles = ceil(sector_dx / LIGHTMAP_LUXEL_SIZE);
-	int sector_y_tiles = ceil(sector_dy / LIGHTMAP_LUXEL_SIZE);
+	Lightmap_GetSectorTiles(sector, &sector_x_tiles, &sector_y_tiles, &sector_x_step, &sector_y_step);
 
-	float sector_x_step = sector_dx / (sector_x_tiles);
-	float sector_y_step = sector_dy / (sector_y_tiles);
+	//direct light pass
+	if (bounce == 0)
+	{
+		//for each light
+		for (int i = 0; i < dA_size(global->light_list); i++)
+		{
+			LightDef* light = dA_at(global->light_list, i);
+
+			if (!Lightmap_IsLightInSector(light, sector))
+			{
+				continue;
+			}
+
+			Lightmap_FloorAndCeillingPass(global, thread, sector, light, sector_x_tiles, sector_y_tiles, sector_x_step, sector_y_step, x, x + 1, bounce);
+		}
+	}
+	//gi or ao pass
+	else
+	{
+		Lightmap_FloorAndCeillingPass(global, thread, sector, NULL, sector_x_tiles, sector_y_tiles, sector_x_step, sector_y_step, x, x + 1, bounce);
+	}
+}
+
+static void Lightmap_Line(LightGlobal* global, LightTraceThread* thread, Linedef* line, int bounce)
+{
+	Sector* sector = Map_GetSector(line->front_sector);
 
 	//direct light pass
 	if (bounce == 0)
@@ -2944,26 +3099,249 @@ void Lightmap_Sector(LightGlobal* global, LightTraceThread* thread, Sector* sect
 		{
 			LightDef* light = dA_at(global->light_list, i);
 
-			if (light->type == LDT__POINT || light->type == LDT__AREA)
+			if (!Lightmap_IsLightInSector(light, sector))
 			{
-				if (!Math_BoxIntersectsBox(light->bbox, sector->bbox))
-				{
-					continue;
-				}
+				continue;
 			}
-			
-			Lightmap_LightPass(global, thread, sector, bounce, sector_dx, sector_dy, sector_x_tiles, sector_y_tiles, sector_x_step, sector_y_step, light);
+
+			Lightmap_LinePass(global, thread, line, light, bounce);
 		}
 	}
 	//gi or ao pass
 	else
 	{
-		Lightmap_LightPass(global, thread, sector, bounce, sector_dx, sector_dy, sector_x_tiles, sector_y_tiles, sector_x_step, sector_y_step, NULL);
+		Lightmap_LinePass(global, thread, line, NULL, bounce);
+	}
+}
+
+static void Lightmap_GetBlockPosition(Lightgrid* lightgrid, int index, float position[3])
+{
+	int z = (index / ((int)lightgrid->bounds[0] * (int)lightgrid->bounds[1]));
+	int y = (index / (int)lightgrid->bounds[0]) % (int)lightgrid->bounds[1];
+	int x = index % (int)lightgrid->bounds[0];
+
+	position[0] = lightgrid->origin[0] + (x * lightgrid->size[0]);
+	position[1] = lightgrid->origin[1] + (y * lightgrid->size[1]);
+	position[2] = lightgrid->origin[2] + (z * lightgrid->size[2]);
+}
+
+static bool Lightmap_IsBlockRebaked(LightGlobal* global, float position[3])
+{
+	if (!global->rebake_sectors)
+	{
+		return true;
+	}
+
+	Sector* sector = Map_FindSector(position[0], position[1]);
+
+	return sector && global->rebake_sectors[sector->index];
+}
+
+static void Lightmap_LightgridSlab(LightGlobal* global, LightTraceThread* thread, int start, int end, int bounce)
+{
+	Lightgrid* lightgrid = &Map_GetMap()->lightgrid;
+
+	double grid_start_time = Time_GetSeconds();
+
+	for (int i = start; i < end; i++)
+	{
+		Lightblock* block = &lightgrid->blocks[i];
+
+		float position[3];
+		Lightmap_GetBlockPosition(lightgrid, i, position);
+
+		//blocks outside the rebaked sectors keep their loaded light
+		if (!Lightmap_IsBlockRebaked(global, position))
+		{
+			continue;
+		}
+
+		if (!Lightblock_Process(global, thread, block, position, bounce))
+		{
+			//mark as out of bounds, so that the sample will be ignored
+			//block->light.r = 0xffff;
+			//block->light.g = 0xffff;
+			//block->light.b = 0xffff;
+		}
 	}
+
+	thread->grid_time += Time_GetSeconds() - grid_start_time;
+}
+
+static void LightGlobal_AddTask(LightGlobal* global, LightTaskType type, int index, int start, int end, float cost)
+{
+	if (global->num_tasks >= global->max_tasks)
+	{
+		int new_max = max(global->max_tasks * 2, MIN_LIGHT_TASKS);
+		LightTask* new_tasks = realloc(global->tasks, sizeof(LightTask) * new_max);
+
+		if (!new_tasks)
+		{
+			return;
+		}
+
+		global->tasks = new_tasks;
+		global->max_tasks = new_max;
+	}
+
+	LightTask* task = &global->tasks[global->num_tasks++];
+
+	task->type = type;
+	task->index = index;
+	task->start = start;
+	task->end = end;
+	task->cost = cost;
+}
+
+static int LightGlobal_CompareTaskCost(const void* a, const void* b)
+{
+	const LightTask* t0 = a;
+	const LightTask* t1 = b;
+
+	if (t0->cost > t1->cost) return -1;
+	if (t0->cost < t1->cost) return 1;
+
+	return 0;
+}
+
+static void LightGlobal_BuildTasks(LightGlobal* global, Map* map, int bounce)
+{
+	global->num_tasks = 0;
+	global->next_task = 0;
+
+	for (int s = 0; s < map->num_sectors; s++)
+	{
+		Sector* sector = Map_GetSector(s);
+
+		if (Lightmap_SkipSector(sector) || !Lightmap_IsSectorRebaked(global, s))
+		{
+			continue;
+		}
+
+		//direct light costs a pass per light that reaches the sector, the other passes trace once per texel
+		int num_passes = 1;
+
+		if (bounce == 0)
+		{
+			num_passes = 0;
+
+			for (int i = 0; i < dA_size(global->light_list); i++)
+			{
+				if (Lightmap_IsLightInSector(dA_at(global->light_list, i), sector))
+				{
+					num_passes++;
+				}
+			}
+
+			if (num_passes == 0)
+			{
+				continue;
+			}
+		}
+
+		//only lightmap floor and ceil if it's open
+		if (sector->base_ceil - sector->base_floor > 0)
+		{
+			int sector_x_tiles, sector_y_tiles;
+			float sector_x_step, sector_y_step;
+
+			Lightmap_GetSectorTiles(sector, &sector_x_tiles, &sector_y_tiles, &sector_x_step, &sector_y_step);
+
+			for (int x = 0; x < sector_x_tiles; x++)
+			{
+				LightGlobal_AddTask(global, LTT__FLOOR_ROW, s, x, x + 1, (float)sector_y_tiles * 2 * num_passes);
+			}
+		}
+
+		//for each linedef
+		LinedefList* list = &global->linedef_list[sector->index];
+		for (int k = 0; k < list->num_lines; k++)
+		{
+			Linedef* line = list->lines[k];
+
+			if (!Lightmap_IsLineVisible(sector, line))
+			{
+				continue;
+			}
+
+			float dx = line->x0 - line->x1;
+			float dy = line->y0 - line->y1;
+
+			int x_tiles = ceil((sqrtf(dx * dx + dy * dy) * 2.0) / LIGHTMAP_LUXEL_SIZE);
+			int y_tiles = ceil(((sector->base_ceil - sector->base_floor) / 2.0) / LIGHTMAP_LUXEL_SIZE);
+
+			LightGlobal_AddTask(global, LTT__LINE, line->index, 0, 0, (float)max(x_tiles, 1) * max(y_tiles, 1) * num_passes);
+		}
+	}
+
+	//lightgrid in slabs of one z layer
+	if (bounce != BOUNCE_AO)
+	{
+		Lightgrid* lightgrid = &map->lightgrid;
+
+		int total_grid_points = lightgrid->block_size[0] * lightgrid->block_size[1] * lightgrid->block_size[2];
+		int slab_size = max((int)lightgrid->bounds[0] * (int)lightgrid->bounds[1], 1);
+
+		for (int i = 0; i < total_grid_points; i += slab_size)
+		{
+			int end = min(i + slab_size, total_grid_points);
+
+			LightGlobal_AddTask(global, LTT__GRID_SLAB, 0, i, end, (float)(end - i));
+		}
+	}
+
+	//largest first, so that nothing big is left over for the end of the pass
+	qsort(global->tasks, global->num_tasks, sizeof(LightTask), LightGlobal_CompareTaskCost);
+}
+
+static void LightGlobal_RunTasks(LightGlobal* global, LightTraceThread* thread, int bounce)
+{
+	double start_time = Time_GetSeconds();
+
+	while (true)
+	{
+		int task_index = Atomic_Increment(&global->next_task) - 1;
+
+		if (task_index >= global->num_tasks)
+		{
+			break;
+		}
+
+		LightTask* task = &global->tasks[task_index];
+
+		switch (task->type)
+		{
+		case LTT__FLOOR_ROW:
+		{
+			Lightmap_SectorRow(global, thread, Map_GetSector(task->index), task->start, bounce);
+			break;
+		}
+		case LTT__LINE:
+		{
+			Lightmap_Line(global, thread, Map_GetLineDef(task->index), bounce);
+			break;
+		}
+		case LTT__GRID_SLAB:
+		{
+			Lightmap_LightgridSlab(global, thread, task->start, task->end, bounce);
+			break;
+		}
+		default:
+			break;
+		}
+
+		thread->tasks_done++;
+	}
+
+	thread->busy_time += Time_GetSeconds() - start_time;
 }
 
 static void Lightmap_DispatchLightmapWork(LightGlobal* global, Map* map, int bounce)
 {
+	LightGlobal_BuildTasks(global, map, bounce);
+
+	double start_time = Time_GetSeconds();
+
 	if (global->num_threads > 0)
 	{
 		//make threads do the work
@@ -2975,47 +3353,417 @@ static void Lightmap_DispatchLightmapWork(LightGlobal* global, Map* map, int bou
 	//do it our selves
 	else
 	{
-		for (int s = 0; s < map->num_sectors; s++)
+		LightGlobal_RunTasks(global, global->thread, bounce);
+	}
+
+	global->dispatch_time += Time_GetSeconds() - start_time;
+}
+
+static double LightGlobal_GetGridTime(LightGlobal* global)
+{
+	if (global->num_threads <= 0)
+	{
+		return global->thread->grid_time;
+	}
+
+	double grid_time = 0;
+
+	for (int i = 0; i < global->num_threads; i++)
+	{
+		grid_time += global->threads[i].grid_time;
+	}
+
+	return grid_time;
+}
+
+static void LightGlobal_PrintThreadUtilization(LightGlobal* global)
+{
+	if (global->dispatch_time <= 0)
+	{
+		return;
+	}
+
+	int num_threads = (global->num_threads > 0) ? global->num_threads : 1;
+	LightTraceThread* threads = (global->num_threads > 0) ? global->threads : global->thread;
+
+	printf("Thread     busy seconds  utilization  tasks\n");
+
+	for (int i = 0; i < num_threads; i++)
+	{
+		LightTraceThread* thread = &threads[i];
+
+		printf("%2i:      %9.3f %11.1f%% %6i\n", i, thread->busy_time, 100.0 * thread->busy_time / global->dispatch_time, thread->tasks_done);
+	}
+}
+
+//rebaked sectors start from nothing, the lightmaps that are kept only light them thru the back lightmaps
+static void Lightmap_PrepareRebake(LightGlobal* global, Map* map)
+{
+	for (int i = 0; i < map->num_sectors; i++)
+	{
+		Sector* sector = Map_GetSector(i);
+
+		if (Lightmap_IsSectorRebaked(global, i))
+		{
+			Lightmap_FreeLightmap(&sector->floor_lightmap);
+			Lightmap_FreeLightmap(&sector->ceil_lightmap);
+		}
+		else
+		{
+			Lightmap_SeedBackLightmap(&global->floor_back_lightmaps[i], &sector->floor_lightmap);
+			Lightmap_SeedBackLightmap(&global->ceil_back_lightmaps[i], &sector->ceil_lightmap);
+		}
+	}
+	for (int i = 0; i < map->num_linedefs; i++)
+	{
+		Linedef* linedef = Map_GetLineDef(i);
+
+		if (Lightmap_IsSectorRebaked(global, linedef->front_sector))
+		{
+			Lightmap_FreeLightmap(&linedef->lightmap);
+		}
+		else
+		{
+			Lightmap_SeedBackLightmap(&global->line_back_lightmaps[i], &linedef->lightmap);
+		}
+	}
+
+	//a full bake gets a new lightgrid
+	if (!global->rebake_sectors)
+	{
+		return;
+	}
+
+	Lightgrid* lightgrid = &map->lightgrid;
+
+	int total_grid_points = lightgrid->block_size[0] * lightgrid->block_size[1] * lightgrid->block_size[2];
+
+	for (int i = 0; i < total_grid_points; i++)
+	{
+		float position[3];
+		Lightmap_GetBlockPosition(lightgrid, i, position);
+
+		if (Lightmap_IsBlockRebaked(global, position))
+		{
+			memset(&lightgrid->blocks[i], 0, sizeof(Lightblock));
+		}
+	}
+}
+
+static unsigned Light_HashData(unsigned hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = data;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * LIGHT_HASH_PRIME;
+	}
+
+	return hash;
+}
+
+static unsigned Light_HashInt(unsigned hash, int value)
+{
+	return Light_HashData(hash, &value, sizeof(value));
+}
+
+static unsigned Light_HashFloat(unsigned hash, float value)
+{
+	return Light_HashData(hash, &value, sizeof(value));
+}
+
+static unsigned Light_HashTexture(unsigned hash, Texture* texture)
+{
+	if (!texture)
+	{
+		return Light_HashInt(hash, -1);
+	}
+
+	//names are not always terminated
+	size_t len = 0;
+
+	while (len < sizeof(texture->name) && texture->name[len])
+	{
+		len++;
+	}
+
+	return Light_HashData(hash, texture->name, len);
+}
+
+static unsigned Light_HashSectorHeights(unsigned hash, Sector* sector)
+{
+	hash = Light_HashFloat(hash, sector->floor);
+	hash = Light_HashFloat(hash, sector->ceil);
+	hash = Light_HashFloat(hash, sector->base_floor);
+	hash = Light_HashFloat(hash, sector->base_ceil);
+
+	return hash;
+}
+
+//every light that the bake would use for this sector's floor, ceiling and lines
+static unsigned Light_HashSectorLights(unsigned hash, dynamic_array* light_list, Sector* sector)
+{
+	for (int i = 0; i < dA_size(light_list); i++)
+	{
+		LightDef* light = dA_at(light_list, i);
+
+		if (!Lightmap_IsLightInSector(light, sector))
 		{
-			Sector* sector = Map_GetSector(s);
+			continue;
+		}
+
+		hash = Light_HashInt(hash, light->type);
+		hash = Light_HashFloat(hash, light->deviance);
+		hash = Light_HashFloat(hash, light->radius);
+		hash = Light_HashFloat(hash, light->attenuation);
+		hash = Light_HashData(hash, light->direction, sizeof(light->direction));
+		hash = Light_HashData(hash, light->position, sizeof(light->position));
+		hash = Light_HashData(hash, light->color, sizeof(light->color));
+		hash = Light_HashInt(hash, light->area_surf_type);
+		hash = Light_HashInt(hash, light->area_surf_index);
+	}
+
+	return hash;
+}
+
+static unsigned Light_HashSector(dynamic_array* light_list, Sector* sector)
+{
+	unsigned hash = LIGHT_HASH_SEED;
+
+	hash = Light_HashSectorHeights(hash, sector);
+	hash = Light_HashData(hash, sector->bbox, sizeof(sector->bbox));
+	hash = Light_HashTexture(hash, sector->floor_texture);
+	hash = Light_HashTexture(hash, sector->ceil_texture);
+	hash = Light_HashInt(hash, sector->light_level);
+	hash = Light_HashInt(hash, sector->special);
+	hash = Light_HashInt(hash, sector->is_sky);
+
+	return Light_HashSectorLights(hash, light_list, sector);
+}
+
+static unsigned Light_HashLinedef(dynamic_array* light_list, Linedef* line)
+{
+	unsigned hash = LIGHT_HASH_SEED;
+
+	hash = Light_HashFloat(hash, line->x0);
+	hash = Light_HashFloat(hash, line->y0);
+	hash = Light_HashFloat(hash, line->x1);
+	hash = Light_HashFloat(hash, line->y1);
+	hash = Light_HashInt(hash, line->front_sector);
+	hash = Light_HashInt(hash, line->back_sector);
+	hash = Light_HashInt(hash, line->special);
+	hash = Light_HashInt(hash, line->sector_tag);
+	hash = Light_HashInt(hash, line->flags);
+
+	for (int i = 0; i < 2; i++)
+	{
+		Sidedef* sidedef = (line->sides[i] >= 0) ? Map_GetSideDef(line->sides[i]) : NULL;
+
+		if (!sidedef)
+		{
+			hash = Light_HashInt(hash, -1);
+			continue;
+		}
+
+		hash = Light_HashTexture(hash, sidedef->top_texture);
+		hash = Light_HashTexture(hash, sidedef->middle_texture);
+		hash = Light_HashTexture(hash, sidedef->bottom_texture);
+		hash = Light_HashInt(hash, sidedef->x_offset);
+		hash = Light_HashInt(hash, sidedef->y_offset);
+	}
+
+	//the wall parts come from the heights on both sides
+	Sector* frontsector = Map_GetSector(line->front_sector);
+	Sector* backsector = (line->back_sector >= 0) ? Map_GetSector(line->back_sector) : NULL;
+
+	if (backsector)
+	{
+		hash = Light_HashSectorHeights(hash, backsector);
+	}
+	if (frontsector)
+	{
+		hash = Light_HashSectorHeights(hash, frontsector);
+		hash = Light_HashSectorLights(hash, light_list, frontsector);
+	}
+
+	return hash;
+}
+
+void Lightmap_CalcHashes(LightCompilerInfo* compiler_info, Map* map, LightHashes* r_hashes)
+{
+	memset(r_hashes, 0, sizeof(LightHashes));
+
+	//only the light list is needed, so no threads are started
+	LightGlobal global;
+	memset(&global, 0, sizeof(LightGlobal));
+
+	LightGlobal_SetupLights(&global, compiler_info, map);
+
+	//settings that change every lightmap
+	unsigned settings = LIGHT_HASH_SEED;
 
-			//dont map some sectors, mostly that change light
-			if (sector->special == SECTOR_SPECIAL__LIGHT_FLICKER || sector->special == SECTOR_SPECIAL__LIGHT_GLOW)
+	settings = Light_HashInt(settings, NUM_BOUNCES);
+	settings = Light_HashFloat(settings, LIGHTMAP_LUXEL_SIZE);
+	settings = Light_HashInt(settings, AA_SAMPLES);
+	settings = Light_HashInt(settings, RADIOSITY_SAMPLES);
+	settings = Light_HashInt(settings, AO_NUM_VECTORS);
+	settings = Light_HashInt(settings, AO_DEPTH);
+	settings = Light_HashData(settings, map->sky_color, sizeof(map->sky_color));
+	settings = Light_HashFloat(settings, (compiler_info) ? compiler_info->sky_scale : SKY_SCALE);
+
+#ifdef DISABLE_AO
+	settings = Light_HashInt(settings, 1);
+#endif
+#ifdef AO_ONLY
+	settings = Light_HashInt(settings, 2);
+#endif
+
+	r_hashes->settings = settings;
+
+	r_hashes->sectors = calloc(max(map->num_sectors, 1), sizeof(unsigned));
+	r_hashes->linedefs = calloc(max(map->num_linedefs, 1), sizeof(unsigned));
+
+	if (r_hashes->sectors && r_hashes->linedefs)
+	{
+		r_hashes->num_sectors = map->num_sectors;
+		r_hashes->num_linedefs = map->num_linedefs;
+
+		for (int i = 0; i < map->num_sectors; i++)
+		{
+			r_hashes->sectors[i] = Light_HashSector(global.light_list, Map_GetSector(i));
+		}
+		for (int i = 0; i < map->num_linedefs; i++)
+		{
+			r_hashes->linedefs[i] = Light_HashLinedef(global.light_list, Map_GetLineDef(i));
+		}
+	}
+
+	if (global.light_list)
+	{
+		dA_Destruct(global.light_list);
+	}
+}
+
+bool* Lightmap_FindRebakeSectors(Map* map, LightHashes* old_hashes, LightHashes* new_hashes, int* r_num_sectors)
+{
+	*r_num_sectors = map->num_sectors;
+
+	//different settings or a different map, everything has to be baked again
+	if (!old_hashes->sectors || !old_hashes->linedefs || !new_hashes->sectors || !new_hashes->linedefs || old_hashes->settings != new_hashes->settings
+		|| old_hashes->num_sectors != map->num_sectors || old_hashes->num_linedefs != map->num_linedefs 
+		|| new_hashes->num_sectors != map->num_sectors || new_hashes->num_linedefs != map->num_linedefs)
+	{
+		return NULL;
+	}
+
+	bool* changed = calloc(max(map->num_sectors, 1), sizeof(bool));
+	bool* rebake = calloc(max(map->num_sectors, 1), sizeof(bool));
+
+	if (!changed || !rebake)
+	{
+		if (changed) free(changed);
+		if (rebake) free(rebake);
+		return NULL;
+	}
+
+	for (int i = 0; i < map->num_sectors; i++)
+	{
+		if (old_hashes->sectors[i] != new_hashes->sectors[i])
+		{
+			changed[i] = true;
+		}
+	}
+	for (int i = 0; i < map->num_linedefs; i++)
+	{
+		if (old_hashes->linedefs[i] == new_hashes->linedefs[i])
+		{
+			continue;
+		}
+
+		Linedef* line = Map_GetLineDef(i);
+
+		if (line->front_sector >= 0) changed[line->front_sector] = true;
+		if (line->back_sector >= 0) changed[line->back_sector] = true;
+	}
+
+	//the bounce light and shadows of a changed sector reach the sectors that can see it, up to the radiosity trace distance.
+	//light radii are smaller than that. every bounce carries the change one reach further, so expand once per bounce from the sectors the last pass added
+	bool* frontier = changed;
+	bool* next_frontier = calloc(max(map->num_sectors, 1), sizeof(bool));
+
+	if (!next_frontier)
+	{
+		free(changed);
+		free(rebake);
+		return NULL;
+	}
+
+	int num_rebake = 0;
+
+	for (int i = 0; i < map->num_sectors; i++)
+	{
+		if (frontier[i])
+		{
+			rebake[i] = true;
+			num_rebake++;
+		}
+	}
+
+	for (int bounce = 0; bounce < NUM_BOUNCES; bounce++)
+	{
+		int num_added = 0;
+
+		memset(next_frontier, 0, sizeof(bool) * map->num_sectors);
+
+		for (int i = 0; i < map->num_sectors; i++)
+		{
+			if (!frontier[i])
 			{
 				continue;
 			}
 
-			Lightmap_Sector(global, global->thread, sector, bounce);
-		}
+			Sector* sector = Map_GetSector(i);
 
-		Lightgrid* lightgrid = &map->lightgrid;
+			float reach_bbox[2][2];
+			reach_bbox[0][0] = sector->bbox[0][0] - RADIOSITY_TRACE_DIST;
+			reach_bbox[0][1] = sector->bbox[0][1] - RADIOSITY_TRACE_DIST;
+			reach_bbox[1][0] = sector->bbox[1][0] + RADIOSITY_TRACE_DIST;
+			reach_bbox[1][1] = sector->bbox[1][1] + RADIOSITY_TRACE_DIST;
 
-		//do it our selves
-		for (int x = 0; x < lightgrid->block_size[0]; x++)
-		{
-			for (int y = 0; y < lightgrid->block_size[1]; y++)
+			for (int k = 0; k < map->num_sectors; k++)
 			{
-				for (int z = 0; z < lightgrid->block_size[2]; z++)
+				if (rebake[k])
 				{
-					int flat_index = ((int)lightgrid->bounds[0] * (int)lightgrid->bounds[1] * z) + ((int)lightgrid->bounds[0] * y) + x;
-					Lightblock* block = &lightgrid->blocks[flat_index];
-					float position[3];
-
-					position[0] = lightgrid->origin[0] + (x * lightgrid->size[0]);
-					position[1] = lightgrid->origin[1] + (y * lightgrid->size[1]);
-					position[2] = lightgrid->origin[2] + (z * lightgrid->size[2]);
+					continue;
+				}
 
-					if (!Lightblock_Process(global, global->thread, block, position, 0))
-					{
-						//mark as out of bounds, so that the sample will be ignored
-						//block->light.r = 0xffff;
-						//block->light.g = 0xffff;
-						//block->light.b = 0xffff;
-					}
+				if (Map_CheckSectorReject(i, k) && Math_BoxIntersectsBox(reach_bbox, Map_GetSector(k)->bbox))
+				{
+					rebake[k] = true;
+					next_frontier[k] = true;
+					num_rebake++;
+					num_added++;
 				}
 			}
 		}
+
+		//nothing new can be reached anymore
+		if (num_added == 0)
+		{
+			break;
+		}
+
+		bool* temp = frontier;
+		frontier = next_frontier;
+		next_frontier = temp;
 	}
+
+	free(frontier);
+	free(next_frontier);
+
+	*r_num_sectors = num_rebake;
+
+	return rebake;
 }
 
 void Lightmap_Create(LightGlobal* global, Map* map)
@@ -3033,11 +3781,30 @@ void Lightmap_Create(LightGlobal* global, Map* map)
 	
 	printf("Creating Lightmaps with %i bounces, %i threads, %i luxel size \n", bounces, global->num_threads, (int)LIGHTMAP_LUXEL_SIZE);
 
-	double start = glfwGetTime();
+	if (global->rebake_sectors)
+	{
+		int num_rebaked = 0;
+
+		for (int i = 0; i < map->num_sectors; i++)
+		{
+			if (global->rebake_sectors[i]) num_rebaked++;
+		}
+
+		printf("Rebaking %i of %i sectors \n", num_rebaked, map->num_sectors);
+	}
+
+	Lightmap_PrepareRebake(global, map);
+
+	LightBakeTimings* timings = &global->timings;
+
+	double start = Time_GetSeconds();
 
 #ifndef AO_ONLY
 	for (int b = 0; b < bounces; b++)
 	{
+		double bounce_start = Time_GetSeconds();
+		double grid_start = LightGlobal_GetGridTime(global);
+
 		if (b > 0)
 		{
 			LightGlobal_GenerateRandomHemishphereVectors(global);
@@ -3047,19 +3814,45 @@ void Lightmap_Create(LightGlobal* global, Map* map)
 		
 		//then swap lightmaps to back buffer
 		Lightmap_SwapLightmaps(global, map);
+
+		timings->bounce_time[b] = Time_GetSeconds() - bounce_start;
+		timings->bounce_grid_time[b] = LightGlobal_GetGridTime(global) - grid_start;
+		timings->num_bounces++;
 	}
 #endif // !AO_ONLY
 	//AO
 #ifndef DISABLE_AO
+	double ao_start = Time_GetSeconds();
+
 	Lightmap_DispatchLightmapWork(global, map, BOUNCE_AO);
+
+	timings->ao_time = Time_GetSeconds() - ao_start;
 #endif // !DISABLE_AO
 
 	//swap all lightmaps from floating to bytes
-	Lightmap_CopyFinalLightmaps(map);
+	Lightmap_CopyFinalLightmaps(global, map);
 
-	double end = glfwGetTime();
+	double end = Time_GetSeconds();
+
+	timings->total_time = end - start;
 
 	printf("Finished creating lightmaps. Time: %f \n", end - start);
+
+	LightGlobal_PrintThreadUtilization(global);
+}
+
+void Lightmap_PrintTimings(LightBakeTimings* timings)
+{
+	//lightgrid time is summed over the threads, so it can be larger than the bounce it was part of
+	printf("Bounce     seconds  lightgrid thread seconds\n");
+
+	for (int b = 0; b < timings->num_bounces; b++)
+	{
+		printf("%2i:      %9.3f %9.3f\n", b, timings->bounce_time[b], timings->bounce_grid_time[b]);
+	}
+
+	printf("AO:       %9.3f\n", timings->ao_time);
+	printf("Total:    %9.3f\n", timings->total_time);
 }
 
 bool Lightblock_Process(LightGlobal* global, LightTraceThread* thread, Lightblock* block, float position[3], int bounce)
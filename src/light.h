@@ -2,12 +2,12 @@
 #define LIGHT_H
 #pragma once
 
-#include <Windows.h>
-
 #include "g_common.h"
+#include "utility.h"
 #include "dynamic_array.h"
 
 #define LIGHTTRACE_MAX_HITS 100000
+#define NUM_BOUNCES 12
 
 //LIGHTMAPPER STUFF
 typedef enum
@@ -65,24 +65,52 @@ typedef struct
 
 typedef struct
 {
-	HANDLE thread_handle;
+	Thread thread_handle;
 	int hits[LIGHTTRACE_MAX_HITS];
+	unsigned hit_masks[LIGHTTRACE_MAX_HITS];
 	struct LightGlobal* globals;
 
-	HANDLE active_event;
-	HANDLE finished_event;
-	HANDLE start_work_event;
+	Event active_event;
+	Event finished_event;
+	Event start_work_event;
 
-	int sector_start;
-	int sector_end;
+	int seed;
 
-	int grid_start;
-	int grid_end;
+	//seconds spent on lightgrid samples, summed over all bounces
+	double grid_time;
 
-	int seed;
+	//seconds spent running tasks and the number of tasks run, for the utilization log
+	double busy_time;
+	int tasks_done;
 } LightTraceThread;
 
+typedef enum
+{
+	LTT__FLOOR_ROW,
+	LTT__LINE,
+	LTT__GRID_SLAB,
+	LTT__MAX
+} LightTaskType;
+
 typedef struct
+{
+	LightTaskType type;
+	int index; //sector for floor rows, linedef for lines
+	int start; //tile row for floor rows, first block for grid slabs
+	int end;
+	float cost;
+} LightTask;
+
+typedef struct LightBakeTimings
+{
+	int num_bounces;
+	double bounce_time[NUM_BOUNCES];
+	double bounce_grid_time[NUM_BOUNCES];
+	double ao_time;
+	double total_time;
+} LightBakeTimings;
+
+typedef struct LightGlobal
 {
 	float sky_scale;
 
@@ -123,18 +151,36 @@ typedef struct
 	bool shutdown_threads;
 	bool work;
 
-	CRITICAL_SECTION start_mutex;
-	HANDLE start_work_event;
+	Mutex start_mutex;
+	Event start_work_event;
 
 	LightTraceThread* thread;
 
 	int bounce;
+
+	//work of the current pass, most expensive tasks first. threads pull them with next_task
+	LightTask* tasks;
+	int num_tasks;
+	int max_tasks;
+	volatile AtomicInt next_task;
+
+	//lightmaps are allocated on first write, rows of the same sector can be on different threads
+	Mutex alloc_mutex;
+
+	double dispatch_time;
+
+	//sectors whose floor, ceiling and lines are baked again, the rest keep their loaded lightmaps. NULL bakes everything
+	bool* rebake_sectors;
+
+	LightBakeTimings timings;
 } LightGlobal;
 
-void LightGlobal_Setup(struct LightGlobal* global, struct LightCompilerInfo* compiler_info);
-void LightGlobal_Destruct(struct LightGlobal* global);
-void Lightmap_Create(struct LightGlobal* global, Map* map);
-void Lightmap_Sector(LightGlobal* global, LightTraceThread* thread, Sector* sector, int bounce);
+void LightGlobal_Setup(LightGlobal* global, struct LightCompilerInfo* compiler_info, int num_threads);
+void LightGlobal_Destruct(LightGlobal* global);
+void Lightmap_Create(LightGlobal* global, Map* map);
 bool Lightblock_Process(LightGlobal* global, LightTraceThread* thread, Lightblock* block, float position[3], int bounce);
+void Lightmap_PrintTimings(LightBakeTimings* timings);
+void Lightmap_CalcHashes(struct LightCompilerInfo* compiler_info, Map* map, LightHashes* r_hashes);
+bool* Lightmap_FindRebakeSectors(Map* map, LightHashes* old_hashes, LightHashes* new_hashes, int* r_num_sectors);
 
 #endif // !LIGHT_H
\ No newline at end of file
@@ -2,11 +2,14 @@
 
 #include "utility.h"
 
-#define LIGHT_MAGIC 0xF0Ce0
+#define LIGHT_MAGIC 0xF0Ce1
+//files from before the hash lump, their lightmaps still load
+#define LIGHT_MAGIC_NO_HASHES 0xF0Ce0
 
 #define LIGHTMAP_LUMP 0
 #define LIGHTGRID_LUMP 1
-#define MAX_LUMPS 2
+#define LIGHTHASH_LUMP 2
+#define MAX_LUMPS 3
 
 typedef struct
 {
@@ -35,6 +38,14 @@ typedef struct
 	int offset;
 } LightgridLump;
 
+typedef struct
+{
+	int settings;
+	int num_sectors;
+	int num_linedefs;
+	int offset;
+} LightHashLump;
+
 typedef struct
 {
 	int magic;
@@ -245,6 +256,43 @@ static bool Load_ParseLightgrid(LightHeader* header, FILE* file, Map* map)
 	return true;
 }
 
+static bool Load_ParseLightHashes(LightHeader* header, FILE* file, Map* map)
+{
+	LightHashLump* hashlump = MallocLump(file, header, LIGHTHASH_LUMP, sizeof(LightHashLump), NULL);
+
+	if (!hashlump)
+	{
+		return false;
+	}
+
+	LightHashes* hashes = &map->light_hashes;
+
+	hashes->settings = Num_LittleLong(hashlump->settings);
+	int num_sectors = Num_LittleLong(hashlump->num_sectors);
+	int num_linedefs = Num_LittleLong(hashlump->num_linedefs);
+	int offset = Num_LittleLong(hashlump->offset);
+
+	free(hashlump);
+
+	if (num_sectors != map->num_sectors || num_linedefs != map->num_linedefs)
+	{
+		return false;
+	}
+
+	hashes->sectors = Read_Data(file, offset, sizeof(unsigned) * num_sectors);
+	hashes->linedefs = Read_Data(file, offset + sizeof(unsigned) * num_sectors, sizeof(unsigned) * num_linedefs);
+
+	if (!hashes->sectors || !hashes->linedefs)
+	{
+		return false;
+	}
+
+	hashes->num_sectors = num_sectors;
+	hashes->num_linedefs = num_linedefs;
+
+	return true;
+}
+
 bool Load_Lightmap(const char* filename, Map* map)
 {
 #ifdef DONT_FILE_LIGHTMAPS
@@ -274,13 +322,21 @@ bool Load_Lightmap(const char* filename, Map* map)
 		return false;
 	}
 
-	if (Num_LittleLong(header.magic) != LIGHT_MAGIC || Num_LittleLong(header.luxel_size) != LIGHTMAP_LUXEL_SIZE)
+	int magic = Num_LittleLong(header.magic);
+
+	if ((magic != LIGHT_MAGIC && magic != LIGHT_MAGIC_NO_HASHES) || Num_LittleLong(header.luxel_size) != LIGHTMAP_LUXEL_SIZE)
 	{
 		printf("Failed to load lightmaps \n");
 		fclose(file);
 		return false;
 	}
 
+	//the old header has no hash lump, what was read into it is lightmap data
+	if (magic == LIGHT_MAGIC_NO_HASHES)
+	{
+		memset(&header.lumps[LIGHTHASH_LUMP], 0, sizeof(LightLump));
+	}
+
 	if (!Load_ParseLightmaps(&header, file, map))
 	{
 		printf("Failed to load lightmaps \n");
@@ -293,6 +349,11 @@ bool Load_Lightmap(const char* filename, Map* map)
 		fclose(file);
 		return false;
 	}
+	//without the hashes the lightmaps still load, but the next rebake has to redo everything
+	if (magic == LIGHT_MAGIC_NO_HASHES || !Load_ParseLightHashes(&header, file, map))
+	{
+		printf("Failed to load light hashes \n");
+	}
 
 	printf("Loaded lightmaps successfully\n");
 
@@ -367,9 +428,12 @@ bool Save_Lightmap(const char* filename, Map* map)
 	}
 	LightgridLump lightgrid_lump;
 	memset(&lightgrid_lump, 0, sizeof(lightgrid_lump));
+	LightHashLump hash_lump;
+	memset(&hash_lump, 0, sizeof(hash_lump));
 	
 	Save_Lump(file, &header, LIGHTMAP_LUMP, lightmaps, sizeof(LightmapLump) * num_lightmaps);
 	Save_Lump(file, &header, LIGHTGRID_LUMP, &lightgrid_lump, sizeof(LightgridLump));
+	Save_Lump(file, &header, LIGHTHASH_LUMP, &hash_lump, sizeof(LightHashLump));
 
 	//save all lightmaps
 	int lightmap_index = 0;
@@ -425,6 +489,19 @@ bool Save_Lightmap(const char* filename, Map* map)
 	lightgrid_lump.z_blocks = Num_LittleLong(map->lightgrid.block_size[2]);
 
 	lightgrid_lump.offset = Save_Data(file, map->lightgrid.blocks, sizeof(Lightblock) * (lightgrid_lump.x_blocks * lightgrid_lump.y_blocks * lightgrid_lump.z_blocks));
+
+	//save light hashes, sectors first and then linedefs
+	LightHashes* hashes = &map->light_hashes;
+
+	if (hashes->sectors && hashes->linedefs)
+	{
+		hash_lump.settings = Num_LittleLong(hashes->settings);
+		hash_lump.num_sectors = Num_LittleLong(hashes->num_sectors);
+		hash_lump.num_linedefs = Num_LittleLong(hashes->num_linedefs);
+
+		hash_lump.offset = Save_Data(file, hashes->sectors, sizeof(unsigned) * hashes->num_sectors);
+		Save_Data(file, hashes->linedefs, sizeof(unsigned) * hashes->num_linedefs);
+	}
 	
 	//save some header info
 	header.magic = Num_LittleLong(LIGHT_MAGIC);
@@ -442,6 +519,7 @@ bool Save_Lightmap(const char* filename, Map* map)
 
 	Save_Lump(file, &header, LIGHTMAP_LUMP, lightmaps, sizeof(LightmapLump) * num_lightmaps);
 	Save_Lump(file, &header, LIGHTGRID_LUMP, &lightgrid_lump, sizeof(LightgridLump));
+	Save_Lump(file, &header, LIGHTHASH_LUMP, &hash_lump, sizeof(LightHashLump));
 
 	long save_size = ftell(file);
 	printf("Saved lightmaps, size: %.3f kb \n", (float)save_size / 1000.0);
@@ -16,6 +16,9 @@
 #define DOOM_VERTEX_SHIFT 1
 #define DOOM_Z_SHIFT 1
 
+//the headless baker turns this off, so that it can bake with its own settings
+static bool s_lightmapsOnLoad = true;
+
 typedef struct
 {
     short		width;		// bounding box size 
@@ -1358,6 +1361,99 @@ static int Load_FindLumpNum(const char* name, wadinfo_t* header, filelump_t* fil
     return -1;
 }
 
+void Load_SetLightmapsOnLoad(bool enable)
+{
+    s_lightmapsOnLoad = enable;
+}
+
+#ifndef DISABLE_LIGHTMAPS
+static void Load_CheckLightmapHashes(const char* filename, LightCompilerInfo* light_compiler_info, Map* map)
+{
+    LightHashes hashes;
+    Lightmap_CalcHashes(light_compiler_info, map, &hashes);
+
+    int num_rebake = 0;
+    bool* rebake_sectors = Lightmap_FindRebakeSectors(map, &map->light_hashes, &hashes, &num_rebake);
+
+    if (!rebake_sectors)
+    {
+        printf("Lightmaps of %s were baked with different settings or an older map, run Lightbake to update them \n", filename);
+    }
+    else if (num_rebake > 0)
+    {
+        printf("Lightmaps of %s are out of date in %i of %i sectors, run Lightbake to update them \n", filename, num_rebake, map->num_sectors);
+    }
+
+    if (rebake_sectors) free(rebake_sectors);
+    if (hashes.sectors) free(hashes.sectors);
+    if (hashes.linedefs) free(hashes.linedefs);
+}
+#endif // !DISABLE_LIGHTMAPS
+
+bool Load_BakeLightmap(const char* filename, LightCompilerInfo* light_compiler_info, int num_threads, bool incremental, LightBakeTimings* r_timings, Map* map)
+{
+#ifdef DISABLE_LIGHTMAPS
+    return false;
+#else
+    LightHashes hashes;
+    Lightmap_CalcHashes(light_compiler_info, map, &hashes);
+
+    //compare with the hashes of the loaded lightmaps, only the sectors a change can reach are baked again
+    bool* rebake_sectors = NULL;
+
+    if (incremental)
+    {
+        int num_rebake = 0;
+        rebake_sectors = Lightmap_FindRebakeSectors(map, &map->light_hashes, &hashes, &num_rebake);
+
+        if (rebake_sectors && num_rebake == 0)
+        {
+            printf("Lightmaps are up to date \n");
+
+            free(rebake_sectors);
+            if (hashes.sectors) free(hashes.sectors);
+            if (hashes.linedefs) free(hashes.linedefs);
+
+            return true;
+        }
+    }
+
+    //a full bake starts with a new lightgrid
+    if (!rebake_sectors)
+    {
+        if (map->lightgrid.blocks) free(map->lightgrid.blocks);
+
+        Map_SetupLightGrid(NULL);
+    }
+
+    //create new lightmaps
+    LightGlobal light_global;
+    LightGlobal_Setup(&light_global, light_compiler_info, num_threads);
+
+    light_global.rebake_sectors = rebake_sectors;
+
+    Lightmap_Create(&light_global, map);
+
+    if (map->light_hashes.sectors) free(map->light_hashes.sectors);
+    if (map->light_hashes.linedefs) free(map->light_hashes.linedefs);
+
+    map->light_hashes = hashes;
+
+    if (r_timings)
+    {
+        *r_timings = light_global.timings;
+    }
+  
+    LightGlobal_Destruct(&light_global);
+
+    bool result = Save_Lightmap(filename, map);
+
+    Map_UpdateObjectsLight();
+
+    return result;
+#endif // DISABLE_LIGHTMAPS
+}
+
 bool Load_Doommap(const char* filename, const char* skyname, LightCompilerInfo* light_compiler_info, Map* map)
 {
     bool result = true;
@@ -1435,22 +1531,17 @@ bool Load_Doommap(const char* filename, const char* skyname, LightCompilerInfo*
 
 #ifndef DISABLE_LIGHTMAPS
 
-    //check for lightmaps
-    if(!Load_Lightmap(filename, map))
+    //check for lightmaps, only a missing file is baked here. rebaking a changed map is left to Lightbake
+    if(s_lightmapsOnLoad)
     {
-        Map_SetupLightGrid(NULL);
-
-        //create new lightmaps
-        LightGlobal light_global;
-        LightGlobal_Setup(&light_global, light_compiler_info);
-
-        Lightmap_Create(&light_global, map);
-  
-        LightGlobal_Destruct(&light_global);
-
-        Save_Lightmap(filename, map);
-
-        Map_UpdateObjectsLight();
+        if (!Load_Lightmap(filename, map))
+        {
+            Load_BakeLightmap(filename, light_compiler_info, 0, false, NULL, map);
+        }
+        else
+        {
+            Load_CheckLightmapHashes(filename, light_compiler_info, map);
+        }
     }
 #endif // !DISABLE_LIGHTMAPS
    
@@ -1581,6 +1672,8 @@ static void Load_FlatTextures(FILE* file, wadinfo_t* header, filelump_t* file_in
         texture->width_mask = 63;
         texture->height_mask = 63;
 
+        Image_GenerateMipmaps(img);
+
         free(flat);
     }
     assets->num_flat_textures = tex_index;
@@ -1770,6 +1863,8 @@ static void Load_PatchyTextures(FILE* file, wadinfo_t* header, filelump_t* file_
         }
 
         ourtexture->height_mask = j - 1;
+
+        Image_GenerateMipmaps(&ourtexture->img);
     }
 
 
@@ -1807,7 +1902,8 @@ static void Load_PNGTextures(FILE* file, wadinfo_t* header, filelump_t* file_inf
         int tex_height = 0;
         int nr_channels = 0;
 
-        unsigned char* png_data = stbi_load_from_memory(data, lump->size, &tex_width, &tex_height, &nr_channels, 0);
+        //the renderer reads 4 channels, so expand rgb pngs
+        unsigned char* png_data = stbi_load_from_memory(data, lump->size, &tex_width, &tex_height, &nr_channels, 4);
 
         if (png_data && tex_width > 0 && tex_height > 0 && nr_channels > 0)
         {
@@ -1827,6 +1923,8 @@ static void Load_PNGTextures(FILE* file, wadinfo_t* header, filelump_t* file_inf
             strncpy(texture->name, lump->name, 8);
             texture->width_mask = tex_width - 1;
             texture->height_mask = tex_height - 1;
+
+            Image_GenerateMipmaps(img);
         }
         
         free(data);
@@ -18,6 +18,11 @@
 #include "sound.h"
 #include "u_math.h"
 
+#ifdef HEADLESS_LIGHTBAKE
+#include "light.h"
+#include "game_info.h"
+#endif // HEADLESS_LIGHTBAKE
+
 #define WINDOW_SCALE 3
 #define WINDOW_WIDTH 640
 #define WINDOW_HEIGHT 360
@@ -26,6 +31,10 @@
 #define MAX_STEPS 8
 #define TICKS_PER_SECOND 60.0
 
+#define TIMEDEMO_DEFAULT_FRAMES 1200
+#define WALL_BENCH_DEFAULT_COLUMNS 20000
+#define SPAN_BENCH_DEFAULT_SPANS 20000
+
 typedef struct
 {
 	double time_scale;
@@ -39,6 +48,7 @@ static EngineData s_engine;
 static const double MIN_DT = 1.0 / 1000000.0;
 static const double TIME_STEP = 1.0 / TICKS_PER_SECOND;
 
+#ifndef HEADLESS
 extern void Render_WindowCallback(GLFWwindow* window, int width, int height);
 
 static void LoadExeIcon(GLFWwindow* window)
@@ -68,9 +78,7 @@ static void MouseScrollCallback(GLFWwindow* window, double xoffset, double yoffs
 
 static bool Engine_SaveCfg(const char* filename)
 {
-	FILE* file = NULL;
-
-	fopen_s(&file, filename, "w");
+	FILE* file = fopen(filename, "w");
 	if (!file)
 	{
 		printf("Failed to save cfg \n");
@@ -80,15 +88,15 @@ static bool Engine_SaveCfg(const char* filename)
 	fprintf(file, "render_scale %i \n", Render_GetRenderScale());
 	fprintf(file, "mouse_sens %.1f \n", Player_GetSensitivity());
 	fprintf(file, "volume %.1f \n", Sound_GetMasterVolume());
+	fprintf(file, "frame_latency %i \n", Render_GetFrameLatency());
+	fprintf(file, "dynamic_res_ms %.1f \n", Render_GetDynamicResolution());
 
 	return fclose(file) == 0;
 }
 
 static bool Engine_LoadCfg(const char* filename)
 {
-	FILE* file = NULL;
-
-	fopen_s(&file, filename, "r");
+	FILE* file = fopen(filename, "r");
 	if (!file)
 	{
 		printf("Failed to load cfg \n");
@@ -117,6 +125,14 @@ static bool Engine_LoadCfg(const char* filename)
 		{
 			Sound_setMasterVolume(value);
 		}
+		else if (!strcmp(buf, "frame_latency"))
+		{
+			Render_SetFrameLatency((int)value);
+		}
+		else if (!strcmp(buf, "dynamic_res_ms"))
+		{
+			Render_SetDynamicResolution(value);
+		}
 	}
 
 	return fclose(file) == 0;
@@ -220,6 +236,7 @@ static void Engine_ExitSubsystems()
 	glfwDestroyWindow(s_engine.window);
 	glfwTerminate();
 }
+#endif // !HEADLESS
 
 uint64_t Engine_GetTicks()
 {
@@ -254,10 +271,182 @@ GLFWwindow* Engine_GetWindow()
 	return s_engine.window;
 }
 
-int main()
+#ifdef HEADLESS_TIMEDEMO
+//usage: timedemo [level index] [num frames] [render scale]
+//       timedemo -bench_walls [num columns]
+//       timedemo -bench_spans [num spans]
+static int Engine_RunTimedemo(int argc, char* argv[])
+{
+	//wall column kernel microbenchmark, needs no assets
+	if (argc > 1 && !strcmp(argv[1], "-bench_walls"))
+	{
+		Video_Setup();
+		Video_BenchmarkWallColumns((argc > 2) ? atoi(argv[2]) : WALL_BENCH_DEFAULT_COLUMNS);
+
+		return 0;
+	}
+	//plane span kernel microbenchmark, scalar against sse2 and avx2
+	if (argc > 1 && !strcmp(argv[1], "-bench_spans"))
+	{
+		Video_Setup();
+		Video_BenchmarkPlaneSpans((argc > 2) ? atoi(argv[2]) : SPAN_BENCH_DEFAULT_SPANS);
+
+		return 0;
+	}
+
+	int level_index = 0;
+	int num_frames = TIMEDEMO_DEFAULT_FRAMES;
+	int scale = WINDOW_SCALE;
+
+	if (argc > 1) level_index = atoi(argv[1]);
+	if (argc > 2) num_frames = atoi(argv[2]);
+	if (argc > 3) scale = atoi(argv[3]);
+
+	//fixed seed so that every run is the same
+	srand(0);
+
+	if (!Sound_InitNoDevice())
+	{
+		printf("ERROR::Failed to init sound!\n");
+		return -1;
+	}
+
+	if (!Render_InitHeadless(WINDOW_WIDTH, WINDOW_HEIGHT, scale))
+	{
+		printf("Failed to load renderer!\n");
+		return -1;
+	}
+
+	if (!Game_Init())
+	{
+		printf("ERROR::Failed to load game assets!\n");
+		return -1;
+	}
+
+	int result = Render_Timedemo(level_index, num_frames) ? 0 : -1;
+
+	Render_ShutDown();
+	Game_Exit();
+	Sound_Shutdown();
+
+	return result;
+}
+#endif // HEADLESS_TIMEDEMO
+
+#ifdef HEADLESS_LIGHTBAKE
+//usage: lightbake [wad path] [light info index] [num threads] [sky name] [-full]
+//       lightbake -level [level index] [num threads] [-full]
+static int Engine_RunLightBake(int argc, char* argv[])
+{
+	int num_levels = sizeof(LEVELS) / sizeof(LEVELS[0]);
+
+	const char* filename = NULL;
+	const char* skyname = NULL;
+	int info_index = 0;
+	int num_threads = 0;
+	bool full_bake = false;
+
+	if (argc > 1 && !strcmp(argv[argc - 1], "-full"))
+	{
+		full_bake = true;
+		argc--;
+	}
+
+	if (argc > 2 && !strcmp(argv[1], "-level"))
+	{
+		info_index = Math_Clampl(atoi(argv[2]), 0, num_levels - 1);
+		filename = LEVELS[info_index];
+		skyname = SKIES[info_index];
+
+		if (argc > 3) num_threads = atoi(argv[3]);
+	}
+	else if (argc > 2)
+	{
+		filename = argv[1];
+		info_index = atoi(argv[2]);
+
+		if (argc > 3) num_threads = atoi(argv[3]);
+
+		skyname = (argc > 4) ? argv[4] : SKIES[Math_Clampl(info_index, 0, num_levels - 1)];
+	}
+	else
+	{
+		printf("usage: lightbake [wad path] [light info index] [num threads] [sky name] [-full]\n");
+		printf("       lightbake -level [level index] [num threads] [-full]\n");
+		return -1;
+	}
+
+	//fixed seed so that every bake of the same map is the same
+	srand(0);
+
+	if (!Sound_InitNoDevice())
+	{
+		printf("ERROR::Failed to init sound!\n");
+		return -1;
+	}
+
+	//map objects take the renderer's object lock, there is still no window
+	if (!Render_InitHeadless(WINDOW_WIDTH, WINDOW_HEIGHT, 1))
+	{
+		printf("Failed to load renderer!\n");
+		return -1;
+	}
+
+	if (!Game_LoadAssets())
+	{
+		printf("ERROR::Failed to load game assets!\n");
+		return -1;
+	}
+
+	LightCompilerInfo* lci = Info_GetLightCompilerInfo(info_index);
+
+	printf("Light bake: %s, light info %i, sky %s\n", filename, info_index, skyname);
+
+	//the lightmap file is loaded here instead, so that -full can ignore it
+	Load_SetLightmapsOnLoad(false);
+
+	int result = -1;
+
+	if (Map_Load(filename, skyname, lci))
+	{
+		LightBakeTimings timings;
+		memset(&timings, 0, sizeof(timings));
+
+		//with an up to date lightmap file only the sectors that changed since are baked again
+		bool incremental = !full_bake && Load_Lightmap(filename, Map_GetMap());
+
+		if (Load_BakeLightmap(filename, lci, num_threads, incremental, &timings, Map_GetMap()))
+		{
+			Lightmap_PrintTimings(&timings);
+			result = 0;
+		}
+		else
+		{
+			printf("ERROR::Failed to save lightmap for %s!\n", filename);
+		}
+	}
+	else
+	{
+		printf("ERROR::Failed to load map %s!\n", filename);
+	}
+
+	Render_ShutDown();
+	Game_Exit();
+	Sound_Shutdown();
+
+	return result;
+}
+#endif // HEADLESS_LIGHTBAKE
+
+int main(int argc, char* argv[])
 {
 	memset(&s_engine, 0, sizeof(EngineData));
 
+#if defined(HEADLESS_TIMEDEMO)
+	return Engine_RunTimedemo(argc, argv);
+#elif defined(HEADLESS_LIGHTBAKE)
+	return Engine_RunLightBake(argc, argv);
+#else
 	srand(time(NULL));
 
 	if (!Engine_SetupSubSystems())
@@ -322,5 +511,6 @@ int main()
 	Engine_ExitSubsystems();
 
 	return 0;
+#endif
 }
 
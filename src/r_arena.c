@@ -0,0 +1,169 @@
+#include "r_common.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "g_common.h"
+
+//allocations are kept 16 byte aligned, enough for the sse loads of the span code
+#define ARENA_ALIGN(x) (((x) + 15) & ~(size_t)15)
+#define ARENA_HEADER_SIZE ARENA_ALIGN(sizeof(FrameArenaBlock))
+
+static unsigned char* Arena_BlockData(FrameArenaBlock* block)
+{
+	return (unsigned char*)block + ARENA_HEADER_SIZE;
+}
+
+static FrameArenaBlock* Arena_NewBlock(size_t min_size)
+{
+	size_t size = max(min_size, (size_t)FRAME_ARENA_BLOCK_SIZE);
+
+	FrameArenaBlock* block = malloc(ARENA_HEADER_SIZE + size);
+
+	if (!block)
+	{
+		printf("Frame arena: out of memory \n");
+		return NULL;
+	}
+
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+
+	return block;
+}
+
+void Arena_Reset(FrameArena* arena)
+{
+	//the blocks stay around, so after the first few frames nothing is allocated anymore
+	for (FrameArenaBlock* block = arena->first; block; block = block->next)
+	{
+		block->used = 0;
+	}
+
+	arena->current = arena->first;
+	arena->last_alloc = NULL;
+}
+
+void Arena_Destroy(FrameArena* arena)
+{
+	FrameArenaBlock* block = arena->first;
+
+	while (block)
+	{
+		FrameArenaBlock* next = block->next;
+		free(block);
+		block = next;
+	}
+
+	memset(arena, 0, sizeof(FrameArena));
+}
+
+void* Arena_Alloc(FrameArena* arena, size_t size)
+{
+	size = ARENA_ALIGN(max(size, (size_t)1));
+
+	FrameArenaBlock* block = arena->current;
+	FrameArenaBlock* prev = NULL;
+
+	//move on to the next block that still has room
+	while (block && block->used + size > block->size)
+	{
+		prev = block;
+		block = block->next;
+	}
+
+	if (!block)
+	{
+		block = Arena_NewBlock(size);
+
+		if (!block)
+		{
+			return NULL;
+		}
+
+		if (prev)
+		{
+			prev->next = block;
+		}
+		else
+		{
+			arena->first = block;
+		}
+	}
+
+	void* ptr = Arena_BlockData(block) + block->used;
+
+	block->used += size;
+
+	arena->current = block;
+	arena->last_alloc = ptr;
+
+	return ptr;
+}
+
+void* Arena_Calloc(FrameArena* arena, size_t size)
+{
+	void* ptr = Arena_Alloc(arena, size);
+
+	if (ptr)
+	{
+		memset(ptr, 0, size);
+	}
+
+	return ptr;
+}
+
+void* Arena_Grow(FrameArena* arena, void* ptr, size_t old_size, size_t new_size)
+{
+	if (!ptr)
+	{
+		return Arena_Alloc(arena, new_size);
+	}
+
+	FrameArenaBlock* block = arena->current;
+
+	//the newest allocation can grow in place
+	if (ptr == arena->last_alloc && block)
+	{
+		size_t offset = (unsigned char*)ptr - Arena_BlockData(block);
+
+		if (offset + ARENA_ALIGN(new_size) <= block->size)
+		{
+			block->used = offset + ARENA_ALIGN(new_size);
+			return ptr;
+		}
+	}
+
+	void* new_ptr = Arena_Alloc(arena, new_size);
+
+	if (new_ptr)
+	{
+		memcpy(new_ptr, ptr, min(old_size, new_size));
+	}
+
+	return new_ptr;
+}
+
+bool Arena_GrowArray(FrameArena* arena, void** array, int* max_count, int count, size_t elem_size)
+{
+	if (count <= *max_count)
+	{
+		return true;
+	}
+
+	int new_max = max(max(*max_count * 2, count), 32);
+
+	void* new_array = Arena_Grow(arena, *array, (size_t)*max_count * elem_size, (size_t)new_max * elem_size);
+
+	if (!new_array)
+	{
+		return false;
+	}
+
+	*array = new_array;
+	*max_count = new_max;
+
+	return true;
+}
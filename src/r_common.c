@@ -4,6 +4,8 @@
 #include <assert.h>
 #include <stb_image/stb_image.h>
 
+#include "g_common.h"
+
 bool Image_Create(Image* img, int p_width, int p_height, int p_numChannels)
 {	
 	memset(img, 0, sizeof(Image));
@@ -133,10 +135,26 @@ void Image_Destruct(Image* img)
 			{
 				free(f_info->alpha_spans);
 			}
+			if (f_info->post_offsets)
+			{
+				free(f_info->post_offsets);
+			}
+			if (f_info->posts)
+			{
+				free(f_info->posts);
+			}
 		}
 
 		free(img->frame_info);
 	}
+
+	for (int i = 0; i < img->num_mipmaps; i++)
+	{
+		Image_Destruct(img->mipmaps[i]);
+		free(img->mipmaps[i]);
+	}
+
+	img->num_mipmaps = 0;
 }
 
 void Image_Clear(Image* img, int c)
@@ -151,7 +169,7 @@ void Image_Set(Image* img, int x, int y, unsigned char r, unsigned char g, unsig
 		return;
 	}
 
-	unsigned char* d = img->data + (x + y * img->width) * img->numChannels;
+	unsigned char* d = img->data + Image_PixelIndex(img, x, y) * img->numChannels;
 
 	if (img->numChannels >= 1) d[0] = r;
 	if (img->numChannels >= 2) d[1] = g;
@@ -279,6 +297,77 @@ void Image_Blur(Image* img, int size, float scale)
 
 }
 
+static void Image_GenerateFramePosts(Image* img, FrameInfo* f_info, int frame_x, int frame_y, int frame_w, int frame_h)
+{
+	f_info->post_offsets = calloc(frame_w + 1, sizeof(int));
+
+	if (!f_info->post_offsets)
+	{
+		return;
+	}
+
+	//count first, so all posts of the frame go in one allocation
+	int num_posts = 0;
+
+	for (int x = 0; x < frame_w; x++)
+	{
+		bool in_post = false;
+
+		for (int y = 0; y < frame_h; y++)
+		{
+			unsigned char* color = Image_Get(img, frame_x + x, frame_y + y);
+			bool opaque = (color && color[3] > 128);
+
+			if (opaque && !in_post)
+			{
+				num_posts++;
+			}
+
+			in_post = opaque;
+		}
+	}
+
+	f_info->posts = malloc(sizeof(SpritePost) * max(num_posts, 1));
+
+	if (!f_info->posts)
+	{
+		free(f_info->post_offsets);
+		f_info->post_offsets = NULL;
+		return;
+	}
+
+	int post_index = 0;
+
+	for (int x = 0; x < frame_w; x++)
+	{
+		f_info->post_offsets[x] = post_index;
+
+		SpritePost* post = NULL;
+
+		for (int y = 0; y < frame_h; y++)
+		{
+			unsigned char* color = Image_Get(img, frame_x + x, frame_y + y);
+
+			if (!color || color[3] <= 128)
+			{
+				post = NULL;
+				continue;
+			}
+
+			if (!post)
+			{
+				post = &f_info->posts[post_index++];
+				post->top = y;
+				post->length = 0;
+			}
+
+			post->length++;
+		}
+	}
+
+	f_info->post_offsets[frame_w] = post_index;
+}
+
 void Image_GenerateFrameInfo(Image* img)
 {
 	const int h_frames = img->h_frames;
@@ -381,11 +470,90 @@ void Image_GenerateFrameInfo(Image* img)
 
 		f_info->min_real_x = (min_x > 0) ? min_x - 1 : 0;
 		f_info->max_real_x = max_x;
+
+		Image_GenerateFramePosts(img, f_info, sprite_offset_x * sprite_rect_width, sprite_offset_y * sprite_rect_height, sprite_rect_width, sprite_rect_height);
 	}
 
 	img->frame_info = frame_infos;
 }
 
+void Image_GenerateMipmaps(Image* img)
+{
+#ifndef DISABLE_MIPMAPS
+	if (!img->data || img->num_mipmaps > 0)
+	{
+		return;
+	}
+
+	Image* src = img;
+
+	while (img->num_mipmaps < MAX_IMAGE_MIPMAPS)
+	{
+		//sprite sheets only get levels where every frame halves evenly, so no texel mixes two frames
+		int frame_w = (img->h_frames > 0) ? src->width / img->h_frames : src->width;
+		int frame_h = (img->v_frames > 0) ? src->height / img->v_frames : src->height;
+
+		if (src->width < 2 || src->height < 2 || (frame_w & 1) || (frame_h & 1))
+		{
+			break;
+		}
+
+		Image* mip = malloc(sizeof(Image));
+
+		if (!mip)
+		{
+			break;
+		}
+
+		if (!Image_Create(mip, src->width / 2, src->height / 2, src->numChannels))
+		{
+			free(mip);
+			break;
+		}
+
+		mip->is_collumn_stored = src->is_collumn_stored;
+
+		for (int x = 0; x < mip->width; x++)
+		{
+			for (int y = 0; y < mip->height; y++)
+			{
+				unsigned char* s[4];
+				s[0] = Image_GetFast(src, x * 2, y * 2);
+				s[1] = Image_GetFast(src, x * 2 + 1, y * 2);
+				s[2] = Image_GetFast(src, x * 2, y * 2 + 1);
+				s[3] = Image_GetFast(src, x * 2 + 1, y * 2 + 1);
+
+				unsigned char* d = Image_GetFast(mip, x, y);
+
+				//weight the colors by alpha, so transparent texels don't darken the edges of sprites
+				int alpha_sum = 0;
+
+				if (mip->numChannels >= 4)
+				{
+					alpha_sum = s[0][3] + s[1][3] + s[2][3] + s[3][3];
+					d[3] = (alpha_sum + 2) / 4;
+				}
+
+				for (int c = 0; c < min(mip->numChannels, 3); c++)
+				{
+					if (alpha_sum > 0)
+					{
+						d[c] = (s[0][c] * s[0][3] + s[1][c] * s[1][3] + s[2][c] * s[2][3] + s[3][c] * s[3][3] + alpha_sum / 2) / alpha_sum;
+					}
+					else
+					{
+						d[c] = (s[0][c] + s[1][c] + s[2][c] + s[3][c] + 2) / 4;
+					}
+				}
+			}
+		}
+
+		img->mipmaps[img->num_mipmaps++] = mip;
+		src = mip;
+	}
+#endif // !DISABLE_MIPMAPS
+}
+
 FrameInfo* Image_GetFrameInfo(Image* img, int frame)
 {
 	int total_frames = img->h_frames * img->v_frames;
@@ -424,6 +592,22 @@ AlphaSpan* FrameInfo_GetAlphaSpan(FrameInfo* frame_info, int x)
 	return &frame_info->alpha_spans[x];
 }
 
+SpritePost* FrameInfo_GetPosts(FrameInfo* frame_info, int x, int* r_num_posts)
+{
+	//columns outside the frame have nothing to draw
+	if (!frame_info->post_offsets || x < 0 || x >= frame_info->width)
+	{
+		*r_num_posts = 0;
+		return NULL;
+	}
+
+	int first = frame_info->post_offsets[x];
+
+	*r_num_posts = frame_info->post_offsets[x + 1] - first;
+
+	return &frame_info->posts[first];
+}
+
 
 void Image_Copy(Image* dest, Image* src)
 {
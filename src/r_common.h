@@ -4,11 +4,23 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <windows.h>
+#include <string.h>
+#include "utility.h"
 #include "u_math.h"
 
+struct Map;
+struct Sector;
+struct Line;
+
+//headless builds have no window, so nothing calls into glfw
+#if defined(HEADLESS_TIMEDEMO) || defined(HEADLESS_LIGHTBAKE)
+#define HEADLESS
+#endif
+
 #define MAX_IMAGE_MIPMAPS 8
 #define DEPTH_CLEAR 9999999
+//rows of a column that share one coarse depth value
+#define COARSE_DEPTH_SHIFT 3
 
 #define BASE_RENDER_WIDTH 640
 #define BASE_RENDER_HEIGHT 360
@@ -37,15 +49,26 @@ typedef struct
 	int min, max;
 } AlphaSpan;
 
+//a run of opaque texels in a frame column, like the posts of doom patches
+typedef struct
+{
+	short top;
+	short length;
+} SpritePost;
+
 typedef struct
 {
 	int min_real_x;
 	int max_real_x;
 	int width;
 	AlphaSpan* alpha_spans;
+
+	//posts of column x are posts[post_offsets[x]] up to posts[post_offsets[x + 1]]
+	int* post_offsets;
+	SpritePost* posts;
 } FrameInfo;
 
-typedef struct
+typedef struct Image
 {
 	int half_width;
 	int half_height;
@@ -60,9 +83,9 @@ typedef struct
 
 	FrameInfo* frame_info;
 
-	//mipmap stuff
-	//int num_mipmaps;
-	//struct Image* mipmaps[MAX_IMAGE_MIPMAPS];
+	//mipmap stuff, mipmaps[0] is half the size of this image
+	int num_mipmaps;
+	struct Image* mipmaps[MAX_IMAGE_MIPMAPS];
 	//float x_scale;
 	//float y_scale;
 
@@ -80,37 +103,58 @@ void Image_Blit(Image* dest, Image* src, int dstX0, int dstY0, int dstX1, int ds
 void Image_Set(Image* img, int x, int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
 Vec4 Image_CalcAverageColor(Image* img, int min_avg, int max_avg);
 
-inline void Image_Set2(Image* img, int x, int y, unsigned char* color)
+//column stored images keep each column contiguous, row stored ones each row
+static inline size_t Image_PixelIndex(Image* img, int x, int y)
+{
+	if (img->is_collumn_stored)
+	{
+		return (size_t)x * (size_t)img->height + (size_t)y;
+	}
+
+	return (size_t)x + (size_t)y * (size_t)img->width;
+}
+//pixel index step when moving one pixel right
+static inline size_t Image_XStride(Image* img)
+{
+	return (img->is_collumn_stored) ? (size_t)img->height : 1;
+}
+//pixel index step when moving one pixel down
+static inline size_t Image_YStride(Image* img)
+{
+	return (img->is_collumn_stored) ? 1 : (size_t)img->width;
+}
+
+static inline void Image_Set2(Image* img, int x, int y, unsigned char* color)
 {
 	if (!img->data || x < 0 || y < 0 || x >= img->width || y >= img->height)
 	{
 		return;
 	}
 
-	unsigned char* d = img->data + (x + y * img->width) * img->numChannels;
+	unsigned char* d = img->data + Image_PixelIndex(img, x, y) * img->numChannels;
 
 	memcpy(d, color, img->numChannels);
 }
-inline void Image_Set3(Image* img, int x, int y, unsigned char* color, int numChannels)
+static inline void Image_Set3(Image* img, int x, int y, unsigned char* color, int numChannels)
 {
 	if (!img->data || x < 0 || y < 0 || x >= img->width || y >= img->height)
 	{
 		return;
 	}
 
-	unsigned char* d = img->data + (x + y * img->width) * img->numChannels;
+	unsigned char* d = img->data + Image_PixelIndex(img, x, y) * img->numChannels;
 
 	memcpy(d, color, numChannels);
 }
-inline void Image_SetFast(Image* img, int x, int y, unsigned char* color)
+static inline void Image_SetFast(Image* img, int x, int y, unsigned char* color)
 {
-	unsigned char* d = img->data + (x + y * img->width) * img->numChannels;
+	unsigned char* d = img->data + Image_PixelIndex(img, x, y) * img->numChannels;
 
 	memcpy(d, color, img->numChannels);
 }
-inline void Image_SetScaled(Image* img, int x, int y, float scale, unsigned char* color)
+static inline void Image_SetScaled(Image* img, int x, int y, float scale, unsigned char* color)
 {
-	unsigned char* d = img->data + (x + y * img->width) * img->numChannels;
+	unsigned char* d = img->data + Image_PixelIndex(img, x, y) * img->numChannels;
 
 	//no scale, so set directly
 	if (scale == 1)
@@ -153,47 +197,46 @@ inline void Image_SetScaled(Image* img, int x, int y, float scale, unsigned char
 	
 }
 
-inline unsigned char* Image_Get(Image* img, int x, int y)
+static inline unsigned char* Image_Get(Image* img, int x, int y)
 {
 	x = Math_Clampl(x, 0, img->width - 1);
 	y = Math_Clampl(y, 0, img->height - 1);
 
-	size_t index = 0;
+	return &img->data[Image_PixelIndex(img, x, y) * img->numChannels];
+}
+static inline unsigned char* Image_GetFast(Image* img, int x, int y)
+{
+	return &img->data[Image_PixelIndex(img, x, y) * img->numChannels];
+}
 
-	if (img->is_collumn_stored)
-	{
-		index = ((x * img->height) + y) * img->numChannels;
-	}
-	else
-	{
-		index = (x + y * img->width) * img->numChannels;
-	}
+void Image_Blur(Image* img, int size, float scale);
+void Image_GenerateFrameInfo(Image* img);
+void Image_GenerateMipmaps(Image* img);
 
-	return &img->data[index];
+//level 0 is the image itself
+static inline Image* Image_GetMipmap(Image* img, int level)
+{
+	return (level > 0) ? img->mipmaps[level - 1] : img;
 }
-inline unsigned char* Image_GetFast(Image* img, int x, int y)
+//picks the level where one step is less than 2 texels
+static inline int Image_SelectMipmap(Image* img, float step)
 {
-	size_t index = 0;
+	int level = 0;
 
-	if (img->is_collumn_stored)
+	while (step >= 2.0f && level < img->num_mipmaps)
 	{
-		index = ((x * img->height) + y) * img->numChannels;
-	}
-	else
-	{
-		index = (x + y * img->width) * img->numChannels;
+		step *= 0.5f;
+		level++;
 	}
 
-	return &img->data[index];
+	return level;
 }
 
-void Image_Blur(Image* img, int size, float scale);
-void Image_GenerateFrameInfo(Image* img);
-
 FrameInfo* Image_GetFrameInfo(Image* img, int frame);
 AlphaSpan* FrameInfo_GetAlphaSpan(FrameInfo* frame_info, int x);
+SpritePost* FrameInfo_GetPosts(FrameInfo* frame_info, int x, int* r_num_posts);
 
-typedef struct
+typedef struct Texture
 {
 	Image img;
 	unsigned char name[10];
@@ -213,14 +256,14 @@ typedef struct
 	int height;
 } Lightmap;
 
-inline Vec3_u16* Lightmap_Get(Lightmap* lightmap, int x, int y)
+static inline Vec3_u16* Lightmap_Get(Lightmap* lightmap, int x, int y)
 {
 	x = Math_Clampl(x, 0, lightmap->width - 1);
 	y = Math_Clampl(y, 0, lightmap->height - 1);
 
 	return &lightmap->data[x + y * lightmap->width];
 }
-inline Vec3_u16* Lightmap_GetFast(Lightmap* lightmap, int x, int y)
+static inline Vec3_u16* Lightmap_GetFast(Lightmap* lightmap, int x, int y)
 {
 	return &lightmap->data[x + y * lightmap->width];
 }
@@ -245,7 +288,7 @@ static void Lightmap_SampleWallLinearPoints(Lightmap* lightmap, float x, float y
 	r_lerp1->g = Math_lerp(s2.g, s3.g, x_frac);
 	r_lerp1->b = Math_lerp(s2.b, s3.b, x_frac);
 }
-inline void Lightmap_SamplePlaneLinearPoints(Lightmap* lightmap, float x, float y, Vec3_u16* r_s0, Vec3_u16* r_s1, Vec3_u16*r_s2, Vec3_u16* r_s3)
+static inline void Lightmap_SamplePlaneLinearPoints(Lightmap* lightmap, float x, float y, Vec3_u16* r_s0, Vec3_u16* r_s1, Vec3_u16*r_s2, Vec3_u16* r_s3)
 {
 	//only designed for plane strip drawing
 	x = Math_Clampl(x, 0, lightmap->width - 1);
@@ -326,6 +369,84 @@ typedef struct
 	bool flip_v;
 } DrawSprite;
 
+//Immutable copy of the sprites in each sector, published by the game thread once per frame
+typedef struct
+{
+	DrawSprite* sprites;
+	int num_sprites;
+	int max_sprites;
+
+	//sprites of sector i are in [sector_offsets[i], sector_offsets[i + 1])
+	int* sector_offsets;
+	int num_sectors;
+	int max_sectors;
+} SpriteSnapshot;
+
+//Sector values that change while playing and are needed for drawing
+typedef struct
+{
+	float r_floor, r_ceil;
+	float floor, ceil;
+	int light_level;
+} SectorRenderState;
+
+#define HUD_MAX_STATUS_MESSAGE 32
+
+//Player and game values the hud needs
+typedef struct
+{
+	Sprite gun_sprite;
+	float gun_offset_x, gun_offset_y;
+
+	float hurt_timer, hit_timer, god_timer, quad_timer;
+
+	int gun;
+	int hp;
+	int bullet_ammo, buck_ammo, rocket_ammo;
+
+	char status_msg[HUD_MAX_STATUS_MESSAGE];
+	float status_msg_timer;
+} HudState;
+
+//Visual map values, the map lines themselves are read from the map
+typedef struct
+{
+	float player_x, player_y, player_angle;
+	float center_x, center_y;
+	float angle;
+	float bbox[2][2];
+	float pulse;
+	float zoom_level;
+
+	int mode;
+	bool rotate;
+	bool player_follow_mode;
+} VisualMapState;
+
+typedef void (*ShaderFun)(Image* image, int x, int y);
+
+//Everything the renderer needs from one simulated frame, so the next frame can be simulated while this one is drawn
+typedef struct
+{
+	SpriteSnapshot sprites;
+
+	SectorRenderState* sectors;
+	int num_sectors;
+	int max_sectors;
+
+	float view_x, view_y, view_z, view_angle;
+	Vec3_u16 extra_light;
+	ShaderFun shader_fun;
+	//first packet that carried the extra light and shader, so they are drawn once even if later packets carry them too
+	unsigned extra_light_sequence;
+	unsigned shader_sequence;
+
+	HudState hud;
+	VisualMapState visual_map;
+
+	unsigned sequence;
+} FramePacket;
+
 typedef struct
 {
 	short first;
@@ -340,6 +461,109 @@ typedef struct
 	//int num_allocated;
 } ClipSegments;
 
+//surface cache, pre-lit texels of lightmapped walls and flats, kept in square blocks per render thread
+#define SURFACE_BLOCK_SHIFT 6
+#define SURFACE_BLOCK_SIZE (1 << SURFACE_BLOCK_SHIFT)
+#define SURFACE_BLOCK_MASK (SURFACE_BLOCK_SIZE - 1)
+#define SURFACE_CACHE_MAX_BYTES (32 * 1024 * 1024)
+
+typedef enum
+{
+	SURF__WALL_TOP,
+	SURF__WALL_MIDDLE,
+	SURF__WALL_BOTTOM,
+	SURF__FLOOR,
+	SURF__CEIL
+} SurfaceType;
+
+typedef struct
+{
+	SurfaceType type;
+	int index;
+
+	//texture is the mip level itself, u and v are texel coordinates of that level
+	Image* texture;
+	int mip_level;
+	Lightmap* lightmap;
+	int light_level;
+
+	//walls, u is the texture x, the full size u - x_offset is the lightmap x and v - light_offset the lightmap y
+	int x_offset;
+	int width_mask;
+	int height_mask;
+	int light_offset;
+
+	//flats, texture space position the lightmap coordinates are measured from
+	float origin_x, origin_y;
+
+	struct SurfaceCache* cache;
+} SurfaceDesc;
+
+typedef struct
+{
+	uint64_t key;
+	int generation;
+
+	//what the texels were lit from, the block is rebuilt if any of it changes
+	Image* texture;
+	int mip_level;
+	Vec3_u16* lightmap_data;
+	int light_level;
+	int x_offset;
+	int height_mask;
+	int light_offset;
+
+	int hash_next;
+	int lru_prev, lru_next;
+
+	//column stored, SURFACE_BLOCK_SIZE x SURFACE_BLOCK_SIZE rgba texels
+	unsigned char* texels;
+} SurfaceBlock;
+
+typedef struct SurfaceCache
+{
+	SurfaceBlock* blocks;
+	unsigned char* texel_memory;
+	int* buckets;
+
+	int num_blocks;
+	int max_blocks;
+	int bucket_mask;
+
+	//most recently used first
+	int lru_head, lru_tail;
+} SurfaceCache;
+
+bool Surface_InitCache(SurfaceCache* cache, size_t max_bytes);
+void Surface_DestroyCache(SurfaceCache* cache);
+void Surface_InvalidateAll();
+SurfaceBlock* Surface_FindBlock(SurfaceCache* cache, SurfaceDesc* desc, int bx, int by, bool* r_build);
+
+//linear allocator for the per frame transients of a render thread, everything is released at once by a reset
+#define FRAME_ARENA_BLOCK_SIZE (1024 * 1024)
+
+typedef struct FrameArenaBlock
+{
+	struct FrameArenaBlock* next;
+	size_t size;
+	size_t used;
+} FrameArenaBlock;
+
+typedef struct
+{
+	FrameArenaBlock* first;
+	FrameArenaBlock* current;
+	void* last_alloc;
+} FrameArena;
+
+void Arena_Reset(FrameArena* arena);
+void Arena_Destroy(FrameArena* arena);
+void* Arena_Alloc(FrameArena* arena, size_t size);
+void* Arena_Calloc(FrameArena* arena, size_t size);
+void* Arena_Grow(FrameArena* arena, void* ptr, size_t old_size, size_t new_size);
+bool Arena_GrowArray(FrameArena* arena, void** array, int* max_count, int count, size_t elem_size);
+
+//a visplane, every column between x1 and x2 of the same plane key is gathered here and drawn once after the bsp walk
 typedef struct
 {
 	short* ytop;
@@ -350,10 +574,21 @@ typedef struct
 	float viewheight;
 	int light;
 
+	//the map sector, not the frame packet copy, for the lightmap placement
+	struct Sector* sector;
+	int x1, x2;
+
 	bool visible;
 	bool is_sky;
 } DrawPlane;
 
+typedef struct
+{
+	DrawPlane** planes;
+	int index;
+	int max_planes;
+} VisPlaneList;
+
 typedef struct
 {
 	float view_x, view_y, view_z;
@@ -370,15 +605,10 @@ typedef struct
 	short* yclip_top;
 	short* yclip_bottom;
 
-	short* floor_plane_ytop;
-	short* floor_plane_ybottom;
-
-	short* ceil_plane_ytop;
-	short* ceil_plane_ybottom;
-
 	float* yslope;
 
 	struct RenderData* render_data;
+	FramePacket* frame_packet;
 
 	float* depth_buffer;
 
@@ -434,6 +664,9 @@ typedef struct
 	struct Line* line;
 	struct Sector* sector;
 
+	DrawPlane* floor_plane;
+	DrawPlane* ceil_plane;
+
 	DrawingArgs* draw_args;
 } LineDrawArgs;
 
@@ -454,20 +687,21 @@ typedef struct
 	bool visible;
 } DrawSeg;
 
-#define MAX_DRAWSEGS 32
-
 typedef struct
 {
-	DrawSeg segs[MAX_DRAWSEGS];
+	DrawSeg** segs;
 	int index;
+	int max_segs;
 } DrawSegList;
 
-#define MAX_DRAWSPRITES 1024
-
-typedef struct
+typedef struct RenderData
 {
-	DrawSprite draw_sprites[MAX_DRAWSPRITES];
+	//draw segs, their ranges, sprites and visplanes live here and are gone after the next setup
+	FrameArena arena;
+
+	DrawSprite* draw_sprites;
 	int num_draw_sprites;
+	int max_draw_sprites;
 
 	ClipSegments clip_segs;
 	DrawSegList draw_segs;
@@ -475,14 +709,106 @@ typedef struct
 	uint64_t* visited_sectors_bitset;
 	size_t bitset_size;
 
-	DrawPlane floor_plane;
-	DrawPlane ceil_plane;
+	VisPlaneList visplanes;
 	short* span_end;
 
+	//plane spans are drawn here first when the framebuffer is column stored
+	unsigned char* span_scratch;
+	float* span_depth_scratch;
+
+	SurfaceCache surface_cache;
+
+	//farthest depth of every 1 << COARSE_DEPTH_SHIFT rows, column after column, built before the sprites are drawn
+	float* coarse_depth;
+	int coarse_depth_rows;
+	bool coarse_depth_valid;
+
+	//sprite occlusion counters
+	int sprite_columns_culled;
+	int sprite_columns_drawn;
+
 	int slice_x_start;
 	int slice_x_end;
+
+	//buffers are sized for the whole width, so that slices can move around without reallocating
+	int width;
 } RenderData;
 
+//front to back ordered list of potentially visible subsectors and line segs, built once per frame and shared by all threads
+typedef struct
+{
+	int line_index;
+	int vis_subsector;
+	short x1, x2;
+} VisSeg;
+
+typedef struct
+{
+	int subsector_index;
+	int seg_offset;
+	int num_segs;
+	short x1, x2;
+} VisSubsector;
+
+//a draw sprite projected to the screen once per frame, the threads only draw the columns of it that are in their range
+typedef struct
+{
+	DrawSprite* sprite;
+	FrameInfo* frame_info;
+
+	//screen rect, clipped to the screen
+	int x1, x2;
+	int y1, y2;
+
+	//frame columns with opaque texels
+	int min_x, max_x;
+
+	float depth;
+	int light_r, light_g, light_b;
+
+	//billboard sprites, texture positions are at x1 and y1
+	Image* mip;
+	int mip_level;
+	float tx_pos, tx_step, tx_add;
+	float ty_pos, ty_step, ty_add;
+
+	//decals
+	float u0, u1;
+	float fsz1, fsz2;
+	float tz1, tz2;
+	Vec3_u16* light_sample;
+
+	//set by every strip the sprite is drawn in, whole sprite culls are counted from them once the frame is done
+	bool column_culled;
+	bool column_drawn;
+} VisSprite;
+
+#define RENDER_STRIP_WIDTH 32
+
+typedef struct
+{
+	VisSubsector* subsectors;
+	int num_subsectors;
+	int max_subsectors;
+
+	VisSeg* segs;
+	int num_segs;
+	int max_segs;
+
+	//segs of each RENDER_STRIP_WIDTH wide bin of columns front to back, bin i is bin_segs[seg_bin_offsets[i]] up to bin_segs[seg_bin_offsets[i + 1]]
+	int* seg_bin_offsets;
+	int* bin_segs;
+
+	//in the frame arena of the render data that built the list
+	VisSprite* sprites;
+	int num_sprites;
+
+	//sprites of each RENDER_STRIP_WIDTH wide bin of columns in draw order, bin i is bin_sprites[bin_offsets[i]] up to bin_sprites[bin_offsets[i + 1]]
+	int* bin_offsets;
+	int* bin_sprites;
+	int num_bins;
+} VisList;
+
 void Video_Setup();
 bool Video_ClipLine(int xmin, int xmax, int ymin, int ymax, int* r_x0, int* r_y0, int* r_x1, int* r_y1);
 void Video_DrawLine(Image* image, int x0, int y0, int x1, int y1, unsigned char* color);
@@ -492,15 +818,20 @@ void Video_DrawBoxLines(Image* image, float box[2][2], unsigned char* color);
 void Video_DrawBox(Image* image, float* depth_buffer, float box[2][3], float view_x, float view_y, float view_z, float view_cos, float view_sin, float tan_sin, float tan_cos, float v_fov, int x_start, int x_end, Vec3_u16* light);
 void Video_DrawScreenTexture(Image* image, Image* texture, float p_x, float p_y, float p_scaleX, float p_scaleY);
 void Video_DrawScreenSprite(Image* image, Sprite* sprite, int start_x, int end_x);
-void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite);
-void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite);
-void Video_DrawWallCollumn(Image* image, float* depth_buffer, struct Texture* texture, int x, int y1, int y2, float depth, int tx, float ty_pos, float ty_step, int lx, float ly_pos, Vec3_u16 light, int height_mask, Lightmap* lm);
+bool Video_ProjectSprite(Image* image, DrawingArgs* args, DrawSprite* sprite, VisSprite* vis);
+void Video_DrawSprite(Image* image, DrawingArgs* args, VisSprite* vis);
+bool Video_ProjectDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite, VisSprite* vis);
+void Video_DrawDecalSprite(Image* image, DrawingArgs* args, VisSprite* vis);
+void Video_DrawWallCollumn(Image* image, float* depth_buffer, struct Texture* texture, int x, int y1, int y2, float depth, int tx, float ty_pos, float ty_step, int lx, float ly_pos, Vec3_u16 light, int height_mask, Lightmap* lm, SurfaceDesc* surface);
 void Video_DrawWallCollumnDepth(Image* image, struct Texture* texture, Lightmap* lm, float* depth_buffer, int x, int y1, int y2, float z, int tx, float ty_pos, float ty_step, int lx, float ly_pos, Vec3_u16 light, int height_mask);
+void Video_BenchmarkWallColumns(int num_columns);
+void Video_BenchmarkPlaneSpans(int num_spans);
 void Video_DrawSkyPlaneStripe(Image* image, float* depth_buffer, struct Texture* texture, int x, int y1, int y2, LineDrawArgs* args);
 void Video_DrawPlaneSpan(Image* image, DrawPlane* plane, LineDrawArgs* args, int y, int x1, int x2);
 void Video_DrawThreadSlice(Image* image, int x1, int x2, Vec3_u16* color);
+void Video_TransposeColumns(Image* dest, Image* src, int x0, int x1);
+void Video_BuildCoarseDepth(Image* image, float* depth_buffer, RenderData* render_data, int x0, int x1);
 
-typedef void (*ShaderFun)(Image* image, int x, int y);
 void Video_Shade(Image* image, ShaderFun shader_fun, int x0, int y0, int x1, int y1);
 
 typedef enum
@@ -517,21 +848,52 @@ typedef enum
 	TWT__SHADER,
 	TWT__DRAW_LEVEL,
 	TWT__DRAW_HUD,
+	TWT__DRAW_FRAME,
+	TWT__TRANSPOSE,
 	TWT__EXIT
 } ThreadWorkType;
 
+typedef struct
+{
+	double lines_time;
+	double draw_segs_time;
+	double sprites_time;
+	double hud_time;
+	double total_time;
+
+	//time spent waiting for work
+	double idle_time;
+
+	//work stealing counters
+	int strips_drawn;
+	int strips_stolen;
+
+	//sprite occlusion counters
+	int sprite_columns_culled;
+	int sprite_columns_drawn;
+} RenderTimings;
+
 typedef struct
 {
 	RenderData render_data;
+	RenderTimings timings;
 
 	ThreadState state;
 
-	HANDLE thread_handle;
+	Thread thread_handle;
 
+	int index;
 	int x_start, x_end;
+
+	//packed strip index range, head in the low 16 bits and tail in the high 16 bits
+	volatile AtomicInt strip_queue;
+
+	//strips from our starting share that are not drawn yet, by us or by thieves
+	volatile AtomicInt strips_pending;
 } RenderThread;
 
 bool Render_Init(int width, int height, int scale);
+bool Render_InitHeadless(int width, int height, int scale);
 void Render_ShutDown();
 void Render_LockObjectMutex(bool writer);
 void Render_UnlockObjectMutex(bool writer);
@@ -546,25 +908,47 @@ void Render_GetWindowSize(int* r_width, int* r_height);
 void Render_GetRenderSize(int* r_width, int* r_height);
 int Render_GetRenderScale();
 void Render_SetRenderScale(int scale);
+void Render_SetDynamicResolution(float target_ms);
+float Render_GetDynamicResolution();
 float Render_GetWindowAspect();
 int Render_IsFullscreen();
 void Render_ToggleFullscreen();
 int Render_GetTicks();
 void Render_Clear(int c);
+void Render_PublishFramePacket(struct Map* map);
+void Render_SetFrameLatency(int frames);
+int Render_GetFrameLatency();
+int Render_GetNumThreads();
+void Render_GetThreadTimings(int index, RenderTimings* dest);
+double Render_GetVisListTime();
+int Render_GetSpritesCulled();
+bool Render_Timedemo(int level_index, int num_frames);
 
 void RenderUtl_ResetClip(ClipSegments* clip, short left, short right);
 void RenderUtl_SetupRenderData(RenderData* data, int width, int x_start, int x_end);
 void RenderUtl_Resize(RenderData* data, int width, int height, int x_start, int x_end);
+void RenderUtl_SetActiveSize(RenderData* data, int width, int height);
 void RenderUtl_DestroyRenderData(RenderData* data);
 bool RenderUtl_CheckVisitedSectorBitset(RenderData* data, int sector);
 void RenderUtl_SetVisitedSectorBitset(RenderData* data, int sector);
 void RenderUtl_AddSpriteToQueue(RenderData* data, Sprite* sprite, int sector_light, Vec3_u16 extra_light, bool is_decal);
+void RenderUtl_SpriteToDrawSprite(DrawSprite* dest, Sprite* sprite, int sector_light, bool is_decal);
+bool RenderUtl_BuildSpriteSnapshot(SpriteSnapshot* snapshot, struct Map* map);
+void RenderUtl_AddSnapshotSpritesToQueue(RenderData* data, SpriteSnapshot* snapshot, int sector);
+void RenderUtl_DestroySpriteSnapshot(SpriteSnapshot* snapshot);
+bool RenderUtl_BuildFramePacket(FramePacket* packet, struct Map* map);
+void RenderUtl_ApplyFramePacketSector(FramePacket* packet, struct Sector* sector);
+void RenderUtl_DestroyFramePacket(FramePacket* packet);
+bool RenderUtl_ReserveVisList(VisList* list, int num_subsectors, int num_segs);
+void RenderUtl_DestroyVisList(VisList* list);
 
 void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args);
 void Scene_ClipAndDraw(ClipSegments* p_clip, int first, int last, bool solid, LineDrawArgs* args, Image* image);
 bool Scene_RenderLine(Image* image, struct Map* map, struct Sector* sector, struct Line* line, DrawingArgs* args);
-void Scene_ProcessSubsector(Image* image, struct Map* map, struct Subsector* sub_sector, DrawingArgs* args);
-int Scene_ProcessBSPNode(Image* image, struct Map* map, int node_index, DrawingArgs* args);
+int Scene_BuildVisList(Image* image, struct Map* map, int node_index, DrawingArgs* args, VisList* vis_list, int x1, int x2);
+void Scene_BinVisSegs(Image* image, VisList* vis_list, RenderData* render_data);
+void Scene_BuildVisSprites(Image* image, struct Map* map, VisList* vis_list, DrawingArgs* args);
+void Scene_DrawVisList(Image* image, struct Map* map, VisList* vis_list, DrawingArgs* args);
 void Scene_DrawDrawSegs(Image* image, DrawSegList* seg_list, float* depth_buffer, DrawingArgs* args);
 
 #define MAX_FONT_GLYPHS 100
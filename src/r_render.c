@@ -12,6 +12,18 @@
 
 extern Vec4* Light_GetLightPoints(int* r_num);
 
+#define SLICE_BALANCE_RATE 0.5
+#define MIN_SLICE_WIDTH 8
+#define FRAME_PACKET_COUNT 3
+#define FRAME_PACKET_MAX_WAIT_MS 100
+#define DEFAULT_FRAME_LATENCY 1
+#define RENDER_BARRIER_SPIN_COUNT 4000
+#define DYNAMIC_RES_MIN_PERCENT 50
+#define DYNAMIC_RES_STEP_PERCENT 5
+#define DYNAMIC_RES_SMOOTHING 0.1
+#define DYNAMIC_RES_HEADROOM 0.8
+#define DYNAMIC_RES_COOLDOWN_FRAMES 8
+
 static const char* VERTEX_SHADER_SOURCE[] =
 {
 	"#version 330 core \n"
@@ -53,12 +65,6 @@ typedef struct
 	short* clip_y_top;
 	short* clip_y_bottom;
 
-	short* floor_plane_ytop;
-	short* floor_plane_ybottom;
-
-	short* ceil_plane_ytop;
-	short* ceil_plane_ybottom;
-
 	short* span_end;
 
 	float* yslopes;
@@ -67,11 +73,25 @@ typedef struct
 
 	Image framebuffer;
 
+	//rows of the column stored framebuffer, for the upload
+	Image upload_buffer;
+
 	float* depth_buffer;
 
 	int w, h;
 	int win_w, win_h;
 
+	//size the buffers were made for, w and h are smaller while dynamic resolution scales down
+	int max_w, max_h;
+
+	//dynamic resolution, disabled when the target is 0
+	float dynamic_res_target_ms;
+	double dynamic_res_avg_ms;
+	double frame_time_ms;
+	int dynamic_res_percent;
+	int dynamic_res_cooldown;
+	float quad_u, quad_v;
+
 	float hfov, vfov;
 
 	float view_x, view_y, view_z, view_cos, view_sin, view_angle;
@@ -79,38 +99,54 @@ typedef struct
 	int scale;
 	bool is_fullscreen;
 
-	Vec3_u16 extra_light;
+	//set by the game thread, carried by every frame packet until one that has them is drawn
+	Vec3_u16 pending_extra_light;
+	ShaderFun pending_shader_fun;
+	unsigned pending_light_sequence;
+	unsigned pending_shader_sequence;
 
 	FontData font_data;
 
-	int threads_finished;
 	int num_threads;
 	RenderThread* threads;
+	int* slice_bounds;
 
 	RenderData render_data;
-
-	ShaderFun fullscreen_shader_fun;
+	VisList vis_list;
+	double vis_time;
+	int sprites_culled;
+
+	//the game thread writes the packet that is neither published nor being drawn
+	FramePacket frame_packets[FRAME_PACKET_COUNT];
+	volatile AtomicInt published_packet;
+	volatile AtomicInt reading_packet;
+	FramePacket* frame_packet;
+	unsigned packet_sequence;
+	volatile unsigned drawn_sequence;
+	unsigned drawn_light_sequence;
+	unsigned drawn_shader_sequence;
+	int frame_latency;
+	Event packet_published_event;
+
+	Vec3_u16 frame_extra_light;
+	ShaderFun frame_shader_fun;
 
 	ThreadWorkType work_type;
 
 	ReaderWriterLockMutex reader_writer_object_mutex;
 
-	CONDITION_VARIABLE start_work_cv;
-	CRITICAL_SECTION start_mutex;
-
-	CONDITION_VARIABLE end_work_cv;
-	CRITICAL_SECTION end_mutex;
+	JobBarrier work_barrier;
 
-	CRITICAL_SECTION main_thread_mutex;
-	CONDITION_VARIABLE main_thread_cv;
-	HANDLE main_thread_active_event;
-	HANDLE main_thread_standby_event;
-	HANDLE main_thread_handle;
+	Mutex main_thread_mutex;
+	CondVar main_thread_cv;
+	Event main_thread_active_event;
+	Event main_thread_standby_event;
+	Thread main_thread_handle;
 
 	bool stall_main_thread;
-	bool shutdown_threads;
 	bool size_changed;
 	bool main_thread_shutdown;
+	bool headless;
 } RenderCore;
 
 static RenderCore s_renderCore;
@@ -145,68 +181,313 @@ static bool Shader_checkCompileErrors(unsigned int p_object, const char* p_type)
 
 static void Render_SizeChanged()
 {
-	EnterCriticalSection(&s_renderCore.main_thread_mutex);
+	Mutex_Lock(&s_renderCore.main_thread_mutex);
 
 	s_renderCore.size_changed = true;
 
-	LeaveCriticalSection(&s_renderCore.main_thread_mutex);
+	Mutex_Unlock(&s_renderCore.main_thread_mutex);
+}
+
+static void Render_SetupDrawingArgs(DrawingArgs* args, RenderData* render_data, int start_x, int end_x)
+{
+	float tangent = tan(Math_DegToRad(VIEW_FOV) / 2.0);
+
+	args->view_x = s_renderCore.view_x;
+	args->view_y = s_renderCore.view_y;
+	args->view_z = s_renderCore.view_z;
+	args->view_cos = s_renderCore.view_cos;
+	args->view_sin = s_renderCore.view_sin;
+	args->tan_cos = tangent * s_renderCore.view_cos;
+	args->tan_sin = tangent * s_renderCore.view_sin;
+	args->focal_length_x = ((float)s_renderCore.w / 2.0) / tangent;
+	args->tangent = tangent;
+	args->view_angle = s_renderCore.view_angle;
+	args->yclip_bottom = s_renderCore.clip_y_bottom;
+	args->yclip_top = s_renderCore.clip_y_top;
+	args->yslope = s_renderCore.yslopes;
+	args->depth_buffer = s_renderCore.depth_buffer;
+	args->h_fov = s_renderCore.hfov * (float)s_renderCore.h;
+	args->v_fov = s_renderCore.vfov * (float)s_renderCore.h;
+	args->start_x = start_x;
+	args->end_x = end_x;
+	args->render_data = render_data;
+	args->frame_packet = s_renderCore.frame_packet;
+	args->extra_light = s_renderCore.frame_extra_light;
+	args->extra_light_max = max(args->extra_light.r, max(args->extra_light.g, args->extra_light.b));
+}
+
+static void Render_CountCulledSprites()
+{
+	VisList* vis_list = &s_renderCore.vis_list;
+
+	s_renderCore.sprites_culled = 0;
+
+	for (int i = 0; i < vis_list->num_sprites; i++)
+	{
+		VisSprite* vis = &vis_list->sprites[i];
+
+		if (vis->column_culled && !vis->column_drawn)
+		{
+			s_renderCore.sprites_culled++;
+		}
+	}
+}
+
+static void Render_BuildVisList(Map* map)
+{
+	double start_time = Time_GetSeconds();
+
+	RenderData* render_data = &s_renderCore.render_data;
+	VisList* vis_list = &s_renderCore.vis_list;
+
+	if (!RenderUtl_ReserveVisList(vis_list, map->num_sub_sectors, map->num_line_segs))
+	{
+		return;
+	}
+
+	//single front to back walk over the whole screen, the threads only clip and draw what ends up in the list
+	RenderUtl_SetupRenderData(render_data, s_renderCore.w, 0, s_renderCore.w);
+
+	DrawingArgs drawing_args;
+	Render_SetupDrawingArgs(&drawing_args, render_data, 0, s_renderCore.w);
+
+	Scene_BuildVisList(&s_renderCore.framebuffer, map, map->num_nodes - 1, &drawing_args, vis_list, 0, s_renderCore.w);
+
+	//a strip then only walks the segs that overlap it
+	Scene_BinVisSegs(&s_renderCore.framebuffer, vis_list, render_data);
+
+	//sprites are projected here too, each thread only gets the ones binned to its columns
+	Scene_BuildVisSprites(&s_renderCore.framebuffer, map, vis_list, &drawing_args);
+
+	s_renderCore.vis_time = Time_GetSeconds() - start_time;
 }
 
-static void Render_Level(Map* map, RenderData* render_data, int start_x, int end_x)
+static void Render_Level(Map* map, RenderData* render_data, RenderTimings* timings, int start_x, int end_x)
 {
+	double start_time = Time_GetSeconds();
+
 	//setup render data
 	RenderUtl_SetupRenderData(render_data, s_renderCore.w, start_x, end_x);
 
 	DrawingArgs drawing_args;
-	
-	float tangent = tan(Math_DegToRad(VIEW_FOV) / 2.0);
-
-	//setup drawing args
-	drawing_args.view_x = s_renderCore.view_x;
-	drawing_args.view_y = s_renderCore.view_y;
-	drawing_args.view_z = s_renderCore.view_z;
-	drawing_args.view_cos = s_renderCore.view_cos;
-	drawing_args.view_sin = s_renderCore.view_sin;
-	drawing_args.tan_cos = tangent * s_renderCore.view_cos;
-	drawing_args.tan_sin = tangent * s_renderCore.view_sin;
-	drawing_args.focal_length_x = ((float)s_renderCore.w / 2.0) / tangent;
-	drawing_args.tangent = tangent;
-	drawing_args.view_angle = s_renderCore.view_angle;
-	drawing_args.yclip_bottom = s_renderCore.clip_y_bottom;
-	drawing_args.yclip_top = s_renderCore.clip_y_top;
-	drawing_args.floor_plane_ytop = s_renderCore.floor_plane_ytop;
-	drawing_args.floor_plane_ybottom = s_renderCore.floor_plane_ybottom;
-	drawing_args.ceil_plane_ytop = s_renderCore.ceil_plane_ytop;
-	drawing_args.ceil_plane_ybottom = s_renderCore.ceil_plane_ybottom;
-	drawing_args.yslope = s_renderCore.yslopes;
-	drawing_args.depth_buffer = s_renderCore.depth_buffer;
-	drawing_args.h_fov = s_renderCore.hfov * (float)s_renderCore.h;
-	drawing_args.v_fov = s_renderCore.vfov * (float)s_renderCore.h;
-	drawing_args.start_x = start_x;
-	drawing_args.end_x = end_x;
-	drawing_args.render_data = render_data;
-	drawing_args.extra_light = s_renderCore.extra_light;
-	drawing_args.extra_light_max = max(drawing_args.extra_light.r, max(drawing_args.extra_light.g, drawing_args.extra_light.b));
+	Render_SetupDrawingArgs(&drawing_args, render_data, start_x, end_x);
 
 	//draw lines and add sprites to draw list
-	int nodes_drawn = Scene_ProcessBSPNode(&s_renderCore.framebuffer, map, map->num_nodes - 1, &drawing_args);
+	Scene_DrawVisList(&s_renderCore.framebuffer, map, &s_renderCore.vis_list, &drawing_args);
+
+	double lines_end_time = Time_GetSeconds();
 
 	//draw draw segs
 	Scene_DrawDrawSegs(&s_renderCore.framebuffer, &render_data->draw_segs, s_renderCore.depth_buffer, &drawing_args);
 
-	//draw sprites and decals
-	for (int i = 0; i < render_data->num_draw_sprites; i++)
+	double draw_segs_end_time = Time_GetSeconds();
+
+	VisList* vis_list = &s_renderCore.vis_list;
+
+	int first_bin = start_x / RENDER_STRIP_WIDTH;
+	int last_bin = min((end_x - 1) / RENDER_STRIP_WIDTH, vis_list->num_bins - 1);
+
+	//walls, planes and masked segs are done, so sprite columns behind them can be skipped
+	if (first_bin <= last_bin && vis_list->bin_offsets[last_bin + 1] > vis_list->bin_offsets[first_bin])
+	{
+		Video_BuildCoarseDepth(&s_renderCore.framebuffer, s_renderCore.depth_buffer, render_data, start_x, end_x);
+	}
+
+	//draw the sprites and decals binned to our columns, a bin at a time so each column gets them in the same order whatever the slices are
+	for (int bin = first_bin; bin <= last_bin; bin++)
+	{
+		drawing_args.start_x = max(start_x, bin * RENDER_STRIP_WIDTH);
+		drawing_args.end_x = min(end_x, (bin + 1) * RENDER_STRIP_WIDTH);
+
+		for (int i = vis_list->bin_offsets[bin]; i < vis_list->bin_offsets[bin + 1]; i++)
+		{
+			VisSprite* vis = &vis_list->sprites[vis_list->bin_sprites[i]];
+
+			if (vis->sprite->decal_line_index >= 0)
+			{
+				Video_DrawDecalSprite(&s_renderCore.framebuffer, &drawing_args, vis);
+			}
+			else
+			{
+				Video_DrawSprite(&s_renderCore.framebuffer, &drawing_args, vis);
+			}
+		}
+	}
+
+	double sprites_end_time = Time_GetSeconds();
+
+	timings->lines_time += lines_end_time - start_time;
+	timings->draw_segs_time += draw_segs_end_time - lines_end_time;
+	timings->sprites_time += sprites_end_time - draw_segs_end_time;
+	timings->sprite_columns_culled += render_data->sprite_columns_culled;
+	timings->sprite_columns_drawn += render_data->sprite_columns_drawn;
+}
+
+static void Render_WaitForFramePacket()
+{
+	if (s_renderCore.frame_latency <= 0 || Game_GetState() != GS__LEVEL)
+	{
+		return;
+	}
+
+	//already drew the newest packet, give the game thread up to the wait time to finish the next one
+	if (s_renderCore.frame_packets[s_renderCore.published_packet].sequence == s_renderCore.drawn_sequence)
+	{
+		Event_WaitTimeout(s_renderCore.packet_published_event, FRAME_PACKET_MAX_WAIT_MS);
+	}
+}
+
+static void Render_AcquireFramePacket()
+{
+	AtomicInt index = 0;
+
+	//retry if the game thread published a new one while we were marking it
+	do
+	{
+		index = s_renderCore.published_packet;
+		Atomic_Exchange(&s_renderCore.reading_packet, index);
+	} while (s_renderCore.published_packet != index);
+
+	FramePacket* packet = &s_renderCore.frame_packets[index];
+
+	s_renderCore.frame_packet = packet;
+	s_renderCore.drawn_sequence = packet->sequence;
+
+	//newer packets can carry the same flash or shader until the game thread sees this one was drawn, only use them once
+	s_renderCore.frame_extra_light = Vec3_u16_Zero();
+	s_renderCore.frame_shader_fun = NULL;
+
+	if (packet->extra_light_sequence > s_renderCore.drawn_light_sequence)
+	{
+		s_renderCore.frame_extra_light = packet->extra_light;
+		s_renderCore.drawn_light_sequence = packet->extra_light_sequence;
+	}
+	if (packet->shader_sequence > s_renderCore.drawn_shader_sequence)
+	{
+		s_renderCore.frame_shader_fun = packet->shader_fun;
+		s_renderCore.drawn_shader_sequence = packet->shader_sequence;
+	}
+}
+
+static void Render_ReleaseFramePacket()
+{
+	s_renderCore.frame_packet = NULL;
+	Atomic_Exchange(&s_renderCore.reading_packet, -1);
+}
+
+static void Render_ResetClipY(int start_x, int end_x)
+{
+	for (int x = start_x; x < end_x; x++)
+	{
+		s_renderCore.clip_y_top[x] = 0;
+		s_renderCore.clip_y_bottom[x] = s_renderCore.h - 1;
+	}
+}
+
+static void Render_SetupStripQueues()
+{
+	int num_threads = s_renderCore.num_threads;
+	int num_strips = (s_renderCore.w + RENDER_STRIP_WIDTH - 1) / RENDER_STRIP_WIDTH;
+
+	//each thread starts with an even share of neighbouring strips
+	for (int i = 0; i < num_threads; i++)
+	{
+		RenderThread* thr = &s_renderCore.threads[i];
+
+		unsigned head = (i * num_strips) / num_threads;
+		unsigned tail = ((i + 1) * num_strips) / num_threads;
+
+		thr->strip_queue = (AtomicInt)((tail << 16) | head);
+		thr->strips_pending = tail - head;
+
+		//the hud and shader are drawn over the columns of the starting share
+		thr->x_start = min(head * RENDER_STRIP_WIDTH, s_renderCore.w);
+		thr->x_end = min(tail * RENDER_STRIP_WIDTH, s_renderCore.w);
+	}
+}
+
+static int Render_PopStrip(RenderThread* thr)
+{
+	//owner takes from the front
+	while (true)
+	{
+		AtomicInt old_value = thr->strip_queue;
+
+		unsigned head = (unsigned)old_value & 0xffff;
+		unsigned tail = ((unsigned)old_value >> 16) & 0xffff;
+
+		if (head >= tail)
+		{
+			return -1;
+		}
+
+		AtomicInt new_value = (AtomicInt)((tail << 16) | (head + 1));
+
+		if (Atomic_CompareExchange(&thr->strip_queue, new_value, old_value) == old_value)
+		{
+			return head;
+		}
+	}
+}
+
+static int Render_StealStrip(RenderThread* thr)
+{
+	//thieves take from the back, furthest away from where the owner is working
+	while (true)
 	{
-		DrawSprite* sprite = &render_data->draw_sprites[i];
+		AtomicInt old_value = thr->strip_queue;
+
+		unsigned head = (unsigned)old_value & 0xffff;
+		unsigned tail = ((unsigned)old_value >> 16) & 0xffff;
+
+		if (head >= tail)
+		{
+			return -1;
+		}
 
-		if (sprite->decal_line_index >= 0)
+		AtomicInt new_value = (AtomicInt)(((tail - 1) << 16) | head);
+
+		if (Atomic_CompareExchange(&thr->strip_queue, new_value, old_value) == old_value)
 		{
-			Video_DrawDecalSprite(&s_renderCore.framebuffer, &drawing_args, sprite);
+			return tail - 1;
 		}
-		else
+	}
+}
+
+static void Render_LevelStrip(Map* map, RenderThread* thread, RenderThread* owner, int strip)
+{
+	int start_x = strip * RENDER_STRIP_WIDTH;
+	int end_x = min(start_x + RENDER_STRIP_WIDTH, s_renderCore.w);
+
+	Render_ResetClipY(start_x, end_x);
+	Render_Level(map, &thread->render_data, &thread->timings, start_x, end_x);
+
+	thread->timings.strips_drawn++;
+
+	Atomic_Decrement(&owner->strips_pending);
+}
+
+static void Render_LevelWorkStealing(Map* map, RenderThread* thread)
+{
+	int num_threads = s_renderCore.num_threads;
+	int strip = -1;
+
+	while ((strip = Render_PopStrip(thread)) >= 0)
+	{
+		Render_LevelStrip(map, thread, thread, strip);
+	}
+
+	//our queue is empty, help the others
+	for (int i = 1; i < num_threads; i++)
+	{
+		RenderThread* victim = &s_renderCore.threads[(thread->index + i) % num_threads];
+
+		while ((strip = Render_StealStrip(victim)) >= 0)
 		{
-			Video_DrawSprite(&s_renderCore.framebuffer, &drawing_args, sprite);
-		}	
+			Render_LevelStrip(map, thread, victim, strip);
+
+			thread->timings.strips_stolen++;
+		}
 	}
 }
 
@@ -330,26 +611,30 @@ static void Render_DrawLightPoints()
 	}
 }
 
-static void Render_MainThreadLoop()
+static void Render_DrawView(float x, float y, float z, float angle, float angleCos, float angleSin);
+
+#ifndef HEADLESS
+static void Render_MainThreadLoop(void* arg)
 {
 	GLFWwindow* window = Engine_GetWindow();
 
 	glfwMakeContextCurrent(window);
 
-	float view_x = 0;
-	float view_y = 0;
-	float view_z = 0;
-	float angle = 0;
-
-	SetEvent(s_renderCore.main_thread_active_event);
+	Event_Set(s_renderCore.main_thread_active_event);
 
 	while (!glfwWindowShouldClose(window) || !s_renderCore.main_thread_shutdown)
 	{
 		float aspect = Render_GetWindowAspect();
 
-		Player_GetView(&view_x, &view_y, &view_z, NULL, &angle);
+		//draw the newest frame the game thread has finished, while it simulates the next one
+		Render_WaitForFramePacket();
+		Render_AcquireFramePacket();
+
+		FramePacket* packet = s_renderCore.frame_packet;
 
-		Render_View(view_x, view_y, view_z, angle, cos(angle), sin(angle));
+		Render_DrawView(packet->view_x, packet->view_y, packet->view_z, packet->view_angle, cos(packet->view_angle), sin(packet->view_angle));
+
+		Render_ReleaseFramePacket();
 
 		glfwSwapBuffers(window);
 
@@ -358,11 +643,11 @@ static void Render_MainThreadLoop()
 			break;
 		}
 
-		EnterCriticalSection(&s_renderCore.main_thread_mutex);
+		Mutex_Lock(&s_renderCore.main_thread_mutex);
 		if (s_renderCore.size_changed)
 		{
 			glViewport(0, 0, s_renderCore.win_w, s_renderCore.win_h);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, s_renderCore.w, s_renderCore.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, s_renderCore.max_w, s_renderCore.max_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 
 			s_renderCore.size_changed = false;
 		}
@@ -370,189 +655,338 @@ static void Render_MainThreadLoop()
 		{
 			if (s_renderCore.stall_main_thread)
 			{
-				ResetEvent(s_renderCore.main_thread_active_event);
-				SetEvent(s_renderCore.main_thread_standby_event);
+				Event_Reset(s_renderCore.main_thread_active_event);
+				Event_Set(s_renderCore.main_thread_standby_event);
 
 				while (s_renderCore.stall_main_thread)
 				{
-					SleepConditionVariableCS(&s_renderCore.main_thread_cv, &s_renderCore.main_thread_mutex, INFINITE);
+					CondVar_Wait(&s_renderCore.main_thread_cv, &s_renderCore.main_thread_mutex);
 				}
 
 				//resume
-				ResetEvent(s_renderCore.main_thread_standby_event);
-				SetEvent(s_renderCore.main_thread_active_event);
+				Event_Reset(s_renderCore.main_thread_standby_event);
+				Event_Set(s_renderCore.main_thread_active_event);
 			}
 		}
-		LeaveCriticalSection(&s_renderCore.main_thread_mutex);
+		Mutex_Unlock(&s_renderCore.main_thread_mutex);
+	}
+}
+#endif // !HEADLESS
+
+static void Render_ThreadLevel(Map* map, RenderThread* thread)
+{
+	//level drawing starts a new frame
+	memset(&thread->timings, 0, sizeof(RenderTimings));
+
+#ifdef RENDER_WORK_STEALING
+	Render_LevelWorkStealing(map, thread);
+#else
+	//setup top and bottom clips
+	Render_ResetClipY(thread->x_start, thread->x_end);
+
+	Render_Level(map, &thread->render_data, &thread->timings, thread->x_start, thread->x_end);
+#endif // RENDER_WORK_STEALING
+}
+
+static void Render_ThreadHud(RenderThread* thread)
+{
+	double start_time = Time_GetSeconds();
+
+	Game_DrawHud(&s_renderCore.framebuffer, &s_renderCore.font_data, s_renderCore.frame_packet, thread->x_start, thread->x_end);
+
+	thread->timings.hud_time += Time_GetSeconds() - start_time;
+}
+
+static void Render_ThreadFrame(Map* map, RenderThread* thread)
+{
+	Render_ThreadLevel(map, thread);
+
+#ifdef RENDER_WORK_STEALING
+	//thieves may still be drawing strips from our columns
+	while (thread->strips_pending > 0)
+	{
+		Thread_Pause();
+	}
+#endif // RENDER_WORK_STEALING
+
+	//nothing else touches our columns, so hud and shader follow without a barrier
+	Render_ThreadHud(thread);
+
+	if (s_renderCore.frame_shader_fun)
+	{
+		Video_Shade(&s_renderCore.framebuffer, s_renderCore.frame_shader_fun, thread->x_start, 0, thread->x_end, s_renderCore.h);
 	}
 }
 
-static void Render_ThreadLoop(RenderThread* thread)
+static void Render_DoThreadWork(RenderThread* thread, ThreadWorkType work_type)
 {
 	Map* map = Map_GetMap();
 
-	int start_tick = s_renderCore.render_ticks;
-	int last_tick = start_tick;
+	thread->state = TS__WORKING;
+
+	double work_start_time = Time_GetSeconds();
 
-	while (!s_renderCore.shutdown_threads)
+	switch (work_type)
 	{
-		//wait for work
-		EnterCriticalSection(&s_renderCore.start_mutex);
+	case TWT__SHADER:
+	{
+		Video_Shade(&s_renderCore.framebuffer, s_renderCore.frame_shader_fun, thread->x_start, 0, thread->x_end, s_renderCore.h);
+		break;
+	}
+	case TWT__DRAW_LEVEL:
+	{
+		Render_ThreadLevel(map, thread);
+		break;
+	}
+	case TWT__DRAW_HUD:
+	{
+		Render_ThreadHud(thread);
+		break;
+	}
+	case TWT__DRAW_FRAME:
+	{
+		Render_ThreadFrame(map, thread);
+		break;
+	}
+	case TWT__TRANSPOSE:
+	{
+		Video_TransposeColumns(&s_renderCore.upload_buffer, &s_renderCore.framebuffer, thread->x_start, thread->x_end);
+		break;
+	}
+	default:
+		break;
+	}
 
-		while (s_renderCore.render_ticks == last_tick)
-		{
-			SleepConditionVariableCS(&s_renderCore.start_work_cv, &s_renderCore.start_mutex, INFINITE);
-		}
-		
-		ThreadWorkType work_type = s_renderCore.work_type;
+	thread->timings.total_time += Time_GetSeconds() - work_start_time;
 
-		last_tick = s_renderCore.render_ticks;
+	//Video_DrawThreadSlice(&s_renderCore.framebuffer, thread->x_start, thread->x_end, NULL);
 
-		LeaveCriticalSection(&s_renderCore.start_mutex);
+	thread->state = TS__SLEEPING;
+}
 
-		//set active state
-		thread->state = TS__WORKING;
+static void Render_ThreadLoop(void* arg)
+{
+	RenderThread* thread = arg;
+	AtomicInt last_epoch = 0;
 
-		//do the work
+	while (true)
+	{
+		//wait for work
+		double wait_start_time = Time_GetSeconds();
 
-		switch (work_type)
-		{
-		case TWT__SHADER:
-		{
-			Video_Shade(&s_renderCore.framebuffer, s_renderCore.fullscreen_shader_fun, thread->x_start, 0, thread->x_end, s_renderCore.h);
-			break;
-		}
-		case TWT__DRAW_LEVEL:
-		{
-			//setup top and bottom clips
-			for (int x = thread->x_start; x < thread->x_end; x++)
-			{
-				s_renderCore.clip_y_top[x] = 0;
-				s_renderCore.clip_y_bottom[x] = s_renderCore.h - 1;
-			}
+		last_epoch = JobBarrier_WaitForEpoch(&s_renderCore.work_barrier, last_epoch);
 
-			Render_Level(map, &thread->render_data, thread->x_start, thread->x_end);
-			break;
-		}
-		case TWT__DRAW_HUD:
+		double idle_time = Time_GetSeconds() - wait_start_time;
+
+		ThreadWorkType work_type = s_renderCore.work_type;
+
+		if (work_type == TWT__EXIT)
 		{
-			Game_DrawHud(&s_renderCore.framebuffer, &s_renderCore.font_data, thread->x_start, thread->x_end);
-			break;
-		}
-		default:
+			JobBarrier_Arrive(&s_renderCore.work_barrier);
 			break;
 		}
 
-		//Video_DrawThreadSlice(&s_renderCore.framebuffer, thread->x_start, thread->x_end, NULL);
+		//do the work
+		Render_DoThreadWork(thread, work_type);
 
-		EnterCriticalSection(&s_renderCore.end_mutex);
-		s_renderCore.threads_finished++;
-		LeaveCriticalSection(&s_renderCore.end_mutex);
-		WakeAllConditionVariable(&s_renderCore.end_work_cv);
+		thread->timings.idle_time += idle_time;
 
-		thread->state = TS__SLEEPING;
+		JobBarrier_Arrive(&s_renderCore.work_barrier);
 	}
 }
 
-
-static void Render_WaitForAllThreads()
+static void Render_RunWork(ThreadWorkType work_type)
 {
-	EnterCriticalSection(&s_renderCore.end_mutex);
+	//thread 0 has no os thread, its slice is drawn by whoever dispatches
+	RenderThread* own_thread = &s_renderCore.threads[0];
+
+	s_renderCore.work_type = work_type;
+	s_renderCore.render_ticks++;
+
+	JobBarrier_Dispatch(&s_renderCore.work_barrier, s_renderCore.num_threads - 1);
 
-	while (s_renderCore.threads_finished < s_renderCore.num_threads)
+	if (work_type != TWT__NONE && work_type != TWT__EXIT)
 	{
-		SleepConditionVariableCS(&s_renderCore.end_work_cv, &s_renderCore.end_mutex, INFINITE);
+		Render_DoThreadWork(own_thread, work_type);
 	}
 
-	LeaveCriticalSection(&s_renderCore.end_mutex);
-	s_renderCore.threads_finished = 0;
-}
+	//wait for all threads to finish
+	double wait_start_time = Time_GetSeconds();
 
-static void Render_SetWorkStateForAllThreads(ThreadWorkType work_type)
-{
-	//set start work event for all threads
-	EnterCriticalSection(&s_renderCore.start_mutex);
-	if (work_type == TWT__EXIT) s_renderCore.shutdown_threads = true;
-	s_renderCore.work_type = work_type;
-	s_renderCore.render_ticks++;
-	LeaveCriticalSection(&s_renderCore.start_mutex);
+	JobBarrier_WaitForArrivals(&s_renderCore.work_barrier);
 
-	WakeAllConditionVariable(&s_renderCore.start_work_cv);
+	own_thread->timings.idle_time += Time_GetSeconds() - wait_start_time;
 }
 
 static void Render_StallMainThread()
 {
-	EnterCriticalSection(&s_renderCore.main_thread_mutex);
+	Mutex_Lock(&s_renderCore.main_thread_mutex);
 	s_renderCore.stall_main_thread = true;
-	LeaveCriticalSection(&s_renderCore.main_thread_mutex);
+	Mutex_Unlock(&s_renderCore.main_thread_mutex);
 
-	WaitForSingleObject(s_renderCore.main_thread_standby_event, INFINITE);
+	Event_Wait(s_renderCore.main_thread_standby_event);
 }
 
 static void Render_ResumeMainThread()
 {
-	EnterCriticalSection(&s_renderCore.main_thread_mutex);
+	Mutex_Lock(&s_renderCore.main_thread_mutex);
 	s_renderCore.stall_main_thread = false;
-	LeaveCriticalSection(&s_renderCore.main_thread_mutex);
-	WakeConditionVariable(&s_renderCore.main_thread_cv);
+	Mutex_Unlock(&s_renderCore.main_thread_mutex);
+	CondVar_WakeOne(&s_renderCore.main_thread_cv);
 
-	WaitForSingleObject(s_renderCore.main_thread_active_event, INFINITE);
+	Event_Wait(s_renderCore.main_thread_active_event);
 }
 
-static void Render_SetThreadsStartAndEnd(int width, int height)
+static void Render_BalanceSlices()
 {
-	float num_threads = s_renderCore.num_threads;
-	int slice = ceil((float)width / num_threads);
-
-	int x_start = 0;
-	int x_end = slice;
+	int num_threads = s_renderCore.num_threads;
+	int width = s_renderCore.w;
+	int* bounds = s_renderCore.slice_bounds;
 
-	for (int i = 0; i < s_renderCore.num_threads; i++)
+	if (num_threads <= 1 || !bounds)
 	{
-		RenderThread* thr = &s_renderCore.threads[i];
+		return;
+	}
 
-		thr->x_start = x_start;
-		thr->x_end = x_end;
+	int min_width = min(MIN_SLICE_WIDTH, width / num_threads);
 
-		RenderUtl_Resize(&thr->render_data, width, height, thr->x_start, thr->x_end);
+	//use the level drawing times of the previous frame as cost, spread evenly over each slice
+	double total = 0;
 
-		x_start = x_end;
-		x_end += slice;
+	for (int i = 0; i < num_threads; i++)
+	{
+		RenderTimings* t = &s_renderCore.threads[i].timings;
 
-		x_start = Math_Clampl(x_start, 0, width);
-		x_end = Math_Clampl(x_end, 0, width);
+		total += t->lines_time + t->draw_segs_time + t->sprites_time;
 	}
 
-	printf("Render Thread Slice: %i\n", slice);
-}
+	if (total <= 0)
+	{
+		return;
+	}
 
-static bool Render_SetupGL(int width, int height)
-{
-	unsigned shader_id = 0;
+	double target = total / num_threads;
+	double acc = 0;
+	int k = 1;
 
-	//setup shaders
+	for (int i = 0; i < num_threads && k < num_threads; i++)
 	{
-		GLuint vertex_id, frag_id;
-		vertex_id = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertex_id, 1, &VERTEX_SHADER_SOURCE, NULL);
-		glCompileShader(vertex_id);
+		RenderThread* thr = &s_renderCore.threads[i];
+		RenderTimings* t = &thr->timings;
 
-		if (!Shader_checkCompileErrors(vertex_id, "Vertex"))
-		{
-			return false;
-		}
-		frag_id = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(frag_id, 1, &FRAGMENT_SHADER_SOURCE, NULL);
-		glCompileShader(frag_id);
+		double cost = t->lines_time + t->draw_segs_time + t->sprites_time;
+		int slice_width = thr->x_end - thr->x_start;
 
-		if (!Shader_checkCompileErrors(frag_id, "Fragment"))
+		//place every boundary that falls inside this slice
+		while (k < num_threads && acc + cost >= target * k)
 		{
-			return false;
+			double frac = (target * k - acc) / cost;
+
+			bounds[k++] = thr->x_start + (int)(frac * slice_width);
 		}
 
-		shader_id = glCreateProgram();
-		glAttachShader(shader_id, vertex_id);
-		glAttachShader(shader_id, frag_id);
+		acc += cost;
+	}
+
+	while (k < num_threads)
+	{
+		bounds[k++] = width;
+	}
+
+	//move only part of the way to avoid oscillating between frames
+	int x_start = 0;
+
+	for (int i = 0; i < num_threads; i++)
+	{
+		RenderThread* thr = &s_renderCore.threads[i];
+
+		int x_end = width;
+
+		if (i < num_threads - 1)
+		{
+			x_end = thr->x_end + (int)((bounds[i + 1] - thr->x_end) * SLICE_BALANCE_RATE);
+			x_end = Math_Clampl(x_end, x_start + min_width, width - (num_threads - i - 1) * min_width);
+		}
+
+		thr->x_start = x_start;
+		thr->x_end = x_end;
+
+		x_start = x_end;
+	}
+}
+
+static int Render_SetThreadSlices(int width)
+{
+	float num_threads = s_renderCore.num_threads;
+	int slice = ceil((float)width / num_threads);
+
+	int x_start = 0;
+	int x_end = slice;
+
+	for (int i = 0; i < s_renderCore.num_threads; i++)
+	{
+		RenderThread* thr = &s_renderCore.threads[i];
+
+		thr->x_start = x_start;
+		thr->x_end = x_end;
+
+		//old timings don't match the new slices
+		memset(&thr->timings, 0, sizeof(RenderTimings));
+
+		x_start = x_end;
+		x_end += slice;
+
+		x_start = Math_Clampl(x_start, 0, width);
+		x_end = Math_Clampl(x_end, 0, width);
+	}
+
+	return slice;
+}
+
+static void Render_SetThreadsStartAndEnd(int width, int height)
+{
+	int slice = Render_SetThreadSlices(width);
+
+	for (int i = 0; i < s_renderCore.num_threads; i++)
+	{
+		RenderThread* thr = &s_renderCore.threads[i];
+
+		RenderUtl_Resize(&thr->render_data, width, height, thr->x_start, thr->x_end);
+	}
+
+	//the visibility pass clips against the whole screen
+	RenderUtl_Resize(&s_renderCore.render_data, width, height, 0, width);
+
+	printf("Render Thread Slice: %i\n", slice);
+}
+
+static bool Render_SetupGL(int width, int height)
+{
+	unsigned shader_id = 0;
+
+	//setup shaders
+	{
+		GLuint vertex_id, frag_id;
+		vertex_id = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex_id, 1, &VERTEX_SHADER_SOURCE, NULL);
+		glCompileShader(vertex_id);
+
+		if (!Shader_checkCompileErrors(vertex_id, "Vertex"))
+		{
+			return false;
+		}
+		frag_id = glCreateShader(GL_FRAGMENT_SHADER);
+		glShaderSource(frag_id, 1, &FRAGMENT_SHADER_SOURCE, NULL);
+		glCompileShader(frag_id);
+
+		if (!Shader_checkCompileErrors(frag_id, "Fragment"))
+		{
+			return false;
+		}
+
+		shader_id = glCreateProgram();
+		glAttachShader(shader_id, vertex_id);
+		glAttachShader(shader_id, frag_id);
 
 		glLinkProgram(shader_id);
 		if (!Shader_checkCompileErrors(shader_id, "Program"))
@@ -589,7 +1023,11 @@ static bool Render_SetupGL(int width, int height)
 			1,  1, 1, 1,
 			1, -1, 1, 0,
 	};
-	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
+	//texture coordinates change with dynamic resolution
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_DYNAMIC_DRAW);
+
+	s_renderCore.quad_u = 1;
+	s_renderCore.quad_v = 1;
 
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (void*)0);
 	glEnableVertexAttribArray(0);
@@ -624,12 +1062,64 @@ void Render_WindowCallback(GLFWwindow* window, int width, int height)
 	Render_SizeChanged();
 }
 
-bool Render_Init(int width, int height, int scale)
+static void Render_SetupSync()
 {
-	memset(&s_renderCore, 0, sizeof(RenderCore));
+	JobBarrier_Init(&s_renderCore.work_barrier, RENDER_BARRIER_SPIN_COUNT);
 
-	Video_Setup();
+	ReaderWriterLockMutex_Init(&s_renderCore.reader_writer_object_mutex);
+	Mutex_Init(&s_renderCore.main_thread_mutex);
+	CondVar_Init(&s_renderCore.main_thread_cv);
+	s_renderCore.main_thread_active_event = Event_Create(true, false);
+	s_renderCore.main_thread_standby_event = Event_Create(true, false);
+
+	s_renderCore.packet_published_event = Event_Create(false, false);
+	s_renderCore.published_packet = 0;
+	s_renderCore.reading_packet = -1;
+	s_renderCore.frame_latency = DEFAULT_FRAME_LATENCY;
+}
+
+static bool Render_SetupThreads()
+{
+	int num_threads = QueryNumLogicalProcessors();
+
+	if (num_threads <= 0)
+	{
+		num_threads = 1;
+	}
+	s_renderCore.threads = calloc(num_threads, sizeof(RenderThread));
+	s_renderCore.slice_bounds = calloc(num_threads + 1, sizeof(int));
+
+	if (!s_renderCore.threads || !s_renderCore.slice_bounds)
+	{
+		return false;
+	}
+
+	for (int i = 0; i < num_threads; i++)
+	{
+		RenderThread* thr = &s_renderCore.threads[i];
+		thr->index = i;
+
+#ifdef SURFACE_CACHE
+		//each thread keeps its own blocks, so no locking while drawing
+		Surface_InitCache(&thr->render_data.surface_cache, SURFACE_CACHE_MAX_BYTES / num_threads);
+#endif // SURFACE_CACHE
+
+		//the dispatching thread does the work of the first one
+		if (i > 0)
+		{
+			thr->thread_handle = Thread_Create(Render_ThreadLoop, thr);
+		}
+	}
 
+	s_renderCore.num_threads = num_threads;
+
+	printf("Initialized Render Threads: %i \n", s_renderCore.num_threads);
+
+	return true;
+}
+
+static int Render_ClampScale(int scale)
+{
 	if (scale < 1)
 	{
 		scale = 1;
@@ -639,6 +1129,35 @@ bool Render_Init(int width, int height, int scale)
 		scale = MAX_RENDER_SCALE;
 	}
 
+	return scale;
+}
+
+static bool Render_SetupFramebufferLayout(int width, int height)
+{
+#ifdef COLUMN_MAJOR_FRAMEBUFFER
+	//walls, sky and sprites are drawn in columns, so keep each column contiguous and swizzle to rows once per frame
+	s_renderCore.framebuffer.is_collumn_stored = true;
+
+	if (!Image_Create(&s_renderCore.upload_buffer, width, height, 4))
+	{
+		return false;
+	}
+
+	printf("Framebuffer: column major \n");
+#endif // COLUMN_MAJOR_FRAMEBUFFER
+
+	return true;
+}
+
+#ifndef HEADLESS
+bool Render_Init(int width, int height, int scale)
+{
+	memset(&s_renderCore, 0, sizeof(RenderCore));
+
+	Video_Setup();
+
+	scale = Render_ClampScale(scale);
+
 	s_renderCore.scale = scale;
 
 	width *= scale;
@@ -646,7 +1165,7 @@ bool Render_Init(int width, int height, int scale)
 
 	if (!Render_SetupGL(width, height))
 	{
-		return;
+		return false;
 	}
 
 	if (!Text_LoadFont("assets/font/font.json", "assets/font/font.png", &s_renderCore.font_data))
@@ -659,6 +1178,11 @@ bool Render_Init(int width, int height, int scale)
 		return false;
 	}
 
+	if (!Render_SetupFramebufferLayout(width, height))
+	{
+		return false;
+	}
+
 	glfwMakeContextCurrent(NULL);
 
 	s_renderCore.win_w = width;
@@ -667,43 +1191,64 @@ bool Render_Init(int width, int height, int scale)
 	s_renderCore.hfov = 0.73;
 	s_renderCore.vfov = 0.25;
 
-	InitializeConditionVariable(&s_renderCore.start_work_cv);
-	InitializeCriticalSection(&s_renderCore.start_mutex);
+	Render_SetupSync();
 
-	InitializeConditionVariable(&s_renderCore.end_work_cv);
-	InitializeCriticalSection(&s_renderCore.end_mutex);
+	s_renderCore.main_thread_handle = Thread_Create(Render_MainThreadLoop, NULL);
 
-	ReaderWriterLockMutex_Init(&s_renderCore.reader_writer_object_mutex);
-	InitializeCriticalSection(&s_renderCore.main_thread_mutex);
-	InitializeConditionVariable(&s_renderCore.main_thread_cv);
-	s_renderCore.main_thread_active_event = CreateEvent(NULL, TRUE, FALSE, NULL);
-	s_renderCore.main_thread_standby_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (!Render_SetupThreads())
+	{
+		return false;
+	}
 
-	DWORD render_thread_id = 0;
-	s_renderCore.main_thread_handle = CreateThread(NULL, 0, Render_MainThreadLoop, NULL, 0, &render_thread_id);
+	Render_ResizeWindow(width, height);
 
-	int num_threads = QueryNumLogicalProcessors();
+	return true;
+}
+#endif // !HEADLESS
 
-	if (num_threads <= 0)
+bool Render_InitHeadless(int width, int height, int scale)
+{
+	memset(&s_renderCore, 0, sizeof(RenderCore));
+
+	Video_Setup();
+
+	//no window, gl context or main render thread, frames are drawn only into the framebuffer
+	s_renderCore.headless = true;
+
+	scale = Render_ClampScale(scale);
+
+	s_renderCore.scale = scale;
+
+	width *= scale;
+	height *= scale;
+
+	if (!Text_LoadFont("assets/font/font.json", "assets/font/font.png", &s_renderCore.font_data))
 	{
-		num_threads = 1;
+		return false;
 	}
-	s_renderCore.threads = calloc(num_threads, sizeof(RenderThread));
 
-	if (!s_renderCore.threads)
+	if (!Image_Create(&s_renderCore.framebuffer, width, height, 4))
 	{
 		return false;
 	}
 
-	for (int i = 0; i < num_threads; i++)
+	if (!Render_SetupFramebufferLayout(width, height))
 	{
-		RenderThread* thr = &s_renderCore.threads[i];
-		thr->thread_handle = CreateThread(NULL, 0, Render_ThreadLoop, thr, 0, &render_thread_id);
+		return false;
 	}
 
-	s_renderCore.num_threads = num_threads;
+	s_renderCore.win_w = width;
+	s_renderCore.win_h = height;
 
-	printf("Initialized Render Threads: %i \n", s_renderCore.num_threads);
+	s_renderCore.hfov = 0.73;
+	s_renderCore.vfov = 0.25;
+
+	Render_SetupSync();
+
+	if (!Render_SetupThreads())
+	{
+		return false;
+	}
 
 	Render_ResizeWindow(width, height);
 
@@ -713,44 +1258,53 @@ bool Render_Init(int width, int height, int scale)
 void Render_ShutDown()
 {
 	//wait for main thread to exit
-	s_renderCore.main_thread_shutdown = true;
-	WaitForSingleObject(s_renderCore.main_thread_handle, INFINITE);
-	CloseHandle(s_renderCore.main_thread_handle);
+	if (!s_renderCore.headless)
+	{
+		s_renderCore.main_thread_shutdown = true;
+		Thread_Join(s_renderCore.main_thread_handle);
+	}
 
 	//shut down render threads
-	Render_SetWorkStateForAllThreads(TWT__EXIT);
-	Render_WaitForAllThreads();
+	Render_RunWork(TWT__EXIT);
 
 	for (int i = 0; i < s_renderCore.num_threads; i++)
 	{
 		RenderThread* thr = &s_renderCore.threads[i];
 
-		WaitForSingleObject(thr->thread_handle, INFINITE);
-
-		CloseHandle(thr->thread_handle);
+		if (thr->thread_handle)
+		{
+			Thread_Join(thr->thread_handle);
+		}
 
 		RenderUtl_DestroyRenderData(&thr->render_data);
 	}
 
+	RenderUtl_DestroyRenderData(&s_renderCore.render_data);
+	RenderUtl_DestroyVisList(&s_renderCore.vis_list);
+
+	for (int i = 0; i < FRAME_PACKET_COUNT; i++)
+	{
+		RenderUtl_DestroyFramePacket(&s_renderCore.frame_packets[i]);
+	}
+
 	ReaderWriterLockMutex_Destruct(&s_renderCore.reader_writer_object_mutex);
-	DeleteCriticalSection(&s_renderCore.main_thread_mutex);
-	DeleteCriticalSection(&s_renderCore.start_mutex);
-	DeleteCriticalSection(&s_renderCore.end_mutex);
-	CloseHandle(s_renderCore.main_thread_active_event);
-	CloseHandle(s_renderCore.main_thread_standby_event);
+	Mutex_Destruct(&s_renderCore.main_thread_mutex);
+	CondVar_Destruct(&s_renderCore.main_thread_cv);
+	JobBarrier_Destruct(&s_renderCore.work_barrier);
+	Event_Destruct(s_renderCore.main_thread_active_event);
+	Event_Destruct(s_renderCore.main_thread_standby_event);
+	Event_Destruct(s_renderCore.packet_published_event);
 
 	Image_Destruct(&s_renderCore.framebuffer);
+	Image_Destruct(&s_renderCore.upload_buffer);
 	Image_Destruct(&s_renderCore.font_data.font_image);
 
 	if (s_renderCore.depth_buffer) free(s_renderCore.depth_buffer);
 	if (s_renderCore.clip_y_bottom) free(s_renderCore.clip_y_bottom);
 	if (s_renderCore.clip_y_top) free(s_renderCore.clip_y_top);
-	if (s_renderCore.floor_plane_ytop) free(s_renderCore.floor_plane_ytop);
-	if (s_renderCore.floor_plane_ybottom) free(s_renderCore.floor_plane_ybottom);
-	if (s_renderCore.ceil_plane_ytop) free(s_renderCore.ceil_plane_ytop);
-	if (s_renderCore.ceil_plane_ybottom) free(s_renderCore.ceil_plane_ybottom);
 	if (s_renderCore.yslopes) free(s_renderCore.yslopes);
 	if (s_renderCore.threads) free(s_renderCore.threads);
+	if (s_renderCore.slice_bounds) free(s_renderCore.slice_bounds);
 }
 
 void Render_LockObjectMutex(bool writer)
@@ -785,10 +1339,13 @@ void Render_FinishAndStall()
 		return;
 	}
 
-	Render_StallMainThread();
+	//no main thread to stall
+	if (!s_renderCore.headless)
+	{
+		Render_StallMainThread();
+	}
 
-	Render_SetWorkStateForAllThreads(TWT__NONE);
-	Render_WaitForAllThreads();
+	Render_RunWork(TWT__NONE);
 }
 
 void Render_Resume()
@@ -804,13 +1361,146 @@ void Render_Resume()
 
 void Render_QueueFullscreenShader(ShaderFun shader_fun)
 {
-	s_renderCore.fullscreen_shader_fun = shader_fun;
+	s_renderCore.pending_shader_fun = shader_fun;
+	s_renderCore.pending_shader_sequence = 0;
 }
 
 
 void Render_SetExtraLightFrame(Vec3_u16 extra_light)
 {
-	s_renderCore.extra_light = extra_light;
+	s_renderCore.pending_extra_light = extra_light;
+	s_renderCore.pending_light_sequence = 0;
+}
+
+static void Render_SetupYSlopes(int height)
+{
+	if (!s_renderCore.yslopes)
+	{
+		return;
+	}
+
+	for (int y = 0; y < height + 2; y++)
+	{
+		s_renderCore.yslopes[y] = ((height * s_renderCore.vfov) / ((height / 2.0 - ((float)y)) - 0.0 * height * s_renderCore.vfov));
+	}
+}
+
+static void Render_SetImageActiveSize(Image* img, int width, int height)
+{
+	//the data stays allocated for the max size, only the layout of the pixels changes
+	img->width = width;
+	img->height = height;
+	img->half_width = width / 2;
+	img->half_height = height / 2;
+}
+
+static void Render_SetActiveSize(int width, int height)
+{
+	Render_SetImageActiveSize(&s_renderCore.framebuffer, width, height);
+
+	if (s_renderCore.upload_buffer.data)
+	{
+		Render_SetImageActiveSize(&s_renderCore.upload_buffer, width, height);
+	}
+
+	Render_SetupYSlopes(height);
+
+	for (int i = 0; i < s_renderCore.num_threads; i++)
+	{
+		RenderUtl_SetActiveSize(&s_renderCore.threads[i].render_data, width, height);
+	}
+
+	RenderUtl_SetActiveSize(&s_renderCore.render_data, width, height);
+
+	Render_SetThreadSlices(width);
+
+	s_renderCore.w = width;
+	s_renderCore.h = height;
+}
+
+static void Render_UpdateDynamicResolution()
+{
+	if (s_renderCore.dynamic_res_target_ms <= 0 || s_renderCore.frame_time_ms <= 0)
+	{
+		return;
+	}
+
+	double frame_ms = s_renderCore.frame_time_ms;
+
+	if (s_renderCore.dynamic_res_avg_ms <= 0)
+	{
+		s_renderCore.dynamic_res_avg_ms = frame_ms;
+	}
+
+	s_renderCore.dynamic_res_avg_ms += (frame_ms - s_renderCore.dynamic_res_avg_ms) * DYNAMIC_RES_SMOOTHING;
+
+	//give the average some frames to settle after each step
+	if (s_renderCore.dynamic_res_cooldown > 0)
+	{
+		s_renderCore.dynamic_res_cooldown--;
+		return;
+	}
+
+	int percent = s_renderCore.dynamic_res_percent;
+
+	if (s_renderCore.dynamic_res_avg_ms > s_renderCore.dynamic_res_target_ms)
+	{
+		percent -= DYNAMIC_RES_STEP_PERCENT;
+	}
+	else if (s_renderCore.dynamic_res_avg_ms < s_renderCore.dynamic_res_target_ms * DYNAMIC_RES_HEADROOM)
+	{
+		percent += DYNAMIC_RES_STEP_PERCENT;
+	}
+
+	percent = Math_Clampl(percent, DYNAMIC_RES_MIN_PERCENT, 100);
+
+	if (percent != s_renderCore.dynamic_res_percent)
+	{
+		s_renderCore.dynamic_res_percent = percent;
+		s_renderCore.dynamic_res_cooldown = DYNAMIC_RES_COOLDOWN_FRAMES;
+	}
+}
+
+static void Render_ApplyDynamicResolution()
+{
+	Render_UpdateDynamicResolution();
+
+	int percent = (s_renderCore.dynamic_res_target_ms > 0) ? s_renderCore.dynamic_res_percent : 100;
+
+	//even sizes keep the half width and height exact
+	int width = ((s_renderCore.max_w * percent) / 100) & ~1;
+	int height = ((s_renderCore.max_h * percent) / 100) & ~1;
+
+	width = Math_Clampl(width, 2, s_renderCore.max_w);
+	height = Math_Clampl(height, 2, s_renderCore.max_h);
+
+	if (width != s_renderCore.w || height != s_renderCore.h)
+	{
+		Render_SetActiveSize(width, height);
+	}
+}
+
+static void Render_UpdateQuadTexCoords()
+{
+	//stop half a texel short, so the linear filter doesn't pick up the unused part of the texture
+	float u = (s_renderCore.w < s_renderCore.max_w) ? (s_renderCore.w - 0.5f) / (float)s_renderCore.max_w : 1.0f;
+	float v = (s_renderCore.h < s_renderCore.max_h) ? (s_renderCore.h - 0.5f) / (float)s_renderCore.max_h : 1.0f;
+
+	if (u == s_renderCore.quad_u && v == s_renderCore.quad_v)
+	{
+		return;
+	}
+
+	const float quad_vertices[16] =
+	{ -1, -1, 0, 0,
+			-1,  1, 0, v,
+			1,  1, u, v,
+			1, -1, u, 0,
+	};
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(quad_vertices), quad_vertices);
+
+	s_renderCore.quad_u = u;
+	s_renderCore.quad_v = v;
 }
 
 void Render_ResizeWindow(int width, int height)
@@ -820,6 +1510,11 @@ void Render_ResizeWindow(int width, int height)
 
 	Image_Resize(&s_renderCore.framebuffer, width, height);
 
+	if (s_renderCore.upload_buffer.data)
+	{
+		Image_Resize(&s_renderCore.upload_buffer, width, height);
+	}
+
 	if (s_renderCore.depth_buffer)
 	{
 		free(s_renderCore.depth_buffer);
@@ -848,31 +1543,23 @@ void Render_ResizeWindow(int width, int height)
 
 	s_renderCore.clip_y_top = calloc(width + 2, sizeof(short));
 
-	if (s_renderCore.floor_plane_ytop) free(s_renderCore.floor_plane_ytop);
-	s_renderCore.floor_plane_ytop = calloc(width + 2, sizeof(short));
-
-	if (s_renderCore.floor_plane_ybottom) free(s_renderCore.floor_plane_ybottom);
-	s_renderCore.floor_plane_ybottom = calloc(width + 2, sizeof(short));
-
-	if (s_renderCore.ceil_plane_ytop) free(s_renderCore.ceil_plane_ytop);
-	s_renderCore.ceil_plane_ytop = calloc(width + 2, sizeof(short));
-
-	if (s_renderCore.ceil_plane_ybottom) free(s_renderCore.ceil_plane_ybottom);
-	s_renderCore.ceil_plane_ybottom = calloc(width + 2, sizeof(short));
-
 	if (s_renderCore.span_end) free(s_renderCore.span_end);
 	s_renderCore.span_end = calloc(width + 2, sizeof(short));
 
 	if (s_renderCore.yslopes) free(s_renderCore.yslopes);
 	s_renderCore.yslopes = calloc(height + 2, sizeof(float));
 
-	for (int y = 0; y < height + 2; y++)
-	{
-		s_renderCore.yslopes[y] = ((height * s_renderCore.vfov) / ((height / 2.0 - ((float)y)) - 0.0 * height * s_renderCore.vfov));
-	}
+	Render_SetupYSlopes(height);
 
 	s_renderCore.w = width;
 	s_renderCore.h = height;
+	s_renderCore.max_w = width;
+	s_renderCore.max_h = height;
+
+	//start again from the full size
+	s_renderCore.dynamic_res_percent = 100;
+	s_renderCore.dynamic_res_avg_ms = 0;
+	s_renderCore.dynamic_res_cooldown = 0;
 
 	printf("Window size: %i W, %i H \n", s_renderCore.w, s_renderCore.h);
 
@@ -881,8 +1568,13 @@ void Render_ResizeWindow(int width, int height)
 	Render_Resume();
 }
 
-void Render_View(float x, float y, float z, float angle, float angleCos, float angleSin)
+static void Render_DrawView(float x, float y, float z, float angle, float angleCos, float angleSin)
 {
+	double start_time = Time_GetSeconds();
+
+	//the threads are idle between frames, so the active size can change here without a stall
+	Render_ApplyDynamicResolution();
+
 	GameState game_state = Game_GetState();
 
 	//store view information
@@ -895,20 +1587,24 @@ void Render_View(float x, float y, float z, float angle, float angleCos, float a
 
 	if (game_state == GS__LEVEL && Game_GetLevelIndex() >= 0)
 	{
-		//set work state for all threads to draw level
-		Render_SetWorkStateForAllThreads(TWT__DRAW_LEVEL);
+#if defined(RENDER_WORK_STEALING)
+		Render_SetupStripQueues();
+#elif !defined(DONT_BALANCE_SLICES)
+		//resize the slices based on how long each thread took last frame
+		Render_BalanceSlices();
+#endif
 
-		//wait for all threads to finish
-		Render_WaitForAllThreads();
+		//find what is potentially visible, once for all threads
+		Render_BuildVisList(Map_GetMap());
 
-		//set work state for all threads to draw hud
-		Render_SetWorkStateForAllThreads(TWT__DRAW_HUD);
+		//draw level, hud and shader in one go, this thread takes the first slice
+		Render_RunWork(TWT__DRAW_FRAME);
 
-		//wait for all threads to finish
-		Render_WaitForAllThreads();
+		//a sprite can be split over several strips, so whole sprite culls are counted once all of them are drawn
+		Render_CountCulledSprites();
 
 		//draw stuff like visual map
-		Game_Draw(&s_renderCore.framebuffer, &s_renderCore.font_data);
+		Game_Draw(&s_renderCore.framebuffer, &s_renderCore.font_data, s_renderCore.frame_packet);
 
 #ifdef DRAW_LIGHT_POINTS
 		Render_DrawLightPoints();
@@ -917,20 +1613,42 @@ void Render_View(float x, float y, float z, float angle, float angleCos, float a
 	}
 	else
 	{
-		Game_Draw(&s_renderCore.framebuffer, &s_renderCore.font_data);
+		Game_Draw(&s_renderCore.framebuffer, &s_renderCore.font_data, s_renderCore.frame_packet);
+	}
+
+	unsigned char* upload_data = s_renderCore.framebuffer.data;
+
+	if (s_renderCore.framebuffer.is_collumn_stored)
+	{
+		//gl wants rows, each thread swizzles its own slice
+		Render_RunWork(TWT__TRANSPOSE);
+
+		upload_data = s_renderCore.upload_buffer.data;
+	}
+
+	if (!s_renderCore.headless)
+	{
+		//only the active part of the max size texture is updated and stretched over the window
+		Render_UpdateQuadTexCoords();
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s_renderCore.w, s_renderCore.h, GL_RGBA, GL_UNSIGNED_BYTE, upload_data);
+
+		//render fullscreen quad
+		glClear(GL_COLOR_BUFFER_BIT);
+		glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 	}
 
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s_renderCore.w, s_renderCore.h, GL_RGBA, GL_UNSIGNED_BYTE, s_renderCore.framebuffer.data);
+	s_renderCore.frame_time_ms = (Time_GetSeconds() - start_time) * 1000.0;
+}
+
+void Render_View(float x, float y, float z, float angle, float angleCos, float angleSin)
+{
+	//sectors and sprites come from the newest packet, the view is the one given
+	Render_AcquireFramePacket();
 
-	//render fullscreen quad
-	glClear(GL_COLOR_BUFFER_BIT);
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	Render_DrawView(x, y, z, angle, angleCos, angleSin);
 
-	//reset stuff
-	Render_LockObjectMutex(true);
-	s_renderCore.fullscreen_shader_fun = NULL;
-	s_renderCore.extra_light = Vec3_u16_Zero();
-	Render_UnlockObjectMutex(true);
+	Render_ReleaseFramePacket();
 }
 
 void Render_GetWindowSize(int* r_width, int* r_height)
@@ -950,16 +1668,21 @@ int Render_GetRenderScale()
 	return s_renderCore.scale;
 }
 
+void Render_SetDynamicResolution(float target_ms)
+{
+	s_renderCore.dynamic_res_target_ms = max(target_ms, 0);
+	s_renderCore.dynamic_res_avg_ms = 0;
+	s_renderCore.dynamic_res_cooldown = 0;
+}
+
+float Render_GetDynamicResolution()
+{
+	return s_renderCore.dynamic_res_target_ms;
+}
+
 void Render_SetRenderScale(int scale)
 {
-	if (scale < 1)
-	{
-		scale = 1;
-	}
-	else if (scale > MAX_RENDER_SCALE)
-	{
-		scale = MAX_RENDER_SCALE;
-	}
+	scale = Render_ClampScale(scale);
 
 	s_renderCore.scale = scale;
 
@@ -984,16 +1707,18 @@ void Render_ToggleFullscreen()
 {
 	s_renderCore.is_fullscreen = !s_renderCore.is_fullscreen;
 
+#ifndef HEADLESS
 	GLFWwindow* window = Engine_GetWindow();
 
 	if (s_renderCore.is_fullscreen)
 	{
-		glfwSetWindowMonitor(window, glfwGetPrimaryMonitor(), 0, 0, s_renderCore.w, s_renderCore.h, GLFW_DONT_CARE);
+		glfwSetWindowMonitor(window, glfwGetPrimaryMonitor(), 0, 0, s_renderCore.max_w, s_renderCore.max_h, GLFW_DONT_CARE);
 	}
 	else
 	{
-		glfwSetWindowMonitor(window, NULL, 0, 0, s_renderCore.w, s_renderCore.h, GLFW_DONT_CARE);
+		glfwSetWindowMonitor(window, NULL, 0, 0, s_renderCore.max_w, s_renderCore.max_h, GLFW_DONT_CARE);
 	}
+#endif // !HEADLESS
 }
 
 int Render_GetTicks()
@@ -1005,3 +1730,98 @@ void Render_Clear(int c)
 {
 	Image_Clear(&s_renderCore.framebuffer, c);
 }
+
+void Render_PublishFramePacket(Map* map)
+{
+	AtomicInt published = s_renderCore.published_packet;
+	AtomicInt reading = s_renderCore.reading_packet;
+
+	//with three packets there is always one that is neither published nor being drawn
+	AtomicInt index = 0;
+
+	while (index == published || index == reading)
+	{
+		index++;
+	}
+
+	FramePacket* packet = &s_renderCore.frame_packets[index];
+
+	if (!RenderUtl_BuildFramePacket(packet, map))
+	{
+		return;
+	}
+
+	Player_GetView(&packet->view_x, &packet->view_y, &packet->view_z, NULL, &packet->view_angle);
+
+	Game_GetHudState(&packet->hud);
+	VisualMap_GetState(&packet->visual_map);
+
+	packet->sequence = ++s_renderCore.packet_sequence;
+
+	//the game loop can publish several packets before the render thread picks one up, so the flash and shader
+	//stay pending until a packet that carried them is drawn
+	unsigned drawn_sequence = s_renderCore.drawn_sequence;
+
+	if (s_renderCore.pending_light_sequence > 0 && drawn_sequence >= s_renderCore.pending_light_sequence)
+	{
+		s_renderCore.pending_extra_light = Vec3_u16_Zero();
+		s_renderCore.pending_light_sequence = 0;
+	}
+	if (s_renderCore.pending_shader_sequence > 0 && drawn_sequence >= s_renderCore.pending_shader_sequence)
+	{
+		s_renderCore.pending_shader_fun = NULL;
+		s_renderCore.pending_shader_sequence = 0;
+	}
+	if (s_renderCore.pending_light_sequence == 0 && (s_renderCore.pending_extra_light.r > 0 || s_renderCore.pending_extra_light.g > 0 || s_renderCore.pending_extra_light.b > 0))
+	{
+		s_renderCore.pending_light_sequence = packet->sequence;
+	}
+	if (s_renderCore.pending_shader_sequence == 0 && s_renderCore.pending_shader_fun)
+	{
+		s_renderCore.pending_shader_sequence = packet->sequence;
+	}
+
+	packet->extra_light = s_renderCore.pending_extra_light;
+	packet->extra_light_sequence = s_renderCore.pending_light_sequence;
+	packet->shader_fun = s_renderCore.pending_shader_fun;
+	packet->shader_sequence = s_renderCore.pending_shader_sequence;
+
+	Atomic_Exchange(&s_renderCore.published_packet, index);
+	Event_Set(s_renderCore.packet_published_event);
+}
+
+void Render_SetFrameLatency(int frames)
+{
+	s_renderCore.frame_latency = Math_Clampl(frames, 0, 1);
+}
+
+int Render_GetFrameLatency()
+{
+	return s_renderCore.frame_latency;
+}
+
+int Render_GetNumThreads()
+{
+	return s_renderCore.num_threads;
+}
+
+void Render_GetThreadTimings(int index, RenderTimings* dest)
+{
+	if (index < 0 || index >= s_renderCore.num_threads)
+	{
+		memset(dest, 0, sizeof(RenderTimings));
+		return;
+	}
+
+	*dest = s_renderCore.threads[index].timings;
+}
+
+double Render_GetVisListTime()
+{
+	return s_renderCore.vis_time;
+}
+
+int Render_GetSpritesCulled()
+{
+	return s_renderCore.sprites_culled;
+}
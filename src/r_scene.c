@@ -14,7 +14,29 @@ enum
 	BOXRIGHT
 };	// bbox coordinates
 
-static bool Scene_checkBBOX(DrawingArgs* args, int width, int height, float p_x, float p_y, float p_sin, float p_cos, float* bspcoord)
+typedef struct
+{
+	float fsz1, fsz2;
+	float u0, u1;
+	int x1, x2;
+} LineProjection;
+
+static bool Scene_IsRangeVisible(ClipSegments* clip, int first, int last)
+{
+	Cliprange* start = clip->solidsegs;
+	while (start->last < last)
+	{
+		start++;
+	}
+	if (first >= start->first && last <= start->last)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+static bool Scene_checkBBOX(DrawingArgs* args, int width, int height, float p_x, float p_y, float p_sin, float p_cos, float* bspcoord, int* r_sx1, int* r_sx2)
 {
 	//src adapted from https://github.com/ZDoom/gzdoom/blob/master/src/rendering/swrenderer/scene/r_opaque_pass.cpp#L338
 
@@ -64,6 +86,10 @@ static bool Scene_checkBBOX(DrawingArgs* args, int width, int height, float p_x,
 	}
 	boxpos = (boxy << 2) + boxx;
 
+	//whole screen, unless we can narrow it down
+	*r_sx1 = 0;
+	*r_sx2 = width;
+
 	if (boxpos == 5)
 	{
 		return true;
@@ -135,16 +161,14 @@ static bool Scene_checkBBOX(DrawingArgs* args, int width, int height, float p_x,
 
 	RenderData* render_data = args->render_data;
 
-	Cliprange* start = render_data->clip_segs.solidsegs;
-	while (start->last < sx2)
-	{
-		start++;
-	}
-	if (sx1 >= start->first && sx2 <= start->last)
+	if (!Scene_IsRangeVisible(&render_data->clip_segs, sx1, sx2))
 	{
 		return false;
 	}
 
+	*r_sx1 = sx1;
+	*r_sx2 = sx2;
+
 	return true;
 }
 
@@ -200,32 +224,40 @@ static bool Scene_IsLineSolid(Line* line, Sector* sector, Sector* backsector, fl
 	return false;
 }
 
-static DrawSeg* Scene_StoreDrawSeg(RenderData* render_data, DrawSegList* seg_list)
+static DrawSeg* Scene_StoreDrawSeg(RenderData* render_data, DrawSegList* seg_list, int first, int last)
 {
-	if (seg_list->index >= MAX_DRAWSEGS)
+	if (!Arena_GrowArray(&render_data->arena, (void**)&seg_list->segs, &seg_list->max_segs, seg_list->index + 1, sizeof(DrawSeg*)))
 	{
 		return NULL;
 	}
 
-	DrawSeg* seg = &seg_list->segs[seg_list->index++];
+	DrawSeg* seg = Arena_Alloc(&render_data->arena, sizeof(DrawSeg));
 
-	if (!seg->ranges)
+	if (!seg)
 	{
-		seg->ranges = calloc((render_data->slice_x_end - render_data->slice_x_start) + 32, sizeof(SegRange));
+		return NULL;
 	}
 
+	//one range for each column of the seg
+	seg->ranges = Arena_Alloc(&render_data->arena, sizeof(SegRange) * max(last - first, 1));
+
+	seg_list->segs[seg_list->index++] = seg;
+
 	return seg;
 }
 
-static void Scene_DrawPlane(Image* image, DrawPlane* plane, LineDrawArgs* args, int x1, int x2)
+static void Scene_DrawPlane(Image* image, DrawPlane* plane, LineDrawArgs* args)
 {
 	//adapted from https://github.com/ZDoom/gzdoom/blob/master/src/rendering/swrenderer/plane/r_planerenderer.cpp#L45
 
-	if (!plane->visible)
+	if (!plane->visible || plane->x1 >= plane->x2)
 	{
 		return;
 	}
 
+	int x1 = plane->x1;
+	int x2 = plane->x2;
+
 	if (plane->is_sky)
 	{
 		for (int x = x1; x < x2; x++)
@@ -253,19 +285,20 @@ static void Scene_DrawPlane(Image* image, DrawPlane* plane, LineDrawArgs* args,
 			int t = plane->ytop[x];
 			int b = plane->ybottom[x];
 
-			size_t index = (size_t)x + (size_t)(t) * (size_t)image->width;
+			size_t index = Image_PixelIndex(image, x, t);
+			size_t y_stride = Image_YStride(image);
 
 			for (int y = t; y < b; y++)
 			{
 				size_t i = index * 4;
 
-				image->data[index + 0] = 0;
-				image->data[index + 1] = 0;
-				image->data[index + 2] = 0;
+				image->data[i + 0] = 0;
+				image->data[i + 1] = 0;
+				image->data[i + 2] = 0;
 
 				depth_buff[index] = fabs(plane->viewheight * args->draw_args->yslope[y]);
 
-				index += image->width;
+				index += y_stride;
 			}
 		}
 
@@ -337,6 +370,238 @@ static void Scene_DrawPlane(Image* image, DrawPlane* plane, LineDrawArgs* args,
 
 }
 
+//plane positions only depend on the view, so the spans of a visplane are set up from the screen x alone
+static void Scene_SetupPlaneDrawArgs(Image* image, DrawingArgs* args, LineDrawArgs* r_args)
+{
+	memset(r_args, 0, sizeof(LineDrawArgs));
+
+	int x1 = 0;
+	int x2 = image->width;
+
+	float plane_angle = args->view_angle - Math_DegToRad(90.0);
+
+	float x_step = cos(plane_angle) / args->focal_length_x;
+	float y_step = -sin(plane_angle) / args->focal_length_x;
+
+	plane_angle += Math_PI / 2.0;
+
+	float plane_cos = cos(plane_angle);
+	float plane_sin = -sin(plane_angle);
+
+	float x = 0;
+
+	x = x2 - image->half_width + 0.5;
+
+	float right_x_pos = plane_cos + x * x_step;
+	float right_y_pos = plane_sin + x * y_step;
+
+	x = x1 - image->half_width + 0.5;
+
+	float left_x_pos = plane_cos + x * x_step;
+	float left_y_pos = plane_sin + x * y_step;
+
+	r_args->x1 = x1;
+	r_args->x2 = x2;
+
+	r_args->plane_base_pos_x = left_x_pos;
+	r_args->plane_base_pos_y = left_y_pos;
+
+	r_args->plane_step_scale_x = (right_x_pos - left_x_pos) / (x2 - x1);
+	r_args->plane_step_scale_y = (right_y_pos - left_y_pos) / (x2 - x1);
+
+	r_args->plane_angle = args->view_angle - Math_DegToRad(90);
+
+	r_args->sky_plane_y_step = 1.0 / (float)args->v_fov;
+	r_args->sky_plane_y_step *= VIEW_FOV / 90.0;
+
+	r_args->draw_args = args;
+}
+
+static void Scene_DrawVisPlane(Image* image, DrawPlane* plane, LineDrawArgs* plane_args)
+{
+	plane_args->sector = plane->sector;
+
+	Scene_DrawPlane(image, plane, plane_args);
+}
+
+static DrawPlane* Scene_NewVisPlane(RenderData* render_data)
+{
+	VisPlaneList* list = &render_data->visplanes;
+
+	if (!Arena_GrowArray(&render_data->arena, (void**)&list->planes, &list->max_planes, list->index + 1, sizeof(DrawPlane*)))
+	{
+		return NULL;
+	}
+
+	DrawPlane* plane = Arena_Alloc(&render_data->arena, sizeof(DrawPlane));
+
+	if (!plane)
+	{
+		return NULL;
+	}
+
+	plane->ytop = Arena_Alloc(&render_data->arena, sizeof(short) * (render_data->width + 2));
+	plane->ybottom = Arena_Alloc(&render_data->arena, sizeof(short) * (render_data->width + 2));
+
+	if (!plane->ytop || !plane->ybottom)
+	{
+		return NULL;
+	}
+
+	list->planes[list->index++] = plane;
+
+	plane->x1 = 0;
+	plane->x2 = 0;
+	plane->visible = false;
+
+	return plane;
+}
+
+static DrawPlane* Scene_FindVisPlane(RenderData* render_data, Texture* texture, Lightmap* lightmap, Sector* sector, float viewheight, int light, bool is_sky)
+{
+	if (!texture)
+	{
+		return NULL;
+	}
+
+	//the sky looks the same at any height and light
+	if (is_sky)
+	{
+		viewheight = 0;
+		light = 0;
+		lightmap = NULL;
+	}
+	//without lightmap data, planes of different sectors can merge
+	else if (lightmap && !lightmap->data)
+	{
+		lightmap = NULL;
+	}
+
+	VisPlaneList* list = &render_data->visplanes;
+
+	for (int i = 0; i < list->index; i++)
+	{
+		DrawPlane* plane = list->planes[i];
+
+		if (plane->texture == texture && plane->lightmap == lightmap && plane->viewheight == viewheight && plane->light == light && plane->is_sky == is_sky)
+		{
+			return plane;
+		}
+	}
+
+	DrawPlane* plane = Scene_NewVisPlane(render_data);
+
+	if (!plane)
+	{
+		return NULL;
+	}
+
+	plane->texture = texture;
+	plane->lightmap = lightmap;
+	plane->sector = sector;
+	plane->viewheight = viewheight;
+	plane->light = light;
+	plane->is_sky = is_sky;
+
+	return plane;
+}
+
+//makes room for the columns first to last, a plane can only take columns that none of its drawn ones overlap
+static DrawPlane* Scene_CheckVisPlane(Image* image, DrawingArgs* args, DrawPlane* plane, int first, int last)
+{
+	if (!plane)
+	{
+		return NULL;
+	}
+
+	//empty
+	if (plane->x1 >= plane->x2)
+	{
+		plane->x1 = first;
+		plane->x2 = last;
+
+		return plane;
+	}
+
+	int overlap_x1 = max(plane->x1, first);
+	int overlap_x2 = min(plane->x2, last);
+
+	bool overlaps = false;
+
+	for (int x = overlap_x1; x < overlap_x2; x++)
+	{
+		if (plane->ytop[x] < plane->ybottom[x])
+		{
+			overlaps = true;
+			break;
+		}
+	}
+
+	if (!overlaps)
+	{
+		//columns between the two ranges don't belong to any seg
+		for (int x = plane->x2; x < first; x++)
+		{
+			plane->ytop[x] = 0;
+			plane->ybottom[x] = 0;
+		}
+		for (int x = last; x < plane->x1; x++)
+		{
+			plane->ytop[x] = 0;
+			plane->ybottom[x] = 0;
+		}
+
+		plane->x1 = min(plane->x1, first);
+		plane->x2 = max(plane->x2, last);
+
+		return plane;
+	}
+
+	RenderData* render_data = args->render_data;
+	DrawPlane* new_plane = Scene_NewVisPlane(render_data);
+
+	if (new_plane)
+	{
+		new_plane->texture = plane->texture;
+		new_plane->lightmap = plane->lightmap;
+		new_plane->sector = plane->sector;
+		new_plane->viewheight = plane->viewheight;
+		new_plane->light = plane->light;
+		new_plane->is_sky = plane->is_sky;
+		new_plane->x1 = first;
+		new_plane->x2 = last;
+
+		return new_plane;
+	}
+
+	//no memory for another plane, the columns gathered so far are final so draw them now and reuse the plane
+	LineDrawArgs plane_args;
+	Scene_SetupPlaneDrawArgs(image, args, &plane_args);
+	Scene_DrawVisPlane(image, plane, &plane_args);
+
+	plane->x1 = first;
+	plane->x2 = last;
+	plane->visible = false;
+
+	return plane;
+}
+
+static void Scene_DrawVisPlanes(Image* image, DrawingArgs* args)
+{
+	RenderData* render_data = args->render_data;
+	VisPlaneList* list = &render_data->visplanes;
+
+	LineDrawArgs plane_args;
+	Scene_SetupPlaneDrawArgs(image, args, &plane_args);
+
+	for (int i = 0; i < list->index; i++)
+	{
+		Scene_DrawVisPlane(image, list->planes[i], &plane_args);
+	}
+
+	list->index = 0;
+}
+
 static void Scene_DrawDrawSeg(Image* image, float* depth_buffer, DrawSeg* seg)
 {
 	if (!seg->visible)
@@ -441,6 +706,25 @@ static void Scene_DrawDrawSeg(Image* image, float* depth_buffer, DrawSeg* seg)
 	}
 }
 
+static SurfaceDesc* Scene_SetupWallSurface(SurfaceDesc* surface, RenderData* render_data, SurfaceType type, Linedef* linedef, Sector* sector)
+{
+	//no cache for this thread
+	if (render_data->surface_cache.max_blocks <= 0)
+	{
+		return NULL;
+	}
+
+	memset(surface, 0, sizeof(SurfaceDesc));
+
+	//texture, lightmap and offsets are filled in per column
+	surface->type = type;
+	surface->index = linedef->index;
+	surface->light_level = sector->light_level;
+	surface->cache = &render_data->surface_cache;
+
+	return surface;
+}
+
 void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 {
 	//lay it out on the stack
@@ -461,8 +745,6 @@ void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 	Texture* top_texture = sidedef->top_texture;
 	Texture* mid_texture = sidedef->middle_texture;
 	Texture* bot_texture = sidedef->bottom_texture;
-	Texture* floor_texture = sector->floor_texture;
-	Texture* ceil_texture = sector->ceil_texture;
 
 	int mid_height_mask = 0;
 
@@ -499,17 +781,24 @@ void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 	float x_pos2 = fabs(args->x2 - first);
 	float texheight = (args->sector_height) * 0.5;
 
-	DrawPlane* floor_plane = &render_data->floor_plane;
-	DrawPlane* ceil_plane = &render_data->ceil_plane;
+	DrawPlane* floor_plane = Scene_CheckVisPlane(image, draw_args, args->floor_plane, first, last);
+	DrawPlane* ceil_plane = Scene_CheckVisPlane(image, draw_args, args->ceil_plane, first, last);
+
+	//later ranges of the same line continue in the planes picked here
+	args->floor_plane = floor_plane;
+	args->ceil_plane = ceil_plane;
 
-	ceil_plane->is_sky = sector->is_sky;
+	SurfaceDesc top_surface_desc, mid_surface_desc, bot_surface_desc;
+	SurfaceDesc* top_surface = Scene_SetupWallSurface(&top_surface_desc, render_data, SURF__WALL_TOP, linedef, sector);
+	SurfaceDesc* mid_surface = Scene_SetupWallSurface(&mid_surface_desc, render_data, SURF__WALL_MIDDLE, linedef, sector);
+	SurfaceDesc* bot_surface = Scene_SetupWallSurface(&bot_surface_desc, render_data, SURF__WALL_BOTTOM, linedef, sector);
 
 	DrawSeg* draw_seg = NULL;
 
 	//check for middle texture
 	if (is_backsector && sidedef->middle_texture)
 	{
-		draw_seg = Scene_StoreDrawSeg(render_data, &render_data->draw_segs);
+		draw_seg = Scene_StoreDrawSeg(render_data, &render_data->draw_segs, first, last);
 		if (draw_seg)
 		{
 			draw_seg->first = first;
@@ -559,7 +848,7 @@ void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 		wall_light.g = Math_Clampl(wall_light.g - depth_shade_scale, 0, MAX_LIGHT_VALUE);
 		wall_light.b = Math_Clampl(wall_light.b - depth_shade_scale, 0, MAX_LIGHT_VALUE);
 
-		if (ceil_texture)
+		if (ceil_plane)
 		{
 			ceil_plane->ytop[x] = ctop;
 			ceil_plane->ybottom[x] = c_yceil;
@@ -569,7 +858,7 @@ void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 				ceil_plane->visible = true;
 			}
 		}
-		if (floor_texture)
+		if (floor_plane)
 		{
 			floor_plane->ytop[x] = c_yfloor;
 			floor_plane->ybottom[x] = cbot;
@@ -603,7 +892,7 @@ void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 					mask = top_texture->height_mask;
 				}
 
-				Video_DrawWallCollumn(image, args->draw_args->depth_buffer, top_texture, x, c_yceil, c_back_yceil, depth, tx, ty_pos, ty_step, lx, ly_pos, wall_light, mask, &linedef->lightmap);
+				Video_DrawWallCollumn(image, args->draw_args->depth_buffer, top_texture, x, c_yceil, c_back_yceil, depth, tx, ty_pos, ty_step, lx, ly_pos, wall_light, mask, &linedef->lightmap, top_surface);
 			}
 
 			if (bot_texture)
@@ -626,7 +915,7 @@ void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 				
 				ty_pos += sidedef->y_offset;
 				
-				Video_DrawWallCollumn(image, args->draw_args->depth_buffer, bot_texture, x, c_back_yfloor, c_yfloor, depth, tx, ty_pos, ty_step, lx, ly_pos, wall_light, bot_texture->height_mask, &linedef->lightmap);
+				Video_DrawWallCollumn(image, args->draw_args->depth_buffer, bot_texture, x, c_back_yfloor, c_yfloor, depth, tx, ty_pos, ty_step, lx, ly_pos, wall_light, bot_texture->height_mask, &linedef->lightmap, bot_surface);
 			}
 			
 			if (!args->is_both_sky)
@@ -661,7 +950,7 @@ void Scene_DrawLineSeg(Image* image, int first, int last, LineDrawArgs* args)
 				ty_pos -= texheight;
 			}		
 
-			Video_DrawWallCollumn(image, args->draw_args->depth_buffer, mid_texture, x, c_yceil, c_yfloor, depth, tx, ty_pos, ty_step, lx, ly_pos, wall_light, mid_height_mask, &linedef->lightmap);
+			Video_DrawWallCollumn(image, args->draw_args->depth_buffer, mid_texture, x, c_yceil, c_yfloor, depth, tx, ty_pos, ty_step, lx, ly_pos, wall_light, mid_height_mask, &linedef->lightmap, mid_surface);
 		}
 
 		x_pos++;
@@ -760,7 +1049,7 @@ crunch:
 		}
 	}
 }
-bool Scene_RenderLine(Image* image, Map* map, Sector* sector, Line* line, DrawingArgs* args)
+static bool Scene_ProjectLine(Image* image, Line* line, DrawingArgs* args, LineProjection* r_proj)
 {
 	//clipping parts adapted from https://github.com/ZDoom/gzdoom/blob/master/src/rendering/swrenderer/line/r_wallsetup.cpp#L52
 	float vx2 = line->x0 - args->view_x;
@@ -789,8 +1078,6 @@ bool Scene_RenderLine(Image* image, Map* map, Sector* sector, Line* line, Drawin
 	float tanZ1 = vx1 * args->tan_cos + vy1 * args->tan_sin;
 	float tanZ2 = vx2 * args->tan_cos + vy2 * args->tan_sin;
 
-	float texwidth = line->width_scale * 2.00;
-
 	float u0 = 0;
 	float u1 = 1;
 
@@ -841,14 +1128,40 @@ bool Scene_RenderLine(Image* image, Map* map, Sector* sector, Line* line, Drawin
 		return false;
 	}
 
-	int x1 = Math_RoundToInt(fsx1);
-	int x2 = Math_RoundToInt(fsx2);
+	r_proj->x1 = Math_RoundToInt(fsx1);
+	r_proj->x2 = Math_RoundToInt(fsx2);
+	r_proj->fsz1 = fsz1;
+	r_proj->fsz2 = fsz2;
+	r_proj->u0 = u0;
+	r_proj->u1 = u1;
+
+	return true;
+}
+
+bool Scene_RenderLine(Image* image, Map* map, Sector* sector, Line* line, DrawingArgs* args)
+{
+	LineProjection proj;
+
+	if (!Scene_ProjectLine(image, line, args, &proj))
+	{
+		return false;
+	}
+
+	int x1 = proj.x1;
+	int x2 = proj.x2;
 
 	//not visible
 	if (x1 >= x2 || x2 <= args->start_x || x1 >= args->end_x)
 	{
 		return false;
 	}
+
+	float fsz1 = proj.fsz1;
+	float fsz2 = proj.fsz2;
+	float u0 = proj.u0;
+	float u1 = proj.u1;
+
+	float texwidth = line->width_scale * 2.00;
 	
 	Linedef* linedef = line->linedef;
 
@@ -898,49 +1211,27 @@ bool Scene_RenderLine(Image* image, Map* map, Sector* sector, Line* line, Drawin
 	float xl = 1.0 / fabs(x2 - x1);
 
 	Sector* backsector = NULL;
+	Sector backsector_state;
 
 	if (line->back_sector >= 0)
 	{
-		backsector = &map->sectors[line->back_sector];
+		//heights and light come from the frame packet, not the sector the game thread is updating
+		backsector_state = map->sectors[line->back_sector];
+		RenderUtl_ApplyFramePacketSector(args->frame_packet, &backsector_state);
+
+		backsector = &backsector_state;
 	}
 
-	tz1 = fsz1;
-	tz2 = fsz2;
+	float tz1 = fsz1;
+	float tz2 = fsz2;
 
 	RenderData* render_data = args->render_data;
 
 	//setup planes
-	DrawPlane* floor_plane = &render_data->floor_plane;
-	DrawPlane* ceil_plane = &render_data->ceil_plane;
-
-	floor_plane->lightmap = &sector->floor_lightmap;
-	floor_plane->light = sector->light_level;
-	floor_plane->visible = false;
-	floor_plane->is_sky = false;
-	floor_plane->texture = sector->floor_texture;
-	floor_plane->viewheight = yfloor;
-
-	floor_plane->ytop = args->floor_plane_ytop;
-	floor_plane->ybottom = args->floor_plane_ybottom;
-
-	ceil_plane->lightmap = &sector->ceil_lightmap;
-	ceil_plane->light = sector->light_level;
-	ceil_plane->visible = false;
-	ceil_plane->is_sky = false;
-	ceil_plane->texture = sector->ceil_texture;
-	ceil_plane->viewheight = yceil;
-
-	ceil_plane->ytop = args->ceil_plane_ytop;
-	ceil_plane->ybottom = args->ceil_plane_ybottom;
-	
-	for (int x = args->start_x; x < args->end_x; x++)
-	{
-		floor_plane->ytop[x] = 0;
-		floor_plane->ybottom[x] = 0;
+	Sector* map_sector = &map->sectors[sector->index];
 
-		ceil_plane->ytop[x] = 0;
-		ceil_plane->ybottom[x] = 0;
-	}
+	DrawPlane* floor_plane = Scene_FindVisPlane(render_data, sector->floor_texture, &map_sector->floor_lightmap, map_sector, yfloor, sector->light_level, false);
+	DrawPlane* ceil_plane = Scene_FindVisPlane(render_data, sector->ceil_texture, &map_sector->ceil_lightmap, map_sector, yceil, sector->light_level, sector->is_sky);
 
 	//setup line draw ags
 	LineDrawArgs line_draw_args;
@@ -963,42 +1254,8 @@ bool Scene_RenderLine(Image* image, Map* map, Sector* sector, Line* line, Drawin
 	line_draw_args.world_bottom = yfloor;
 	line_draw_args.world_top = yceil;
 	line_draw_args.lowest_ceilling = sector->floor;
-
-	//for floor and ceil plane rendering
-	{
-		float plane_angle = args->view_angle - Math_DegToRad(90.0);
-
-		float x_step = cos(plane_angle) / args->focal_length_x;
-		float y_step = -sin(plane_angle) / args->focal_length_x;
-
-		plane_angle += Math_PI / 2.0;
-
-		float plane_cos = cos(plane_angle);
-		float plane_sin = -sin(plane_angle);
-
-		float x = 0;
-
-		x = x2 - image->half_width + 0.5;
-
-		float right_x_pos = plane_cos + x * x_step;
-		float right_y_pos = plane_sin + x * y_step;
-
-		x = x1 - image->half_width + 0.5;
-
-		float left_x_pos = plane_cos + x * x_step;
-		float left_y_pos = plane_sin + x * y_step;
-
-		line_draw_args.plane_base_pos_x = left_x_pos;
-		line_draw_args.plane_base_pos_y = left_y_pos;
-
-		line_draw_args.plane_step_scale_x = (right_x_pos - left_x_pos) / (x2 - x1);
-		line_draw_args.plane_step_scale_y = (right_y_pos - left_y_pos) / (x2 - x1);
-
-		line_draw_args.plane_angle = args->view_angle - Math_DegToRad(90);
-
-		line_draw_args.sky_plane_y_step = 1.0 / (float)args->v_fov;
-		line_draw_args.sky_plane_y_step *= VIEW_FOV / 90.0;
-	}
+	line_draw_args.floor_plane = floor_plane;
+	line_draw_args.ceil_plane = ceil_plane;
 
 	if (backsector)
 	{
@@ -1050,84 +1307,98 @@ bool Scene_RenderLine(Image* image, Map* map, Sector* sector, Line* line, Drawin
 		Scene_ClipAndDraw(&render_data->clip_segs, begin_x, end_x, true, &line_draw_args, image);
 	}
 
-	//draw floor plane
-	Scene_DrawPlane(image, floor_plane, &line_draw_args, begin_x, end_x);
+	return true;
+}
 
-	//draw ceil plane
-	Scene_DrawPlane(image, ceil_plane, &line_draw_args, begin_x, end_x);
+static void Scene_AddSubsectorSprites(Subsector* sub_sector, DrawingArgs* args)
+{
+	int sector_index = sub_sector->sector->index;
 
-	return true;
+	if (RenderUtl_CheckVisitedSectorBitset(args->render_data, sector_index))
+	{
+		return;
+	}
+
+	//add the sector sprites from the frame packet to queue, to be drawn later on
+	RenderUtl_AddSnapshotSpritesToQueue(args->render_data, (args->frame_packet) ? &args->frame_packet->sprites : NULL, sector_index);
+
+	RenderUtl_SetVisitedSectorBitset(args->render_data, sector_index);
 }
 
-void Scene_ProcessSubsector(Image* image, Map* map, Subsector* sub_sector, DrawingArgs* args)
+static void Scene_AddVisSubsector(Image* image, Map* map, int subsector_index, DrawingArgs* args, VisList* vis_list, int x1, int x2)
 {
-	if (!RenderUtl_CheckVisitedSectorBitset(args->render_data, sub_sector->sector->index))
+	if (vis_list->num_subsectors >= vis_list->max_subsectors)
 	{
-		Render_LockObjectMutex(false);
+		return;
+	}
 
-		Sector* sector = sub_sector->sector;
+	Subsector* sub_sector = &map->sub_sectors[subsector_index];
+	RenderData* render_data = args->render_data;
+	ClipSegments* clip = &render_data->clip_segs;
 
-		int light = sector->light_level;
+	VisSubsector* vis_sub = &vis_list->subsectors[vis_list->num_subsectors++];
+	vis_sub->subsector_index = subsector_index;
+	vis_sub->seg_offset = vis_list->num_segs;
+	vis_sub->x1 = x1;
+	vis_sub->x2 = x2;
 
-		//add object sprites to queue, to be drawn later on
-		Object* obj = sector->object_list;
+	//keep sector info on the stack
+	Sector sector = *sub_sector->sector;
+	RenderUtl_ApplyFramePacketSector(args->frame_packet, &sector);
 
-		while (obj)
-		{
-			Sprite* sprite = &obj->sprite;
+	for (int i = 0; i < sub_sector->num_lines; i++)
+	{
+		int line_index = sub_sector->line_offset + i;
+		Line* line = &map->line_segs[line_index];
 
-			RenderUtl_AddSpriteToQueue(args->render_data, sprite, light, args->extra_light, obj->type == OT__DECAL);
+		LineProjection proj;
 
-			obj = obj->sector_next;
+		if (!Scene_ProjectLine(image, line, args, &proj))
+		{
+			continue;
 		}
 
-		//also add additional sprites that can cross multiple sectors
-		if (sector->render_object_list && sector->sorted_render_object_list && Object_Pool_UsedSize(sector->render_object_list) > 0)
-		{
-			int num = dA_size(sector->sorted_render_object_list);
-			int added_sprites = 0;
+		int begin_x = max(proj.x1, args->start_x);
+		int end_x = min(proj.x2, args->end_x);
 
-			for (int i = 0; i < num; i++)
-			{
-				ObjectID* id = dA_at(sector->sorted_render_object_list, i);
+		//fully hidden behind already clipped solid segs
+		if (begin_x >= end_x || !Scene_IsRangeVisible(clip, begin_x, end_x))
+		{
+			continue;
+		}
 
-				if (*id < 0)
-				{
-					continue;
-				}
+		bool is_solid = true;
 
-				Object* obj = Map_GetObject(*id);
-				Sprite* sprite = &obj->sprite;
+		if (line->back_sector >= 0)
+		{
+			Sector backsector = map->sectors[line->back_sector];
+			RenderUtl_ApplyFramePacketSector(args->frame_packet, &backsector);
 
-				RenderUtl_AddSpriteToQueue(args->render_data, sprite, light, args->extra_light, obj->type == OT__DECAL);
+			float yscale1 = args->v_fov * (1.0 / proj.fsz1);
+			float yscale2 = args->v_fov * (1.0 / proj.fsz2);
 
-				added_sprites++;
+			float yceil = sector.r_ceil - args->view_z;
+			float yfloor = sector.r_floor - args->view_z;
+			float ybacksector_ceil = backsector.r_ceil - args->view_z;
+			float ybacksector_floor = backsector.r_floor - args->view_z;
 
-				if (added_sprites >= sector->render_object_list->used_pool_size)
-				{
-					break;
-				}
-			}
+			is_solid = Scene_IsLineSolid(line, &sector, &backsector, yfloor * yscale1, yceil * yscale1, yfloor * yscale2, yceil * yscale2, 
+				ybacksector_floor * yscale1, ybacksector_ceil * yscale1, ybacksector_floor * yscale2, ybacksector_ceil * yscale2);
 		}
 
-		Render_UnlockObjectMutex(false);
+		VisSeg* vis_seg = &vis_list->segs[vis_list->num_segs++];
+		vis_seg->line_index = line_index;
+		vis_seg->vis_subsector = vis_list->num_subsectors - 1;
+		vis_seg->x1 = begin_x;
+		vis_seg->x2 = end_x;
 
-		RenderUtl_SetVisitedSectorBitset(args->render_data, sub_sector->sector->index);
+		Scene_ClipAndDraw(clip, begin_x, end_x, is_solid, NULL, NULL);
 	}
 
-	//keep sector info on the stack
-	Sector sector = *sub_sector->sector;
-
-	//render line segments
-	for (int i = 0; i < sub_sector->num_lines; i++)
-	{
-		Line* line = &map->line_segs[sub_sector->line_offset + i];
-
-		Scene_RenderLine(image, map, &sector, line, args);
-	}
+	vis_sub->num_segs = vis_list->num_segs - vis_sub->seg_offset;
 }
 
-int Scene_ProcessBSPNode(Image* image, Map* map, int node_index, DrawingArgs* args)
+int Scene_BuildVisList(Image* image, Map* map, int node_index, DrawingArgs* args, VisList* vis_list, int x1, int x2)
 {
 	if (node_index & MF__NODE_SUBSECTOR)
 	{
@@ -1139,9 +1410,8 @@ int Scene_ProcessBSPNode(Image* image, Map* map, int node_index, DrawingArgs* ar
 		{
 			node_index &= ~MF__NODE_SUBSECTOR;
 		}
-		Subsector* subsector = &map->sub_sectors[node_index];
 
-		Scene_ProcessSubsector(image, map, subsector, args);
+		Scene_AddVisSubsector(image, map, node_index, args, vis_list, x1, x2);
 
 		return 1;
 	}
@@ -1151,23 +1421,238 @@ int Scene_ProcessBSPNode(Image* image, Map* map, int node_index, DrawingArgs* ar
 	BSPNode* node = &map->bsp_nodes[node_index];
 
 	int side = BSP_GetNodeSide(node, args->view_x, args->view_y);
-	total += Scene_ProcessBSPNode(image, map, node->children[side], args);
+	total += Scene_BuildVisList(image, map, node->children[side], args, vis_list, x1, x2);
 
 	side = side ^ 1;
 
-	if(Scene_checkBBOX(args, image->width, image->height, args->view_x, args->view_y, args->view_sin, args->view_cos, node->bbox[side]))
+	//the far side inherits the screen range of its bounding box
+	int sx1 = 0;
+	int sx2 = 0;
+
+	if(Scene_checkBBOX(args, image->width, image->height, args->view_x, args->view_y, args->view_sin, args->view_cos, node->bbox[side], &sx1, &sx2))
 	{
-		total += Scene_ProcessBSPNode(image, map, node->children[side], args);
+		total += Scene_BuildVisList(image, map, node->children[side], args, vis_list, sx1, sx2);
 	}
 
 	return total;
 }
 
+void Scene_BinVisSegs(Image* image, VisList* vis_list, RenderData* render_data)
+{
+	int num_bins = (image->width + RENDER_STRIP_WIDTH - 1) / RENDER_STRIP_WIDTH;
+	int num_bin_segs = 0;
+
+	for (int i = 0; i < vis_list->num_segs; i++)
+	{
+		VisSeg* vis_seg = &vis_list->segs[i];
+
+		num_bin_segs += (vis_seg->x2 - 1) / RENDER_STRIP_WIDTH - vis_seg->x1 / RENDER_STRIP_WIDTH + 1;
+	}
+
+	vis_list->seg_bin_offsets = Arena_Alloc(&render_data->arena, sizeof(int) * (num_bins + 1));
+	vis_list->bin_segs = Arena_Alloc(&render_data->arena, sizeof(int) * max(num_bin_segs, 1));
+
+	if (!vis_list->seg_bin_offsets || !vis_list->bin_segs)
+	{
+		//the strips walk the whole list instead
+		vis_list->seg_bin_offsets = NULL;
+		vis_list->bin_segs = NULL;
+		return;
+	}
+
+	//same counting as the sprite bins, filling backwards keeps every bin front to back
+	memset(vis_list->seg_bin_offsets, 0, sizeof(int) * (num_bins + 1));
+
+	for (int i = 0; i < vis_list->num_segs; i++)
+	{
+		VisSeg* vis_seg = &vis_list->segs[i];
+
+		for (int bin = vis_seg->x1 / RENDER_STRIP_WIDTH; bin <= (vis_seg->x2 - 1) / RENDER_STRIP_WIDTH; bin++)
+		{
+			vis_list->seg_bin_offsets[bin]++;
+		}
+	}
+	for (int bin = 1; bin <= num_bins; bin++)
+	{
+		vis_list->seg_bin_offsets[bin] += vis_list->seg_bin_offsets[bin - 1];
+	}
+	for (int i = vis_list->num_segs - 1; i >= 0; i--)
+	{
+		VisSeg* vis_seg = &vis_list->segs[i];
+
+		for (int bin = vis_seg->x1 / RENDER_STRIP_WIDTH; bin <= (vis_seg->x2 - 1) / RENDER_STRIP_WIDTH; bin++)
+		{
+			vis_list->bin_segs[--vis_list->seg_bin_offsets[bin]] = i;
+		}
+	}
+}
+
+void Scene_BuildVisSprites(Image* image, Map* map, VisList* vis_list, DrawingArgs* args)
+{
+	RenderData* render_data = args->render_data;
+
+	vis_list->num_sprites = 0;
+
+	//queue the sprites of every sector the walk reached, front to back
+	for (int i = 0; i < vis_list->num_subsectors; i++)
+	{
+		VisSubsector* vis_sub = &vis_list->subsectors[i];
+
+		Scene_AddSubsectorSprites(&map->sub_sectors[vis_sub->subsector_index], args);
+	}
+
+	vis_list->sprites = Arena_Alloc(&render_data->arena, sizeof(VisSprite) * max(render_data->num_draw_sprites, 1));
+
+	if (!vis_list->sprites)
+	{
+		return;
+	}
+
+	//project them once for all threads
+	int num_bin_sprites = 0;
+
+	for (int i = 0; i < render_data->num_draw_sprites; i++)
+	{
+		DrawSprite* sprite = &render_data->draw_sprites[i];
+		VisSprite* vis = &vis_list->sprites[vis_list->num_sprites];
+
+		bool visible = (sprite->decal_line_index >= 0) ? Video_ProjectDecalSprite(image, args, sprite, vis) : Video_ProjectSprite(image, args, sprite, vis);
+
+		if (!visible)
+		{
+			continue;
+		}
+
+		//decal ends are rounded from the clipped line, keep them on the screen for the bins
+		vis->x1 = max(vis->x1, 0);
+		vis->x2 = min(vis->x2, image->width);
+
+		if (vis->x1 >= vis->x2)
+		{
+			continue;
+		}
+
+		vis->column_culled = false;
+		vis->column_drawn = false;
+
+		num_bin_sprites += (vis->x2 - 1) / RENDER_STRIP_WIDTH - vis->x1 / RENDER_STRIP_WIDTH + 1;
+		vis_list->num_sprites++;
+	}
+
+	int num_bins = (image->width + RENDER_STRIP_WIDTH - 1) / RENDER_STRIP_WIDTH;
+
+	vis_list->bin_offsets = Arena_Alloc(&render_data->arena, sizeof(int) * (num_bins + 1));
+	vis_list->bin_sprites = Arena_Alloc(&render_data->arena, sizeof(int) * max(num_bin_sprites, 1));
+
+	if (!vis_list->bin_offsets || !vis_list->bin_sprites)
+	{
+		vis_list->num_sprites = 0;
+		return;
+	}
+
+	//count the sprites of each bin, then make the counts into end offsets
+	memset(vis_list->bin_offsets, 0, sizeof(int) * (num_bins + 1));
+
+	for (int i = 0; i < vis_list->num_sprites; i++)
+	{
+		VisSprite* vis = &vis_list->sprites[i];
+
+		for (int bin = vis->x1 / RENDER_STRIP_WIDTH; bin <= (vis->x2 - 1) / RENDER_STRIP_WIDTH; bin++)
+		{
+			vis_list->bin_offsets[bin]++;
+		}
+	}
+	for (int bin = 1; bin <= num_bins; bin++)
+	{
+		vis_list->bin_offsets[bin] += vis_list->bin_offsets[bin - 1];
+	}
+
+	//filling backwards moves each offset to the start of its bin and keeps the sprites in draw order
+	for (int i = vis_list->num_sprites - 1; i >= 0; i--)
+	{
+		VisSprite* vis = &vis_list->sprites[i];
+
+		for (int bin = vis->x1 / RENDER_STRIP_WIDTH; bin <= (vis->x2 - 1) / RENDER_STRIP_WIDTH; bin++)
+		{
+			vis_list->bin_sprites[--vis_list->bin_offsets[bin]] = i;
+		}
+	}
+
+	vis_list->num_bins = num_bins;
+}
+
+static void Scene_DrawVisBin(Image* image, Map* map, VisList* vis_list, DrawingArgs* args, int bin)
+{
+	int vis_subsector = -1;
+	Sector sector;
+
+	for (int i = vis_list->seg_bin_offsets[bin]; i < vis_list->seg_bin_offsets[bin + 1]; i++)
+	{
+		VisSeg* vis_seg = &vis_list->segs[vis_list->bin_segs[i]];
+
+		//the segs of a subsector are next to each other, so the sector is only copied when it changes
+		if (vis_seg->vis_subsector != vis_subsector)
+		{
+			vis_subsector = vis_seg->vis_subsector;
+
+			sector = *map->sub_sectors[vis_list->subsectors[vis_subsector].subsector_index].sector;
+			RenderUtl_ApplyFramePacketSector(args->frame_packet, &sector);
+		}
+
+		Scene_RenderLine(image, map, &sector, &map->line_segs[vis_seg->line_index], args);
+	}
+}
+
+void Scene_DrawVisList(Image* image, Map* map, VisList* vis_list, DrawingArgs* args)
+{
+	int first_bin = args->start_x / RENDER_STRIP_WIDTH;
+	int last_bin = (args->end_x - 1) / RENDER_STRIP_WIDTH;
+
+	//a strip only walks its own bin, wider slices walk the whole list so segs over several bins stay front to back and are drawn once
+	if (vis_list->bin_segs && first_bin == last_bin)
+	{
+		Scene_DrawVisBin(image, map, vis_list, args, first_bin);
+		Scene_DrawVisPlanes(image, args);
+		return;
+	}
+
+	for (int i = 0; i < vis_list->num_subsectors; i++)
+	{
+		VisSubsector* vis_sub = &vis_list->subsectors[i];
+		Subsector* sub_sector = &map->sub_sectors[vis_sub->subsector_index];
+
+		if (vis_sub->num_segs <= 0)
+		{
+			continue;
+		}
+
+		//keep sector info on the stack
+		Sector sector = *sub_sector->sector;
+		RenderUtl_ApplyFramePacketSector(args->frame_packet, &sector);
+
+		//render line segments that overlap our slice
+		for (int k = 0; k < vis_sub->num_segs; k++)
+		{
+			VisSeg* vis_seg = &vis_list->segs[vis_sub->seg_offset + k];
+
+			if (vis_seg->x2 <= args->start_x || vis_seg->x1 >= args->end_x)
+			{
+				continue;
+			}
+
+			Scene_RenderLine(image, map, &sector, &map->line_segs[vis_seg->line_index], args);
+		}
+	}
+
+	//floors and ceilings are drawn once the walk is done, a row of a plane is one span no matter how many segs it was seen through
+	Scene_DrawVisPlanes(image, args);
+}
+
 void Scene_DrawDrawSegs(Image* image, DrawSegList* seg_list, float* depth_buffer, DrawingArgs* args)
 {
 	for (int i = 0; i < seg_list->index; i++)
 	{
-		DrawSeg* seg = &seg_list->segs[i];
+		DrawSeg* seg = seg_list->segs[i];
 
 		Scene_DrawDrawSeg(image, depth_buffer, seg);
 	}
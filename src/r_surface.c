@@ -0,0 +1,212 @@
+#include "r_common.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "g_common.h"
+
+#define SURFACE_BLOCK_BYTES (SURFACE_BLOCK_SIZE * SURFACE_BLOCK_SIZE * 4)
+
+//bumped when the map or its lightmaps change, every block built before is stale
+static int s_surfaceGeneration = 1;
+
+static uint64_t Surface_MakeKey(SurfaceType type, int mip_level, int index, int bx, int by)
+{
+	return ((uint64_t)mip_level << 60) | ((uint64_t)type << 56) | ((uint64_t)(index & 0xFFFFFF) << 32) | ((uint64_t)(uint16_t)bx << 16) | (uint64_t)(uint16_t)by;
+}
+
+static int Surface_HashKey(SurfaceCache* cache, uint64_t key)
+{
+	return (int)((key * 0x9E3779B97F4A7C15ull) >> 32) & cache->bucket_mask;
+}
+
+static void Surface_LRURemove(SurfaceCache* cache, int index)
+{
+	SurfaceBlock* block = &cache->blocks[index];
+
+	if (block->lru_prev != NULL_INDEX) cache->blocks[block->lru_prev].lru_next = block->lru_next;
+	else cache->lru_head = block->lru_next;
+
+	if (block->lru_next != NULL_INDEX) cache->blocks[block->lru_next].lru_prev = block->lru_prev;
+	else cache->lru_tail = block->lru_prev;
+
+	block->lru_prev = NULL_INDEX;
+	block->lru_next = NULL_INDEX;
+}
+
+static void Surface_LRUPushFront(SurfaceCache* cache, int index)
+{
+	SurfaceBlock* block = &cache->blocks[index];
+
+	block->lru_prev = NULL_INDEX;
+	block->lru_next = cache->lru_head;
+
+	if (cache->lru_head != NULL_INDEX) cache->blocks[cache->lru_head].lru_prev = index;
+	else cache->lru_tail = index;
+
+	cache->lru_head = index;
+}
+
+static void Surface_HashRemove(SurfaceCache* cache, int index)
+{
+	SurfaceBlock* block = &cache->blocks[index];
+	int* link = &cache->buckets[Surface_HashKey(cache, block->key)];
+
+	while (*link != NULL_INDEX)
+	{
+		if (*link == index)
+		{
+			*link = block->hash_next;
+			break;
+		}
+
+		link = &cache->blocks[*link].hash_next;
+	}
+
+	block->hash_next = NULL_INDEX;
+}
+
+static bool Surface_IsBlockValid(SurfaceBlock* block, SurfaceDesc* desc)
+{
+	//the light offset of some wall parts wobbles with screen rounding, a texel of light shift is not visible
+	return block->generation == s_surfaceGeneration && block->texture == desc->texture && block->mip_level == desc->mip_level && block->lightmap_data == desc->lightmap->data
+		&& block->light_level == desc->light_level && block->x_offset == desc->x_offset && block->height_mask == desc->height_mask
+		&& abs(block->light_offset - desc->light_offset) <= 1;
+}
+
+static void Surface_StoreDesc(SurfaceBlock* block, SurfaceDesc* desc)
+{
+	block->generation = s_surfaceGeneration;
+	block->texture = desc->texture;
+	block->mip_level = desc->mip_level;
+	block->lightmap_data = desc->lightmap->data;
+	block->light_level = desc->light_level;
+	block->x_offset = desc->x_offset;
+	block->height_mask = desc->height_mask;
+	block->light_offset = desc->light_offset;
+}
+
+bool Surface_InitCache(SurfaceCache* cache, size_t max_bytes)
+{
+	memset(cache, 0, sizeof(SurfaceCache));
+
+	int max_blocks = (int)(max_bytes / SURFACE_BLOCK_BYTES);
+
+	if (max_blocks <= 0)
+	{
+		return false;
+	}
+
+	int num_buckets = 1;
+
+	while (num_buckets < max_blocks * 2)
+	{
+		num_buckets <<= 1;
+	}
+
+	cache->blocks = calloc(max_blocks, sizeof(SurfaceBlock));
+	cache->texel_memory = malloc((size_t)max_blocks * SURFACE_BLOCK_BYTES);
+	cache->buckets = malloc(sizeof(int) * num_buckets);
+
+	if (!cache->blocks || !cache->texel_memory || !cache->buckets)
+	{
+		printf("Surface cache: out of memory \n");
+		Surface_DestroyCache(cache);
+		return false;
+	}
+
+	for (int i = 0; i < num_buckets; i++)
+	{
+		cache->buckets[i] = NULL_INDEX;
+	}
+	for (int i = 0; i < max_blocks; i++)
+	{
+		SurfaceBlock* block = &cache->blocks[i];
+
+		block->hash_next = NULL_INDEX;
+		block->lru_prev = NULL_INDEX;
+		block->lru_next = NULL_INDEX;
+		block->texels = cache->texel_memory + (size_t)i * SURFACE_BLOCK_BYTES;
+	}
+
+	cache->max_blocks = max_blocks;
+	cache->bucket_mask = num_buckets - 1;
+	cache->lru_head = NULL_INDEX;
+	cache->lru_tail = NULL_INDEX;
+
+	return true;
+}
+
+void Surface_DestroyCache(SurfaceCache* cache)
+{
+	if (cache->blocks) free(cache->blocks);
+	if (cache->texel_memory) free(cache->texel_memory);
+	if (cache->buckets) free(cache->buckets);
+
+	memset(cache, 0, sizeof(SurfaceCache));
+}
+
+void Surface_InvalidateAll()
+{
+	s_surfaceGeneration++;
+}
+
+SurfaceBlock* Surface_FindBlock(SurfaceCache* cache, SurfaceDesc* desc, int bx, int by, bool* r_build)
+{
+	uint64_t key = Surface_MakeKey(desc->type, desc->mip_level, desc->index, bx, by);
+	int bucket = Surface_HashKey(cache, key);
+
+	for (int i = cache->buckets[bucket]; i != NULL_INDEX; i = cache->blocks[i].hash_next)
+	{
+		SurfaceBlock* block = &cache->blocks[i];
+
+		if (block->key != key)
+		{
+			continue;
+		}
+
+		if (cache->lru_head != i)
+		{
+			Surface_LRURemove(cache, i);
+			Surface_LRUPushFront(cache, i);
+		}
+
+		*r_build = !Surface_IsBlockValid(block, desc);
+
+		if (*r_build)
+		{
+			Surface_StoreDesc(block, desc);
+		}
+
+		return block;
+	}
+
+	//take a free block, or evict the least recently used one
+	int index = NULL_INDEX;
+
+	if (cache->num_blocks < cache->max_blocks)
+	{
+		index = cache->num_blocks++;
+	}
+	else
+	{
+		index = cache->lru_tail;
+
+		Surface_HashRemove(cache, index);
+		Surface_LRURemove(cache, index);
+	}
+
+	SurfaceBlock* block = &cache->blocks[index];
+
+	block->key = key;
+	block->hash_next = cache->buckets[bucket];
+	cache->buckets[bucket] = index;
+
+	Surface_LRUPushFront(cache, index);
+	Surface_StoreDesc(block, desc);
+
+	*r_build = true;
+
+	return block;
+}
@@ -0,0 +1,225 @@
+#include "r_common.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "g_common.h"
+#include "game_info.h"
+#include "utility.h"
+#include "u_math.h"
+
+#define TIMEDEMO_WARMUP_FRAMES 16
+#define TIMEDEMO_FRAMES_PER_STOP 120
+
+static int Timedemo_CompareFrameTimes(const void* a, const void* b)
+{
+	double t0 = *(const double*)a;
+	double t1 = *(const double*)b;
+
+	if (t0 < t1) return -1;
+	if (t0 > t1) return 1;
+
+	return 0;
+}
+
+static void Timedemo_GetCamera(Map* map, int frame, int num_frames, float* r_x, float* r_y, float* r_z, float* r_angle)
+{
+	//the path makes a full turn at each stop, first stop is the spawn point and the rest are spread evenly over the subsectors
+	int num_stops = max(num_frames / TIMEDEMO_FRAMES_PER_STOP, 1);
+	int stop = min(frame / TIMEDEMO_FRAMES_PER_STOP, num_stops - 1);
+	int stop_frame = frame % TIMEDEMO_FRAMES_PER_STOP;
+
+	float x = map->player_spawn_point_x;
+	float y = map->player_spawn_point_y;
+	float angle = map->player_spawn_rot;
+
+	if (stop > 0 && map->num_sub_sectors > 0)
+	{
+		Subsector* sub_sector = &map->sub_sectors[(stop * map->num_sub_sectors) / num_stops];
+
+		//subsectors are convex, so the average of the seg points is inside
+		x = 0;
+		y = 0;
+
+		for (int i = 0; i < sub_sector->num_lines; i++)
+		{
+			Line* line = &map->line_segs[sub_sector->line_offset + i];
+
+			x += line->x0;
+			y += line->y0;
+		}
+
+		if (sub_sector->num_lines > 0)
+		{
+			x /= sub_sector->num_lines;
+			y /= sub_sector->num_lines;
+		}
+	}
+
+	angle += ((float)stop_frame / (float)TIMEDEMO_FRAMES_PER_STOP) * Math_DegToRad(360);
+
+	float z = 0;
+	Sector* sector = Map_FindSector(x, y);
+
+	if (sector)
+	{
+		z = min(sector->floor + PLAYER_HEIGHT, sector->ceil - 1);
+	}
+
+	*r_x = x;
+	*r_y = y;
+	*r_z = z;
+	*r_angle = angle;
+}
+
+bool Render_Timedemo(int level_index, int num_frames)
+{
+	if (num_frames <= 0)
+	{
+		return false;
+	}
+
+	int num_levels = sizeof(LEVELS) / sizeof(LEVELS[0]);
+	level_index = Math_Clampl(level_index, 0, num_levels - 1);
+
+	int num_threads = Render_GetNumThreads();
+
+	double* frame_times = calloc(num_frames, sizeof(double));
+	RenderTimings* thread_timings = calloc(num_threads, sizeof(RenderTimings));
+
+	if (!frame_times || !thread_timings)
+	{
+		if (frame_times) free(frame_times);
+		if (thread_timings) free(thread_timings);
+		return false;
+	}
+
+	//loads the map through Map_LoadFromIndex and spawns the player for the hud
+	if (!Game_ChangeLevel(level_index, false))
+	{
+		free(frame_times);
+		free(thread_timings);
+		return false;
+	}
+
+	Game_SetState(GS__LEVEL);
+
+	Map* map = Map_GetMap();
+
+	int render_w = 0;
+	int render_h = 0;
+	Render_GetRenderSize(&render_w, &render_h);
+
+	printf("Timedemo: level %i, %i frames, %i x %i, %i threads\n", Game_GetLevelIndex(), num_frames, render_w, render_h, num_threads);
+
+#ifdef LIGHT_FIXED_POINT
+	printf("Light: fixed point\n");
+#else
+	printf("Light: lut\n");
+#endif // LIGHT_FIXED_POINT
+
+	float x, y, z, angle;
+	double vis_time = 0;
+	int sprites_culled = 0;
+
+	for (int i = 0; i < TIMEDEMO_WARMUP_FRAMES; i++)
+	{
+		Timedemo_GetCamera(map, 0, num_frames, &x, &y, &z, &angle);
+		Render_View(x, y, z, angle, cos(angle), sin(angle));
+	}
+
+	for (int i = 0; i < num_frames; i++)
+	{
+		Timedemo_GetCamera(map, i, num_frames, &x, &y, &z, &angle);
+
+		double start_time = Time_GetSeconds();
+
+		Render_View(x, y, z, angle, cos(angle), sin(angle));
+
+		frame_times[i] = (Time_GetSeconds() - start_time) * 1000.0;
+		vis_time += Render_GetVisListTime();
+		sprites_culled += Render_GetSpritesCulled();
+
+		for (int k = 0; k < num_threads; k++)
+		{
+			RenderTimings timings;
+			Render_GetThreadTimings(k, &timings);
+
+			thread_timings[k].lines_time += timings.lines_time;
+			thread_timings[k].draw_segs_time += timings.draw_segs_time;
+			thread_timings[k].sprites_time += timings.sprites_time;
+			thread_timings[k].hud_time += timings.hud_time;
+			thread_timings[k].total_time += timings.total_time;
+			thread_timings[k].idle_time += timings.idle_time;
+			thread_timings[k].strips_drawn += timings.strips_drawn;
+			thread_timings[k].strips_stolen += timings.strips_stolen;
+			thread_timings[k].sprite_columns_culled += timings.sprite_columns_culled;
+			thread_timings[k].sprite_columns_drawn += timings.sprite_columns_drawn;
+		}
+	}
+
+	//frame stats
+	double total = 0;
+
+	for (int i = 0; i < num_frames; i++)
+	{
+		total += frame_times[i];
+	}
+
+	qsort(frame_times, num_frames, sizeof(double), Timedemo_CompareFrameTimes);
+
+	int p99_index = Math_Clampl((int)ceil(num_frames * 0.99) - 1, 0, num_frames - 1);
+
+	printf("Frame ms: min %.3f, avg %.3f, p99 %.3f, max %.3f\n", frame_times[0], total / num_frames, frame_times[p99_index], frame_times[num_frames - 1]);
+
+	//per thread and per phase stats, all in average ms per frame
+	double to_ms = 1000.0 / num_frames;
+	RenderTimings phase_total;
+	memset(&phase_total, 0, sizeof(phase_total));
+
+	printf("Visibility pass ms: %.3f\n", vis_time * to_ms);
+	printf("Thread ms:   lines  segs    sprites hud     total   idle    strips steals\n");
+
+	for (int i = 0; i < num_threads; i++)
+	{
+		RenderTimings* t = &thread_timings[i];
+
+		printf("%2i:       %7.3f %7.3f %7.3f %7.3f %7.3f %7.3f %6i %6i\n", i, t->lines_time * to_ms, t->draw_segs_time * to_ms, t->sprites_time * to_ms, t->hud_time * to_ms, t->total_time * to_ms, 
+			t->idle_time * to_ms, t->strips_drawn, t->strips_stolen);
+
+		phase_total.lines_time += t->lines_time;
+		phase_total.draw_segs_time += t->draw_segs_time;
+		phase_total.sprites_time += t->sprites_time;
+		phase_total.hud_time += t->hud_time;
+		phase_total.total_time += t->total_time;
+		phase_total.idle_time += t->idle_time;
+		phase_total.strips_drawn += t->strips_drawn;
+		phase_total.strips_stolen += t->strips_stolen;
+		phase_total.sprite_columns_culled += t->sprite_columns_culled;
+		phase_total.sprite_columns_drawn += t->sprite_columns_drawn;
+	}
+
+	to_ms /= num_threads;
+
+	printf("avg:      %7.3f %7.3f %7.3f %7.3f %7.3f %7.3f\n", phase_total.lines_time * to_ms, phase_total.draw_segs_time * to_ms, phase_total.sprites_time * to_ms, phase_total.hud_time * to_ms, phase_total.total_time * to_ms,
+		phase_total.idle_time * to_ms);
+
+	if (phase_total.strips_drawn > 0)
+	{
+		printf("Strips stolen: %i of %i (%.1f%%)\n", phase_total.strips_stolen, phase_total.strips_drawn, 100.0 * phase_total.strips_stolen / phase_total.strips_drawn);
+	}
+
+	int sprite_columns = phase_total.sprite_columns_culled + phase_total.sprite_columns_drawn;
+
+	if (sprite_columns > 0)
+	{
+		printf("Sprite columns culled: %i of %i (%.1f%%), whole sprites culled: %i\n", phase_total.sprite_columns_culled, sprite_columns, 100.0 * phase_total.sprite_columns_culled / sprite_columns,
+			sprites_culled);
+	}
+
+	free(frame_times);
+	free(thread_timings);
+
+	return true;
+}
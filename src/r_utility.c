@@ -41,8 +41,21 @@ void RenderUtl_SetupRenderData(RenderData* data, int width, int x_start, int x_e
 		memset(data->visited_sectors_bitset, 0, sizeof(uint64_t) * data->bitset_size);
 	}
 
+	//last frame's draw segs, sprites and visplanes are all released here
+	Arena_Reset(&data->arena);
+
+	data->draw_sprites = NULL;
 	data->num_draw_sprites = 0;
+	data->max_draw_sprites = 0;
+	data->draw_segs.segs = NULL;
 	data->draw_segs.index = 0;
+	data->draw_segs.max_segs = 0;
+	data->visplanes.planes = NULL;
+	data->visplanes.index = 0;
+	data->visplanes.max_planes = 0;
+	data->coarse_depth_valid = false;
+	data->sprite_columns_culled = 0;
+	data->sprite_columns_drawn = 0;
 
 	RenderUtl_ResetClip(&data->clip_segs, 0, width);
 
@@ -74,42 +87,56 @@ void RenderUtl_Resize(RenderData* data, int width, int height, int x_start, int
 	}
 
 	data->span_end = calloc(height + 2, sizeof(short));
-	data->clip_segs.solidsegs = calloc((x_end - x_start) + 32, sizeof(Cliprange));
+
+	if (data->span_scratch) free(data->span_scratch);
+	if (data->span_depth_scratch) free(data->span_depth_scratch);
+
+	data->span_scratch = calloc(width + 2, 4);
+	data->span_depth_scratch = calloc(width + 2, sizeof(float));
+
+	if (data->coarse_depth) free(data->coarse_depth);
+
+	data->coarse_depth_rows = (height + (1 << COARSE_DEPTH_SHIFT) - 1) >> COARSE_DEPTH_SHIFT;
+	data->coarse_depth = calloc((size_t)(width + 2) * data->coarse_depth_rows, sizeof(float));
+	data->coarse_depth_valid = false;
+	data->clip_segs.solidsegs = calloc(width + 32, sizeof(Cliprange));
 
 	data->slice_x_start = x_start;
 	data->slice_x_end = x_end;
+	data->width = width;
+}
 
-	//just free the ranges, we will allocate when we actually need the draw seg
-	for (int i = 0; i < MAX_DRAWSEGS; i++)
-	{
-		DrawSeg* seg = &data->draw_segs.segs[i];
-
-		if (seg->ranges)
-		{
-			free(seg->ranges);
-			seg->ranges = NULL;
-		}
-	}
+void RenderUtl_SetActiveSize(RenderData* data, int width, int height)
+{
+	//the buffers were made for a size at least this big by RenderUtl_Resize
+	data->coarse_depth_rows = (height + (1 << COARSE_DEPTH_SHIFT) - 1) >> COARSE_DEPTH_SHIFT;
+	data->coarse_depth_valid = false;
+	data->width = width;
 }
 
 void RenderUtl_DestroyRenderData(RenderData* data)
 {
 	if (data->visited_sectors_bitset) free(data->visited_sectors_bitset);
 	if (data->span_end) free(data->span_end);
+	if (data->span_scratch) free(data->span_scratch);
+	if (data->span_depth_scratch) free(data->span_depth_scratch);
+	if (data->coarse_depth) free(data->coarse_depth);
 	if (data->clip_segs.solidsegs) free(data->clip_segs.solidsegs);
 
+	Surface_DestroyCache(&data->surface_cache);
+
 	data->visited_sectors_bitset = NULL;
+	data->span_scratch = NULL;
+	data->span_depth_scratch = NULL;
+	data->coarse_depth = NULL;
 
-	for (int i = 0; i < MAX_DRAWSEGS; i++)
-	{
-		DrawSeg* seg = &data->draw_segs.segs[i];
+	Arena_Destroy(&data->arena);
 
-		if (seg->ranges)
-		{
-			free(seg->ranges);
-			seg->ranges = NULL;
-		}
-	}
+	data->draw_sprites = NULL;
+	data->num_draw_sprites = 0;
+	data->max_draw_sprites = 0;
+	memset(&data->draw_segs, 0, sizeof(DrawSegList));
+	memset(&data->visplanes, 0, sizeof(VisPlaneList));
 }
 
 bool RenderUtl_CheckVisitedSectorBitset(RenderData* data, int sector)
@@ -142,20 +169,8 @@ void RenderUtl_SetVisitedSectorBitset(RenderData* data, int sector)
 	data->visited_sectors_bitset[mask_index] |= mask;
 }
 
-void RenderUtl_AddSpriteToQueue(RenderData* data, Sprite* sprite, int sector_light, Vec3_u16 extra_light, bool is_decal)
+void RenderUtl_SpriteToDrawSprite(DrawSprite* dest, Sprite* sprite, int sector_light, bool is_decal)
 {
-	if (data->num_draw_sprites >= MAX_DRAWSPRITES)
-	{
-		return;
-	}
-
-	assert(sprite->img);
-
-	if (!sprite->img)
-	{
-		return;
-	}
-
 	const int h_frames = sprite->img->h_frames;
 	const int v_frames = sprite->img->v_frames;
 
@@ -176,24 +191,273 @@ void RenderUtl_AddSpriteToQueue(RenderData* data, Sprite* sprite, int sector_lig
 	light.b = sector_light;
 #endif
 
-
 	//Convert to draw sprite
-	DrawSprite* draw_sprite = &data->draw_sprites[data->num_draw_sprites++];
-	memset(draw_sprite, 0, sizeof(DrawSprite));
-
-	draw_sprite->frame = sprite->frame + (sprite->frame_offset_x) + (sprite->frame_offset_y * sprite->img->h_frames);
-	draw_sprite->img = sprite->img;
-	draw_sprite->x = sprite->x + sprite->offset_x;
-	draw_sprite->y = sprite->y + sprite->offset_y;
-	draw_sprite->z = sprite->z + sprite->offset_z;
-	draw_sprite->scale_x = sprite->scale_x;
-	draw_sprite->scale_y = sprite->scale_y;
-	draw_sprite->frame_offset_x = sprite_offset_x;
-	draw_sprite->frame_offset_y = sprite_offset_y;
-	draw_sprite->sprite_rect_width = sprite_rect_width;
-	draw_sprite->sprite_rect_height = sprite_rect_height;
-	draw_sprite->light = light;
-	draw_sprite->flip_h = sprite->flip_h;
-	draw_sprite->flip_v = sprite->flip_v;
-	draw_sprite->decal_line_index = (is_decal) ? sprite->decal_line_index : -1;
+	memset(dest, 0, sizeof(DrawSprite));
+
+	dest->frame = sprite->frame + (sprite->frame_offset_x) + (sprite->frame_offset_y * sprite->img->h_frames);
+	dest->img = sprite->img;
+	dest->x = sprite->x + sprite->offset_x;
+	dest->y = sprite->y + sprite->offset_y;
+	dest->z = sprite->z + sprite->offset_z;
+	dest->scale_x = sprite->scale_x;
+	dest->scale_y = sprite->scale_y;
+	dest->frame_offset_x = sprite_offset_x;
+	dest->frame_offset_y = sprite_offset_y;
+	dest->sprite_rect_width = sprite_rect_width;
+	dest->sprite_rect_height = sprite_rect_height;
+	dest->light = light;
+	dest->flip_h = sprite->flip_h;
+	dest->flip_v = sprite->flip_v;
+	dest->decal_line_index = (is_decal) ? sprite->decal_line_index : -1;
+}
+
+void RenderUtl_AddSpriteToQueue(RenderData* data, Sprite* sprite, int sector_light, Vec3_u16 extra_light, bool is_decal)
+{
+	assert(sprite->img);
+
+	if (!sprite->img)
+	{
+		return;
+	}
+
+	if (!Arena_GrowArray(&data->arena, (void**)&data->draw_sprites, &data->max_draw_sprites, data->num_draw_sprites + 1, sizeof(DrawSprite)))
+	{
+		return;
+	}
+
+	RenderUtl_SpriteToDrawSprite(&data->draw_sprites[data->num_draw_sprites++], sprite, sector_light, is_decal);
+}
+
+static bool RenderUtl_SnapshotAddSprite(SpriteSnapshot* snapshot, Sprite* sprite, int sector_light, bool is_decal)
+{
+	if (!sprite->img)
+	{
+		return true;
+	}
+
+	if (snapshot->num_sprites >= snapshot->max_sprites)
+	{
+		int new_max = (snapshot->max_sprites > 0) ? snapshot->max_sprites * 2 : 256;
+
+		DrawSprite* sprites = realloc(snapshot->sprites, sizeof(DrawSprite) * new_max);
+
+		if (!sprites)
+		{
+			return false;
+		}
+
+		snapshot->sprites = sprites;
+		snapshot->max_sprites = new_max;
+	}
+
+	RenderUtl_SpriteToDrawSprite(&snapshot->sprites[snapshot->num_sprites++], sprite, sector_light, is_decal);
+
+	return true;
+}
+
+bool RenderUtl_BuildSpriteSnapshot(SpriteSnapshot* snapshot, Map* map)
+{
+	if (map->num_sectors + 1 > snapshot->max_sectors)
+	{
+		if (snapshot->sector_offsets) free(snapshot->sector_offsets);
+
+		snapshot->sector_offsets = calloc(map->num_sectors + 1, sizeof(int));
+		snapshot->max_sectors = (snapshot->sector_offsets) ? map->num_sectors + 1 : 0;
+
+		if (!snapshot->sector_offsets)
+		{
+			snapshot->num_sectors = 0;
+			return false;
+		}
+	}
+
+	snapshot->num_sprites = 0;
+	snapshot->num_sectors = map->num_sectors;
+
+	for (int i = 0; i < map->num_sectors; i++)
+	{
+		Sector* sector = &map->sectors[i];
+
+		int light = sector->light_level;
+
+		snapshot->sector_offsets[i] = snapshot->num_sprites;
+
+		//object sprites
+		Object* obj = sector->object_list;
+
+		while (obj)
+		{
+			if (!RenderUtl_SnapshotAddSprite(snapshot, &obj->sprite, light, obj->type == OT__DECAL))
+			{
+				snapshot->num_sectors = 0;
+				return false;
+			}
+
+			obj = obj->sector_next;
+		}
+
+		//also add additional sprites that can cross multiple sectors
+		if (sector->render_object_list && sector->sorted_render_object_list && Object_Pool_UsedSize(sector->render_object_list) > 0)
+		{
+			int num = dA_size(sector->sorted_render_object_list);
+			int added_sprites = 0;
+
+			for (int k = 0; k < num; k++)
+			{
+				ObjectID* id = dA_at(sector->sorted_render_object_list, k);
+
+				if (*id < 0)
+				{
+					continue;
+				}
+
+				Object* render_obj = Map_GetObject(*id);
+
+				if (!RenderUtl_SnapshotAddSprite(snapshot, &render_obj->sprite, light, render_obj->type == OT__DECAL))
+				{
+					snapshot->num_sectors = 0;
+					return false;
+				}
+
+				added_sprites++;
+
+				if (added_sprites >= sector->render_object_list->used_pool_size)
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	snapshot->sector_offsets[map->num_sectors] = snapshot->num_sprites;
+
+	return true;
+}
+
+void RenderUtl_AddSnapshotSpritesToQueue(RenderData* data, SpriteSnapshot* snapshot, int sector)
+{
+	if (!snapshot || sector < 0 || sector >= snapshot->num_sectors)
+	{
+		return;
+	}
+
+	int first = snapshot->sector_offsets[sector];
+	int count = snapshot->sector_offsets[sector + 1] - first;
+
+	if (count <= 0)
+	{
+		return;
+	}
+
+	if (!Arena_GrowArray(&data->arena, (void**)&data->draw_sprites, &data->max_draw_sprites, data->num_draw_sprites + count, sizeof(DrawSprite)))
+	{
+		return;
+	}
+
+	memcpy(&data->draw_sprites[data->num_draw_sprites], &snapshot->sprites[first], sizeof(DrawSprite) * count);
+	data->num_draw_sprites += count;
+}
+
+void RenderUtl_DestroySpriteSnapshot(SpriteSnapshot* snapshot)
+{
+	if (snapshot->sprites) free(snapshot->sprites);
+	if (snapshot->sector_offsets) free(snapshot->sector_offsets);
+
+	memset(snapshot, 0, sizeof(SpriteSnapshot));
+}
+
+bool RenderUtl_BuildFramePacket(FramePacket* packet, Map* map)
+{
+	if (map->num_sectors > packet->max_sectors)
+	{
+		if (packet->sectors) free(packet->sectors);
+
+		packet->sectors = calloc(map->num_sectors, sizeof(SectorRenderState));
+		packet->max_sectors = (packet->sectors) ? map->num_sectors : 0;
+
+		if (!packet->sectors)
+		{
+			packet->num_sectors = 0;
+			return false;
+		}
+	}
+
+	packet->num_sectors = map->num_sectors;
+
+	for (int i = 0; i < map->num_sectors; i++)
+	{
+		Sector* sector = &map->sectors[i];
+		SectorRenderState* state = &packet->sectors[i];
+
+		state->r_floor = sector->r_floor;
+		state->r_ceil = sector->r_ceil;
+		state->floor = sector->floor;
+		state->ceil = sector->ceil;
+		state->light_level = sector->light_level;
+	}
+
+	return RenderUtl_BuildSpriteSnapshot(&packet->sprites, map);
+}
+
+void RenderUtl_ApplyFramePacketSector(FramePacket* packet, Sector* sector)
+{
+	if (!packet || sector->index < 0 || sector->index >= packet->num_sectors)
+	{
+		return;
+	}
+
+	SectorRenderState* state = &packet->sectors[sector->index];
+
+	sector->r_floor = state->r_floor;
+	sector->r_ceil = state->r_ceil;
+	sector->floor = state->floor;
+	sector->ceil = state->ceil;
+	sector->light_level = state->light_level;
+}
+
+void RenderUtl_DestroyFramePacket(FramePacket* packet)
+{
+	RenderUtl_DestroySpriteSnapshot(&packet->sprites);
+
+	if (packet->sectors) free(packet->sectors);
+
+	memset(packet, 0, sizeof(FramePacket));
+}
+
+bool RenderUtl_ReserveVisList(VisList* list, int num_subsectors, int num_segs)
+{
+	if (num_subsectors > list->max_subsectors)
+	{
+		if (list->subsectors) free(list->subsectors);
+
+		list->subsectors = calloc(num_subsectors, sizeof(VisSubsector));
+		list->max_subsectors = (list->subsectors) ? num_subsectors : 0;
+	}
+	if (num_segs > list->max_segs)
+	{
+		if (list->segs) free(list->segs);
+
+		list->segs = calloc(num_segs, sizeof(VisSeg));
+		list->max_segs = (list->segs) ? num_segs : 0;
+	}
+
+	list->num_subsectors = 0;
+	list->num_segs = 0;
+	list->seg_bin_offsets = NULL;
+	list->bin_segs = NULL;
+	list->sprites = NULL;
+	list->num_sprites = 0;
+	list->bin_offsets = NULL;
+	list->bin_sprites = NULL;
+	list->num_bins = 0;
+
+	return list->subsectors && list->segs;
+}
+
+void RenderUtl_DestroyVisList(VisList* list)
+{
+	if (list->subsectors) free(list->subsectors);
+	if (list->segs) free(list->segs);
+
+	memset(list, 0, sizeof(VisList));
 }
@@ -4,15 +4,42 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
+#include <immintrin.h>
 
 #include "g_common.h"
 #include "u_math.h"
+#include "utility.h"
 
 //#define WHITE_TEXTURES
 
 static const float PI = 3.14159265359;
+
+//texel * light / 255 without a table, the bias makes it exact integer division for unsaturated values
+//the table is filled with the same values, so the simd spans, which always use this form, match either
+#define LIGHT_FIXED_SCALE 257
+
+#ifdef LIGHT_FIXED_POINT
+static inline unsigned char Video_ApplyLight(unsigned texel, unsigned light)
+{
+#ifdef WHITE_TEXTURES
+	texel = 255;
+#endif // WHITE_TEXTURES
+
+	unsigned l = (texel * light * LIGHT_FIXED_SCALE + LIGHT_FIXED_SCALE) >> 16;
+
+	return (l > 255) ? 255 : (unsigned char)l;
+}
+#else
 static unsigned char LIGHT_LUT[256][MAX_LIGHT_VALUE];
 
+#define Video_ApplyLight(texel, light) LIGHT_LUT[texel][light]
+#endif // LIGHT_FIXED_POINT
+
+static void Video_SetupPlaneSpans();
+static void Video_SetupWallColumns();
+static void Video_SetupTranspose();
+
 const int INSIDE = 0b0000;
 const int LEFT = 0b0001;
 const int RIGHT = 0b0010;
@@ -34,27 +61,33 @@ static float Video_FastLerp(float v, float from, float to)
 
 void Video_Setup()
 {
+#ifndef LIGHT_FIXED_POINT
 	//setup light lut
 	for (int i = 0; i < 256; i++)
 	{
 		for (int k = 0; k < MAX_LIGHT_VALUE; k++)
 		{
-			float light = (float)k / 255.0f;
-
 #ifdef WHITE_TEXTURES
-			int l = (float)255.0 * light;
+			unsigned texel = 255;
 #else
-			int l = (float)i * light;
+			unsigned texel = i;
 #endif // WHITE_TEXTURES
 
-			if (l < 0) l = 0;
-			else if (l > 255) l = 255;
+			unsigned l = (texel * k * LIGHT_FIXED_SCALE + LIGHT_FIXED_SCALE) >> 16;
+
+			if (l > 255) l = 255;
 
 			LIGHT_LUT[i][k] = (unsigned char)l;		
 		}
 	}
+#endif // !LIGHT_FIXED_POINT
 
 	float s = 0;
+
+	//pick the plane span and wall column kernels for this cpu
+	Video_SetupPlaneSpans();
+	Video_SetupWallColumns();
+	Video_SetupTranspose();
 }
 
 
@@ -354,13 +387,13 @@ void Video_DrawBox(Image* image, float* depth_buffer, float box[2][3], float vie
 
 	if (light)
 	{
-		unsigned char color[4] = { LIGHT_LUT[255][light->r], LIGHT_LUT[255][light->g], LIGHT_LUT[255][light->b], 255 };
+		unsigned char color[4] = { Video_ApplyLight(255, light->r), Video_ApplyLight(255, light->g), Video_ApplyLight(255, light->b), 255 };
 
 		for (int x = draw_start_x; x < draw_end_x; x++)
 		{
 			for (int y = draw_start_y; y < draw_end_y; y++)
 			{
-				if (depth_buffer && transform_y_tan <= depth_buffer[x + y * image->width])
+				if (depth_buffer && transform_y_tan <= depth_buffer[Image_PixelIndex(image, x, y)])
 				{
 					Image_Set2(image, x, y, color);
 				}
@@ -379,16 +412,16 @@ void Video_DrawBox(Image* image, float* depth_buffer, float box[2][3], float vie
 		unsigned char right_color[4] = { 128, 255, 128, 255 };
 
 		//top line
-		for (int x = draw_start_x; x < draw_end_x; x++) { if (transform_y_tan <= depth_buffer[x + draw_start_y * image->width]) Image_Set2(image, x, draw_start_y, top_color); };
+		for (int x = draw_start_x; x < draw_end_x; x++) { if (transform_y_tan <= depth_buffer[Image_PixelIndex(image, x, draw_start_y)]) Image_Set2(image, x, draw_start_y, top_color); };
 
 		//bottom line
-		for (int x = draw_start_x; x < draw_end_x; x++) { if (transform_y_tan <= depth_buffer[x + draw_end_y * image->width]) Image_Set2(image, x, draw_end_y, top_color); };
+		for (int x = draw_start_x; x < draw_end_x; x++) { if (transform_y_tan <= depth_buffer[Image_PixelIndex(image, x, draw_end_y)]) Image_Set2(image, x, draw_end_y, top_color); };
 
 		//left line
-		for (int y = draw_start_y; y < draw_end_y; y++) { if (transform_y_tan <= depth_buffer[draw_start_x + y * image->width]) Image_Set2(image, draw_start_x, y, top_color); };
+		for (int y = draw_start_y; y < draw_end_y; y++) { if (transform_y_tan <= depth_buffer[Image_PixelIndex(image, draw_start_x, y)]) Image_Set2(image, draw_start_x, y, top_color); };
 
 		//right line
-		for (int y = draw_start_y; y < draw_end_y; y++) { if (transform_y_tan <= depth_buffer[draw_end_x + y * image->width]) Image_Set2(image, draw_end_x, y, top_color); };
+		for (int y = draw_start_y; y < draw_end_y; y++) { if (transform_y_tan <= depth_buffer[Image_PixelIndex(image, draw_end_x, y)]) Image_Set2(image, draw_end_x, y, top_color); };
 	}
 
 }
@@ -603,7 +636,7 @@ void Video_DrawScreenSprite(Image* image, Sprite* sprite, int start_x, int end_x
 				}
 			}
 
-			unsigned char clr[4] = { LIGHT_LUT[color[0]][light.r], LIGHT_LUT[color[1]][light.g], LIGHT_LUT[color[2]][light.b], 255 };
+			unsigned char clr[4] = { Video_ApplyLight(color[0], light.r), Video_ApplyLight(color[1], light.g), Video_ApplyLight(color[2], light.b), 255 };
 
 			//try to set as many pixels in a row as possible
 			while (y < y_max)
@@ -638,12 +671,88 @@ void Video_DrawScreenSprite(Image* image, Sprite* sprite, int start_x, int end_x
 	}
 }
 
-void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
+void Video_BuildCoarseDepth(Image* image, float* depth_buffer, RenderData* render_data, int x0, int x1)
+{
+	if (!render_data->coarse_depth)
+	{
+		return;
+	}
+
+	const int block_size = 1 << COARSE_DEPTH_SHIFT;
+
+	int rows = render_data->coarse_depth_rows;
+	size_t y_stride = Image_YStride(image);
+
+	for (int x = x0; x < x1; x++)
+	{
+		float* coarse = render_data->coarse_depth + (size_t)x * rows;
+		size_t index = Image_PixelIndex(image, x, 0);
+
+		for (int row = 0; row < rows; row++)
+		{
+			int count = min(block_size, image->height - (row << COARSE_DEPTH_SHIFT));
+			float max_depth = 0;
+
+			for (int y = 0; y < count; y++)
+			{
+				max_depth = max(max_depth, depth_buffer[index]);
+				index += y_stride;
+			}
+
+			coarse[row] = max_depth;
+		}
+	}
+
+	render_data->coarse_depth_valid = true;
+}
+
+//farthest depth between rows y1 and y2 of a column, anything behind it is hidden there
+static float Video_CoarseDepthMax(RenderData* render_data, int x, int y1, int y2)
+{
+	if (!render_data->coarse_depth_valid || y2 <= y1)
+	{
+		return DEPTH_CLEAR;
+	}
+
+	float* coarse = render_data->coarse_depth + (size_t)x * render_data->coarse_depth_rows;
+
+	int row1 = max(y1, 0) >> COARSE_DEPTH_SHIFT;
+	int row2 = min((y2 - 1) >> COARSE_DEPTH_SHIFT, render_data->coarse_depth_rows - 1);
+
+	float max_depth = 0;
+
+	for (int row = row1; row <= row2; row++)
+	{
+		max_depth = max(max_depth, coarse[row]);
+	}
+
+	return max_depth;
+}
+
+//first screen row in [y0, y1) whose frame row is at least texel, uses the same truncation as the texel fetch
+static int Video_SpritePostRow(float start_ty_pos, float ty_step, int y0, int y1, int texel)
+{
+	int y = y0 + (int)ceilf((texel - start_ty_pos) / ty_step);
+	y = Math_Clampl(y, y0, y1);
+
+	while (y > y0 && (int)(start_ty_pos + (y - 1 - y0) * ty_step) >= texel)
+	{
+		y--;
+	}
+	while (y < y1 && (int)(start_ty_pos + (y - y0) * ty_step) < texel)
+	{
+		y++;
+	}
+
+	return y;
+}
+
+bool Video_ProjectSprite(Image* image, DrawingArgs* args, DrawSprite* sprite, VisSprite* vis)
 {
 	//invalid scale
 	if (sprite->scale_x <= 0 || sprite->scale_y <= 0)
 	{
-		return;
+		return false;
 	}
 	//completely transparent
 	//if (sprite->transparency >= 1)
@@ -661,13 +770,13 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (transform_y <= 0)
 	{
-		return;
+		return false;
 	}
 
 	float transform_y_tan = local_sprite_x * args->tan_cos + local_sprite_y * args->tan_sin;
 
 	//if (transform_x >= -transform_y_tan && transform_x > transform_y_tan) return;
-	if (transform_y_tan == 0) return;
+	if (transform_y_tan == 0) return false;
 
 	float fsx1 = image->half_width + transform_x * image->half_width / transform_y_tan;
 
@@ -683,7 +792,7 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (sprite_height <= 0 || sprite_width <= 0)
 	{
-		return;
+		return false;
 	}
 
 	int sprite_half_width = sprite_width / 2;
@@ -701,7 +810,7 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (!frame_info)
 	{
-		return;
+		return false;
 	}
 
 	int min_x = (sprite->flip_h) ? ((sprite_rect_width)-(frame_info->max_real_x)) : frame_info->min_real_x;
@@ -712,7 +821,7 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (draw_start_x >= args->end_x)
 	{
-		return;
+		return false;
 	}
 
 	int draw_end_x = sprite_half_width + sprite_screen_x;
@@ -720,12 +829,12 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (draw_end_x <= args->start_x)
 	{
-		return;
+		return false;
 	}
 
 	if (draw_start_x >= draw_end_x)
 	{
-		return;
+		return false;
 	}
 
 	int screen_offset_y = (int)((image->half_height) - (local_sprite_z * yscale));
@@ -739,7 +848,7 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (draw_start_y >= image->height || draw_end_y <= 0)
 	{
-		return;
+		return false;
 	}
 
 	Vec3_u16 light = sprite->light;
@@ -767,11 +876,9 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	float ty_add = (sprite_offset_y * sprite_rect_height);
 
-
-	unsigned char* dest = image->data;
-	size_t dest_index_step = (size_t)image->width;
-	
-	float xl = 1.0 / fabs(draw_end_x - draw_start_x);
+	//sheet coordinates stay at full size, only the texel fetch is shifted down to the level
+	int mip_level = Image_SelectMipmap(sprite->img, max(fabs(tx_step), ty_step));
+	Image* mip = Image_GetMipmap(sprite->img, mip_level);
 
 	float depth_scale = (transform_y * DEPTH_SHADING_SCALE);
 
@@ -799,10 +906,82 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 	light_b = Math_Clampl(light_b - depth_scale, 0, MAX_LIGHT_VALUE - 1);
 #endif
 
+	vis->sprite = sprite;
+	vis->frame_info = frame_info;
+	vis->x1 = draw_start_x;
+	vis->x2 = draw_end_x;
+	vis->y1 = draw_start_y;
+	vis->y2 = draw_end_y;
+	vis->min_x = min_x;
+	vis->max_x = max_x;
+	vis->depth = transform_y_tan;
+	vis->light_r = light_r;
+	vis->light_g = light_g;
+	vis->light_b = light_b;
+	vis->mip = mip;
+	vis->mip_level = mip_level;
+	vis->tx_pos = tx_pos;
+	vis->tx_step = tx_step;
+	vis->tx_add = tx_add;
+	vis->ty_pos = start_ty_pos;
+	vis->ty_step = ty_step;
+	vis->ty_add = ty_add;
+
+	return true;
+}
+
+void Video_DrawSprite(Image* image, DrawingArgs* args, VisSprite* vis)
+{
+	int draw_start_x = max(vis->x1, args->start_x);
+	int draw_end_x = min(vis->x2, args->end_x);
+
+	if (draw_start_x >= draw_end_x)
+	{
+		return;
+	}
+
+	DrawSprite* sprite = vis->sprite;
+	FrameInfo* frame_info = vis->frame_info;
+
+	int sprite_rect_width = sprite->sprite_rect_width;
+
+	int min_x = vis->min_x;
+	int max_x = vis->max_x;
+
+	int draw_start_y = vis->y1;
+	int draw_end_y = vis->y2;
+
+	float transform_y_tan = vis->depth;
+
+	int light_r = vis->light_r;
+	int light_g = vis->light_g;
+	int light_b = vis->light_b;
+
+	float tx_step = vis->tx_step;
+	float tx_pos = vis->tx_pos + (draw_start_x - vis->x1) * tx_step;
+	float tx_add = vis->tx_add;
+
+	float start_ty_pos = vis->ty_pos;
+	float ty_step = vis->ty_step;
+	float ty_add = vis->ty_add;
+
+	int mip_level = vis->mip_level;
+	Image* mip = vis->mip;
+
+	size_t tex_y_stride = Image_YStride(mip) * mip->numChannels;
+
+	unsigned char* dest = image->data;
+	size_t dest_index_step = Image_YStride(image);
+
+	RenderData* render_data = args->render_data;
+
+	int columns_culled = 0;
+	int columns_drawn = 0;
+
 	//try to make this loop as fast as possible
 	for (int x = draw_start_x; x < draw_end_x; x++)
 	{
-		size_t dest_index = (size_t)x + (size_t)(draw_start_y) * (size_t)image->width;
+		size_t dest_index = Image_PixelIndex(image, x, draw_start_y);
 
 		int tx = tx_pos;
 		int local_tx = max(tx, tx_add) - min(tx, tx_add);
@@ -819,80 +998,99 @@ void Video_DrawSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 	
 		int span_x = (sprite->flip_h) ? (sprite_rect_width - local_tx) : local_tx;
 
-		AlphaSpan* span = FrameInfo_GetAlphaSpan(frame_info, span_x);
+		int num_posts = 0;
+		SpritePost* posts = FrameInfo_GetPosts(frame_info, span_x, &num_posts);
 
-		if (span->min > span->max)
+		if (num_posts <= 0)
+		{
+			tx_pos += tx_step;
+			continue;
+		}
+
+		//every pixel of the column is behind a wall or plane
+		if (transform_y_tan >= Video_CoarseDepthMax(render_data, x, draw_start_y, draw_end_y))
 		{
+			columns_culled++;
 			tx_pos += tx_step;
 			continue;
 		}
 
-		float x_pos = fabs(x - draw_start_x);
-		float depth = (x_pos * xl) + transform_y;
+		columns_drawn++;
 
-		int min_y = (sprite->flip_v) ? (sprite_rect_height - (span->max)) : span->min;
-		int max_y = (sprite->flip_v) ? (sprite_rect_height - (span->min)) : span->max;
+		unsigned char* tex_column = Image_Get(mip, tx >> mip_level, 0);
 
-		float ty_pos = start_ty_pos + ty_add;
-		float ty_local_pos = start_ty_pos;
-		for (int y = draw_start_y; y < draw_end_y; y++)
+		//only the opaque runs are walked, the holes between them are skipped without touching the texels
+		for (int p = 0; p < num_posts; p++)
 		{
-			int ty = ty_pos;
-			int local_ty = ty_local_pos;
+			SpritePost* post = &posts[p];
 
-			if (local_ty < min_y)
-			{
-				ty_pos += ty_step;
-				ty_local_pos += ty_step;
-				dest_index += dest_index_step;
-				continue;
-			}
-			else if (local_ty > max_y)
+			int post_start_y = Video_SpritePostRow(start_ty_pos, ty_step, draw_start_y, draw_end_y, post->top);
+
+			if (post_start_y >= draw_end_y)
 			{
 				break;
 			}
 
-			unsigned char* tex_data = Image_Get(sprite->img, tx, ty);
+			int post_end_y = Video_SpritePostRow(start_ty_pos, ty_step, draw_start_y, draw_end_y, post->top + post->length);
+			post_end_y = max(post_end_y, post_start_y);
 
-			if (tex_data[3] > 128 && transform_y_tan < args->depth_buffer[dest_index])
+			size_t post_dest_index = dest_index + (size_t)(post_start_y - draw_start_y) * dest_index_step;
+
+			for (int y = post_start_y; y < post_end_y; y++)
 			{
-				args->depth_buffer[dest_index] = transform_y_tan;
+				if (transform_y_tan < args->depth_buffer[post_dest_index])
+				{
+					args->depth_buffer[post_dest_index] = transform_y_tan;
 
-				size_t i = dest_index * 4;
+					int ty = (int)ty_add + (int)(start_ty_pos + (y - draw_start_y) * ty_step);
+					ty = min(ty >> mip_level, mip->height - 1);
 
-				//avoid loops, this is faster
-				dest[i + 0] = LIGHT_LUT[tex_data[0]][light_r];
-				dest[i + 1] = LIGHT_LUT[tex_data[1]][light_g];
-				dest[i + 2] = LIGHT_LUT[tex_data[2]][light_b];
-			}
+					unsigned char* tex_data = tex_column + (size_t)ty * tex_y_stride;
 
-			ty_pos += ty_step;
-			ty_local_pos += ty_step;
-			dest_index += dest_index_step;
+					size_t i = post_dest_index * 4;
+
+					//avoid loops, this is faster
+					dest[i + 0] = Video_ApplyLight(tex_data[0], light_r);
+					dest[i + 1] = Video_ApplyLight(tex_data[1], light_g);
+					dest[i + 2] = Video_ApplyLight(tex_data[2], light_b);
+				}
+
+				post_dest_index += dest_index_step;
+			}
 		}
 
 		tx_pos += tx_step;
 	}
 
+	render_data->sprite_columns_culled += columns_culled;
+	render_data->sprite_columns_drawn += columns_drawn;
+
+	if (columns_culled > 0)
+	{
+		vis->column_culled = true;
+	}
+	if (columns_drawn > 0)
+	{
+		vis->column_drawn = true;
+	}
 }
 
-void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
+bool Video_ProjectDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite, VisSprite* vis)
 {
 	if (sprite->decal_line_index < 0)
 	{
-		return;
+		return false;
 	}
 
 	Linedef* line = Map_GetLineDef(sprite->decal_line_index);
 
 	if (!line)
 	{
-		return;
+		return false;
 	}
 	Linedef* decal_line = line;
 
 	float half_sprite_width = sprite->sprite_rect_width / 2;
-	float half_sprite_height = sprite->sprite_rect_height / 2;
 
 	float decal_rect_left = half_sprite_width / 4;
 	float decal_rect_right = half_sprite_width / 4;
@@ -949,7 +1147,7 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 	//completely behind the view plane
 	if (tz1 <= 0 && tz2 <= 0)
 	{
-		return;
+		return false;
 	}
 
 	float tanZ1 = vx1 * args->tan_cos + vy1 * args->tan_sin;
@@ -964,17 +1162,17 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (tx1 >= -tanZ1)
 	{
-		if (tx1 > tanZ1) return;
-		if (tanZ1 == 0) return;
+		if (tx1 > tanZ1) return false;
+		if (tanZ1 == 0) return false;
 		fsx1 = image->half_width + tx1 * image->half_width / tanZ1;
 		fsz1 = tanZ1;
 		u0 = 0.0f;
 	}
 	else
 	{
-		if (tx2 < -tanZ2) return;
+		if (tx2 < -tanZ2) return false;
 		float den = tx1 - tx2 - tanZ2 + tanZ1;
-		if (den == 0) return;
+		if (den == 0) return false;
 		fsx1 = 0;
 		u0 = (tx1 + tanZ1) / den;
 		fsz1 = tanZ1 + (tanZ2 - tanZ1) * u0;
@@ -982,21 +1180,21 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (fsz1 <= 0)
 	{
-		return;
+		return false;
 	}
 	if (tx2 <= tanZ2)
 	{
-		if (tx2 < -tanZ2) return;
-		if (tanZ2 == 0) return;
+		if (tx2 < -tanZ2) return false;
+		if (tanZ2 == 0) return false;
 		fsx2 = image->half_width + tx2 * image->half_width / tanZ2;
 		fsz2 = tanZ2;
 		u1 = 1.0f;
 	}
 	else
 	{
-		if (tx1 > tanZ1) return;
+		if (tx1 > tanZ1) return false;
 		float den = tanZ2 - tanZ1 - tx2 + tx1;
-		if (den == 0) return;
+		if (den == 0) return false;
 		fsx2 = image->width;
 		u1 = (tx1 - tanZ1) / den;
 		fsz2 = tanZ1 + (tanZ2 - tanZ1) * u1;
@@ -1004,7 +1202,7 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	if (fsz2 <= 0)
 	{
-		return;
+		return false;
 	}
 
 	int x1 = (int)floor(fsx1 + 0.5);
@@ -1013,14 +1211,14 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 	//not visible
 	if (x1 >= x2 || x2 <= args->start_x || x1 >= args->end_x)
 	{
-		return;
+		return false;
 	}
 
 	FrameInfo* frame_info = Image_GetFrameInfo(sprite->img, sprite->frame);
 
 	if (!frame_info)
 	{
-		return;
+		return false;
 	}
 	int min_x = (sprite->flip_h) ? ((sprite->sprite_rect_width)-(frame_info->max_real_x)) : frame_info->min_real_x;
 	int max_x = (sprite->flip_h) ? ((sprite->sprite_rect_width)-(frame_info->min_real_x)) : frame_info->max_real_x;
@@ -1032,11 +1230,118 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 	u1 *= texwidth;
 
 	Sector* frontsector = Map_GetSector(decal_line->front_sector);
+
+	float depth_scale = (tanZ1 * DEPTH_SHADING_SCALE);
+
+	Lightmap* lightmap = &line->lightmap;
+	Vec3_u16* light_sample = NULL;
+
+	if(lightmap->data)
+	{
+		int line_tx = 0;
+		int line_ty = 0;
+
+		float z = sprite->z;
+		line_ty = (z - frontsector->floor) / (frontsector->ceil - frontsector->floor);
+
+		float u = 0;
+		float t = 0;
+
+		t = frac;
+
+		u = t + u * t;
+		u = fabs(u);
+		u *= line->width * 2;
+
+		line_tx = u;
+
+		int lx = line_tx / LIGHTMAP_LUXEL_SIZE;
+		int ly = line_ty / LIGHTMAP_LUXEL_SIZE;
+
+		light_sample = Lightmap_Get(lightmap, lx, ly);
+	}
+
+	int light_r = Math_Clampl(sprite->light.r - depth_scale, 0, MAX_LIGHT_VALUE - 1);
+	int light_g = Math_Clampl(sprite->light.g - depth_scale, 0, MAX_LIGHT_VALUE - 1);
+	int light_b = Math_Clampl(sprite->light.b - depth_scale, 0, MAX_LIGHT_VALUE - 1);
+
+#ifndef DISABLE_LIGHTMAPS
+
+	if (!light_sample)
+	{
+		return false;
+	}
+
+#endif // DISABLE_LIGHTMAPS
+
+	vis->sprite = sprite;
+	vis->frame_info = frame_info;
+	vis->x1 = x1;
+	vis->x2 = x2;
+	vis->min_x = min_x;
+	vis->max_x = max_x;
+	vis->light_r = light_r;
+	vis->light_g = light_g;
+	vis->light_b = light_b;
+	vis->u0 = u0;
+	vis->u1 = u1;
+	vis->fsz1 = fsz1;
+	vis->fsz2 = fsz2;
+	vis->tz1 = tanZ1;
+	vis->tz2 = tanZ2;
+	vis->light_sample = light_sample;
+
+	return true;
+}
+
+void Video_DrawDecalSprite(Image* image, DrawingArgs* args, VisSprite* vis)
+{
+	int begin_x = max(vis->x1, args->start_x);
+	int end_x = min(vis->x2, args->end_x);
+
+	if (begin_x >= end_x)
+	{
+		return;
+	}
+
+	DrawSprite* sprite = vis->sprite;
+	FrameInfo* frame_info = vis->frame_info;
+	Linedef* decal_line = Map_GetLineDef(sprite->decal_line_index);
+
+	float half_sprite_height = sprite->sprite_rect_height / 2;
+
+	int x1 = vis->x1;
+	int x2 = vis->x2;
+
+	float fsz1 = vis->fsz1;
+	float fsz2 = vis->fsz2;
+
+	float u0 = vis->u0;
+	float u1 = vis->u1;
+
+	int min_x = vis->min_x;
+	int max_x = vis->max_x;
+
+	int light_r = vis->light_r;
+	int light_g = vis->light_g;
+	int light_b = vis->light_b;
+
+	Vec3_u16* light_sample = vis->light_sample;
+
+	//heights come from the frame packet, not the sectors the game thread is moving
+	Sector frontsector_state = *Map_GetSector(decal_line->front_sector);
+	RenderUtl_ApplyFramePacketSector(args->frame_packet, &frontsector_state);
+
+	Sector* frontsector = &frontsector_state;
 	Sector* backsector = NULL;
+	Sector backsector_state;
 
 	if (decal_line->back_sector >= 0)
 	{
-		backsector = Map_GetSector(decal_line->back_sector);
+		backsector_state = *Map_GetSector(decal_line->back_sector);
+		RenderUtl_ApplyFramePacketSector(args->frame_packet, &backsector_state);
+
+		backsector = &backsector_state;
 	}
 
 	float yscale1 = args->v_fov * (1.0 / fsz1);
@@ -1081,11 +1386,8 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 	int bottom_y1 = (image->half_height) - (int)((ybottom)*yscale1);
 	int bottom_y2 = (image->half_height) - (int)((ybottom)*yscale2);
 
-	int begin_x = max(x1, args->start_x);
-	int end_x = min(x2, args->end_x);
-
-	tz1 = tanZ1;
-	tz2 = tanZ2;
+	float tz1 = vis->tz1;
+	float tz2 = vis->tz2;
 
 	float xl = 1.0 / fabs(x2 - x1);
 	float x_pos = fabs(begin_x - x1);
@@ -1102,49 +1404,10 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 	float texheight = sprite->sprite_rect_height;
 
-	float depth_scale = (tz1 * DEPTH_SHADING_SCALE);
-
-	Lightmap* lightmap = &line->lightmap;
-	Vec3_u16* light_sample = NULL;
-
-	if(lightmap->data)
-	{
-		int line_tx = 0;
-		int line_ty = 0;
-
-		float z = sprite->z;
-		line_ty = (z - frontsector->floor) / (frontsector->ceil - frontsector->floor);
-
-		float u = 0;
-		float t = 0;
-
-		t = frac;
-
-		u = t + u * t;
-		u = fabs(u);
-		u *= line->width * 2;
-
-		line_tx = u;
-
-		int lx = line_tx / LIGHTMAP_LUXEL_SIZE;
-		int ly = line_ty / LIGHTMAP_LUXEL_SIZE;
-
-		light_sample = Lightmap_Get(lightmap, lx, ly);
-	}
-
-	int light_r = Math_Clampl(sprite->light.r - depth_scale, 0, MAX_LIGHT_VALUE - 1);
-	int light_g = Math_Clampl(sprite->light.g - depth_scale, 0, MAX_LIGHT_VALUE - 1);
-	int light_b = Math_Clampl(sprite->light.b - depth_scale, 0, MAX_LIGHT_VALUE - 1);
-
-#ifndef DISABLE_LIGHTMAPS
-
-	if (!light_sample)
-	{
-		return;
-	}
-
-#endif // DISABLE_LIGHTMAPS
+	RenderData* render_data = args->render_data;
 
+	int columns_culled = 0;
+	int columns_drawn = 0;
 
 	for (int x = begin_x; x < end_x; x++)
 	{
@@ -1206,6 +1469,17 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 			c_yfloor = Math_Clampl(c_yfloor, c_back_ybottom, c_front_ybottom);
 		}
 
+		//every pixel of the column is behind something nearer than the wall
+		if (depth > Video_CoarseDepthMax(render_data, x, c_yceil, c_yfloor))
+		{
+			columns_culled++;
+			x_pos++;
+			x_pos2--;
+			continue;
+		}
+
+		columns_drawn++;
+
 		float yl = 1.0 / max(fabs(yfloor - yceil), 0.001);
 		float ty_step = texheight * yl;
 
@@ -1226,7 +1500,7 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 				break;
 			}
 
-			if (depth <= args->depth_buffer[x + y * image->width])
+			if (depth <= args->depth_buffer[Image_PixelIndex(image, x, y)])
 			{
 				int ty = (int)ty_pos;
 				unsigned char* tex_color = Image_Get(sprite->img, tx, ty);
@@ -1238,27 +1512,27 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 
 				if (tex_color[3] > 128)
 				{
-					size_t index = ((size_t)x + (size_t)y * (size_t)image->width) * (size_t)image->numChannels;
+					size_t index = Image_PixelIndex(image, x, y) * (size_t)image->numChannels;
 
 					//mix with img color
 					//both are half transparent
-					unsigned char img_r = LIGHT_LUT[image->data[index + 0]][127];
-					unsigned char img_g = LIGHT_LUT[image->data[index + 1]][127];
-					unsigned char img_b = LIGHT_LUT[image->data[index + 2]][127];
+					unsigned char img_r = Video_ApplyLight(image->data[index + 0], 127);
+					unsigned char img_g = Video_ApplyLight(image->data[index + 1], 127);
+					unsigned char img_b = Video_ApplyLight(image->data[index + 2], 127);
 
-					unsigned char decal_r = LIGHT_LUT[tex_color[0]][127];
-					unsigned char decal_g = LIGHT_LUT[tex_color[1]][127];
-					unsigned char decal_b = LIGHT_LUT[tex_color[2]][127];
+					unsigned char decal_r = Video_ApplyLight(tex_color[0], 127);
+					unsigned char decal_g = Video_ApplyLight(tex_color[1], 127);
+					unsigned char decal_b = Video_ApplyLight(tex_color[2], 127);
 
 #ifdef DISABLE_LIGHTMAPS
 					//avoid loops
-					image->data[index + 0] = LIGHT_LUT[img_r + decal_r][light_r];
-					image->data[index + 1] = LIGHT_LUT[img_g + decal_g][light_g];
-					image->data[index + 2] = LIGHT_LUT[img_b + decal_b][light_b];
+					image->data[index + 0] = Video_ApplyLight(img_r + decal_r, light_r);
+					image->data[index + 1] = Video_ApplyLight(img_g + decal_g, light_g);
+					image->data[index + 2] = Video_ApplyLight(img_b + decal_b, light_b);
 #else
-					image->data[index + 0] = LIGHT_LUT[img_r + decal_r][light_sample->r];
-					image->data[index + 1] = LIGHT_LUT[img_g + decal_g][light_sample->g];
-					image->data[index + 2] = LIGHT_LUT[img_b + decal_b][light_sample->b];
+					image->data[index + 0] = Video_ApplyLight(img_r + decal_r, light_sample->r);
+					image->data[index + 1] = Video_ApplyLight(img_g + decal_g, light_sample->g);
+					image->data[index + 2] = Video_ApplyLight(img_b + decal_b, light_sample->b);
 #endif // DISABLE_LIGHTMAPS
 				}
 			}
@@ -1270,291 +1544,1848 @@ void Video_DrawDecalSprite(Image* image, DrawingArgs* args, DrawSprite* sprite)
 		x_pos++;
 		x_pos2--;
 	}
+
+	render_data->sprite_columns_culled += columns_culled;
+	render_data->sprite_columns_drawn += columns_drawn;
+
+	if (columns_culled > 0)
+	{
+		vis->column_culled = true;
+	}
+	if (columns_drawn > 0)
+	{
+		vis->column_drawn = true;
+	}
 }
 
-void Video_DrawWallCollumn(Image* image, float* depth_buffer, Texture* texture, int x, int y1, int y2, float depth, int tx, float ty_pos, float ty_step, int lx, float ly_pos, Vec3_u16 light, int height_mask, Lightmap* lm)
+typedef struct
 {
-	unsigned char* dest = image->data;
-	size_t index = (size_t)x + (size_t)(y1) * (size_t)image->width;
+	unsigned char* dest;
+	float* depth_buffer;
+	size_t stride;
 
-	tx &= texture->width_mask;
+	Image* texture;
+	int tx;
+	int height_mask;
+	float ty_pos, ty_step;
 
-	//optimized lightmap only loop
-	if (lm && lm->data)
-	{
-		float flx = Math_Clamp((float)lx * LIGHTMAP_INV_LUXEL_SIZE, 0, lm->width - 1);
-		float flx_frac = flx - (int)flx;
+	Lightmap* lightmap;
+	float flx, flx_frac, next_flx;
+	float fly, fly_step;
 
-		float next_flx = Math_Clampl(flx + 1, 0, lm->width - 1);
+	Vec3_u16 light;
+	float depth;
 
-		float fly = (ly_pos * LIGHTMAP_INV_LUXEL_SIZE);
-		int prev_ly = -1;
+	int count;
+} WallColumn;
 
-		float fly_step = ty_step * LIGHTMAP_INV_LUXEL_SIZE;
+typedef void (*WallColumnFun)(WallColumn* col);
 
-		Vec4 lerp_light0 = Vec4_Zero();
-		Vec4 lerp_light1 = Vec4_Zero();
-		Vec4 lerp_dx = Vec4_Zero();
+static WallColumnFun s_wallColumnLightmapped;
+static WallColumnFun s_wallColumnLightmappedDepth;
 
-		for (int y = y1; y < y2; y++)
-		{
-			int ty = (int)ty_pos & height_mask;
+static void Video_WallColumnLightmapped(WallColumn* col)
+{
+	unsigned char* dest = col->dest;
+	float* depth_buffer = col->depth_buffer;
 
-			unsigned char* data = Image_Get(&texture->img, tx, ty);
+	float ty_pos = col->ty_pos;
+	float fly = col->fly;
+	int prev_ly = -1;
 
-			int ly = (int)fly;
-			float fly_frac = fly - ly;
+	Vec3_u16 light = col->light;
 
-			//sample 2 points between this and the next luxel
-			if (ly != prev_ly)
-			{
-				Lightmap_SampleWallLinearPoints(lm, flx, fly, next_flx, flx_frac, &lerp_light0, &lerp_light1);
+	Vec4 lerp_light0 = Vec4_Zero();
+	Vec4 lerp_light1 = Vec4_Zero();
+	Vec4 lerp_dx = Vec4_Zero();
 
-				lerp_dx.r = lerp_light1.r - lerp_light0.r;
-				lerp_dx.g = lerp_light1.g - lerp_light0.g;
-				lerp_dx.b = lerp_light1.b - lerp_light0.b;
+	for (int y = 0; y < col->count; y++)
+	{
+		int ty = (int)ty_pos & col->height_mask;
 
-				lerp_light0.r = lerp_light0.r + lerp_dx.r * fly_frac;
-				lerp_light0.g = lerp_light0.g + lerp_dx.g * fly_frac;
-				lerp_light0.b = lerp_light0.b + lerp_dx.b * fly_frac;
+		unsigned char* data = Image_Get(col->texture, col->tx, ty);
 
-				lerp_dx.r *= fly_step;
-				lerp_dx.g *= fly_step;
-				lerp_dx.b *= fly_step;
+		int ly = (int)fly;
+		float fly_frac = fly - ly;
 
-				prev_ly = ly;
-			}
+		//sample 2 points between this and the next luxel
+		if (ly != prev_ly)
+		{
+			Lightmap_SampleWallLinearPoints(col->lightmap, col->flx, fly, col->next_flx, col->flx_frac, &lerp_light0, &lerp_light1);
+
+			lerp_dx.r = lerp_light1.r - lerp_light0.r;
+			lerp_dx.g = lerp_light1.g - lerp_light0.g;
+			lerp_dx.b = lerp_light1.b - lerp_light0.b;
+
+			lerp_light0.r = lerp_light0.r + lerp_dx.r * fly_frac;
+			lerp_light0.g = lerp_light0.g + lerp_dx.g * fly_frac;
+			lerp_light0.b = lerp_light0.b + lerp_dx.b * fly_frac;
+
+			lerp_dx.r *= col->fly_step;
+			lerp_dx.g *= col->fly_step;
+			lerp_dx.b *= col->fly_step;
+
+			prev_ly = ly;
+		}
+
+		//light step
+		lerp_light0.r += lerp_dx.r;
+		lerp_light0.g += lerp_dx.g;
+		lerp_light0.b += lerp_dx.b;
+
+		int current_light_r = lerp_light0.r;
+		int current_light_g = lerp_light0.g;
+		int current_light_b = lerp_light0.b;
+
+		//clamp
+		current_light_r = Math_Clampl(current_light_r + light.r, 0, MAX_LIGHT_VALUE - 1);
+		current_light_g = Math_Clampl(current_light_g + light.g, 0, MAX_LIGHT_VALUE - 1);
+		current_light_b = Math_Clampl(current_light_b + light.b, 0, MAX_LIGHT_VALUE - 1);
+
+		//avoid loops
+		dest[0] = Video_ApplyLight(data[0], current_light_r);
+		dest[1] = Video_ApplyLight(data[1], current_light_g);
+		dest[2] = Video_ApplyLight(data[2], current_light_b);
+
+		*depth_buffer = col->depth;
+
+		ty_pos += col->ty_step;
+		fly += col->fly_step;
+		dest += col->stride * 4;
+		depth_buffer += col->stride;
+	}
+}
+
+static void Video_WallColumnLightmappedDepth(WallColumn* col)
+{
+	unsigned char* dest = col->dest;
+	float* depth_buffer = col->depth_buffer;
+
+	float ty_pos = col->ty_pos;
+	float fly = col->fly;
+	int prev_ly = -1;
+
+	Vec3_u16 light = col->light;
+
+	Vec4 lerp_light0 = Vec4_Zero();
+	Vec4 lerp_light1 = Vec4_Zero();
+	Vec4 lerp_dx = Vec4_Zero();
+
+	for (int y = 0; y < col->count; y++)
+	{
+		int ty = (int)ty_pos & col->height_mask;
+
+		unsigned char* data = Image_Get(col->texture, col->tx, ty);
+
+		int ly = (int)fly;
+		float fly_frac = fly - ly;
+
+		//sample 2 points between this and the next luxel
+		if (ly != prev_ly)
+		{
+			Lightmap_SampleWallLinearPoints(col->lightmap, col->flx, fly, col->next_flx, col->flx_frac, &lerp_light0, &lerp_light1);
+
+			lerp_dx.r = lerp_light1.r - lerp_light0.r;
+			lerp_dx.g = lerp_light1.g - lerp_light0.g;
+			lerp_dx.b = lerp_light1.b - lerp_light0.b;
+
+			lerp_light0.r = lerp_light0.r + lerp_dx.r * fly_frac;
+			lerp_light0.g = lerp_light0.g + lerp_dx.g * fly_frac;
+			lerp_light0.b = lerp_light0.b + lerp_dx.b * fly_frac;
+
+			lerp_dx.r *= col->fly_step;
+			lerp_dx.g *= col->fly_step;
+			lerp_dx.b *= col->fly_step;
+
+			prev_ly = ly;
+		}
+
+		//light step
+		lerp_light0.r += lerp_dx.r;
+		lerp_light0.g += lerp_dx.g;
+		lerp_light0.b += lerp_dx.b;
+
+		if (data[3] > 128 && col->depth <= *depth_buffer)
+		{
+			int current_light_r = lerp_light0.r;
+			int current_light_g = lerp_light0.g;
+			int current_light_b = lerp_light0.b;
+
+			//clamp
+			current_light_r = Math_Clampl(current_light_r + light.r, 0, MAX_LIGHT_VALUE - 1);
+			current_light_g = Math_Clampl(current_light_g + light.g, 0, MAX_LIGHT_VALUE - 1);
+			current_light_b = Math_Clampl(current_light_b + light.b, 0, MAX_LIGHT_VALUE - 1);
+
+			//avoid loops
+			dest[0] = Video_ApplyLight(data[0], current_light_r);
+			dest[1] = Video_ApplyLight(data[1], current_light_g);
+			dest[2] = Video_ApplyLight(data[2], current_light_b);
+
+			*depth_buffer = col->depth;
+		}
+
+		ty_pos += col->ty_step;
+		fly += col->fly_step;
+		dest += col->stride * 4;
+		depth_buffer += col->stride;
+	}
+}
+
+//Same math as the scalar columns, bit identical. The texture column address is worked out once instead of clamping
+//both coordinates per texel, and the three light channels are stepped, truncated and clamped together.
+//Rows are strided unless the framebuffer is column stored, so the stores stay scalar.
+
+typedef struct
+{
+	unsigned char* texels;
+	size_t ty_stride;
+	int max_ty;
+
+	__m128 lerp_light;
+	__m128 lerp_dx;
+	__m128i light;
+
+	int prev_ly;
+} WallColumn_SSE2;
+
+static void Video_WallColumnSetup_SSE2(WallColumn* col, WallColumn_SSE2* state)
+{
+	Image* texture = col->texture;
+
+	//Image_Get clamps, tx is the same for the whole column so only ty needs it per texel
+	state->texels = Image_Get(texture, col->tx, 0);
+	state->ty_stride = (texture->is_collumn_stored) ? texture->numChannels : (size_t)texture->width * texture->numChannels;
+	state->max_ty = texture->height - 1;
+
+	state->lerp_light = _mm_setzero_ps();
+	state->lerp_dx = _mm_setzero_ps();
+	state->light = _mm_setr_epi32(col->light.r, col->light.g, col->light.b, 0);
+	state->prev_ly = -1;
+}
+
+static void Video_WallColumnLightStep_SSE2(WallColumn* col, WallColumn_SSE2* state, float fly)
+{
+	int ly = (int)fly;
+	float fly_frac = fly - ly;
+
+	if (ly != state->prev_ly)
+	{
+		Vec4 lerp_light0, lerp_light1;
+		Lightmap_SampleWallLinearPoints(col->lightmap, col->flx, fly, col->next_flx, col->flx_frac, &lerp_light0, &lerp_light1);
+
+		__m128 l0 = _mm_setr_ps(lerp_light0.r, lerp_light0.g, lerp_light0.b, 0);
+		__m128 l1 = _mm_setr_ps(lerp_light1.r, lerp_light1.g, lerp_light1.b, 0);
+
+		__m128 dx = _mm_sub_ps(l1, l0);
+
+		state->lerp_light = _mm_add_ps(l0, _mm_mul_ps(dx, _mm_set1_ps(fly_frac)));
+		state->lerp_dx = _mm_mul_ps(dx, _mm_set1_ps(col->fly_step));
+
+		state->prev_ly = ly;
+	}
+
+	state->lerp_light = _mm_add_ps(state->lerp_light, state->lerp_dx);
+}
+
+static __m128i Video_WallColumnLight_SSE2(WallColumn_SSE2* state)
+{
+	__m128i li = _mm_add_epi32(_mm_cvttps_epi32(state->lerp_light), state->light);
+
+	//saturating to 16 bits first doesn't change the clamped result
+	__m128i ls = _mm_packs_epi32(li, li);
+	ls = _mm_max_epi16(ls, _mm_setzero_si128());
+	ls = _mm_min_epi16(ls, _mm_set1_epi16(MAX_LIGHT_VALUE - 1));
+
+	return ls;
+}
+
+static void Video_WallColumnLightmapped_SSE2(WallColumn* col)
+{
+	unsigned char* dest = col->dest;
+	float* depth_buffer = col->depth_buffer;
+
+	float ty_pos = col->ty_pos;
+	float fly = col->fly;
+
+	WallColumn_SSE2 state;
+	Video_WallColumnSetup_SSE2(col, &state);
+
+	for (int y = 0; y < col->count; y++)
+	{
+		int ty = Math_Clampl((int)ty_pos & col->height_mask, 0, state.max_ty);
+
+		unsigned char* data = state.texels + ty * state.ty_stride;
+
+		Video_WallColumnLightStep_SSE2(col, &state, fly);
+
+		__m128i ls = Video_WallColumnLight_SSE2(&state);
+
+		dest[0] = Video_ApplyLight(data[0], _mm_extract_epi16(ls, 0));
+		dest[1] = Video_ApplyLight(data[1], _mm_extract_epi16(ls, 1));
+		dest[2] = Video_ApplyLight(data[2], _mm_extract_epi16(ls, 2));
+
+		*depth_buffer = col->depth;
+
+		ty_pos += col->ty_step;
+		fly += col->fly_step;
+		dest += col->stride * 4;
+		depth_buffer += col->stride;
+	}
+}
+
+static void Video_WallColumnLightmappedDepth_SSE2(WallColumn* col)
+{
+	unsigned char* dest = col->dest;
+	float* depth_buffer = col->depth_buffer;
+
+	float ty_pos = col->ty_pos;
+	float fly = col->fly;
+
+	WallColumn_SSE2 state;
+	Video_WallColumnSetup_SSE2(col, &state);
+
+	for (int y = 0; y < col->count; y++)
+	{
+		int ty = Math_Clampl((int)ty_pos & col->height_mask, 0, state.max_ty);
+
+		unsigned char* data = state.texels + ty * state.ty_stride;
+
+		Video_WallColumnLightStep_SSE2(col, &state, fly);
+
+		if (data[3] > 128 && col->depth <= *depth_buffer)
+		{
+			__m128i ls = Video_WallColumnLight_SSE2(&state);
+
+			dest[0] = Video_ApplyLight(data[0], _mm_extract_epi16(ls, 0));
+			dest[1] = Video_ApplyLight(data[1], _mm_extract_epi16(ls, 1));
+			dest[2] = Video_ApplyLight(data[2], _mm_extract_epi16(ls, 2));
+
+			*depth_buffer = col->depth;
+		}
+
+		ty_pos += col->ty_step;
+		fly += col->fly_step;
+		dest += col->stride * 4;
+		depth_buffer += col->stride;
+	}
+}
+
+static void Video_SetupWallColumns()
+{
+	s_wallColumnLightmapped = Video_WallColumnLightmapped;
+	s_wallColumnLightmappedDepth = Video_WallColumnLightmappedDepth;
+
+#ifndef DISABLE_SIMD_SPANS
+	if (QueryCPUSupportsSSE2())
+	{
+		s_wallColumnLightmapped = Video_WallColumnLightmapped_SSE2;
+		s_wallColumnLightmappedDepth = Video_WallColumnLightmappedDepth_SSE2;
+
+		printf("Wall columns: SSE2 \n");
+	}
+#endif // !DISABLE_SIMD_SPANS
+}
+
+static void Video_SetupWallColumnLightmap(WallColumn* col, Lightmap* lm, int lx, float ly_pos, float ty_step)
+{
+	col->lightmap = lm;
+
+	col->flx = Math_Clamp((float)lx * LIGHTMAP_INV_LUXEL_SIZE, 0, lm->width - 1);
+	col->flx_frac = col->flx - (int)col->flx;
+
+	col->next_flx = Math_Clampl(col->flx + 1, 0, lm->width - 1);
+
+	col->fly = (ly_pos * LIGHTMAP_INV_LUXEL_SIZE);
+	col->fly_step = ty_step * LIGHTMAP_INV_LUXEL_SIZE;
+}
+
+//Surface cache blocks hold the texture already multiplied by the baked light, so columns and spans that have
+//no dynamic light on them only copy texels. Light is sampled per texel instead of being stepped along the column,
+//so it can differ from the direct path by a fraction of a texel.
+//Minified surfaces are built from their mip level, so a block still covers about as many texels as are drawn.
+//The texels match the direct path, light is sampled at the full size position of the first texel they cover.
+
+static void Video_BuildWallSurfaceBlock(SurfaceBlock* block, SurfaceDesc* desc, int bx, int by)
+{
+	Lightmap* lm = desc->lightmap;
+
+	for (int cu = 0; cu < SURFACE_BLOCK_SIZE; cu++)
+	{
+		int u = (bx << SURFACE_BLOCK_SHIFT) + cu;
+		int tx = u & desc->width_mask;
+		int lx = u * (1 << desc->mip_level) - desc->x_offset;
+
+		float flx = Math_Clamp((float)lx * LIGHTMAP_INV_LUXEL_SIZE, 0, lm->width - 1);
+		float flx_frac = flx - (int)flx;
+		int next_flx = Math_Clampl(flx + 1, 0, lm->width - 1);
+
+		unsigned char* dest = block->texels + (size_t)cu * SURFACE_BLOCK_SIZE * 4;
+
+		for (int cv = 0; cv < SURFACE_BLOCK_SIZE; cv++)
+		{
+			int v = (by << SURFACE_BLOCK_SHIFT) + cv;
+
+			unsigned char* data = Image_Get(desc->texture, tx, v & desc->height_mask);
+
+			float fly = Math_Clamp((float)(v * (1 << desc->mip_level) - desc->light_offset) * LIGHTMAP_INV_LUXEL_SIZE, 0, lm->height - 1);
+			float fly_frac = fly - (int)fly;
+
+			Vec4 lerp_light0, lerp_light1;
+			Lightmap_SampleWallLinearPoints(lm, flx, fly, next_flx, flx_frac, &lerp_light0, &lerp_light1);
+
+			int light_r = Math_Clampl(Math_lerp(lerp_light0.r, lerp_light1.r, fly_frac), 0, MAX_LIGHT_VALUE - 1);
+			int light_g = Math_Clampl(Math_lerp(lerp_light0.g, lerp_light1.g, fly_frac), 0, MAX_LIGHT_VALUE - 1);
+			int light_b = Math_Clampl(Math_lerp(lerp_light0.b, lerp_light1.b, fly_frac), 0, MAX_LIGHT_VALUE - 1);
+
+			//avoid loops
+			dest[0] = Video_ApplyLight(data[0], light_r);
+			dest[1] = Video_ApplyLight(data[1], light_g);
+			dest[2] = Video_ApplyLight(data[2], light_b);
+			dest[3] = 255;
+
+			dest += 4;
+		}
+	}
+}
+
+static void Video_BuildFlatSurfaceBlock(SurfaceBlock* block, SurfaceDesc* desc, int bx, int by)
+{
+	Lightmap* lm = desc->lightmap;
+
+	Vec3_u16 s0, s1, s2, s3;
+
+	for (int cu = 0; cu < SURFACE_BLOCK_SIZE; cu++)
+	{
+		int u = (bx << SURFACE_BLOCK_SHIFT) + cu;
+
+		//same mapping as the plane spans
+		float flx = ((float)(u * (1 << desc->mip_level)) - desc->origin_x) * LIGHTMAP_INV_LUXEL_SIZE + lm->width;
+		float lx_frac = flx - (int)flx;
+
+		unsigned char* dest = block->texels + (size_t)cu * SURFACE_BLOCK_SIZE * 4;
+
+		for (int cv = 0; cv < SURFACE_BLOCK_SIZE; cv++)
+		{
+			int v = (by << SURFACE_BLOCK_SHIFT) + cv;
+
+			float fly = ((float)(v * (1 << desc->mip_level)) - desc->origin_y) * LIGHTMAP_INV_LUXEL_SIZE;
+			float ly_frac = fly - (int)fly;
+
+			Lightmap_SamplePlaneLinearPoints(lm, flx, fly, &s0, &s1, &s2, &s3);
+
+			int light_r = Math_lerp(Math_lerp(s0.r, s1.r, lx_frac), Math_lerp(s2.r, s3.r, lx_frac), ly_frac);
+			int light_g = Math_lerp(Math_lerp(s0.g, s1.g, lx_frac), Math_lerp(s2.g, s3.g, lx_frac), ly_frac);
+			int light_b = Math_lerp(Math_lerp(s0.b, s1.b, lx_frac), Math_lerp(s2.b, s3.b, lx_frac), ly_frac);
+
+			light_r = Math_Clampl(light_r, 0, MAX_LIGHT_VALUE - 1);
+			light_g = Math_Clampl(light_g, 0, MAX_LIGHT_VALUE - 1);
+			light_b = Math_Clampl(light_b, 0, MAX_LIGHT_VALUE - 1);
+
+			unsigned char* data = Image_GetFast(desc->texture, u & desc->width_mask, v & desc->height_mask);
+
+			//avoid loops
+			dest[0] = Video_ApplyLight(data[0], light_r);
+			dest[1] = Video_ApplyLight(data[1], light_g);
+			dest[2] = Video_ApplyLight(data[2], light_b);
+			dest[3] = 255;
+
+			dest += 4;
+		}
+	}
+}
+
+static unsigned char* Video_GetSurfaceBlock(SurfaceDesc* desc, int bx, int by)
+{
+	bool build = false;
+	SurfaceBlock* block = Surface_FindBlock(desc->cache, desc, bx, by, &build);
+
+	if (build)
+	{
+		if (desc->type == SURF__FLOOR || desc->type == SURF__CEIL)
+		{
+			Video_BuildFlatSurfaceBlock(block, desc, bx, by);
+		}
+		else
+		{
+			Video_BuildWallSurfaceBlock(block, desc, bx, by);
+		}
+	}
+
+	return block->texels;
+}
+
+static void Video_WallColumnSurface(WallColumn* col, SurfaceDesc* desc, int u)
+{
+	unsigned char* dest = col->dest;
+	float* depth_buffer = col->depth_buffer;
+
+	float ty_pos = col->ty_pos;
+
+	int bx = u >> SURFACE_BLOCK_SHIFT;
+	size_t column_offset = (size_t)(u & SURFACE_BLOCK_MASK) * SURFACE_BLOCK_SIZE * 4;
+
+	//a new block is only looked up every SURFACE_BLOCK_SIZE texels
+	int prev_by = INT_MIN;
+	unsigned char* column = NULL;
+
+	for (int y = 0; y < col->count; y++)
+	{
+		int ty = (int)ty_pos;
+		int by = ty >> SURFACE_BLOCK_SHIFT;
+
+		if (by != prev_by)
+		{
+			column = Video_GetSurfaceBlock(desc, bx, by) + column_offset;
+			prev_by = by;
+		}
+
+		unsigned char* data = column + (ty & SURFACE_BLOCK_MASK) * 4;
+
+		//avoid loops
+		dest[0] = data[0];
+		dest[1] = data[1];
+		dest[2] = data[2];
+
+		*depth_buffer = col->depth;
+
+		ty_pos += col->ty_step;
+		dest += col->stride * 4;
+		depth_buffer += col->stride;
+	}
+}
+
+void Video_DrawWallCollumn(Image* image, float* depth_buffer, Texture* texture, int x, int y1, int y2, float depth, int tx, float ty_pos, float ty_step, int lx, float ly_pos, Vec3_u16 light, int height_mask, Lightmap* lm, SurfaceDesc* surface)
+{
+	unsigned char* dest = image->data;
+	size_t index = Image_PixelIndex(image, x, y1);
+	size_t y_stride = Image_YStride(image);
+
+	int x_offset = tx - lx;
+
+	//the lightmap keeps the full size coordinates, only the texture ones are scaled to the level
+	int mip_level = Image_SelectMipmap(&texture->img, ty_step);
+	float mip_scale = 1.0f / (float)(1 << mip_level);
+
+	Image* mip = Image_GetMipmap(&texture->img, mip_level);
+	float tex_ty_pos = ty_pos * mip_scale;
+	float tex_ty_step = ty_step * mip_scale;
+	int tex_height_mask = height_mask >> mip_level;
+
+	tx = (tx >> mip_level) & (texture->width_mask >> mip_level);
+
+	//optimized lightmap only loop
+	if (lm && lm->data)
+	{
+		WallColumn col;
+		col.dest = dest + index * 4;
+		col.depth_buffer = depth_buffer + index;
+		col.stride = y_stride;
+		col.texture = mip;
+		col.tx = tx;
+		col.height_mask = tex_height_mask;
+		col.ty_pos = tex_ty_pos;
+		col.ty_step = tex_ty_step;
+		col.light = light;
+		col.depth = depth;
+		col.count = y2 - y1;
+
+		//only baked light, so the pre-lit texels can be copied
+		if (surface && surface->cache && (light.r | light.g | light.b) == 0)
+		{
+			surface->texture = mip;
+			surface->mip_level = mip_level;
+			surface->lightmap = lm;
+			surface->x_offset = x_offset;
+			surface->width_mask = texture->width_mask >> mip_level;
+			surface->height_mask = tex_height_mask;
+			surface->light_offset = (int)floorf(ty_pos - ly_pos + 0.5f);
+
+			//columns of the blocks are texture x of the level, so they line up with the texels
+			Video_WallColumnSurface(&col, surface, (lx + x_offset) >> mip_level);
+			return;
+		}
+
+		Video_SetupWallColumnLightmap(&col, lm, lx, ly_pos, ty_step);
+
+		s_wallColumnLightmapped(&col);
+	}
+	else
+	{
+		int max_light = max(light.r, max(light.g, light.b));
+
+		if (max_light > 0)
+		{
+			for (int y = y1; y < y2; y++)
+			{
+				int ty = (int)tex_ty_pos & tex_height_mask;
+
+				unsigned char* data = Image_Get(mip, tx, ty);
+
+				size_t i = index * 4;
+
+				//avoid loops
+				dest[i + 0] = Video_ApplyLight(data[0], light.r);
+				dest[i + 1] = Video_ApplyLight(data[1], light.g);
+				dest[i + 2] = Video_ApplyLight(data[2], light.b);
+
+				depth_buffer[index] = depth;
+
+				tex_ty_pos += tex_ty_step;
+				index += y_stride;
+			}
+		}
+		else
+		{
+			//set depth and also set image to black
+			for (int y = y1; y < y2; y++)
+			{
+				size_t i = index * 4;
+
+				//avoid loops
+				dest[i + 0] = 0;
+				dest[i + 1] = 0;
+				dest[i + 2] = 0;
+
+				depth_buffer[index] = depth;
+
+				index += y_stride;
+			}
+		}	
+	}
+
+}
+
+void Video_DrawWallCollumnDepth(Image* image, Texture* texture, Lightmap* lm, float* depth_buffer, int x, int y1, int y2, float z, int tx, float ty_pos, float ty_step, int lx, float ly_pos, Vec3_u16 light, int height_mask)
+{
+	unsigned char* dest = image->data;
+	size_t index = Image_PixelIndex(image, x, y1);
+	size_t y_stride = Image_YStride(image);
+
+	//optimized lightmap only loop
+	if (lm && lm->data)
+	{
+		WallColumn col;
+		col.dest = dest + index * 4;
+		col.depth_buffer = depth_buffer + index;
+		col.stride = y_stride;
+		col.texture = &texture->img;
+		col.tx = tx & texture->width_mask;
+		col.height_mask = height_mask;
+		col.ty_pos = ty_pos;
+		col.ty_step = ty_step;
+		col.light = light;
+		col.depth = z;
+		col.count = y2 - y1;
+
+		Video_SetupWallColumnLightmap(&col, lm, lx, ly_pos, ty_step);
+
+		s_wallColumnLightmappedDepth(&col);
+	}
+	else
+	{
+		tx &= texture->width_mask;
+		for (int y = y1; y < y2; y++)
+		{
+			int ty = (int)ty_pos & height_mask;
+
+			unsigned char* data = Image_Get(&texture->img, tx, ty);
+
+			if (data[3] > 128 && z <= depth_buffer[index])
+			{
+				size_t i = index * 4;
+
+				//avoid loops
+				dest[i + 0] = Video_ApplyLight(data[0], light.r);
+				dest[i + 1] = Video_ApplyLight(data[1], light.g);
+				dest[i + 2] = Video_ApplyLight(data[2], light.b);
+
+				depth_buffer[index] = z;
+			}
+
+			ty_pos += ty_step;
+			index += y_stride;
+		}
+	}
+}
+
+//Column stored framebuffers are swizzled back to rows before they are uploaded, in tiles of rows so that
+//the rows being written stay in cache while the columns are read straight through.
+//Works on any 32 bit elements, so colors and depth go through the same code.
+
+#define TRANSPOSE_TILE_ROWS 64
+
+typedef void (*TransposeFun)(unsigned* dest, const unsigned* src, int width, int height, int x0, int x1);
+
+static TransposeFun s_transposeColumns;
+
+static void Video_TransposeColumns_Scalar(unsigned* dest, const unsigned* src, int width, int height, int x0, int x1)
+{
+	for (int tile_y = 0; tile_y < height; tile_y += TRANSPOSE_TILE_ROWS)
+	{
+		int tile_end_y = min(tile_y + TRANSPOSE_TILE_ROWS, height);
+
+		for (int x = x0; x < x1; x++)
+		{
+			const unsigned* column = src + (size_t)x * height;
+
+			for (int y = tile_y; y < tile_end_y; y++)
+			{
+				dest[(size_t)y * width + x] = column[y];
+			}
+		}
+	}
+}
+
+static void Video_TransposeColumns_SSE2(unsigned* dest, const unsigned* src, int width, int height, int x0, int x1)
+{
+	//4x4 blocks, the columns and rows that don't fill a block are done one element at a time
+	int block_x1 = x0 + ((x1 - x0) & ~3);
+	int block_height = height & ~3;
+
+	for (int tile_y = 0; tile_y < block_height; tile_y += TRANSPOSE_TILE_ROWS)
+	{
+		int tile_end_y = min(tile_y + TRANSPOSE_TILE_ROWS, block_height);
+
+		for (int x = x0; x < block_x1; x += 4)
+		{
+			const unsigned* c = src + (size_t)x * height;
+
+			for (int y = tile_y; y < tile_end_y; y += 4)
+			{
+				__m128i c0 = _mm_loadu_si128((const __m128i*)(c + y));
+				__m128i c1 = _mm_loadu_si128((const __m128i*)(c + height + y));
+				__m128i c2 = _mm_loadu_si128((const __m128i*)(c + height * 2 + y));
+				__m128i c3 = _mm_loadu_si128((const __m128i*)(c + height * 3 + y));
+
+				__m128i t0 = _mm_unpacklo_epi32(c0, c1);
+				__m128i t1 = _mm_unpacklo_epi32(c2, c3);
+				__m128i t2 = _mm_unpackhi_epi32(c0, c1);
+				__m128i t3 = _mm_unpackhi_epi32(c2, c3);
+
+				unsigned* d = dest + (size_t)y * width + x;
+
+				_mm_storeu_si128((__m128i*)d, _mm_unpacklo_epi64(t0, t1));
+				_mm_storeu_si128((__m128i*)(d + width), _mm_unpackhi_epi64(t0, t1));
+				_mm_storeu_si128((__m128i*)(d + width * 2), _mm_unpacklo_epi64(t2, t3));
+				_mm_storeu_si128((__m128i*)(d + width * 3), _mm_unpackhi_epi64(t2, t3));
+			}
+		}
+	}
+
+	//leftover columns
+	for (int x = block_x1; x < x1; x++)
+	{
+		const unsigned* column = src + (size_t)x * height;
+
+		for (int y = 0; y < height; y++)
+		{
+			dest[(size_t)y * width + x] = column[y];
+		}
+	}
+
+	//leftover rows
+	for (int x = x0; x < block_x1; x++)
+	{
+		const unsigned* column = src + (size_t)x * height;
+
+		for (int y = block_height; y < height; y++)
+		{
+			dest[(size_t)y * width + x] = column[y];
+		}
+	}
+}
+
+static void Video_SetupTranspose()
+{
+	s_transposeColumns = Video_TransposeColumns_Scalar;
+
+#ifndef DISABLE_SIMD_SPANS
+	if (QueryCPUSupportsSSE2())
+	{
+		s_transposeColumns = Video_TransposeColumns_SSE2;
+	}
+#endif // !DISABLE_SIMD_SPANS
+}
+
+void Video_TransposeColumns(Image* dest, Image* src, int x0, int x1)
+{
+	if (!src->is_collumn_stored || dest->is_collumn_stored || dest->width != src->width || dest->height != src->height || src->numChannels != 4 || dest->numChannels != 4)
+	{
+		return;
+	}
+
+	x0 = Math_Clampl(x0, 0, src->width);
+	x1 = Math_Clampl(x1, 0, src->width);
+
+	if (x0 >= x1)
+	{
+		return;
+	}
+
+	s_transposeColumns((unsigned*)dest->data, (const unsigned*)src->data, src->width, src->height, x0, x1);
+}
+
+#define WALL_BENCH_WIDTH 640
+#define WALL_BENCH_HEIGHT 400
+#define WALL_BENCH_TEXTURE_SIZE 128
+#define WALL_BENCH_RUNS 8
+
+static double Video_BenchWallKernel(WallColumnFun fun, WallColumn* columns, int num_columns, Image* image, float* depth_buffer, Image* src_image, float* src_depth)
+{
+	double best = 0;
+
+	for (int run = 0; run < WALL_BENCH_RUNS; run++)
+	{
+		memcpy(image->data, src_image->data, (size_t)image->width * image->height * 4);
+		memcpy(depth_buffer, src_depth, sizeof(float) * image->width * image->height);
+
+		double start_time = Time_GetSeconds();
+
+		for (int i = 0; i < num_columns; i++)
+		{
+			fun(&columns[i]);
+		}
+
+		double time = Time_GetSeconds() - start_time;
+
+		if (run == 0 || time < best)
+		{
+			best = time;
+		}
+	}
+
+	return best;
+}
+
+void Video_BenchmarkWallColumns(int num_columns)
+{
+	Image texture;
+	Image src_image, image, ref_image, col_image;
+	Lightmap lightmap;
+
+	memset(&lightmap, 0, sizeof(Lightmap));
+
+	lightmap.width = 64;
+	lightmap.height = 32;
+	lightmap.data = calloc(lightmap.width * lightmap.height, sizeof(Vec3_u16));
+
+	float* src_depth = calloc(WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT, sizeof(float));
+	float* depth_buffer = calloc(WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT, sizeof(float));
+	float* ref_depth = calloc(WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT, sizeof(float));
+	float* col_src_depth = calloc(WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT, sizeof(float));
+	float* col_depth = calloc(WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT, sizeof(float));
+	WallColumn* columns = calloc(num_columns, sizeof(WallColumn));
+	WallColumn* col_columns = calloc(num_columns, sizeof(WallColumn));
+
+	if (!lightmap.data || !src_depth || !depth_buffer || !ref_depth || !col_src_depth || !col_depth || !columns || !col_columns || num_columns <= 0
+		|| !Image_Create(&texture, WALL_BENCH_TEXTURE_SIZE, WALL_BENCH_TEXTURE_SIZE, 4) || !Image_Create(&src_image, WALL_BENCH_WIDTH, WALL_BENCH_HEIGHT, 4)
+		|| !Image_Create(&image, WALL_BENCH_WIDTH, WALL_BENCH_HEIGHT, 4) || !Image_Create(&ref_image, WALL_BENCH_WIDTH, WALL_BENCH_HEIGHT, 4)
+		|| !Image_Create(&col_image, WALL_BENCH_WIDTH, WALL_BENCH_HEIGHT, 4))
+	{
+		printf("Wall column benchmark: out of memory \n");
+		return;
+	}
+
+	//fixed seed so runs can be compared
+	srand(1);
+
+	texture.is_collumn_stored = true;
+
+	for (int i = 0; i < texture.width * texture.height * texture.numChannels; i++)
+	{
+		texture.data[i] = rand() & 255;
+	}
+	for (int i = 0; i < lightmap.width * lightmap.height; i++)
+	{
+		lightmap.data[i].r = rand() % MAX_LIGHT_VALUE;
+		lightmap.data[i].g = rand() % MAX_LIGHT_VALUE;
+		lightmap.data[i].b = rand() % MAX_LIGHT_VALUE;
+	}
+	for (int i = 0; i < WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT; i++)
+	{
+		src_depth[i] = (float)(rand() % 1000);
+	}
+
+	//same targets in a column stored framebuffer, the source image is all zeroes in both layouts
+	col_image.is_collumn_stored = true;
+
+	for (int x = 0; x < WALL_BENCH_WIDTH; x++)
+	{
+		for (int y = 0; y < WALL_BENCH_HEIGHT; y++)
+		{
+			col_src_depth[(size_t)x * WALL_BENCH_HEIGHT + y] = src_depth[x + (size_t)y * WALL_BENCH_WIDTH];
+		}
+	}
+
+	long long num_pixels = 0;
+
+	for (int i = 0; i < num_columns; i++)
+	{
+		WallColumn* col = &columns[i];
+
+		int x = rand() % WALL_BENCH_WIDTH;
+		int y1 = rand() % WALL_BENCH_HEIGHT;
+		int y2 = y1 + rand() % (WALL_BENCH_HEIGHT - y1 + 1);
+
+		float ty_step = 0.05f + (rand() % 400) / 100.0f;
+		float ly_pos = (float)(rand() % 256);
+
+		col->dest = image.data + ((size_t)x + (size_t)y1 * WALL_BENCH_WIDTH) * 4;
+		col->depth_buffer = depth_buffer + x + (size_t)y1 * WALL_BENCH_WIDTH;
+		col->stride = WALL_BENCH_WIDTH;
+		col->texture = &texture;
+		col->tx = rand() % WALL_BENCH_TEXTURE_SIZE;
+		col->height_mask = WALL_BENCH_TEXTURE_SIZE - 1;
+		col->ty_pos = (float)(rand() % 512);
+		col->ty_step = ty_step;
+		col->light.r = rand() % 256;
+		col->light.g = rand() % 256;
+		col->light.b = rand() % 256;
+		col->depth = (float)(rand() % 1000);
+		col->count = y2 - y1;
+
+		Video_SetupWallColumnLightmap(col, &lightmap, rand() % (lightmap.width * (int)LIGHTMAP_LUXEL_SIZE), ly_pos, ty_step);
+
+		num_pixels += col->count;
+
+		col_columns[i] = *col;
+		col_columns[i].dest = col_image.data + ((size_t)x * WALL_BENCH_HEIGHT + y1) * 4;
+		col_columns[i].depth_buffer = col_depth + (size_t)x * WALL_BENCH_HEIGHT + y1;
+		col_columns[i].stride = 1;
+	}
+
+	printf("Wall column benchmark: %i columns, %lld pixels, best of %i runs \n", num_columns, num_pixels, WALL_BENCH_RUNS);
+
+	WallColumnFun scalar_funs[2] = { Video_WallColumnLightmapped, Video_WallColumnLightmappedDepth };
+	WallColumnFun simd_funs[2] = { Video_WallColumnLightmapped_SSE2, Video_WallColumnLightmappedDepth_SSE2 };
+	const char* names[2] = { "lightmapped", "lightmapped depth" };
+
+	for (int k = 0; k < 2; k++)
+	{
+		double scalar_time = Video_BenchWallKernel(scalar_funs[k], columns, num_columns, &image, depth_buffer, &src_image, src_depth);
+
+		memcpy(ref_image.data, image.data, (size_t)WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT * 4);
+		memcpy(ref_depth, depth_buffer, sizeof(float) * WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT);
+
+		double simd_time = Video_BenchWallKernel(simd_funs[k], columns, num_columns, &image, depth_buffer, &src_image, src_depth);
+
+		bool identical = !memcmp(ref_image.data, image.data, (size_t)WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT * 4) 
+			&& !memcmp(ref_depth, depth_buffer, sizeof(float) * WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT);
+
+		printf("%-18s scalar %8.3f ms (%6.2f ns/px), sse2 %8.3f ms (%6.2f ns/px), %.2fx, %s \n", names[k],
+			scalar_time * 1000.0, scalar_time * 1e9 / max(num_pixels, 1), simd_time * 1000.0, simd_time * 1e9 / max(num_pixels, 1), 
+			(simd_time > 0) ? scalar_time / simd_time : 0.0, (identical) ? "identical" : "MISMATCH");
+
+		//sse2 again, into the column stored framebuffer, then swizzled back to rows to check it
+		double col_time = Video_BenchWallKernel(simd_funs[k], col_columns, num_columns, &col_image, col_depth, &src_image, col_src_depth);
+
+		double start_time = Time_GetSeconds();
+
+		s_transposeColumns((unsigned*)image.data, (const unsigned*)col_image.data, WALL_BENCH_WIDTH, WALL_BENCH_HEIGHT, 0, WALL_BENCH_WIDTH);
+
+		double transpose_time = Time_GetSeconds() - start_time;
+
+		s_transposeColumns((unsigned*)depth_buffer, (const unsigned*)col_depth, WALL_BENCH_WIDTH, WALL_BENCH_HEIGHT, 0, WALL_BENCH_WIDTH);
+
+		identical = !memcmp(ref_image.data, image.data, (size_t)WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT * 4)
+			&& !memcmp(ref_depth, depth_buffer, sizeof(float) * WALL_BENCH_WIDTH * WALL_BENCH_HEIGHT);
+
+		printf("%-18s sse2 columns %8.3f ms (%6.2f ns/px), transpose %8.3f ms, %.2fx, %s \n", names[k],
+			col_time * 1000.0, col_time * 1e9 / max(num_pixels, 1), transpose_time * 1000.0,
+			(col_time > 0) ? scalar_time / col_time : 0.0, (identical) ? "identical" : "MISMATCH");
+	}
+
+	Image_Destruct(&texture);
+	Image_Destruct(&src_image);
+	Image_Destruct(&image);
+	Image_Destruct(&ref_image);
+	Image_Destruct(&col_image);
+
+	free(lightmap.data);
+	free(src_depth);
+	free(depth_buffer);
+	free(ref_depth);
+	free(col_src_depth);
+	free(col_depth);
+	free(columns);
+	free(col_columns);
+}
+
+void Video_DrawSkyPlaneStripe(Image* image, float* depth_buffer, Texture* texture, int x, int y1, int y2, LineDrawArgs* args)
+{
+	if (y2 <= y1)
+	{
+		return;
+	}
+
+	const float TEX_HEIGHT_SCALE = 0.35;
+	const float TEX_Y_OFFSET = 28.0 * 0.5;
+
+	unsigned char* dest = image->data;
+	size_t index = Image_PixelIndex(image, x, y1);
+	size_t y_stride = Image_YStride(image);
+
+	float tex_cylinder = texture->img.width;
+	float tex_height = texture->img.height * TEX_HEIGHT_SCALE;
+
+	float x_angle = (0.5 - x / (float)image->width) * args->draw_args->tangent * Math_DegToRad(90);
+	float angle = (args->plane_angle + x_angle) * tex_cylinder;
+
+	angle = fabs(angle);
+
+	float tex_y_step = args->sky_plane_y_step * tex_height;
+	float tex_y_pos = (float)y1 * tex_y_step;
+
+	tex_y_pos += TEX_Y_OFFSET;
+
+	int tex_x = (int)angle & texture->width_mask;
+
+	for (int y = y1; y < y2; y++)
+	{
+		unsigned char* data = Image_GetFast(&texture->img, tex_x, (int)tex_y_pos & texture->height_mask);
+
+		size_t i = index * 4;
+
+		//avoid loops
+		dest[i + 0] = data[0];
+		dest[i + 1] = data[1];
+		dest[i + 2] = data[2];
+
+		depth_buffer[index] = DEPTH_CLEAR;
+
+		tex_y_pos += tex_y_step;
+		index += y_stride;
+	}
+}
+typedef struct
+{
+	unsigned char* dest;
+	float* depth_buffer;
+
+	Image* texture;
+	int tex_mask;
+	Lightmap* lightmap;
+
+	float x_pos, y_pos;
+	float x_step, y_step;
+
+	float flx_pos, fly_pos;
+	float flx_step, fly_step;
+
+	float distance;
+
+	Vec3_u16 extra_light;
+	int light_r, light_g, light_b;
+
+	int count;
+} PlaneSpan;
+
+typedef void (*PlaneSpanFun)(PlaneSpan* span);
+
+static PlaneSpanFun s_planeSpanLightmapped;
+static PlaneSpanFun s_planeSpanFlat;
+
+//Plane light is the bilinear lerp of the four luxels around each pixel, in fixed point so that the simd spans can do the
+//same math with a couple of multiply adds and still match. The fractions are clamped, outside the lightmap the edge luxels are used.
+#define SPAN_LIGHT_FRAC_BITS 14
+#define SPAN_LIGHT_FRAC_ONE (1 << SPAN_LIGHT_FRAC_BITS)
+
+static inline int Video_SpanLightFrac(float f)
+{
+	return Math_Clampl((int)((f - (int)f) * SPAN_LIGHT_FRAC_ONE), 0, SPAN_LIGHT_FRAC_ONE - 1);
+}
+
+static inline int Video_SpanLightLerp(int s0, int s1, int s2, int s3, int fx, int fy)
+{
+	int top = (s0 * (SPAN_LIGHT_FRAC_ONE - fx) + s1 * fx) >> SPAN_LIGHT_FRAC_BITS;
+	int bottom = (s2 * (SPAN_LIGHT_FRAC_ONE - fx) + s3 * fx) >> SPAN_LIGHT_FRAC_BITS;
+
+	return (top * (SPAN_LIGHT_FRAC_ONE - fy) + bottom * fy) >> SPAN_LIGHT_FRAC_BITS;
+}
+
+static void Video_PlaneSpanLightmapped(PlaneSpan* span)
+{
+	Lightmap* lightmap = span->lightmap;
+	Vec3_u16 extra_light = span->extra_light;
+
+	unsigned char* dest = span->dest;
+
+	float x_pos = span->x_pos;
+	float y_pos = span->y_pos;
+	float flx_pos = span->flx_pos;
+	float fly_pos = span->fly_pos;
+
+	Vec3_u16 s0 = Vec3_u16_Zero();
+	Vec3_u16 s1 = Vec3_u16_Zero();
+	Vec3_u16 s2 = Vec3_u16_Zero();
+	Vec3_u16 s3 = Vec3_u16_Zero();
+
+	int prev_lx = -1;
+	int prev_ly = -1;
+
+	for (int x = 0; x < span->count; x++)
+	{
+		float flx = flx_pos + lightmap->width;
+		float fly = fly_pos;
+
+		int lx = (int)flx;
+		int ly = (int)fly;
+
+		if (lx != prev_lx || ly != prev_ly)
+		{
+			Lightmap_SamplePlaneLinearPoints(lightmap, flx, fly, &s0, &s1, &s2, &s3);
+
+			prev_lx = lx;
+			prev_ly = ly;
+		}
+
+		int fx = Video_SpanLightFrac(flx);
+		int fy = Video_SpanLightFrac(fly);
+
+		int light_r = Video_SpanLightLerp(s0.r, s1.r, s2.r, s3.r, fx, fy);
+		int light_g = Video_SpanLightLerp(s0.g, s1.g, s2.g, s3.g, fx, fy);
+		int light_b = Video_SpanLightLerp(s0.b, s1.b, s2.b, s3.b, fx, fy);
+
+		light_r = Math_Clampl(light_r + extra_light.r, 0, MAX_LIGHT_VALUE - 1);
+		light_g = Math_Clampl(light_g + extra_light.g, 0, MAX_LIGHT_VALUE - 1);
+		light_b = Math_Clampl(light_b + extra_light.b, 0, MAX_LIGHT_VALUE - 1);
+
+		unsigned char* data = Image_GetFast(span->texture, (int)x_pos & span->tex_mask, (int)y_pos & span->tex_mask);
+
+		size_t i = (size_t)x * 4;
+
+		//avoid loops
+		dest[i + 0] = Video_ApplyLight(data[0], light_r);
+		dest[i + 1] = Video_ApplyLight(data[1], light_g);
+		dest[i + 2] = Video_ApplyLight(data[2], light_b);
+
+		span->depth_buffer[x] = span->distance;
+
+		x_pos += span->x_step;
+		y_pos += span->y_step;
+		flx_pos += span->flx_step;
+		fly_pos += span->fly_step;
+	}
+}
+
+static void Video_PlaneSpanSurface(PlaneSpan* span, SurfaceDesc* desc)
+{
+	unsigned char* dest = span->dest;
+
+	float x_pos = span->x_pos;
+	float y_pos = span->y_pos;
+
+	int prev_bx = INT_MIN;
+	int prev_by = INT_MIN;
+	unsigned char* block = NULL;
+
+	for (int x = 0; x < span->count; x++)
+	{
+		int u = (int)x_pos;
+		int v = (int)y_pos;
+
+		int bx = u >> SURFACE_BLOCK_SHIFT;
+		int by = v >> SURFACE_BLOCK_SHIFT;
+
+		if (bx != prev_bx || by != prev_by)
+		{
+			block = Video_GetSurfaceBlock(desc, bx, by);
+			prev_bx = bx;
+			prev_by = by;
+		}
+
+		unsigned char* data = block + ((size_t)((u & SURFACE_BLOCK_MASK) << SURFACE_BLOCK_SHIFT) + (v & SURFACE_BLOCK_MASK)) * 4;
+
+		size_t i = (size_t)x * 4;
+
+		//avoid loops
+		dest[i + 0] = data[0];
+		dest[i + 1] = data[1];
+		dest[i + 2] = data[2];
+
+		span->depth_buffer[x] = span->distance;
+
+		x_pos += span->x_step;
+		y_pos += span->y_step;
+	}
+}
+
+static void Video_PlaneSpanFlat(PlaneSpan* span)
+{
+	unsigned char* dest = span->dest;
+
+	float x_pos = span->x_pos;
+	float y_pos = span->y_pos;
+
+	for (int x = 0; x < span->count; x++)
+	{
+		unsigned char* data = Image_GetFast(span->texture, (int)x_pos & span->tex_mask, (int)y_pos & span->tex_mask);
+
+		size_t i = (size_t)x * 4;
+
+		//avoid loops
+		dest[i + 0] = Video_ApplyLight(data[0], span->light_r);
+		dest[i + 1] = Video_ApplyLight(data[1], span->light_g);
+		dest[i + 2] = Video_ApplyLight(data[2], span->light_b);
+
+		span->depth_buffer[x] = span->distance;
+
+		x_pos += span->x_step;
+		y_pos += span->y_step;
+	}
+}
+
+//The simd spans give the same output as the scalar ones. Positions are running sums, so they are still stepped one pixel at a time,
+//the light lerp of a pixel is done for all three channels at once and the batches cover texel addressing, the light multiply and the depth stores.
+//The multiply is always the fixed point form, which the light table holds the same values as.
+
+#define SPAN_BATCH_SSE2 4
+#define SPAN_BATCH_AVX2 8
+
+//msvc takes avx2 intrinsics anywhere, gcc and clang only in functions built for avx2
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+typedef struct
+{
+	//luxels of the current cell, s0 s1 and s2 s3 side by side for each channel
+	__m128i top, bottom;
+	__m128i extra_light;
+
+	int prev_lx, prev_ly;
+} SpanLight_SSE2;
+
+static void Video_SpanLightSetup_SSE2(SpanLight_SSE2* light, Vec3_u16 extra_light)
+{
+	light->top = _mm_setzero_si128();
+	light->bottom = _mm_setzero_si128();
+	light->extra_light = _mm_setr_epi32(extra_light.r, extra_light.g, extra_light.b, 0);
+	light->prev_lx = -1;
+	light->prev_ly = -1;
+}
+
+//cells and lerp weights of a batch of light positions, the same float math as Video_SpanLightFrac.
+//a weight is 1 - frac in the low 16 bits and frac in the high ones, to multiply add with a pair of luxels
+static void Video_SpanLightWeights_SSE2(float* fs, int* r_cells, int* r_weights)
+{
+	__m128 f = _mm_loadu_ps(fs);
+	__m128i cell = _mm_cvttps_epi32(f);
+	__m128i frac = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(f, _mm_cvtepi32_ps(cell)), _mm_set1_ps(SPAN_LIGHT_FRAC_ONE)));
+
+	//only negative positions need the clamp, the fraction of the rest is below one
+	frac = _mm_andnot_si128(_mm_srai_epi32(frac, 31), frac);
+
+	_mm_storeu_si128((__m128i*)r_cells, cell);
+	_mm_storeu_si128((__m128i*)r_weights, _mm_or_si128(_mm_slli_epi32(frac, 16), _mm_sub_epi32(_mm_set1_epi32(SPAN_LIGHT_FRAC_ONE), frac)));
+}
+
+TARGET_AVX2 static void Video_SpanLightWeights_AVX2(float* fs, int* r_cells, int* r_weights)
+{
+	__m256 f = _mm256_loadu_ps(fs);
+	__m256i cell = _mm256_cvttps_epi32(f);
+	__m256i frac = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(f, _mm256_cvtepi32_ps(cell)), _mm256_set1_ps(SPAN_LIGHT_FRAC_ONE)));
+
+	frac = _mm256_max_epi32(frac, _mm256_setzero_si256());
+
+	_mm256_storeu_si256((__m256i*)r_cells, cell);
+	_mm256_storeu_si256((__m256i*)r_weights, _mm256_or_si256(_mm256_slli_epi32(frac, 16), _mm256_sub_epi32(_mm256_set1_epi32(SPAN_LIGHT_FRAC_ONE), frac)));
+}
+
+static __m128i Video_SpanLight_SSE2(SpanLight_SSE2* light, Lightmap* lightmap, float flx, float fly, int lx, int ly, int weight_x, int weight_y)
+{
+	if (lx != light->prev_lx || ly != light->prev_ly)
+	{
+		Vec3_u16 s0, s1, s2, s3;
+		Lightmap_SamplePlaneLinearPoints(lightmap, flx, fly, &s0, &s1, &s2, &s3);
+
+		light->top = _mm_setr_epi16(s0.r, s1.r, s0.g, s1.g, s0.b, s1.b, 0, 0);
+		light->bottom = _mm_setr_epi16(s2.r, s3.r, s2.g, s3.g, s2.b, s3.b, 0, 0);
+
+		light->prev_lx = lx;
+		light->prev_ly = ly;
+	}
+
+	//a multiply add does both products of a lerp and their sum
+	__m128i wx = _mm_set1_epi32(weight_x);
+	__m128i wy = _mm_set1_epi32(weight_y);
+
+	__m128i top = _mm_srai_epi32(_mm_madd_epi16(light->top, wx), SPAN_LIGHT_FRAC_BITS);
+	__m128i bottom = _mm_srai_epi32(_mm_madd_epi16(light->bottom, wx), SPAN_LIGHT_FRAC_BITS);
+
+	//luxels are well below 16 bits, so top and bottom fit side by side for the lerp along y
+	__m128i l = _mm_madd_epi16(_mm_or_si128(top, _mm_slli_epi32(bottom, 16)), wy);
+	__m128i li = _mm_add_epi32(_mm_srai_epi32(l, SPAN_LIGHT_FRAC_BITS), light->extra_light);
+
+	//saturating to 16 bits first doesn't change the clamped result
+	__m128i ls = _mm_packs_epi32(li, li);
+	ls = _mm_max_epi16(ls, _mm_setzero_si128());
+	ls = _mm_min_epi16(ls, _mm_set1_epi16(MAX_LIGHT_VALUE - 1));
+
+	return ls;
+}
+
+static __m128i Video_SpanLightStep_SSE2(SpanLight_SSE2* light, Lightmap* lightmap, float flx, float fly)
+{
+	int fx = Video_SpanLightFrac(flx);
+	int fy = Video_SpanLightFrac(fly);
+
+	return Video_SpanLight_SSE2(light, lightmap, flx, fly, (int)flx, (int)fly, (fx << 16) | (SPAN_LIGHT_FRAC_ONE - fx), (fy << 16) | (SPAN_LIGHT_FRAC_ONE - fy));
+}
+
+static unsigned int Video_SpanTexel(Image* texture, int tx, int ty)
+{
+	unsigned char* data = Image_GetFast(texture, tx, ty);
+
+	return data[0] | (data[1] << 8) | (data[2] << 16);
+}
+
+static void Video_SpanTexels_SSE2(Image* texture, int tex_mask, float* xs, float* ys, unsigned int* r_texels)
+{
+	__m128i mask = _mm_set1_epi32(tex_mask);
+
+	int txs[SPAN_BATCH_SSE2];
+	int tys[SPAN_BATCH_SSE2];
+
+	_mm_storeu_si128((__m128i*)txs, _mm_and_si128(_mm_cvttps_epi32(_mm_loadu_ps(xs)), mask));
+	_mm_storeu_si128((__m128i*)tys, _mm_and_si128(_mm_cvttps_epi32(_mm_loadu_ps(ys)), mask));
+
+	for (int k = 0; k < SPAN_BATCH_SSE2; k++)
+	{
+		r_texels[k] = Video_SpanTexel(texture, txs[k], tys[k]);
+	}
+}
+
+TARGET_AVX2 static void Video_SpanTexels_AVX2(Image* texture, int tex_mask, float* xs, float* ys, unsigned int* r_texels)
+{
+	__m256i mask = _mm256_set1_epi32(tex_mask);
+
+	__m256i tx = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(xs)), mask);
+	__m256i ty = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_loadu_ps(ys)), mask);
+
+	//gathering whole dwords would read past the last texel of 3 channel images
+	if (texture->numChannels != 4)
+	{
+		int txs[SPAN_BATCH_AVX2];
+		int tys[SPAN_BATCH_AVX2];
+
+		_mm256_storeu_si256((__m256i*)txs, tx);
+		_mm256_storeu_si256((__m256i*)tys, ty);
+
+		for (int k = 0; k < SPAN_BATCH_AVX2; k++)
+		{
+			r_texels[k] = Video_SpanTexel(texture, txs[k], tys[k]);
+		}
+		return;
+	}
+
+	//same addressing as Image_GetFast
+	__m256i x_scale = _mm256_set1_epi32((texture->is_collumn_stored) ? texture->height : 1);
+	__m256i y_scale = _mm256_set1_epi32((texture->is_collumn_stored) ? 1 : texture->width);
+
+	__m256i offset = _mm256_add_epi32(_mm256_mullo_epi32(tx, x_scale), _mm256_mullo_epi32(ty, y_scale));
+
+	__m256i texels = _mm256_i32gather_epi32((const int*)texture->data, offset, 4);
+	texels = _mm256_and_si256(texels, _mm256_set1_epi32(0xffffff));
+
+	_mm256_storeu_si256((__m256i*)r_texels, texels);
+}
+
+static void Video_SpanStoreLit(unsigned char* d, unsigned int texel, int light_r, int light_g, int light_b)
+{
+	d[0] = Video_ApplyLight(texel & 255, light_r);
+	d[1] = Video_ApplyLight((texel >> 8) & 255, light_g);
+	d[2] = Video_ApplyLight((texel >> 16) & 255, light_b);
+}
 
-			//light step
-			lerp_light0.r += lerp_dx.r;
-			lerp_light0.g += lerp_dx.g;
-			lerp_light0.b += lerp_dx.b;
+//channels of two pixels as 16 bits each, texel * light is up to 20 bits so the low and high halves are multiplied separately
+static __m128i Video_ApplyLight_SSE2(__m128i texels, __m128i lights)
+{
+	__m128i lo = _mm_mullo_epi16(texels, lights);
+	__m128i hi = _mm_mulhi_epu16(texels, lights);
 
-			int current_light_r = lerp_light0.r;
-			int current_light_g = lerp_light0.g;
-			int current_light_b = lerp_light0.b;
+	__m128i p0 = _mm_unpacklo_epi16(lo, hi);
+	__m128i p1 = _mm_unpackhi_epi16(lo, hi);
 
-			//clamp
-			current_light_r = Math_Clampl(current_light_r + light.r, 0, MAX_LIGHT_VALUE - 1);
-			current_light_g = Math_Clampl(current_light_g + light.g, 0, MAX_LIGHT_VALUE - 1);
-			current_light_b = Math_Clampl(current_light_b + light.b, 0, MAX_LIGHT_VALUE - 1);
+	//times LIGHT_FIXED_SCALE is a shift and an add
+	__m128i bias = _mm_set1_epi32(LIGHT_FIXED_SCALE);
 
-			size_t i = index * 4;
+	p0 = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(p0, _mm_slli_epi32(p0, 8)), bias), 16);
+	p1 = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(p1, _mm_slli_epi32(p1, 8)), bias), 16);
 
-			//avoid loops
-			dest[i + 0] = LIGHT_LUT[data[0]][current_light_r];
-			dest[i + 1] = LIGHT_LUT[data[1]][current_light_g];
-			dest[i + 2] = LIGHT_LUT[data[2]][current_light_b];
+	return _mm_packs_epi32(p0, p1);
+}
 
-			depth_buffer[index] = depth;
+TARGET_AVX2 static __m256i Video_ApplyLight_AVX2(__m256i texels, __m256i lights)
+{
+	__m256i lo = _mm256_mullo_epi16(texels, lights);
+	__m256i hi = _mm256_mulhi_epu16(texels, lights);
 
-			ty_pos += ty_step;
-			fly += fly_step;
-			index += image->width;
-		}
-	}
-	else
-	{
-		int max_light = max(light.r, max(light.g, light.b));
+	__m256i p0 = _mm256_unpacklo_epi16(lo, hi);
+	__m256i p1 = _mm256_unpackhi_epi16(lo, hi);
 
-		if (max_light > 0)
-		{
-			for (int y = y1; y < y2; y++)
-			{
-				int ty = (int)ty_pos & height_mask;
+	__m256i bias = _mm256_set1_epi32(LIGHT_FIXED_SCALE);
 
-				unsigned char* data = Image_Get(&texture->img, tx, ty);
+	p0 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(p0, _mm256_slli_epi32(p0, 8)), bias), 16);
+	p1 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(p1, _mm256_slli_epi32(p1, 8)), bias), 16);
 
-				size_t i = index * 4;
+	return _mm256_packs_epi32(p0, p1);
+}
 
-				//avoid loops
-				dest[i + 0] = LIGHT_LUT[data[0]][light.r];
-				dest[i + 1] = LIGHT_LUT[data[1]][light.g];
-				dest[i + 2] = LIGHT_LUT[data[2]][light.b];
+//lights are r g b 0 per pixel, 16 bits each, for pixels 0 1 and 2 3. the alpha of the destination is kept like the scalar stores do
+static void Video_SpanStoreLit_SSE2(unsigned char* dest, unsigned int* texels, __m128i lights01, __m128i lights23)
+{
+	__m128i t = _mm_loadu_si128((const __m128i*)texels);
 
-				depth_buffer[index] = depth;
+#ifdef WHITE_TEXTURES
+	t = _mm_set1_epi32(0xffffff);
+#endif // WHITE_TEXTURES
 
-				ty_pos += ty_step;
-				index += image->width;
-			}
+	__m128i lit01 = Video_ApplyLight_SSE2(_mm_unpacklo_epi8(t, _mm_setzero_si128()), lights01);
+	__m128i lit23 = Video_ApplyLight_SSE2(_mm_unpackhi_epi8(t, _mm_setzero_si128()), lights23);
+
+	//saturating to 8 bits is the clamp at 255
+	__m128i lit = _mm_packus_epi16(lit01, lit23);
+	__m128i alpha = _mm_and_si128(_mm_loadu_si128((const __m128i*)dest), _mm_set1_epi32(0xff000000));
+
+	_mm_storeu_si128((__m128i*)dest, _mm_or_si128(lit, alpha));
+}
+
+//same for 8 pixels, the unpacks work within each 128 bit half so the lights are for pixels 0 1 4 5 and 2 3 6 7
+TARGET_AVX2 static void Video_SpanStoreLit_AVX2(unsigned char* dest, unsigned int* texels, __m256i lights0145, __m256i lights2367)
+{
+	__m256i t = _mm256_loadu_si256((const __m256i*)texels);
+
+#ifdef WHITE_TEXTURES
+	t = _mm256_set1_epi32(0xffffff);
+#endif // WHITE_TEXTURES
+
+	__m256i lit0145 = Video_ApplyLight_AVX2(_mm256_unpacklo_epi8(t, _mm256_setzero_si256()), lights0145);
+	__m256i lit2367 = Video_ApplyLight_AVX2(_mm256_unpackhi_epi8(t, _mm256_setzero_si256()), lights2367);
+
+	__m256i lit = _mm256_packus_epi16(lit0145, lit2367);
+	__m256i alpha = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)dest), _mm256_set1_epi32(0xff000000));
+
+	_mm256_storeu_si256((__m256i*)dest, _mm256_or_si256(lit, alpha));
+}
+
+TARGET_AVX2 static void Video_SpanStoreLitBatch_AVX2(unsigned char* dest, unsigned int* texels, unsigned short lights[][4])
+{
+	__m256i lights0123 = _mm256_loadu_si256((const __m256i*)lights[0]);
+	__m256i lights4567 = _mm256_loadu_si256((const __m256i*)lights[4]);
+
+	Video_SpanStoreLit_AVX2(dest, texels, _mm256_permute2x128_si256(lights0123, lights4567, 0x20), _mm256_permute2x128_si256(lights0123, lights4567, 0x31));
+}
+
+TARGET_AVX2 static void Video_SpanStoreFlatBatch_AVX2(unsigned char* dest, unsigned int* texels, __m128i light)
+{
+	__m256i lights = _mm256_broadcastsi128_si256(light);
+
+	Video_SpanStoreLit_AVX2(dest, texels, lights, lights);
+}
+
+static void Video_PlaneSpanLightmapped_SIMD(PlaneSpan* span, bool avx2)
+{
+	Lightmap* lightmap = span->lightmap;
+	Image* texture = span->texture;
+
+	unsigned char* dest = span->dest;
+	float* depth_buffer = span->depth_buffer;
+
+	float x_pos = span->x_pos;
+	float y_pos = span->y_pos;
+	float flx_pos = span->flx_pos;
+	float fly_pos = span->fly_pos;
+
+	int batch = (avx2) ? SPAN_BATCH_AVX2 : SPAN_BATCH_SSE2;
+
+	SpanLight_SSE2 light;
+	Video_SpanLightSetup_SSE2(&light, span->extra_light);
+
+	__m128 depth = _mm_set1_ps(span->distance);
+
+	float xs[SPAN_BATCH_AVX2];
+	float ys[SPAN_BATCH_AVX2];
+	float flxs[SPAN_BATCH_AVX2];
+	float flys[SPAN_BATCH_AVX2];
+	int lxs[SPAN_BATCH_AVX2];
+	int lys[SPAN_BATCH_AVX2];
+	int weights_x[SPAN_BATCH_AVX2];
+	int weights_y[SPAN_BATCH_AVX2];
+	unsigned int texels[SPAN_BATCH_AVX2];
+	unsigned short lights[SPAN_BATCH_AVX2][4];
+
+	int x = 0;
+
+	for (; x + batch <= span->count; x += batch)
+	{
+		for (int k = 0; k < batch; k++)
+		{
+			xs[k] = x_pos;
+			ys[k] = y_pos;
+			flxs[k] = flx_pos + lightmap->width;
+			flys[k] = fly_pos;
+
+			x_pos += span->x_step;
+			y_pos += span->y_step;
+			flx_pos += span->flx_step;
+			fly_pos += span->fly_step;
+		}
+
+		if (avx2)
+		{
+			Video_SpanLightWeights_AVX2(flxs, lxs, weights_x);
+			Video_SpanLightWeights_AVX2(flys, lys, weights_y);
 		}
 		else
 		{
-			//set depth and also set image to black
-			for (int y = y1; y < y2; y++)
-			{
-				size_t i = index * 4;
+			Video_SpanLightWeights_SSE2(flxs, lxs, weights_x);
+			Video_SpanLightWeights_SSE2(flys, lys, weights_y);
+		}
 
-				//avoid loops
-				dest[i + 0] = 0;
-				dest[i + 1] = 0;
-				dest[i + 2] = 0;
+		for (int k = 0; k < batch; k++)
+		{
+			__m128i ls = Video_SpanLight_SSE2(&light, lightmap, flxs[k], flys[k], lxs[k], lys[k], weights_x[k], weights_y[k]);
+			_mm_storel_epi64((__m128i*)lights[k], ls);
+		}
 
-				depth_buffer[index] = depth;
+		if (avx2)
+		{
+			Video_SpanTexels_AVX2(texture, span->tex_mask, xs, ys, texels);
+			Video_SpanStoreLitBatch_AVX2(dest + (size_t)x * 4, texels, lights);
+		}
+		else
+		{
+			Video_SpanTexels_SSE2(texture, span->tex_mask, xs, ys, texels);
+			Video_SpanStoreLit_SSE2(dest + (size_t)x * 4, texels, _mm_loadu_si128((const __m128i*)lights[0]), _mm_loadu_si128((const __m128i*)lights[2]));
+		}
 
-				index += image->width;
-			}
-		}	
+		for (int k = 0; k < batch; k += 4)
+		{
+			_mm_storeu_ps(depth_buffer + x + k, depth);
+		}
 	}
 
+	//leftover pixels, the light state has to carry on from the batches
+	for (; x < span->count; x++)
+	{
+		__m128i ls = Video_SpanLightStep_SSE2(&light, lightmap, flx_pos + lightmap->width, fly_pos);
+		_mm_storel_epi64((__m128i*)lights[0], ls);
+
+		unsigned int texel = Video_SpanTexel(texture, (int)x_pos & span->tex_mask, (int)y_pos & span->tex_mask);
+
+		Video_SpanStoreLit(dest + (size_t)x * 4, texel, lights[0][0], lights[0][1], lights[0][2]);
+
+		depth_buffer[x] = span->distance;
+
+		x_pos += span->x_step;
+		y_pos += span->y_step;
+		flx_pos += span->flx_step;
+		fly_pos += span->fly_step;
+	}
 }
 
-void Video_DrawWallCollumnDepth(Image* image, Texture* texture, Lightmap* lm, float* depth_buffer, int x, int y1, int y2, float z, int tx, float ty_pos, float ty_step, int lx, float ly_pos, Vec3_u16 light, int height_mask)
+static void Video_PlaneSpanFlat_SIMD(PlaneSpan* span, bool avx2)
 {
-	unsigned char* dest = image->data;
-	size_t index = (size_t)x + (size_t)(y1) * (size_t)image->width;
+	Image* texture = span->texture;
 
-	//optimized lightmap only loop
-	if (lm && lm->data)
-	{
-		float flx = Math_Clamp((float)lx * LIGHTMAP_INV_LUXEL_SIZE, 0, lm->width - 1);
-		float flx_frac = flx - (int)flx;
+	unsigned char* dest = span->dest;
+	float* depth_buffer = span->depth_buffer;
 
-		float next_flx = Math_Clampl(flx + 1, 0, lm->width - 1);
+	float x_pos = span->x_pos;
+	float y_pos = span->y_pos;
 
-		float fly = (ly_pos * LIGHTMAP_INV_LUXEL_SIZE);
-		int prev_ly = -1;
+	int batch = (avx2) ? SPAN_BATCH_AVX2 : SPAN_BATCH_SSE2;
 
-		float fly_step = ty_step * LIGHTMAP_INV_LUXEL_SIZE;
+	__m128 depth = _mm_set1_ps(span->distance);
+	__m128i light = _mm_setr_epi16(span->light_r, span->light_g, span->light_b, 0, span->light_r, span->light_g, span->light_b, 0);
 
-		Vec4 lerp_light0 = Vec4_Zero();
-		Vec4 lerp_light1 = Vec4_Zero();
-		Vec4 lerp_dx = Vec4_Zero();
+	float xs[SPAN_BATCH_AVX2];
+	float ys[SPAN_BATCH_AVX2];
+	unsigned int texels[SPAN_BATCH_AVX2];
 
-		tx &= texture->width_mask;
+	int x = 0;
 
-		for (int y = y1; y < y2; y++)
+	for (; x + batch <= span->count; x += batch)
+	{
+		for (int k = 0; k < batch; k++)
 		{
-			int ty = (int)ty_pos & height_mask;
+			xs[k] = x_pos;
+			ys[k] = y_pos;
 
-			unsigned char* data = Image_Get(&texture->img, tx, ty);
+			x_pos += span->x_step;
+			y_pos += span->y_step;
+		}
 
-			int ly = (int)fly;
-			float fly_frac = fly - ly;
+		if (avx2)
+		{
+			Video_SpanTexels_AVX2(texture, span->tex_mask, xs, ys, texels);
+			Video_SpanStoreFlatBatch_AVX2(dest + (size_t)x * 4, texels, light);
+		}
+		else
+		{
+			Video_SpanTexels_SSE2(texture, span->tex_mask, xs, ys, texels);
+			Video_SpanStoreLit_SSE2(dest + (size_t)x * 4, texels, light, light);
+		}
 
-			//sample 2 points between this and the next luxel
-			if (ly != prev_ly)
-			{
-				Lightmap_SampleWallLinearPoints(lm, flx, fly, next_flx, flx_frac, &lerp_light0, &lerp_light1);
+		for (int k = 0; k < batch; k += 4)
+		{
+			_mm_storeu_ps(depth_buffer + x + k, depth);
+		}
+	}
 
-				lerp_dx.r = lerp_light1.r - lerp_light0.r;
-				lerp_dx.g = lerp_light1.g - lerp_light0.g;
-				lerp_dx.b = lerp_light1.b - lerp_light0.b;
+	for (; x < span->count; x++)
+	{
+		unsigned int texel = Video_SpanTexel(texture, (int)x_pos & span->tex_mask, (int)y_pos & span->tex_mask);
 
-				lerp_light0.r = lerp_light0.r + lerp_dx.r * fly_frac;
-				lerp_light0.g = lerp_light0.g + lerp_dx.g * fly_frac;
-				lerp_light0.b = lerp_light0.b + lerp_dx.b * fly_frac;
+		Video_SpanStoreLit(dest + (size_t)x * 4, texel, span->light_r, span->light_g, span->light_b);
 
-				lerp_dx.r *= fly_step;
-				lerp_dx.g *= fly_step;
-				lerp_dx.b *= fly_step;
+		depth_buffer[x] = span->distance;
 
-				prev_ly = ly;
-			}
+		x_pos += span->x_step;
+		y_pos += span->y_step;
+	}
+}
 
-			//light step
-			lerp_light0.r += lerp_dx.r;
-			lerp_light0.g += lerp_dx.g;
-			lerp_light0.b += lerp_dx.b;
+static void Video_PlaneSpanLightmapped_SSE2(PlaneSpan* span)
+{
+	Video_PlaneSpanLightmapped_SIMD(span, false);
+}
 
-			if (data[3] > 128 && z <= depth_buffer[index])
-			{
-				int current_light_r = lerp_light0.r;
-				int current_light_g = lerp_light0.g;
-				int current_light_b = lerp_light0.b;
+static void Video_PlaneSpanLightmapped_AVX2(PlaneSpan* span)
+{
+	Video_PlaneSpanLightmapped_SIMD(span, true);
+}
 
-				//clamp
-				current_light_r = Math_Clampl(current_light_r + light.r, 0, MAX_LIGHT_VALUE - 1);
-				current_light_g = Math_Clampl(current_light_g + light.g, 0, MAX_LIGHT_VALUE - 1);
-				current_light_b = Math_Clampl(current_light_b + light.b, 0, MAX_LIGHT_VALUE - 1);
+static void Video_PlaneSpanFlat_SSE2(PlaneSpan* span)
+{
+	Video_PlaneSpanFlat_SIMD(span, false);
+}
 
-				size_t i = index * 4;
+static void Video_PlaneSpanFlat_AVX2(PlaneSpan* span)
+{
+	Video_PlaneSpanFlat_SIMD(span, true);
+}
 
-				//avoid loops
-				dest[i + 0] = LIGHT_LUT[data[0]][current_light_r];
-				dest[i + 1] = LIGHT_LUT[data[1]][current_light_g];
-				dest[i + 2] = LIGHT_LUT[data[2]][current_light_b];
+static void Video_SetupPlaneSpans()
+{
+	s_planeSpanLightmapped = Video_PlaneSpanLightmapped;
+	s_planeSpanFlat = Video_PlaneSpanFlat;
 
-				depth_buffer[index] = z;
-			}
+#ifndef DISABLE_SIMD_SPANS
+	//the avx2 lightmapped span measured slower than the sse2 one in -bench_spans, so avx2 is only used for flat spans
+	if (QueryCPUSupportsSSE2())
+	{
+		//the flat sse2 span measured no faster than the scalar one in -bench_spans, the texel loads are the whole cost there
+		s_planeSpanLightmapped = Video_PlaneSpanLightmapped_SSE2;
 
-			ty_pos += ty_step;
-			fly += fly_step;
-			index += image->width;
-		}
+		printf("Plane spans: SSE2 lightmapped \n");
 	}
-	else
+	if (QueryCPUSupportsAVX2())
 	{
-		tx &= texture->width_mask;
-		for (int y = y1; y < y2; y++)
-		{
-			int ty = (int)ty_pos & height_mask;
+		s_planeSpanFlat = Video_PlaneSpanFlat_AVX2;
 
-			unsigned char* data = Image_Get(&texture->img, tx, ty);
+		printf("Plane spans: AVX2 flat \n");
+	}
+#endif // !DISABLE_SIMD_SPANS
+}
 
-			if (data[3] > 128 && z <= depth_buffer[index])
-			{
-				size_t i = index * 4;
+#define SPAN_BENCH_WIDTH 640
+#define SPAN_BENCH_HEIGHT 400
+#define SPAN_BENCH_TEXTURE_SIZE 64
+#define SPAN_BENCH_RUNS 8
 
-				//avoid loops
-				dest[i + 0] = LIGHT_LUT[data[0]][light.r];
-				dest[i + 1] = LIGHT_LUT[data[1]][light.g];
-				dest[i + 2] = LIGHT_LUT[data[2]][light.b];
+static double Video_BenchSpanKernel(PlaneSpanFun fun, PlaneSpan* spans, int num_spans, Image* image, float* depth_buffer, Image* src_image, float* src_depth)
+{
+	double best = 0;
 
-				depth_buffer[index] = z;
-			}
+	for (int run = 0; run < SPAN_BENCH_RUNS; run++)
+	{
+		memcpy(image->data, src_image->data, (size_t)image->width * image->height * 4);
+		memcpy(depth_buffer, src_depth, sizeof(float) * image->width * image->height);
 
-			ty_pos += ty_step;
-			index += image->width;
+		double start_time = Time_GetSeconds();
+
+		for (int i = 0; i < num_spans; i++)
+		{
+			fun(&spans[i]);
+		}
+
+		double time = Time_GetSeconds() - start_time;
+
+		if (run == 0 || time < best)
+		{
+			best = time;
 		}
 	}
+
+	return best;
 }
 
-void Video_DrawSkyPlaneStripe(Image* image, float* depth_buffer, Texture* texture, int x, int y1, int y2, LineDrawArgs* args)
+void Video_BenchmarkPlaneSpans(int num_spans)
 {
-	if (y2 <= y1)
+	Image texture;
+	Image src_image, image, ref_image;
+	Lightmap lightmap;
+
+	memset(&lightmap, 0, sizeof(Lightmap));
+
+	lightmap.width = 64;
+	lightmap.height = 64;
+	lightmap.data = calloc(lightmap.width * lightmap.height, sizeof(Vec3_u16));
+
+	float* src_depth = calloc(SPAN_BENCH_WIDTH * SPAN_BENCH_HEIGHT, sizeof(float));
+	float* depth_buffer = calloc(SPAN_BENCH_WIDTH * SPAN_BENCH_HEIGHT, sizeof(float));
+	float* ref_depth = calloc(SPAN_BENCH_WIDTH * SPAN_BENCH_HEIGHT, sizeof(float));
+	PlaneSpan* spans = calloc(num_spans, sizeof(PlaneSpan));
+
+	if (!lightmap.data || !src_depth || !depth_buffer || !ref_depth || !spans || num_spans <= 0
+		|| !Image_Create(&texture, SPAN_BENCH_TEXTURE_SIZE, SPAN_BENCH_TEXTURE_SIZE, 4) || !Image_Create(&src_image, SPAN_BENCH_WIDTH, SPAN_BENCH_HEIGHT, 4)
+		|| !Image_Create(&image, SPAN_BENCH_WIDTH, SPAN_BENCH_HEIGHT, 4) || !Image_Create(&ref_image, SPAN_BENCH_WIDTH, SPAN_BENCH_HEIGHT, 4))
 	{
+		printf("Plane span benchmark: out of memory \n");
 		return;
 	}
 
-	const float TEX_HEIGHT_SCALE = 0.35;
-	const float TEX_Y_OFFSET = 28.0 * 0.5;
+	//fixed seed so runs can be compared
+	srand(1);
 
-	unsigned char* dest = image->data;
-	size_t index = (size_t)x + (size_t)(y1) * (size_t)image->width;
+	for (int i = 0; i < texture.width * texture.height * texture.numChannels; i++)
+	{
+		texture.data[i] = rand() & 255;
+	}
+	for (int i = 0; i < lightmap.width * lightmap.height; i++)
+	{
+		//baked luxels leave room for the extra light
+		lightmap.data[i].r = rand() % (MAX_LIGHT_VALUE - 255);
+		lightmap.data[i].g = rand() % (MAX_LIGHT_VALUE - 255);
+		lightmap.data[i].b = rand() % (MAX_LIGHT_VALUE - 255);
+	}
+	//the alpha of the target is random too, the kernels have to leave it alone
+	for (int i = 0; i < SPAN_BENCH_WIDTH * SPAN_BENCH_HEIGHT * 4; i++)
+	{
+		src_image.data[i] = rand() & 255;
+	}
+	for (int i = 0; i < SPAN_BENCH_WIDTH * SPAN_BENCH_HEIGHT; i++)
+	{
+		src_depth[i] = (float)(rand() % 1000);
+	}
 
-	float tex_cylinder = texture->img.width;
-	float tex_height = texture->img.height * TEX_HEIGHT_SCALE;
+	long long num_pixels = 0;
 
-	float x_angle = (0.5 - x / (float)image->width) * args->draw_args->tangent * Math_DegToRad(90);
-	float angle = (args->plane_angle + x_angle) * tex_cylinder;
+	for (int i = 0; i < num_spans; i++)
+	{
+		PlaneSpan* span = &spans[i];
 
-	angle = fabs(angle);
+		int y = rand() % SPAN_BENCH_HEIGHT;
+		int x1 = rand() % SPAN_BENCH_WIDTH;
+		int x2 = x1 + rand() % (SPAN_BENCH_WIDTH - x1);
 
-	float tex_y_step = args->sky_plane_y_step * tex_height;
-	float tex_y_pos = (float)y1 * tex_y_step;
+		//near and far planes, up to a few texels per pixel
+		float x_step = ((rand() % 400) - 200) / 100.0f;
+		float y_step = ((rand() % 400) - 200) / 100.0f;
 
-	tex_y_pos += TEX_Y_OFFSET;
+		span->dest = image.data + ((size_t)x1 + (size_t)y * SPAN_BENCH_WIDTH) * 4;
+		span->depth_buffer = depth_buffer + x1 + (size_t)y * SPAN_BENCH_WIDTH;
+		span->texture = &texture;
+		span->tex_mask = SPAN_BENCH_TEXTURE_SIZE - 1;
+		span->lightmap = &lightmap;
+		span->x_pos = (float)(rand() % 4096);
+		span->y_pos = (float)(rand() % 4096);
+		span->x_step = x_step;
+		span->y_step = y_step;
+		span->flx_pos = -(float)(rand() % (lightmap.width * 100)) / 100.0f;
+		span->fly_pos = (float)(rand() % (lightmap.height * 100)) / 100.0f;
+		span->flx_step = x_step * LIGHTMAP_INV_LUXEL_SIZE;
+		span->fly_step = y_step * LIGHTMAP_INV_LUXEL_SIZE;
+		span->distance = (float)(rand() % 1000);
+		span->extra_light.r = (rand() & 1) ? rand() % 256 : 0;
+		span->extra_light.g = span->extra_light.r;
+		span->extra_light.b = span->extra_light.r;
+		span->light_r = rand() % MAX_LIGHT_VALUE;
+		span->light_g = rand() % MAX_LIGHT_VALUE;
+		span->light_b = rand() % MAX_LIGHT_VALUE;
+		span->count = x2 - x1 + 1;
 
-	int tex_x = (int)angle & texture->width_mask;
+		num_pixels += span->count;
+	}
 
-	for (int y = y1; y < y2; y++)
+	bool avx2 = QueryCPUSupportsAVX2();
+
+	printf("Plane span benchmark: %i spans, %lld pixels, best of %i runs%s \n", num_spans, num_pixels, SPAN_BENCH_RUNS, (avx2) ? "" : ", no avx2");
+
+	PlaneSpanFun scalar_funs[2] = { Video_PlaneSpanLightmapped, Video_PlaneSpanFlat };
+	PlaneSpanFun sse2_funs[2] = { Video_PlaneSpanLightmapped_SSE2, Video_PlaneSpanFlat_SSE2 };
+	PlaneSpanFun avx2_funs[2] = { Video_PlaneSpanLightmapped_AVX2, Video_PlaneSpanFlat_AVX2 };
+	const char* names[2] = { "lightmapped", "flat" };
+
+	size_t image_bytes = (size_t)SPAN_BENCH_WIDTH * SPAN_BENCH_HEIGHT * 4;
+	size_t depth_bytes = sizeof(float) * SPAN_BENCH_WIDTH * SPAN_BENCH_HEIGHT;
+
+	for (int k = 0; k < 2; k++)
 	{
-		unsigned char* data = Image_GetFast(&texture->img, tex_x, (int)tex_y_pos & texture->height_mask);
+		double scalar_time = Video_BenchSpanKernel(scalar_funs[k], spans, num_spans, &image, depth_buffer, &src_image, src_depth);
+
+		memcpy(ref_image.data, image.data, image_bytes);
+		memcpy(ref_depth, depth_buffer, depth_bytes);
+
+		double sse2_time = Video_BenchSpanKernel(sse2_funs[k], spans, num_spans, &image, depth_buffer, &src_image, src_depth);
+
+		bool identical = !memcmp(ref_image.data, image.data, image_bytes) && !memcmp(ref_depth, depth_buffer, depth_bytes);
+
+		double avx2_time = 0;
+
+		if (avx2)
+		{
+			avx2_time = Video_BenchSpanKernel(avx2_funs[k], spans, num_spans, &image, depth_buffer, &src_image, src_depth);
+
+			identical = identical && !memcmp(ref_image.data, image.data, image_bytes) && !memcmp(ref_depth, depth_buffer, depth_bytes);
+		}
+
+		printf("%-12s scalar %8.3f ms (%5.2f ns/px), sse2 %8.3f ms (%5.2f ns/px, %.2fx), avx2 %8.3f ms (%5.2f ns/px, %.2fx), %s \n", names[k],
+			scalar_time * 1000.0, scalar_time * 1e9 / max(num_pixels, 1),
+			sse2_time * 1000.0, sse2_time * 1e9 / max(num_pixels, 1), (sse2_time > 0) ? scalar_time / sse2_time : 0.0,
+			avx2_time * 1000.0, avx2_time * 1e9 / max(num_pixels, 1), (avx2_time > 0) ? scalar_time / avx2_time : 0.0,
+			(identical) ? "identical" : "MISMATCH");
+	}
+
+	Image_Destruct(&texture);
+	Image_Destruct(&src_image);
+	Image_Destruct(&image);
+	Image_Destruct(&ref_image);
+
+	free(lightmap.data);
+	free(src_depth);
+	free(depth_buffer);
+	free(ref_depth);
+	free(spans);
+}
+
+//column stored framebuffers get the span drawn into a contiguous row first, so the span kernels stay the same
+static void Video_ScatterPlaneSpan(Image* image, float* depth_buffer, PlaneSpan* span, size_t index)
+{
+	unsigned char* dest = image->data;
+	unsigned char* src = span->dest;
+	size_t x_stride = Image_XStride(image);
 
+	for (int x = 0; x < span->count; x++)
+	{
 		size_t i = index * 4;
+		size_t k = (size_t)x * 4;
 
 		//avoid loops
-		dest[i + 0] = data[0];
-		dest[i + 1] = data[1];
-		dest[i + 2] = data[2];
+		dest[i + 0] = src[k + 0];
+		dest[i + 1] = src[k + 1];
+		dest[i + 2] = src[k + 2];
 
-		depth_buffer[index] = DEPTH_CLEAR;
+		depth_buffer[index] = span->distance;
 
-		tex_y_pos += tex_y_step;
-		index += image->width;
+		index += x_stride;
 	}
 }
+
 void Video_DrawPlaneSpan(Image* image, DrawPlane* plane, LineDrawArgs* args, int y, int x1, int x2)
 {
 	//return;
@@ -1562,8 +3393,7 @@ void Video_DrawPlaneSpan(Image* image, DrawPlane* plane, LineDrawArgs* args, int
 
 	float* depth_buffer = args->draw_args->depth_buffer;
 
-	unsigned char* dest = image->data;
-	size_t index = (size_t)x1 + (size_t)(y) * (size_t)image->width;
+	size_t index = Image_PixelIndex(image, x1, y);
 
 	//setup
 	float distance = fabs(plane->viewheight * args->draw_args->yslope[y]);
@@ -1591,6 +3421,32 @@ void Video_DrawPlaneSpan(Image* image, DrawPlane* plane, LineDrawArgs* args, int
 	Vec3_u16 extra_light = args->draw_args->extra_light;
 	float depth_scale = (distance * DEPTH_SHADING_SCALE);
 
+	//distance is the same along the whole span, so one level fits all of it
+	//the lightmap keeps the full size coordinates, only the texture ones are scaled to the level
+	int mip_level = Image_SelectMipmap(&texture->img, max(fabs(x_step), fabs(y_step)));
+	float mip_scale = 1.0f / (float)(1 << mip_level);
+
+	PlaneSpan span;
+	span.dest = image->data + index * 4;
+	span.depth_buffer = depth_buffer + index;
+	span.texture = Image_GetMipmap(&texture->img, mip_level);
+	span.tex_mask = 63 >> mip_level;
+	span.lightmap = plane->lightmap;
+	span.x_pos = x_pos * mip_scale;
+	span.y_pos = y_pos * mip_scale;
+	span.x_step = x_step * mip_scale;
+	span.y_step = y_step * mip_scale;
+	span.distance = distance;
+	span.count = x2 - x1 + 1;
+
+	if (image->is_collumn_stored)
+	{
+		RenderData* render_data = args->draw_args->render_data;
+
+		span.dest = render_data->span_scratch;
+		span.depth_buffer = render_data->span_depth_scratch;
+	}
+
 	//optimized lightmap only loop
 	if (plane->lightmap && plane->lightmap->data)
 	{
@@ -1606,133 +3462,54 @@ void Video_DrawPlaneSpan(Image* image, DrawPlane* plane, LineDrawArgs* args, int
 		float sector_size_x = sector->bbox[1][0] * 2;
 		float sector_size_y = sector->bbox[1][1] * 2;
 
-		Vec3_u16 s0 = Vec3_u16_Zero();
-		Vec3_u16 s1 = Vec3_u16_Zero();
-		Vec3_u16 s2 = Vec3_u16_Zero();
-		Vec3_u16 s3 = Vec3_u16_Zero();
+		span.flx_pos = ((x_pos - (sector_size_x)) * LIGHTMAP_INV_LUXEL_SIZE);
+		span.flx_step = x_step * LIGHTMAP_INV_LUXEL_SIZE;
 
-		Vec4 lerp0 = Vec4_Zero();
-		Vec4 lerp1 = Vec4_Zero();
+		span.fly_pos = ((y_pos + (sector_size_y)) * LIGHTMAP_INV_LUXEL_SIZE);
+		span.fly_step = y_step * LIGHTMAP_INV_LUXEL_SIZE;
 
-		Vec4 sdx0 = Vec4_Zero();
-		Vec4 sdx1 = Vec4_Zero();
-		
-		float flx_pos = ((x_pos - (sector_size_x)) * LIGHTMAP_INV_LUXEL_SIZE);
-		float flx_step = x_step * LIGHTMAP_INV_LUXEL_SIZE;
-
-		float fly_pos = ((y_pos + (sector_size_y)) * LIGHTMAP_INV_LUXEL_SIZE);
-		float fly_step = y_step * LIGHTMAP_INV_LUXEL_SIZE;
+		span.extra_light = extra_light;
 
-		int prev_lx = -1;
-		int prev_ly = -1;
+		RenderData* render_data = args->draw_args->render_data;
 
-		for (int x = x1; x <= x2; x++)
+		//only baked light, so the pre-lit texels can be copied
+		if (render_data->surface_cache.max_blocks > 0 && (extra_light.r | extra_light.g | extra_light.b) == 0)
 		{
-			float flx = flx_pos + plane->lightmap->width;
-			float fly = fly_pos;
-
-			int lx = (int)flx;
-			int ly = (int)fly;
-
-			float lx_frac = flx - (int)flx;
-			float ly_frac = fly - (int)fly;
-
-			if (lx != prev_lx || ly != prev_ly)
-			{
-				Lightmap_SamplePlaneLinearPoints(plane->lightmap, flx, fly, &s0, &s1, &s2, &s3);
-
-				//hyper optimization lunacy
-				sdx0.r = (s1.r - s0.r);
-				sdx0.g = (s1.g - s0.g);
-				sdx0.b = (s1.b - s0.b);
-				
-				sdx1.r = (s3.r - s2.r);
-				sdx1.g = (s3.g - s2.g);
-				sdx1.b = (s3.b - s2.b);
-
-				lerp0.r = s0.r + sdx0.r * lx_frac;
-				lerp0.g = s0.g + sdx0.g * lx_frac;
-				lerp0.b = s0.b + sdx0.b * lx_frac;
-
-				lerp1.r = s2.r + sdx1.r * lx_frac;
-				lerp1.g = s2.g + sdx1.g * lx_frac;
-				lerp1.b = s2.b + sdx1.b * lx_frac;
-
-				//calc step size
-				sdx0.r *= flx_step;
-				sdx0.g *= flx_step;
-				sdx0.b *= flx_step;
-
-				sdx1.r *= flx_step;
-				sdx1.g *= flx_step;
-				sdx1.b *= flx_step;
-
-				prev_lx = lx;
-				prev_ly = ly;
-			}
-
-			lerp0.r += sdx0.r;
-			lerp0.g += sdx0.g;
-			lerp0.b += sdx0.b;
-					
-			lerp1.r += sdx1.r;
-			lerp1.g += sdx1.g;
-			lerp1.b += sdx1.b;
-
-			int light_r = Math_lerp(lerp0.r, lerp1.r, ly_frac);
-			int light_g = Math_lerp(lerp0.g, lerp1.g, ly_frac);
-			int light_b = Math_lerp(lerp0.b, lerp1.b, ly_frac);
-
-			light_r = Math_Clampl(light_r + extra_light.r, 0, MAX_LIGHT_VALUE - 1);
-			light_g = Math_Clampl(light_g + extra_light.g, 0, MAX_LIGHT_VALUE - 1);
-			light_b = Math_Clampl(light_b + extra_light.b, 0, MAX_LIGHT_VALUE - 1);;
-
-			unsigned char* data = Image_GetFast(&texture->img, (int)x_pos & 63, (int)y_pos & 63);
-
-			index = ((size_t)x + (size_t)y * (size_t)image->width);
-			size_t i = index * 4;
-
-			//avoid loops
-			dest[i + 0] = LIGHT_LUT[data[0]][light_r];
-			dest[i + 1] = LIGHT_LUT[data[1]][light_g];
-			dest[i + 2] = LIGHT_LUT[data[2]][light_b];
-
-			depth_buffer[index] = distance;
-
-			x_pos += x_step;
-			y_pos += y_step;
-			flx_pos += flx_step;
-			fly_pos += fly_step;
+			SurfaceDesc surface;
+			memset(&surface, 0, sizeof(SurfaceDesc));
+
+			surface.type = (plane->lightmap == &sector->floor_lightmap) ? SURF__FLOOR : SURF__CEIL;
+			surface.index = sector->index;
+			surface.texture = span.texture;
+			surface.mip_level = mip_level;
+			surface.width_mask = span.tex_mask;
+			surface.height_mask = span.tex_mask;
+			surface.lightmap = plane->lightmap;
+			surface.light_level = plane->light;
+			surface.origin_x = sector_size_x;
+			surface.origin_y = -sector_size_y;
+			surface.cache = &render_data->surface_cache;
+
+			Video_PlaneSpanSurface(&span, &surface);
+		}
+		else
+		{
+			s_planeSpanLightmapped(&span);
 		}
 	}
 	else
 	{
-		int light_r = Math_Clampl((plane->light + extra_light.r) - depth_scale, 0, MAX_LIGHT_VALUE - 1);
-		int light_g = Math_Clampl((plane->light + extra_light.g) - depth_scale, 0, MAX_LIGHT_VALUE - 1);
-		int light_b = Math_Clampl((plane->light + extra_light.b) - depth_scale, 0, MAX_LIGHT_VALUE - 1);
-
-		for (int x = x1; x <= x2; x++)
-		{
-			unsigned char* data = Image_GetFast(&texture->img, (int)x_pos & 63, (int)y_pos & 63);
-
-			index = ((size_t)x + (size_t)y * (size_t)image->width);
-			size_t i = index * 4;
-
-			//avoid loops
-			dest[i + 0] = LIGHT_LUT[data[0]][light_r];
-			dest[i + 1] = LIGHT_LUT[data[1]][light_g];
-			dest[i + 2] = LIGHT_LUT[data[2]][light_b];
-
-			depth_buffer[index] = distance;
+		span.light_r = Math_Clampl((plane->light + extra_light.r) - depth_scale, 0, MAX_LIGHT_VALUE - 1);
+		span.light_g = Math_Clampl((plane->light + extra_light.g) - depth_scale, 0, MAX_LIGHT_VALUE - 1);
+		span.light_b = Math_Clampl((plane->light + extra_light.b) - depth_scale, 0, MAX_LIGHT_VALUE - 1);
 
-			x_pos += x_step;
-			y_pos += y_step;
-		}
+		s_planeSpanFlat(&span);
 	}
-	
 
-
-	
+	if (image->is_collumn_stored)
+	{
+		Video_ScatterPlaneSpan(image, depth_buffer, &span, index);
+	}
 }
 
 void Video_DrawThreadSlice(Image* image, int x1, int x2, Vec3_u16* color)
@@ -1782,7 +3559,7 @@ void Video_Shade(Image* image, ShaderFun shader_fun, int x0, int y0, int x1, int
 	{
 		for (int y = y0; y < y1; y++)
 		{
-			shader_fun(image, x, y, 0, 0);
+			shader_fun(image, x, y);
 		}
 	}
 
@@ -495,6 +495,31 @@ int Sound_Init()
 	return 1;
 }
 
+int Sound_InitNoDevice()
+{
+	memset(&sound_core, 0, sizeof(sound_core));
+
+	//for headless runs, sounds are still loaded and played, but nothing is output
+	ma_engine_config config = ma_engine_config_init();
+	config.noDevice = MA_TRUE;
+	config.channels = 2;
+	config.sampleRate = 48000;
+
+	ma_result result;
+
+	result = ma_engine_init(&config, &sound_core.sound_engine);
+
+	if (result != MA_SUCCESS)
+	{
+		printf("Failed to init MA sound engine \n");
+		return 0;
+	}
+
+	ma_engine_listener_set_world_up(&sound_core.sound_engine, 0, 0, 0, 1);
+
+	return 1;
+}
+
 void Sound_Shutdown()
 {
 	Sound_FlushAll();
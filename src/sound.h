@@ -19,10 +19,11 @@ typedef struct
 } Sound;
 
 int Sound_Init();
+int Sound_InitNoDevice();
 void Sound_Shutdown();
 
 ma_engine* Sound_GetEngine();
-bool Sound_DeleteSound(int id);
+void Sound_DeleteSound(int id);
 bool Sound_load(const char* p_filePath, unsigned p_flags, ma_sound* r_sound);
 bool Sound_createGroup(unsigned p_flags, ma_sound_group* r_group);
 void Sound_setMasterVolume(float volume);
@@ -1,6 +1,7 @@
 #include "u_object_pool.h"
 
 #include <assert.h>
+#include <string.h>
 
 Object_Pool* _objPoolInit(size_t alloc_size, unsigned init_size)
 {
@@ -4,6 +4,18 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#ifndef _WIN32
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#endif
+
 int File_GetLength(FILE* p_file)
 {
 	int pos;
@@ -19,9 +31,7 @@ int File_GetLength(FILE* p_file)
 
 unsigned char* File_Parse(const char* p_filePath, int* r_length)
 {
-	FILE* file = NULL;
-
-	fopen_s(&file, p_filePath, "rb"); //use rb because otherwise it can cause reading issues
+	FILE* file = fopen(p_filePath, "rb"); //use rb because otherwise it can cause reading issues
 	if (!file)
 	{
 		printf("Failed to open file for parsing at path: %s!\n", p_filePath);
@@ -34,7 +44,7 @@ unsigned char* File_Parse(const char* p_filePath, int* r_length)
 		return NULL;
 	}
 	memset(buffer, 0, file_length + 1);
-	fread_s(buffer, file_length, 1, file_length, file);
+	fread(buffer, 1, file_length, file);
 
 	//CLEAN UP
 	fclose(file);
@@ -67,63 +77,523 @@ bool File_Read(FILE* file, void* dest, int count)
 	return true;
 }
 
+#ifdef _WIN32
+Thread Thread_Create(ThreadFun fun, void* arg)
+{
+	return CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)fun, arg, 0, NULL);
+}
+
+void Thread_Join(Thread thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+void Thread_Pause()
+{
+	YieldProcessor();
+}
+
+Event Event_Create(bool manual_reset, bool initial_state)
+{
+	return CreateEvent(NULL, manual_reset, initial_state, NULL);
+}
+
+void Event_Destruct(Event event)
+{
+	CloseHandle(event);
+}
+
+void Event_Set(Event event)
+{
+	SetEvent(event);
+}
+
+void Event_Reset(Event event)
+{
+	ResetEvent(event);
+}
+
+void Event_Wait(Event event)
+{
+	WaitForSingleObject(event, INFINITE);
+}
+
+bool Event_WaitTimeout(Event event, int milliseconds)
+{
+	return WaitForSingleObject(event, milliseconds) == WAIT_OBJECT_0;
+}
+
+void Mutex_Init(Mutex* mutex)
+{
+	InitializeCriticalSection(mutex);
+}
+
+void Mutex_Destruct(Mutex* mutex)
+{
+	DeleteCriticalSection(mutex);
+}
+
+void Mutex_Lock(Mutex* mutex)
+{
+	EnterCriticalSection(mutex);
+}
+
+void Mutex_Unlock(Mutex* mutex)
+{
+	LeaveCriticalSection(mutex);
+}
+
+void CondVar_Init(CondVar* cv)
+{
+	InitializeConditionVariable(cv);
+}
+
+void CondVar_Destruct(CondVar* cv)
+{
+	//nothing to free on windows
+}
+
+void CondVar_Wait(CondVar* cv, Mutex* mutex)
+{
+	SleepConditionVariableCS(cv, mutex, INFINITE);
+}
+
+void CondVar_WakeOne(CondVar* cv)
+{
+	WakeConditionVariable(cv);
+}
+
+void CondVar_WakeAll(CondVar* cv)
+{
+	WakeAllConditionVariable(cv);
+}
+
+AtomicInt Atomic_Increment(volatile AtomicInt* value)
+{
+	return InterlockedIncrement(value);
+}
+
+AtomicInt Atomic_Decrement(volatile AtomicInt* value)
+{
+	return InterlockedDecrement(value);
+}
+
+AtomicInt Atomic_Exchange(volatile AtomicInt* value, AtomicInt exchange)
+{
+	return InterlockedExchange(value, exchange);
+}
+
+AtomicInt Atomic_CompareExchange(volatile AtomicInt* value, AtomicInt exchange, AtomicInt comparand)
+{
+	return InterlockedCompareExchange(value, exchange, comparand);
+}
+#else
+struct ThreadPosix
+{
+	pthread_t handle;
+	ThreadFun fun;
+	void* arg;
+};
+
+struct EventPosix
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cv;
+	bool manual_reset;
+	bool signaled;
+	//bumped on every set, so that a manual reset event that is set and reset again still releases the threads that were already waiting, like on windows
+	unsigned generation;
+};
+
+static void* Thread_Start(void* arg)
+{
+	struct ThreadPosix* thread = arg;
+
+	thread->fun(thread->arg);
+
+	return NULL;
+}
+
+Thread Thread_Create(ThreadFun fun, void* arg)
+{
+	struct ThreadPosix* thread = calloc(1, sizeof(struct ThreadPosix));
+
+	if (!thread)
+	{
+		return NULL;
+	}
+
+	thread->fun = fun;
+	thread->arg = arg;
+
+	if (pthread_create(&thread->handle, NULL, Thread_Start, thread) != 0)
+	{
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+void Thread_Join(Thread thread)
+{
+	pthread_join(thread->handle, NULL);
+	free(thread);
+}
+
+void Thread_Pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	sched_yield();
+#endif
+}
+
+Event Event_Create(bool manual_reset, bool initial_state)
+{
+	struct EventPosix* event = calloc(1, sizeof(struct EventPosix));
+
+	if (!event)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_init(&event->mutex, NULL);
+	pthread_cond_init(&event->cv, NULL);
+
+	event->manual_reset = manual_reset;
+	event->signaled = initial_state;
+
+	return event;
+}
+
+void Event_Destruct(Event event)
+{
+	pthread_cond_destroy(&event->cv);
+	pthread_mutex_destroy(&event->mutex);
+
+	free(event);
+}
+
+void Event_Set(Event event)
+{
+	pthread_mutex_lock(&event->mutex);
+
+	event->signaled = true;
+	event->generation++;
+
+	if (event->manual_reset)
+	{
+		pthread_cond_broadcast(&event->cv);
+	}
+	else
+	{
+		pthread_cond_signal(&event->cv);
+	}
+
+	pthread_mutex_unlock(&event->mutex);
+}
+
+void Event_Reset(Event event)
+{
+	pthread_mutex_lock(&event->mutex);
+	event->signaled = false;
+	pthread_mutex_unlock(&event->mutex);
+}
+
+void Event_Wait(Event event)
+{
+	pthread_mutex_lock(&event->mutex);
+
+	unsigned generation = event->generation;
+
+	while (!event->signaled && !(event->manual_reset && event->generation != generation))
+	{
+		pthread_cond_wait(&event->cv, &event->mutex);
+	}
+
+	if (!event->manual_reset)
+	{
+		event->signaled = false;
+	}
+
+	pthread_mutex_unlock(&event->mutex);
+}
+
+bool Event_WaitTimeout(Event event, int milliseconds)
+{
+	struct timespec until;
+	clock_gettime(CLOCK_REALTIME, &until);
+
+	until.tv_sec += milliseconds / 1000;
+	until.tv_nsec += (long)(milliseconds % 1000) * 1000000;
+
+	if (until.tv_nsec >= 1000000000)
+	{
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&event->mutex);
+
+	unsigned generation = event->generation;
+
+	while (!event->signaled && !(event->manual_reset && event->generation != generation))
+	{
+		if (pthread_cond_timedwait(&event->cv, &event->mutex, &until) != 0)
+		{
+			break;
+		}
+	}
+
+	bool signaled = event->signaled || (event->manual_reset && event->generation != generation);
+
+	if (signaled && !event->manual_reset)
+	{
+		event->signaled = false;
+	}
+
+	pthread_mutex_unlock(&event->mutex);
+
+	return signaled;
+}
+
+void Mutex_Init(Mutex* mutex)
+{
+	//critical sections can be entered again by the owning thread
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+
+	pthread_mutex_init(mutex, &attr);
+
+	pthread_mutexattr_destroy(&attr);
+}
+
+void Mutex_Destruct(Mutex* mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void Mutex_Lock(Mutex* mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void Mutex_Unlock(Mutex* mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void CondVar_Init(CondVar* cv)
+{
+	pthread_cond_init(cv, NULL);
+}
+
+void CondVar_Destruct(CondVar* cv)
+{
+	pthread_cond_destroy(cv);
+}
+
+void CondVar_Wait(CondVar* cv, Mutex* mutex)
+{
+	pthread_cond_wait(cv, mutex);
+}
+
+void CondVar_WakeOne(CondVar* cv)
+{
+	pthread_cond_signal(cv);
+}
+
+void CondVar_WakeAll(CondVar* cv)
+{
+	pthread_cond_broadcast(cv);
+}
+
+AtomicInt Atomic_Increment(volatile AtomicInt* value)
+{
+	return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+AtomicInt Atomic_Decrement(volatile AtomicInt* value)
+{
+	return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+
+AtomicInt Atomic_Exchange(volatile AtomicInt* value, AtomicInt exchange)
+{
+	return __atomic_exchange_n(value, exchange, __ATOMIC_SEQ_CST);
+}
+
+AtomicInt Atomic_CompareExchange(volatile AtomicInt* value, AtomicInt exchange, AtomicInt comparand)
+{
+	//comparand gets the old value when the exchange fails and already is the old value when it succeeds
+	__atomic_compare_exchange_n(value, &comparand, exchange, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+
+	return comparand;
+}
+#endif // _WIN32
+
 void ReaderWriterLockMutex_Init(ReaderWriterLockMutex* lock)
 {
 	memset(lock, 0, sizeof(ReaderWriterLockMutex));
 
 	lock->num_readers = 0;
 
-	InitializeCriticalSection(&lock->write_mutex);
-	InitializeCriticalSection(&lock->reader_count_mutex);
+	Mutex_Init(&lock->write_mutex);
+	Mutex_Init(&lock->reader_count_mutex);
 
-	lock->readers_cleared_event = CreateEvent(NULL, TRUE, TRUE, NULL);
+	lock->readers_cleared_event = Event_Create(true, true);
 }
 
 void ReaderWriterLockMutex_Destruct(ReaderWriterLockMutex* lock)
 {
-	WaitForSingleObject(lock->readers_cleared_event, INFINITE);
+	Event_Wait(lock->readers_cleared_event);
 
-	CloseHandle(lock->readers_cleared_event);
-	DeleteCriticalSection(&lock->write_mutex);
-	DeleteCriticalSection(&lock->reader_count_mutex);
+	Event_Destruct(lock->readers_cleared_event);
+	Mutex_Destruct(&lock->write_mutex);
+	Mutex_Destruct(&lock->reader_count_mutex);
 }
 
 void ReaderWriterLockMutex_EnterRead(ReaderWriterLockMutex* lock)
 {
-	EnterCriticalSection(&lock->write_mutex);
-	EnterCriticalSection(&lock->reader_count_mutex);
+	Mutex_Lock(&lock->write_mutex);
+	Mutex_Lock(&lock->reader_count_mutex);
 
 	if (++lock->num_readers == 1)
 	{
-		ResetEvent(lock->readers_cleared_event);
+		Event_Reset(lock->readers_cleared_event);
 	}
 	
-	LeaveCriticalSection(&lock->reader_count_mutex);
-	LeaveCriticalSection(&lock->write_mutex);
+	Mutex_Unlock(&lock->reader_count_mutex);
+	Mutex_Unlock(&lock->write_mutex);
 }
 void ReaderWriterLockMutex_ExitRead(ReaderWriterLockMutex* lock)
 {
-	EnterCriticalSection(&lock->reader_count_mutex);
+	Mutex_Lock(&lock->reader_count_mutex);
 
 	if (--lock->num_readers == 0)
 	{
-		SetEvent(lock->readers_cleared_event);
+		Event_Set(lock->readers_cleared_event);
 	}
 
-	LeaveCriticalSection(&lock->reader_count_mutex);
+	Mutex_Unlock(&lock->reader_count_mutex);
 }
 
 void ReaderWriterLockMutex_EnterWrite(ReaderWriterLockMutex* lock)
 {
-	EnterCriticalSection(&lock->write_mutex);
-	WaitForSingleObject(lock->readers_cleared_event, INFINITE);
+	Mutex_Lock(&lock->write_mutex);
+	Event_Wait(lock->readers_cleared_event);
 }
 
 void ReaderWriterLockMutex_ExitWrite(ReaderWriterLockMutex* lock)
 {
-	LeaveCriticalSection(&lock->write_mutex);
+	Mutex_Unlock(&lock->write_mutex);
+}
+
+void JobBarrier_Init(JobBarrier* barrier, int spin_count)
+{
+	memset(barrier, 0, sizeof(JobBarrier));
+
+	barrier->spin_count = spin_count;
+
+	Mutex_Init(&barrier->park_mutex);
+	CondVar_Init(&barrier->start_cv);
+	CondVar_Init(&barrier->end_cv);
+}
+
+void JobBarrier_Destruct(JobBarrier* barrier)
+{
+	Mutex_Destruct(&barrier->park_mutex);
+	CondVar_Destruct(&barrier->start_cv);
+	CondVar_Destruct(&barrier->end_cv);
+}
+
+void JobBarrier_Dispatch(JobBarrier* barrier, int num_workers)
+{
+	Atomic_Exchange(&barrier->num_remaining, num_workers);
+	Atomic_Increment(&barrier->epoch);
+
+	//only take the lock when someone gave up spinning, the lock makes sure a parking worker can't miss the wake
+	if (barrier->num_parked_workers > 0)
+	{
+		Mutex_Lock(&barrier->park_mutex);
+		Mutex_Unlock(&barrier->park_mutex);
+
+		CondVar_WakeAll(&barrier->start_cv);
+	}
+}
+
+AtomicInt JobBarrier_WaitForEpoch(JobBarrier* barrier, AtomicInt last_epoch)
+{
+	for (int i = 0; i < barrier->spin_count; i++)
+	{
+		if (barrier->epoch != last_epoch)
+		{
+			return barrier->epoch;
+		}
+
+		Thread_Pause();
+	}
+
+	Mutex_Lock(&barrier->park_mutex);
+	Atomic_Increment(&barrier->num_parked_workers);
+
+	while (barrier->epoch == last_epoch)
+	{
+		CondVar_Wait(&barrier->start_cv, &barrier->park_mutex);
+	}
+
+	Atomic_Decrement(&barrier->num_parked_workers);
+	Mutex_Unlock(&barrier->park_mutex);
+
+	return barrier->epoch;
+}
+
+void JobBarrier_Arrive(JobBarrier* barrier)
+{
+	if (Atomic_Decrement(&barrier->num_remaining) > 0)
+	{
+		return;
+	}
+
+	//last one in, wake the dispatcher if it stopped spinning
+	if (barrier->dispatcher_parked)
+	{
+		Mutex_Lock(&barrier->park_mutex);
+		Mutex_Unlock(&barrier->park_mutex);
+
+		CondVar_WakeAll(&barrier->end_cv);
+	}
 }
 
+void JobBarrier_WaitForArrivals(JobBarrier* barrier)
+{
+	for (int i = 0; i < barrier->spin_count; i++)
+	{
+		if (barrier->num_remaining <= 0)
+		{
+			return;
+		}
+
+		Thread_Pause();
+	}
+
+	Mutex_Lock(&barrier->park_mutex);
+	Atomic_Exchange(&barrier->dispatcher_parked, 1);
+
+	while (barrier->num_remaining > 0)
+	{
+		CondVar_Wait(&barrier->end_cv, &barrier->park_mutex);
+	}
+
+	Atomic_Exchange(&barrier->dispatcher_parked, 0);
+	Mutex_Unlock(&barrier->park_mutex);
+}
+
+#ifdef _WIN32
 int QueryNumLogicalProcessors()
 {
 	//src https://stackoverflow.com/a/52716113
@@ -181,6 +651,109 @@ int QueryNumLogicalProcessors()
 	return concurrency;
 }
 
+#else
+int QueryNumLogicalProcessors()
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (count <= 0)
+	{
+		return 0;
+	}
+
+	return (int)count;
+}
+#endif // _WIN32
+
+static void CPU_Id(int info[4], int leaf, int sub_leaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(info, leaf, sub_leaf);
+#else
+	unsigned regs[4] = { 0, 0, 0, 0 };
+	__cpuid_count(leaf, sub_leaf, regs[0], regs[1], regs[2], regs[3]);
+
+	for (int i = 0; i < 4; i++)
+	{
+		info[i] = (int)regs[i];
+	}
+#endif
+}
+
+static uint64_t CPU_GetXCR0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned lo = 0;
+	unsigned hi = 0;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+
+	return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+bool QueryCPUSupportsSSE2()
+{
+	int info[4];
+
+	CPU_Id(info, 1, 0);
+
+	return (info[3] & (1 << 26)) != 0;
+}
+
+bool QueryCPUSupportsAVX2()
+{
+	int info[4];
+
+	CPU_Id(info, 0, 0);
+
+	if (info[0] < 7)
+	{
+		return false;
+	}
+
+	//needs avx and osxsave
+	CPU_Id(info, 1, 0);
+
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+	{
+		return false;
+	}
+
+	//the os has to save the ymm registers
+	if ((CPU_GetXCR0() & 6) != 6)
+	{
+		return false;
+	}
+
+	CPU_Id(info, 7, 0);
+
+	return (info[1] & (1 << 5)) != 0;
+}
+
+double Time_GetSeconds()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER s_frequency;
+
+	if (s_frequency.QuadPart == 0)
+	{
+		QueryPerformanceFrequency(&s_frequency);
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	return (double)counter.QuadPart / (double)s_frequency.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#endif // _WIN32
+}
+
 bool Num_IsLittleEndian()
 {
 	volatile uint32_t i = 0x01234567;
@@ -3,21 +3,77 @@
 #pragma once
 
 #include <stdio.h>
-#include <Windows.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <strings.h>
+
+#define _stricmp strcasecmp
+#endif // _WIN32
 
 int File_GetLength(FILE* p_file);
 unsigned char* File_Parse(const char* p_filePath, int* r_length);
 bool File_Write(FILE* file, void* src, int count);
 bool File_Read(FILE* file, void* dest, int count);
 
+//threads, locks and events map to win32 on windows and to pthreads everywhere else
+#ifdef _WIN32
+typedef HANDLE Thread;
+typedef HANDLE Event;
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE CondVar;
+typedef LONG AtomicInt;
+#else
+typedef struct ThreadPosix* Thread;
+typedef struct EventPosix* Event;
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t CondVar;
+typedef int32_t AtomicInt;
+#endif
+
+typedef void (*ThreadFun)(void* arg);
+
+Thread Thread_Create(ThreadFun fun, void* arg);
+void Thread_Join(Thread thread);
+void Thread_Pause();
+
+//manual reset events stay set until reset, auto reset events release one waiter and reset
+Event Event_Create(bool manual_reset, bool initial_state);
+void Event_Destruct(Event event);
+void Event_Set(Event event);
+void Event_Reset(Event event);
+void Event_Wait(Event event);
+//returns false when the wait timed out
+bool Event_WaitTimeout(Event event, int milliseconds);
+
+void Mutex_Init(Mutex* mutex);
+void Mutex_Destruct(Mutex* mutex);
+void Mutex_Lock(Mutex* mutex);
+void Mutex_Unlock(Mutex* mutex);
+
+void CondVar_Init(CondVar* cv);
+void CondVar_Destruct(CondVar* cv);
+void CondVar_Wait(CondVar* cv, Mutex* mutex);
+void CondVar_WakeOne(CondVar* cv);
+void CondVar_WakeAll(CondVar* cv);
+
+//all return the new value, except exchange and compare exchange that return the old one
+AtomicInt Atomic_Increment(volatile AtomicInt* value);
+AtomicInt Atomic_Decrement(volatile AtomicInt* value);
+AtomicInt Atomic_Exchange(volatile AtomicInt* value, AtomicInt exchange);
+AtomicInt Atomic_CompareExchange(volatile AtomicInt* value, AtomicInt exchange, AtomicInt comparand);
+
 //src https://web.archive.org/web/20250118080332/http://www.glennslayden.com/code/win32/reader-writer-lock
 typedef struct
 {
-	CRITICAL_SECTION write_mutex;
-	CRITICAL_SECTION reader_count_mutex;
+	Mutex write_mutex;
+	Mutex reader_count_mutex;
 	
-	HANDLE readers_cleared_event;
+	Event readers_cleared_event;
 
 	int num_readers;
 } ReaderWriterLockMutex;
@@ -29,7 +85,32 @@ void ReaderWriterLockMutex_ExitRead(ReaderWriterLockMutex* lock);
 void ReaderWriterLockMutex_EnterWrite(ReaderWriterLockMutex* lock);
 void ReaderWriterLockMutex_ExitWrite(ReaderWriterLockMutex* lock);
 
+//Job dispatch barrier, waiters spin on an atomic epoch for a while before parking on a condition variable
+typedef struct
+{
+	Mutex park_mutex;
+	CondVar start_cv;
+	CondVar end_cv;
+
+	volatile AtomicInt epoch;
+	volatile AtomicInt num_remaining;
+	volatile AtomicInt num_parked_workers;
+	volatile AtomicInt dispatcher_parked;
+
+	int spin_count;
+} JobBarrier;
+
+void JobBarrier_Init(JobBarrier* barrier, int spin_count);
+void JobBarrier_Destruct(JobBarrier* barrier);
+void JobBarrier_Dispatch(JobBarrier* barrier, int num_workers);
+AtomicInt JobBarrier_WaitForEpoch(JobBarrier* barrier, AtomicInt last_epoch);
+void JobBarrier_Arrive(JobBarrier* barrier);
+void JobBarrier_WaitForArrivals(JobBarrier* barrier);
+
 int QueryNumLogicalProcessors();
+bool QueryCPUSupportsSSE2();
+bool QueryCPUSupportsAVX2();
+double Time_GetSeconds();
 
 bool Num_IsLittleEndian();
 bool Num_IsBigEndian();